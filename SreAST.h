@@ -0,0 +1,921 @@
+#ifndef SRE_AST_H
+#define SRE_AST_H
+
+// 内部头文件：词法分析、语法树和解析器，仅供引擎内部的各个实现文件使用
+#include "SreRuleEngine.h"
+#include "SreArena.h"
+#include "SreProfile.h"
+#include "SreRegex.h"
+#include "SreSearch.h"
+#include <cctype>
+#include <algorithm>
+#include <charconv>
+
+// 如果使用 C++11 没有 std::make_unique，可以自己实现一个简单版本
+template<typename T, typename... Args>
+std::unique_ptr<T> sre_make_unique(Args&&... args) {
+    return std::unique_ptr<T>(new T(std::forward<Args>(args)...));
+}
+
+// =============================
+// 词法分析相关
+// =============================
+enum class SreTokenType {
+    Identifier,     // 标识符（函数名）
+    Variable,       // 变量引用 #{name}，text 为去掉 #{ } 之后的变量名
+    StringLiteral,  // 字符串常量（单引号括起来的）
+    Number,         // 数字常量：[-]digits[.digits][e[+-]digits]
+    Comma,
+    LParen,
+    RParen,
+    And,
+    Or,
+    Not,
+    Less,           // <
+    LessEqual,      // <=
+    Greater,        // >
+    GreaterEqual,   // >=
+    Equal,          // ==
+    NotEqual,       // !=
+    In,             // in
+    End
+};
+
+// 词法单元：text 是指向输入的视图，不做拷贝，只在输入存活期间有效
+struct SreToken {
+    SreTokenType type;
+    std::string_view text;
+};
+
+class SreLexer {
+public:
+    // 不拷贝输入，调用方需保证 input 在解析期间有效
+    SreLexer(std::string_view input) : input_(input), pos_(0) {}
+
+    SreToken nextToken() {
+        skipWhitespace();
+        if (pos_ >= input_.size()) return { SreTokenType::End, std::string_view() };
+
+        unsigned char c = static_cast<unsigned char>(input_[pos_]);
+        if (std::isalpha(c)) {
+            size_t start = pos_;
+            while (pos_ < input_.size() && isIdentifierChar(input_[pos_])) pos_++;
+            std::string_view s = input_.substr(start, pos_ - start);
+            if (equalsIgnoreCase(s, "and")) return { SreTokenType::And, s };
+            if (equalsIgnoreCase(s, "or"))  return { SreTokenType::Or, s };
+            if (equalsIgnoreCase(s, "not")) return { SreTokenType::Not, s };
+            if (equalsIgnoreCase(s, "in"))  return { SreTokenType::In, s };
+            return { SreTokenType::Identifier, s };
+        } else if (std::isdigit(c) || (c == '-' && pos_ + 1 < input_.size() && isDigit(input_[pos_ + 1]))) {
+            size_t start = pos_;
+            if (c == '-') pos_++;
+            skipDigits();
+            if (pos_ + 1 < input_.size() && input_[pos_] == '.' && isDigit(input_[pos_ + 1])) {
+                pos_++;
+                skipDigits();
+            }
+            if (pos_ < input_.size() && (input_[pos_] == 'e' || input_[pos_] == 'E')) {
+                size_t exp = pos_ + 1;
+                if (exp < input_.size() && (input_[exp] == '+' || input_[exp] == '-')) exp++;
+                if (exp < input_.size() && isDigit(input_[exp])) {
+                    pos_ = exp;
+                    skipDigits();
+                }
+            }
+            return { SreTokenType::Number, input_.substr(start, pos_ - start) };
+        } else if (c=='#' && pos_ + 1 < input_.size() && input_[pos_ + 1]=='{') {
+            pos_ += 2; // 跳过 #{
+            size_t close = input_.find('}', pos_);
+            if (close == std::string_view::npos) {
+                throw std::runtime_error("Unterminated variable reference");
+            }
+            std::string_view name = input_.substr(pos_, close - pos_);
+            pos_ = close + 1;
+            return { SreTokenType::Variable, name };
+        } else if (c=='\'') {
+            pos_++; // 跳过开头的 '
+            size_t close = input_.find('\'', pos_);
+            if (close == std::string_view::npos) {
+                throw std::runtime_error("Unterminated string literal");
+            }
+            std::string_view s = input_.substr(pos_, close - pos_);
+            pos_ = close + 1; // 跳过结尾的 '
+            return { SreTokenType::StringLiteral, s };
+        } else if(c==',') {
+            return { SreTokenType::Comma, input_.substr(pos_++, 1) };
+        } else if(c=='(') {
+            return { SreTokenType::LParen, input_.substr(pos_++, 1) };
+        } else if(c==')') {
+            return { SreTokenType::RParen, input_.substr(pos_++, 1) };
+        } else if (c=='<' || c=='>' || c=='=' || c=='!') {
+            bool withEqual = pos_ + 1 < input_.size() && input_[pos_ + 1] == '=';
+            if (!withEqual && (c == '=' || c == '!')) {
+                throw std::runtime_error("Unexpected character: " + std::string(1, static_cast<char>(c)));
+            }
+            std::string_view s = input_.substr(pos_, withEqual ? 2 : 1);
+            pos_ += s.size();
+            switch (c) {
+                case '<': return { withEqual ? SreTokenType::LessEqual : SreTokenType::Less, s };
+                case '>': return { withEqual ? SreTokenType::GreaterEqual : SreTokenType::Greater, s };
+                case '=': return { SreTokenType::Equal, s };
+                default:  return { SreTokenType::NotEqual, s };
+            }
+        } else {
+            throw std::runtime_error("Unexpected character: " + std::string(1, static_cast<char>(c)));
+        }
+    }
+private:
+    static bool isDigit(char c) {
+        return std::isdigit(static_cast<unsigned char>(c)) != 0;
+    }
+    void skipDigits() {
+        while (pos_ < input_.size() && isDigit(input_[pos_])) pos_++;
+    }
+    static bool isIdentifierChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+    // keyword 为小写 ASCII
+    static bool equalsIgnoreCase(std::string_view s, std::string_view keyword) {
+        if (s.size() != keyword.size()) return false;
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(s[i])) != keyword[i]) return false;
+        }
+        return true;
+    }
+    void skipWhitespace() {
+        while(pos_ < input_.size() && std::isspace(static_cast<unsigned char>(input_[pos_]))) pos_++;
+    }
+    std::string_view input_;
+    size_t pos_;
+};
+
+// =============================
+// 比较运算使用的标量：字面量在编译期解析，上下文中的字符串在第一次按数值或布尔值使用时转换，
+// 转换结果缓存在标量中。平凡析构，可以放在内存池中
+// =============================
+struct SreScalar {
+    enum Type : uint8_t { Unset, String, Int, Double, Bool };
+    // 字符串按数值解析的结果，Unparsed 表示尚未解析
+    enum Numeric : uint8_t { Unparsed, ParsedInt, ParsedDouble, NotNumber };
+
+    Type type = Unset;
+    Numeric numeric = Unparsed;
+    int64_t i = 0;        // Int、Bool 以及解析为整数的字符串
+    double d = 0;         // 所有数值
+    std::string_view text;
+
+    static SreScalar ofText(std::string_view text) {
+        SreScalar s;
+        s.type = String;
+        s.text = text;
+        return s;
+    }
+    static SreScalar ofValue(const SreValue &value) {
+        SreScalar s;
+        s.text = value.text();
+        s.i = value.asInt();
+        s.d = value.asDouble();
+        switch (value.type()) {
+            case SreValue::Type::String: s.type = String; break;
+            case SreValue::Type::Int:    s.type = Int; break;
+            case SreValue::Type::Double: s.type = Double; break;
+            case SreValue::Type::Bool:   s.type = Bool; break;
+        }
+        return s;
+    }
+
+    bool isNumber() const { return type == Int || type == Double; }
+    // 取数值，isInt 表示可以按整数精确比较；布尔值和不是数值的字符串返回 false
+    bool number(bool &isInt) {
+        if (type == String) {
+            if (numeric == Unparsed) parse();
+            if (numeric == NotNumber) return false;
+            isInt = numeric == ParsedInt;
+            return true;
+        }
+        if (type == Bool) return false;
+        isInt = type == Int;
+        return true;
+    }
+    // 取布尔值，字符串只接受 true/false（不区分大小写）
+    bool boolean(bool &value) const {
+        if (type != String) {
+            value = type == Double ? d != 0 : i != 0;
+            return true;
+        }
+        if (text.size() == 4 && equalsIgnoreCase(text, "true")) {
+            value = true;
+            return true;
+        }
+        if (text.size() == 5 && equalsIgnoreCase(text, "false")) {
+            value = false;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    void parse() {
+        const char *first = text.data();
+        const char *last = first + text.size();
+        numeric = NotNumber;
+        if (text.empty()) return;
+        std::from_chars_result r = std::from_chars(first, last, i);
+        if (r.ec == std::errc() && r.ptr == last) {
+            d = static_cast<double>(i);
+            numeric = ParsedInt;
+            return;
+        }
+        r = std::from_chars(first, last, d);
+        if (r.ec == std::errc() && r.ptr == last) numeric = ParsedDouble;
+    }
+    static bool equalsIgnoreCase(std::string_view s, const char *keyword) {
+        for (size_t k = 0; k < s.size(); ++k) {
+            if (std::tolower(static_cast<unsigned char>(s[k])) != keyword[k]) return false;
+        }
+        return true;
+    }
+};
+
+// 不抛异常的求值状态：缺失的变量和不能求值的部分得到一个特殊的空值（missingValue），
+// 读到它的函数调用、比较和非空判断直接为 false，不调用函数；Error 语义下同时记录错误
+struct SreEvalStatus {
+    explicit SreEvalStatus(SreMissing missing) : missing(missing) {}
+
+    SreMissing missing;
+    SreError error = SreError::None;
+    std::string_view variable;
+
+    static std::string_view missingValue() { return std::string_view(kMissing, 0); }
+    static bool isMissing(std::string_view value) { return value.data() == kMissing; }
+
+    // 变量不存在：Empty 语义下返回普通的空字符串，否则返回特殊空值
+    std::string_view missingVariable(const std::string &name) {
+        if (missing == SreMissing::Empty) return std::string_view();
+        if (variable.data() == nullptr) variable = name;
+        return missingValue();
+    }
+    // 不能求值的部分，不论缺失语义都算错误
+    std::string_view invalid() {
+        if (error == SreError::None) error = SreError::InvalidExpression;
+        return missingValue();
+    }
+    // 读到了特殊空值，结果总是 false
+    bool consume() {
+        if (missing == SreMissing::Error && error == SreError::None) error = SreError::MissingVariable;
+        return false;
+    }
+
+private:
+    static constexpr char kMissing[1] = {};
+};
+
+// 一次求值中按需取到的值（SreLazyContext）：第一次读到某个变量时调用取值函数，之后直接返回
+// 第一次调用取值函数时才分配缓存，取到的值在求值结束前地址不变
+class SreLazyMemo {
+public:
+    explicit SreLazyMemo(const SreLazyContext &ctx) : ctx_(ctx) {}
+    SreLazyMemo(const SreLazyMemo &) = delete;
+    SreLazyMemo &operator=(const SreLazyMemo &) = delete;
+
+    // 变量的值，不存在时返回空
+    const std::string *resolve(const std::string &name) {
+        auto it = ctx_.index_.find(name);
+        if (it == ctx_.index_.end()) return nullptr;
+        const SreLazyContext::Entry &entry = ctx_.entries_[it->second];
+        if (!entry.resolve) return &entry.value;
+        if (values_.empty()) {
+            values_.resize(ctx_.entries_.size());
+            states_.assign(ctx_.entries_.size(), Unknown);
+        }
+        uint8_t &state = states_[it->second];
+        if (state == Unknown) {
+            // 取值函数抛异常时保持 Unknown
+            state = entry.resolve(values_[it->second]) ? Found : Missing;
+        }
+        return state == Found ? &values_[it->second] : nullptr;
+    }
+
+private:
+    enum : uint8_t { Unknown, Found, Missing };
+    const SreLazyContext &ctx_;
+    std::vector<std::string> values_;
+    std::vector<uint8_t> states_;
+};
+
+// =============================
+// 求值上下文：统一 SreContext、SreSlotContext、SreTypedContext 和 SreLazyContext 几种取值方式
+// 变量节点优先按下标取值，其次按名字在带类型的、按需取值的或字符串上下文中查找
+// =============================
+struct SreEvalContext {
+    const SreContext *map;
+    const SreSlotContext *slots;
+    const SreTypedContext *typed = nullptr;
+    // 单条规则求值时比较运算的变量缓存，下标为 SreCompareOperand::memo；为空时每次都重新转换
+    SreScalar *memo = nullptr;
+    size_t memoSize = 0;
+    // 不为空时为不抛异常的求值，见 SreEvalStatus
+    SreEvalStatus *status = nullptr;
+    // 不为空时为按需取值的上下文
+    SreLazyMemo *lazy = nullptr;
+    // 规则集的字段视图（SreFieldSource）：按规则集符号表的变量下标取值，不为空时不再按名字查找
+    const std::string_view *fields = nullptr;
+
+    // 取变量值，变量不存在时抛异常（不抛异常的求值见 SreEvalStatus::missingVariable）
+    std::string_view lookup(const std::string &name, size_t slot) const {
+        if (slots) {
+            if (slot >= slots->size()) return missingVariable(name);
+            return (*slots)[slot];
+        }
+        if (typed) {
+            const SreValue *value = findTyped(name);
+            return value ? value->text() : missingVariable(name);
+        }
+        if (lazy) {
+            const std::string *value = lazy->resolve(name);
+            return value ? std::string_view(*value) : missingVariable(name);
+        }
+        auto it = map->find(name);
+        if (it == map->end()) return missingVariable(name);
+        return it->second;
+    }
+    // 取变量的标量值：带类型的上下文保留类型，其它上下文为字符串
+    SreScalar scalar(const std::string &name, size_t slot) const {
+        if (typed) {
+            const SreValue *value = findTyped(name);
+            return value ? SreScalar::ofValue(*value) : SreScalar::ofText(missingVariable(name));
+        }
+        return SreScalar::ofText(lookup(name, slot));
+    }
+    // 字段视图中下标为 index 的变量，data() 为空表示字段不存在
+    std::string_view field(uint32_t index, const std::string &name) const {
+        std::string_view value = fields[index];
+        return value.data() ? value : missingVariable(name);
+    }
+    SreScalar *memoSlot(uint32_t index) const {
+        return index < memoSize ? memo + index : nullptr;
+    }
+    // 读到的值是否为特殊空值，只在不抛异常的求值中可能为 true
+    bool missing(std::string_view value) const {
+        return status && SreEvalStatus::isMissing(value);
+    }
+
+private:
+    const SreValue *findTyped(const std::string &name) const {
+        auto it = typed->find(name);
+        return it == typed->end() ? nullptr : &it->second;
+    }
+    std::string_view missingVariable(const std::string &name) const {
+        if (status) return status->missingVariable(name);
+        throw std::runtime_error("Variable not found: " + name);
+    }
+};
+
+// 单次求值的比较缓存：变量少时放在栈上，超过时放在堆上
+class SreScalarMemo {
+public:
+    explicit SreScalarMemo(size_t size) : size_(size) {
+        if (size > kInline) {
+            heap_.resize(size);
+            data_ = heap_.data();
+        } else {
+            data_ = reinterpret_cast<SreScalar *>(inline_);
+            for (size_t k = 0; k < size; ++k) new (data_ + k) SreScalar();
+        }
+    }
+    SreScalarMemo(const SreScalarMemo &) = delete;
+    SreScalarMemo &operator=(const SreScalarMemo &) = delete;
+
+    SreScalar *data() { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    static const size_t kInline = 8;
+    alignas(SreScalar) unsigned char inline_[kInline * sizeof(SreScalar)];
+    std::vector<SreScalar> heap_;
+    SreScalar *data_;
+    size_t size_;
+};
+
+// =============================
+// AST节点及求值接口
+// 我们采用两种求值接口：evalString() 和 evalBool()
+// 如果节点本质上是字符串型（如变量、常量），evalString() 返回实际字符串；若需要布尔值，则对字符串非空判 true
+// 对于逻辑操作节点和函数节点，evalBool() 返回布尔值
+// 如果不适用的接口调用将抛异常
+// 节点全部分配在编译结果的 SreArena 中：子节点为裸指针，文本为指向内存池的视图，
+// 节点平凡析构，不需要逐个释放，因此基类没有虚析构函数
+// =============================
+// 节点类型，供降级到字节码等编译期遍历使用
+enum class SreNodeKind { Logical, Value, Function, Compare };
+
+class SreASTNode {
+public:
+    virtual SreNodeKind kind() const = 0;
+    // 返回布尔值，适用于逻辑表达式
+    virtual bool evalBool(const SreEvalContext &ctx) const {
+        if (ctx.status) {
+            ctx.status->invalid();
+            return false;
+        }
+        throw std::runtime_error("Not a boolean expression node");
+    }
+    // 返回字符串，适用于变量和字面量
+    // 返回的视图指向上下文中的值或节点自身的字面量，不做拷贝
+    virtual std::string_view evalString(const SreEvalContext &ctx) const {
+        if (ctx.status) return ctx.status->invalid();
+        throw std::runtime_error("Not a string expression node");
+    }
+};
+
+using SreASTNodePtr = const SreASTNode *;
+
+// 内存池中的子节点数组
+class SreNodeList {
+public:
+    SreNodeList(const SreASTNodePtr *data, size_t size) : data_(data), size_(size) {}
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    SreASTNodePtr operator[](size_t i) const { return data_[i]; }
+    const SreASTNodePtr *begin() const { return data_; }
+    const SreASTNodePtr *end() const { return data_ + size_; }
+private:
+    const SreASTNodePtr *data_;
+    size_t size_;
+};
+
+// 逻辑节点（and, or, not），其子节点均要求为 boolean 表达式
+// and/or 为 n 元节点，按顺序短路求值；not 只有一个子节点
+// 节点为函数调用时返回其性能分析的调用点编号，否则为 npos
+inline uint32_t sreProfileSite(SreASTNodePtr node);
+
+class SreLogicalNode : public SreASTNode {
+public:
+    enum Operator { And, Or, Not };
+    // 子节点数组位于内存池中
+    SreLogicalNode(Operator op, const SreASTNodePtr *operands, size_t count)
+        : op_(op), operands_(operands, count) {}
+
+    SreNodeKind kind() const override { return SreNodeKind::Logical; }
+    Operator op() const { return op_; }
+    const SreNodeList &operands() const { return operands_; }
+
+    bool evalBool(const SreEvalContext &ctx) const override {
+        switch(op_) {
+            case And:
+                for (size_t i = 0; i < operands_.size(); ++i) {
+                    if (!operands_[i]->evalBool(ctx)) {
+#if SRE_PROFILING
+                        if (i + 1 < operands_.size()) SreProfileThread::current().shortCircuit(sreProfileSite(operands_[i]));
+#endif
+                        return false;
+                    }
+                }
+                return true;
+            case Or:
+                for (size_t i = 0; i < operands_.size(); ++i) {
+                    if (operands_[i]->evalBool(ctx)) {
+#if SRE_PROFILING
+                        if (i + 1 < operands_.size()) SreProfileThread::current().shortCircuit(sreProfileSite(operands_[i]));
+#endif
+                        return true;
+                    }
+                }
+                return false;
+            case Not:
+                return !operands_[0]->evalBool(ctx);
+        }
+        throw std::runtime_error("Invalid logical operator");
+    }
+private:
+    Operator op_;
+    SreNodeList operands_;
+};
+
+// 变量或字符串常量节点：对于变量节点，返回上下文中对应的值；对于字符串常量节点，返回自身值
+class SreValueNode : public SreASTNode {
+public:
+    // 字符串常量，文本位于内存池中
+    explicit SreValueNode(std::string_view literal)
+        : val_(literal), name_(nullptr), slot_(SreSchema::npos) {}
+    // 变量引用，name 位于内存池中；slot 为变量在 SreSchema 中的下标
+    SreValueNode(const std::string *name, size_t slot)
+        : val_(*name), name_(name), slot_(slot) {}
+
+    SreNodeKind kind() const override { return SreNodeKind::Value; }
+    // 常量的文本或变量名
+    std::string_view value() const { return val_; }
+    bool isVariable() const { return name_ != nullptr; }
+    const std::string &name() const { return *name_; }
+    size_t slot() const { return slot_; }
+
+    std::string_view evalString(const SreEvalContext &ctx) const override {
+        if (name_) {
+            return ctx.lookup(*name_, slot_);
+        } else {
+            return val_;
+        }
+    }
+    // 如果要求布尔值，则返回非空判断
+    bool evalBool(const SreEvalContext &ctx) const override {
+        // 可根据需要调整，这里简单认为非空字符串为 true
+        std::string_view value = evalString(ctx);
+        if (ctx.missing(value)) return ctx.status->consume();
+        return !value.empty();
+    }
+private:
+    std::string_view val_;
+    const std::string *name_;  // 常量为空
+    size_t slot_;
+};
+
+// 函数调用节点，函数调用用于返回布尔值（例如 contains）
+// 函数在编译时绑定，求值时直接调用，不再按名字查找
+class SreFunctionNode : public SreASTNode {
+public:
+    // 参数数组和函数名位于内存池中；函数项由内存池持有（SreArena::retain）
+    SreFunctionNode(std::string_view name, const SreFunctionEntry *func, const SreASTNodePtr *args, size_t argc)
+        : name_(name), func_(func), args_(args, argc) {}
+
+    SreNodeKind kind() const override { return SreNodeKind::Function; }
+    std::string_view name() const { return name_; }
+    const SreFunctionEntry *function() const { return func_; }
+    const SreNodeList &args() const { return args_; }
+    // 性能分析的调用点编号，编译时在规则发布之前设置一次（见 SreProfile.h）
+    uint32_t profileSite() const { return profileSite_; }
+    void setProfileSite(uint32_t site) const { profileSite_ = site; }
+
+    bool evalBool(const SreEvalContext &ctx) const override {
+#if SRE_PROFILING
+        SreProfileScope scope(profileSite_);
+        return scope.finish(call(ctx));
+#else
+        return call(ctx);
+#endif
+    }
+private:
+    bool call(const SreEvalContext &ctx) const {
+        // 参数较少时使用栈上缓冲区，避免每次求值分配内存
+        std::string_view inlineArgs[kInlineArgs];
+        std::vector<std::string_view> heapArgs;
+        std::string_view *evaluatedArgs = inlineArgs;
+        if (args_.size() > kInlineArgs) {
+            heapArgs.resize(args_.size());
+            evaluatedArgs = heapArgs.data();
+        }
+        for (size_t i = 0; i < args_.size(); ++i) {
+            // 对于函数调用参数，我们认为调用 evalString 得到实际值
+            evaluatedArgs[i] = args_[i]->evalString(ctx);
+        }
+        if (ctx.status) {
+            // 不抛异常的求值：参数缺失时不调用函数
+            for (size_t i = 0; i < args_.size(); ++i) {
+                if (SreEvalStatus::isMissing(evaluatedArgs[i])) return ctx.status->consume();
+            }
+        }
+        return func_->call(SreArgs(evaluatedArgs, args_.size()));
+    }
+
+    static const size_t kInlineArgs = 8;
+    std::string_view name_;
+    const SreFunctionEntry *func_;
+    SreNodeList args_;
+    mutable uint32_t profileSite_ = SreProfiler::npos;
+};
+
+inline uint32_t sreProfileSite(SreASTNodePtr node) {
+    return node->kind() == SreNodeKind::Function ? static_cast<const SreFunctionNode *>(node)->profileSite()
+                                                 : SreProfiler::npos;
+}
+
+// 比较运算的一个操作数：变量，或者在编译期已经解析好的常量
+struct SreCompareOperand {
+    const SreValueNode *var;  // 常量为空
+    SreScalar literal;        // 仅常量
+    uint32_t memo;            // 仅变量：在单条规则的比较缓存中的下标
+};
+
+// 比较节点：a > b、a == b、a in (b, c, ...)，操作数只能是变量或常量
+// 任意一侧为数值（数字常量或带类型的数值）时按数值比较，另一侧不是数值时只有 != 成立；
+// 否则任意一侧为布尔值时按布尔值比较；否则按字符串字典序比较。两侧都是整数时精确比较，其余按 double 比较
+class SreCompareNode : public SreASTNode {
+public:
+    enum Operator { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual, In };
+    // 操作数数组位于内存池中，第一个为左侧，in 的右侧可以有多个
+    SreCompareNode(Operator op, const SreCompareOperand *operands, size_t count)
+        : op_(op), operands_(operands), count_(count) {}
+
+    SreNodeKind kind() const override { return SreNodeKind::Compare; }
+    Operator op() const { return op_; }
+    size_t operandCount() const { return count_; }
+    const SreCompareOperand &operand(size_t i) const { return operands_[i]; }
+
+    bool evalBool(const SreEvalContext &ctx) const override {
+        bool missing = false;
+        bool result = evaluate([&](size_t i, SreScalar &local) -> SreScalar & {
+            const SreCompareOperand &o = operands_[i];
+            if (!o.var) {
+                local = o.literal;
+                return local;
+            }
+            SreScalar *cached = ctx.memoSlot(o.memo);
+            SreScalar &target = cached ? *cached : local;
+            if (target.type == SreScalar::Unset) target = ctx.scalar(o.var->name(), o.var->slot());
+            missing = missing || ctx.missing(target.text);
+            return target;
+        });
+        return missing ? ctx.status->consume() : result;
+    }
+
+    // resolve(i, local) 返回第 i 个操作数的标量，可以返回 local 或调用方自己的缓存
+    template<typename Resolve>
+    bool evaluate(Resolve resolve) const {
+        return evaluate(op_, count_, resolve);
+    }
+    // 字节码等不持有节点的调用方使用
+    template<typename Resolve>
+    static bool evaluate(Operator op, size_t count, Resolve resolve) {
+        SreScalar lhsLocal;
+        SreScalar &lhs = resolve(0, lhsLocal);
+        if (op != In) {
+            SreScalar rhsLocal;
+            return compare(op, lhs, resolve(1, rhsLocal));
+        }
+        for (size_t i = 1; i < count; ++i) {
+            SreScalar rhsLocal;
+            if (compare(Equal, lhs, resolve(i, rhsLocal))) return true;
+        }
+        return false;
+    }
+
+    static bool compare(Operator op, SreScalar &a, SreScalar &b) {
+        int order;
+        if (a.isNumber() || b.isNumber()) {
+            bool aInt, bInt;
+            if (!a.number(aInt) || !b.number(bInt)) return op == NotEqual;
+            if (aInt && bInt) {
+                order = a.i < b.i ? -1 : (a.i > b.i ? 1 : 0);
+            } else {
+                if (a.d != a.d || b.d != b.d) return op == NotEqual;  // NaN
+                order = a.d < b.d ? -1 : (a.d > b.d ? 1 : 0);
+            }
+        } else if (a.type == SreScalar::Bool || b.type == SreScalar::Bool) {
+            bool av, bv;
+            if (!a.boolean(av) || !b.boolean(bv)) return op == NotEqual;
+            order = static_cast<int>(av) - static_cast<int>(bv);
+        } else {
+            int c = a.text.compare(b.text);
+            order = c < 0 ? -1 : (c > 0 ? 1 : 0);
+        }
+        switch (op) {
+            case Less:         return order < 0;
+            case LessEqual:    return order <= 0;
+            case Greater:      return order > 0;
+            case GreaterEqual: return order >= 0;
+            case Equal:
+            case In:           return order == 0;
+            case NotEqual:     return order != 0;
+        }
+        throw std::runtime_error("Invalid comparison operator");
+    }
+
+private:
+    Operator op_;
+    const SreCompareOperand *operands_;
+    size_t count_;
+};
+
+// =============================
+// 解析器（递归下降解析器）
+// =============================
+class SreParser {
+public:
+    // 节点分配在 arena 中；schema 不为空时，变量引用在编译期解析为下标；
+    // patterns 不为空时，matches/like 的常量模式在编译期编译并从缓存中共享
+    SreParser(SreLexer &lexer, const SreFunctionTable &functions, SreArena &arena, SreSchema *schema = nullptr,
+              SrePatternCache *patterns = nullptr)
+        : lexer_(lexer), functions_(functions), arena_(arena), schema_(schema), patterns_(patterns) {
+        currentToken_ = lexer_.nextToken();
+    }
+    // 解析顶级表达式，返回一个 AST 节点，该表达式应为 boolean 表达式
+    SreASTNodePtr parseExpression() {
+        return parseOr();
+    }
+    // 比较运算中出现的不同变量个数
+    size_t memoCount() const { return memoVars_.size(); }
+private:
+    // a or b or c 直接解析为一个 n 元节点
+    SreASTNodePtr parseOr() {
+        size_t base = argStack_.size();
+        argStack_.push_back(parseAnd());
+        while (currentToken_.type == SreTokenType::Or) {
+            consume(SreTokenType::Or);
+            argStack_.push_back(parseAnd());
+        }
+        return makeLogical(SreLogicalNode::Or, base);
+    }
+    SreASTNodePtr parseAnd() {
+        size_t base = argStack_.size();
+        argStack_.push_back(parseNot());
+        while (currentToken_.type == SreTokenType::And) {
+            consume(SreTokenType::And);
+            argStack_.push_back(parseNot());
+        }
+        return makeLogical(SreLogicalNode::And, base);
+    }
+    SreASTNodePtr parseNot() {
+        if (currentToken_.type == SreTokenType::Not) {
+            consume(SreTokenType::Not);
+            SreASTNodePtr operand = parseNot();
+            return arena_.make<SreLogicalNode>(SreLogicalNode::Not, arena_.copyArray(&operand, 1), 1);
+        }
+        return parseComparison();
+    }
+    // primary [op primary] 或 primary in (primary, ...)
+    SreASTNodePtr parseComparison() {
+        SreTokenType first = currentToken_.type;
+        SreASTNodePtr lhs = parsePrimary();
+        SreCompareNode::Operator op;
+        if (!compareOperator(currentToken_.type, op)) return lhs;
+        consume(currentToken_.type);
+        size_t base = compareStack_.size();
+        compareStack_.push_back(makeOperand(lhs, first));
+        if (op == SreCompareNode::In) {
+            consume(SreTokenType::LParen);
+            for (;;) {
+                first = currentToken_.type;
+                compareStack_.push_back(makeOperand(parsePrimary(), first));
+                if (currentToken_.type != SreTokenType::Comma) break;
+                consume(SreTokenType::Comma);
+            }
+            consume(SreTokenType::RParen);
+        } else {
+            first = currentToken_.type;
+            compareStack_.push_back(makeOperand(parsePrimary(), first));
+        }
+        size_t count = compareStack_.size() - base;
+        const SreCompareOperand *operands = arena_.copyArray(compareStack_.data() + base, count);
+        compareStack_.resize(base);
+        return arena_.make<SreCompareNode>(op, operands, count);
+    }
+    static bool compareOperator(SreTokenType type, SreCompareNode::Operator &op) {
+        switch (type) {
+            case SreTokenType::Less:         op = SreCompareNode::Less; return true;
+            case SreTokenType::LessEqual:    op = SreCompareNode::LessEqual; return true;
+            case SreTokenType::Greater:      op = SreCompareNode::Greater; return true;
+            case SreTokenType::GreaterEqual: op = SreCompareNode::GreaterEqual; return true;
+            case SreTokenType::Equal:        op = SreCompareNode::Equal; return true;
+            case SreTokenType::NotEqual:     op = SreCompareNode::NotEqual; return true;
+            case SreTokenType::In:           op = SreCompareNode::In; return true;
+            default:                         return false;
+        }
+    }
+    // 常量的类型由词法单元决定：数字为数值，裸标识符 true/false 为布尔值，其余为字符串
+    SreCompareOperand makeOperand(SreASTNodePtr node, SreTokenType token) {
+        if (node->kind() != SreNodeKind::Value) {
+            throw std::runtime_error("Comparison operand must be a variable or literal");
+        }
+        const SreValueNode *value = static_cast<const SreValueNode *>(node);
+        SreCompareOperand operand = { nullptr, SreScalar(), 0 };
+        if (value->isVariable()) {
+            operand.var = value;
+            operand.memo = memoIndex(&value->name());
+            return operand;
+        }
+        SreScalar literal = SreScalar::ofText(value->value());
+        bool isInt;
+        bool flag;
+        if (token == SreTokenType::Number && literal.number(isInt)) {
+            literal.type = isInt ? SreScalar::Int : SreScalar::Double;
+        } else if (token == SreTokenType::Identifier && literal.boolean(flag)) {
+            literal.type = SreScalar::Bool;
+            literal.i = flag;
+            literal.d = flag;
+        } else {
+            // 与变量按数值比较时不必再解析
+            literal.number(isInt);
+        }
+        operand.literal = literal;
+        return operand;
+    }
+    // 变量名已驻留在内存池中，按地址去重
+    uint32_t memoIndex(const std::string *name) {
+        for (size_t k = 0; k < memoVars_.size(); ++k) {
+            if (memoVars_[k] == name) return static_cast<uint32_t>(k);
+        }
+        memoVars_.push_back(name);
+        return static_cast<uint32_t>(memoVars_.size() - 1);
+    }
+    // 把 argStack_[base, end) 合并为一个逻辑节点，只有一项时直接返回该项
+    SreASTNodePtr makeLogical(SreLogicalNode::Operator op, size_t base) {
+        size_t count = argStack_.size() - base;
+        SreASTNodePtr node = argStack_[base];
+        if (count > 1) {
+            node = arena_.make<SreLogicalNode>(op, arena_.copyArray(argStack_.data() + base, count), count);
+        }
+        argStack_.resize(base);
+        return node;
+    }
+    SreASTNodePtr parsePrimary() {
+        if (currentToken_.type == SreTokenType::LParen) {
+            consume(SreTokenType::LParen);
+            SreASTNodePtr node = parseExpression();
+            consume(SreTokenType::RParen);
+            return node;
+        } else if (currentToken_.type == SreTokenType::Identifier) {
+            std::string_view name = currentToken_.text;
+            consume(SreTokenType::Identifier);
+            if (currentToken_.type == SreTokenType::LParen) {
+                // 函数调用
+                consume(SreTokenType::LParen);
+                // 参数先压入共用的临时栈（嵌套调用从 base 之后继续压），再整体拷贝到内存池
+                size_t base = argStack_.size();
+                if (currentToken_.type != SreTokenType::RParen) {
+                    argStack_.push_back(parseExpression());
+                    while (currentToken_.type == SreTokenType::Comma) {
+                        consume(SreTokenType::Comma);
+                        argStack_.push_back(parseExpression());
+                    }
+                }
+                consume(SreTokenType::RParen);
+                const SreFunctionEntry *func = bindFunction(name);
+                size_t argc = argStack_.size() - base;
+                if (argc == 2) func = bindPattern(func, argStack_[base + 1]);
+                func = bindFolded(func, argStack_.data() + base, argc);
+                const SreASTNodePtr *args = arena_.copyArray(argStack_.data() + base, argc);
+                argStack_.resize(base);
+                return arena_.make<SreFunctionNode>(arena_.copy(name), func, args, argc);
+            } else {
+                // 不是函数调用的裸标识符按字符串常量处理
+                return arena_.make<SreValueNode>(arena_.copy(name));
+            }
+        } else if (currentToken_.type == SreTokenType::Variable) {
+            // 变量引用，例如 #{a}
+            const std::string *name = arena_.intern(currentToken_.text);
+            consume(SreTokenType::Variable);
+            size_t slot = schema_ ? schema_->intern(*name) : SreSchema::npos;
+            return arena_.make<SreValueNode>(name, slot);
+        } else if (currentToken_.type == SreTokenType::StringLiteral || currentToken_.type == SreTokenType::Number) {
+            // 不在比较运算中的数字与字符串常量相同
+            std::string_view s = currentToken_.text;
+            consume(currentToken_.type);
+            return arena_.make<SreValueNode>(arena_.copy(s));
+        } else {
+            throw std::runtime_error("Unexpected token: " + std::string(currentToken_.text));
+        }
+    }
+    // 按小写函数名绑定，未注册的函数在编译期报错
+    const SreFunctionEntry *bindFunction(std::string_view name) {
+        std::string lower(name);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        auto it = functions_.find(lower);
+        if (it == functions_.end()) {
+            throw std::runtime_error("Function not found: " + std::string(name));
+        }
+        arena_.retain(it->second);
+        return it->second.get();
+    }
+    // matches/like 的模式是常量时换成已编译模式的函数项
+    const SreFunctionEntry *bindPattern(const SreFunctionEntry *func, SreASTNodePtr pattern) {
+        if (!patterns_ || (func->builtin != SreBuiltin::Matches && func->builtin != SreBuiltin::Like)) return func;
+        if (pattern->kind() != SreNodeKind::Value) return func;
+        const SreValueNode &value = static_cast<const SreValueNode &>(*pattern);
+        if (value.isVariable()) return func;
+        std::shared_ptr<const SreFunctionEntry> bound = patterns_->bind(func->builtin, value.value());
+        arena_.retain(bound);
+        return bound.get();
+    }
+    // icontains/icontainsAny 的字面量全为常量时在编译期折叠，换成不再折叠字面量的函数项
+    const SreFunctionEntry *bindFolded(const SreFunctionEntry *func, SreASTNodePtr *args, size_t argc) {
+        if (!patterns_ || (func->builtin != SreBuiltin::IContains && func->builtin != SreBuiltin::IContainsAny)) return func;
+        if (argc < 2) return func;
+        for (size_t i = 1; i < argc; ++i) {
+            if (args[i]->kind() != SreNodeKind::Value || static_cast<const SreValueNode &>(*args[i]).isVariable()) return func;
+        }
+        for (size_t i = 1; i < argc; ++i) {
+            std::string folded = SreCaseFold::fold(static_cast<const SreValueNode &>(*args[i]).value());
+            args[i] = arena_.make<SreValueNode>(arena_.copy(folded));
+        }
+        std::shared_ptr<const SreFunctionEntry> bound = SrePatternCache::folded(func->builtin);
+        arena_.retain(bound);
+        return bound.get();
+    }
+    void consume(SreTokenType type) {
+        if (currentToken_.type != type) {
+            throw std::runtime_error("Expected token type mismatch");
+        }
+        currentToken_ = lexer_.nextToken();
+    }
+    SreLexer &lexer_;
+    const SreFunctionTable &functions_;
+    SreArena &arena_;
+    SreSchema *schema_;
+    SrePatternCache *patterns_;
+    std::vector<SreASTNodePtr> argStack_;
+    std::vector<SreCompareOperand> compareStack_;
+    std::vector<const std::string *> memoVars_;
+    SreToken currentToken_;
+};
+
+
+#endif // SRE_AST_H
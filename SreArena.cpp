@@ -0,0 +1,52 @@
+#include "SreArena.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+void *SreArena::allocate(size_t size, size_t align) {
+    size_t pad = (align - reinterpret_cast<uintptr_t>(cur_) % align) % align;
+    if (pad + size > left_) {
+        // 新块至少能放下本次请求；块大小从小块开始逐步翻倍，上限 64KB，小规则不会浪费整块内存
+        size_t blockSize = std::max(blockSize_, size + align);
+        blocks_.emplace_back(std::unique_ptr<char[]>(new char[blockSize]), blockSize);
+        cur_ = blocks_.back().first.get();
+        left_ = blockSize;
+        blockSize_ = std::min<size_t>(blockSize_ * 2, 64 * 1024);
+        pad = (align - reinterpret_cast<uintptr_t>(cur_) % align) % align;
+    }
+    char *out = cur_ + pad;
+    cur_ += pad + size;
+    left_ -= pad + size;
+    used_ += size;
+    return out;
+}
+
+std::string_view SreArena::copy(std::string_view text) {
+    if (text.empty()) return std::string_view();
+    char *out = static_cast<char *>(allocate(text.size(), 1));
+    std::memcpy(out, text.data(), text.size());
+    return std::string_view(out, text.size());
+}
+
+const std::string *SreArena::intern(std::string_view text) {
+    // 单条规则引用的变量很少，线性查找即可
+    for (const std::string &s : strings_) {
+        if (s == text) return &s;
+    }
+    strings_.emplace_front(text);
+    used_ += sizeof(std::string) + (strings_.front().size() > 15 ? strings_.front().capacity() : 0);
+    return &strings_.front();
+}
+
+void SreArena::retain(std::shared_ptr<const void> object) {
+    for (auto &kept : retained_) {
+        if (kept == object) return;
+    }
+    retained_.push_back(std::move(object));
+}
+
+size_t SreArena::bytesReserved() const {
+    size_t total = 0;
+    for (auto &block : blocks_) total += block.second;
+    return total;
+}
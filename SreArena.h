@@ -0,0 +1,64 @@
+#ifndef SRE_ARENA_H
+#define SRE_ARENA_H
+
+// 内部头文件：编译结果使用的内存池
+// 语法树节点和文本按顺序分配在大块内存中，不单独释放，内存池销毁时一次性整体释放；
+// 因此放入内存池的对象必须是平凡析构的
+#include <cstddef>
+#include <forward_list>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class SreArena {
+public:
+    explicit SreArena(size_t blockSize = 256) : blockSize_(blockSize), cur_(nullptr), left_(0), used_(0) {}
+    SreArena(const SreArena &) = delete;
+    SreArena &operator=(const SreArena &) = delete;
+
+    void *allocate(size_t size, size_t align);
+
+    template<typename T, typename... Args>
+    T *make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects must be trivially destructible");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // 拷贝一组元素到内存池，返回首地址
+    template<typename T>
+    T *copyArray(const T *data, size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "arena arrays must be trivially copyable");
+        if (count == 0) return nullptr;
+        T *out = static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+        std::uninitialized_copy(data, data + count, out);
+        return out;
+    }
+
+    // 拷贝文本到内存池
+    std::string_view copy(std::string_view text);
+    // 需要作为 std::string 使用的文本（例如按变量名查找 SreContext），相同文本只保存一份，
+    // 地址在内存池销毁前保持不变
+    const std::string *intern(std::string_view text);
+    // 内存池销毁前保持对象存活，例如节点引用的函数；同一对象只记录一次
+    void retain(std::shared_ptr<const void> object);
+
+    // 已分配出去的字节数
+    size_t bytesUsed() const { return used_; }
+    // 从系统申请的字节数
+    size_t bytesReserved() const;
+
+private:
+    size_t blockSize_;
+    char *cur_;
+    size_t left_;
+    size_t used_;
+    std::vector<std::pair<std::unique_ptr<char[]>, size_t>> blocks_;
+    std::forward_list<std::string> strings_;
+    std::vector<std::shared_ptr<const void>> retained_;
+};
+
+#endif // SRE_ARENA_H
@@ -0,0 +1,316 @@
+#include "SreAsync.h"
+
+// 异步调用的结果
+struct SreAsyncEvaluator::Result {
+    bool value;
+    std::exception_ptr error;
+};
+
+// 一次提交的求值
+struct SreAsyncEvaluator::Task {
+    SreCompiledRule rule;
+    SreContext ctx;
+    Callback callback;
+    std::unordered_map<std::string, Result> results;  // 已得到的异步调用结果，键见 sreAsyncKey
+    // 挂起时结果未知的调用
+    std::shared_ptr<const SreAsyncFunction> function;
+    std::string key;
+    std::vector<std::string> args;
+};
+
+// 已登记或已发出的批次：第 i 个调用的键和等待它的求值
+struct SreAsyncEvaluator::Flight {
+    std::vector<std::string> keys;
+    std::vector<std::vector<Task *>> waiting;
+};
+
+// 尚未发出的批次
+struct SreAsyncEvaluator::Open {
+    std::shared_ptr<const SreAsyncFunction> function;
+    std::shared_ptr<SreAsyncBatch> batch;
+    std::shared_ptr<Flight> flight;
+    std::unordered_map<std::string, size_t> index;  // 键 -> 批次中的下标
+    std::chrono::steady_clock::time_point created;
+};
+
+thread_local SreAsyncEvaluator::Task *SreAsyncEvaluator::current_ = nullptr;
+
+namespace {
+
+// 调用的键：函数地址加上带长度前缀的各个参数
+std::string sreAsyncKey(const SreAsyncFunction *function, SreArgs args) {
+    std::string key(reinterpret_cast<const char *>(&function), sizeof(function));
+    for (const std::string_view &arg : args) {
+        uint32_t size = static_cast<uint32_t>(arg.size());
+        key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+        key.append(arg.data(), arg.size());
+    }
+    return key;
+}
+
+} // namespace
+
+SreAsyncBatch::~SreAsyncBatch() {
+    for (size_t i = 0; i < calls_.size(); ++i) {
+        report(i, false, std::make_exception_ptr(std::runtime_error("Async call was not completed")));
+    }
+}
+
+void SreAsyncBatch::add(std::vector<std::string> values) {
+    Call call;
+    call.values = std::move(values);
+    call.views.assign(call.values.begin(), call.values.end());
+    calls_.push_back(std::move(call));
+    reported_.push_back(0);
+}
+
+bool SreAsyncBatch::report(size_t i, bool result, std::exception_ptr error) {
+    if (i >= calls_.size()) throw std::runtime_error("Async call index out of range");
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (reported_[i]) return false;
+        reported_[i] = 1;
+    }
+    reply_(i, result, std::move(error));
+    return true;
+}
+
+void SreAsyncBatch::complete(size_t i, bool result) {
+    if (!report(i, result, nullptr)) throw std::runtime_error("Async call already completed");
+}
+
+void SreAsyncBatch::fail(size_t i, std::exception_ptr error) {
+    if (!error) error = std::make_exception_ptr(std::runtime_error("Async call failed"));
+    if (!report(i, false, std::move(error))) throw std::runtime_error("Async call already completed");
+}
+
+void SreRuleEngine::registerAsyncFunction(const std::string &name, SreAsyncFunction func) {
+    std::shared_ptr<const SreAsyncFunction> function = std::make_shared<const SreAsyncFunction>(std::move(func));
+    registerEntry(name, [function](SreArgs args) { return SreAsyncEvaluator::call(function, args); },
+                  SreBuiltin::None, false);
+}
+
+SreAsyncEvaluator::SreAsyncEvaluator(const SreRuleEngine &engine) : SreAsyncEvaluator(engine, Options()) {}
+
+SreAsyncEvaluator::SreAsyncEvaluator(const SreRuleEngine &engine, const Options &options)
+    : engine_(engine), options_(options) {
+    if (options_.threads == 0) options_.threads = 1;
+    if (options_.maxBatch == 0) options_.maxBatch = 1;
+    workers_.reserve(options_.threads);
+    for (size_t i = 0; i < options_.threads; ++i) {
+        workers_.emplace_back([this] { workerLoop(); });
+    }
+}
+
+SreAsyncEvaluator::~SreAsyncEvaluator() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &worker : workers_) worker.join();
+}
+
+void SreAsyncEvaluator::submit(const SreCompiledRule &rule, SreContext ctx, Callback callback) {
+    if (!rule.valid()) throw std::runtime_error("Rule is not compiled");
+    std::unique_ptr<Task> task(new Task());
+    task->rule = rule;
+    task->ctx = std::move(ctx);
+    task->callback = std::move(callback);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.push_back(task.release());
+        ++inflight_;
+    }
+    wake_.notify_one();
+}
+
+std::future<bool> SreAsyncEvaluator::submit(const SreCompiledRule &rule, SreContext ctx) {
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+    submit(rule, std::move(ctx), [promise](bool matched, std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(matched);
+        }
+    });
+    return future;
+}
+
+void SreAsyncEvaluator::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return inflight_ == 0; });
+}
+
+size_t SreAsyncEvaluator::batchCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return batches_;
+}
+
+size_t SreAsyncEvaluator::callCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return calls_;
+}
+
+bool SreAsyncEvaluator::call(const std::shared_ptr<const SreAsyncFunction> &function, SreArgs args) {
+    Task *task = current_;
+    if (!task) {
+        // 不在求值器中：单独成批，阻塞到结果到达
+        auto promise = std::make_shared<std::promise<bool>>();
+        std::future<bool> future = promise->get_future();
+        std::shared_ptr<SreAsyncBatch> batch(new SreAsyncBatch(
+            [promise](size_t, bool result, std::exception_ptr error) {
+                if (error) {
+                    promise->set_exception(error);
+                } else {
+                    promise->set_value(result);
+                }
+            }));
+        batch->add(std::vector<std::string>(args.begin(), args.end()));
+        (*function)(batch);
+        batch.reset();
+        return future.get();
+    }
+    std::string key = sreAsyncKey(function.get(), args);
+    auto it = task->results.find(key);
+    if (it != task->results.end()) {
+        if (it->second.error) std::rethrow_exception(it->second.error);
+        return it->second.value;
+    }
+    task->function = function;
+    task->key = std::move(key);
+    task->args.assign(args.begin(), args.end());
+    throw Suspend();
+}
+
+void SreAsyncEvaluator::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        if (!ready_.empty()) {
+            Task *task = ready_.front();
+            ready_.pop_front();
+            lock.unlock();
+            run(task);
+            lock.lock();
+            continue;
+        }
+        if (!open_.empty()) {
+            // 就绪的求值都已挂起或完成：等待到最早的批次满 linger 后全部发出
+            auto now = std::chrono::steady_clock::now();
+            auto deadline = now;
+            if (options_.linger.count() > 0) {
+                deadline = std::chrono::steady_clock::time_point::max();
+                for (auto &entry : open_) deadline = std::min(deadline, entry.second->created + options_.linger);
+            }
+            if (deadline > now && !stop_) {
+                wake_.wait_until(lock, deadline);
+                continue;
+            }
+            std::vector<std::shared_ptr<Open>> opens;
+            opens.reserve(open_.size());
+            for (auto &entry : open_) opens.push_back(std::move(entry.second));
+            open_.clear();
+            lock.unlock();
+            for (auto &open : opens) dispatch(open);
+            lock.lock();
+            continue;
+        }
+        if (stop_) return;
+        wake_.wait(lock);
+    }
+}
+
+void SreAsyncEvaluator::run(Task *task) {
+    bool matched = false;
+    bool suspended = false;
+    std::exception_ptr error;
+    current_ = task;
+    try {
+        matched = engine_.evaluate(task->rule, task->ctx);
+    } catch (const Suspend &) {
+        suspended = true;
+    } catch (...) {
+        error = std::current_exception();
+    }
+    current_ = nullptr;
+
+    if (suspended) {
+        std::vector<std::shared_ptr<Open>> full;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            suspend(task, full);
+        }
+        for (auto &open : full) dispatch(open);
+        return;
+    }
+
+    std::unique_ptr<Task> done(task);
+    try {
+        done->callback(matched, error);
+    } catch (...) {
+        // 回调的异常无处报告，忽略
+    }
+    done.reset();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--inflight_ == 0) idle_.notify_all();
+}
+
+void SreAsyncEvaluator::suspend(Task *task, std::vector<std::shared_ptr<Open>> &full) {
+    std::shared_ptr<const SreAsyncFunction> function = std::move(task->function);
+    std::shared_ptr<Open> &slot = open_[function.get()];
+    if (!slot) {
+        slot = std::make_shared<Open>();
+        slot->function = function;
+        slot->flight = std::make_shared<Flight>();
+        slot->created = std::chrono::steady_clock::now();
+        std::shared_ptr<Flight> flight = slot->flight;
+        slot->batch.reset(new SreAsyncBatch([this, flight](size_t index, bool result, std::exception_ptr error) {
+            resolve(flight, index, result, std::move(error));
+        }));
+    }
+    std::shared_ptr<Open> open = slot;
+    auto inserted = open->index.emplace(task->key, open->batch->size());
+    if (inserted.second) {
+        open->batch->add(std::move(task->args));
+        open->flight->keys.push_back(std::move(task->key));
+        open->flight->waiting.emplace_back();
+    }
+    open->flight->waiting[inserted.first->second].push_back(task);
+    task->key.clear();
+    task->args.clear();
+    if (open->batch->size() >= options_.maxBatch) {
+        open_.erase(function.get());
+        full.push_back(std::move(open));
+    }
+}
+
+void SreAsyncEvaluator::dispatch(const std::shared_ptr<Open> &open) {
+    std::shared_ptr<SreAsyncBatch> batch = std::move(open->batch);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++batches_;
+        calls_ += batch->size();
+    }
+    try {
+        (*open->function)(batch);
+    } catch (...) {
+        // 异步函数本身抛异常：尚未报告的调用都按该异常失败
+        std::exception_ptr error = std::current_exception();
+        for (size_t i = 0; i < batch->size(); ++i) batch->report(i, false, error);
+    }
+    // 异步函数没有保留批次时，析构让未报告的调用失败
+}
+
+void SreAsyncEvaluator::resolve(const std::shared_ptr<Flight> &flight, size_t index, bool result,
+                                std::exception_ptr error) {
+    // 持锁通知：最后一个结果到达后求值器可能随时析构
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Task *task : flight->waiting[index]) {
+        task->results[flight->keys[index]] = Result{ result, error };
+        ready_.push_back(task);
+    }
+    flight->waiting[index].clear();
+    wake_.notify_one();
+}
@@ -0,0 +1,121 @@
+#ifndef SRE_ASYNC_H
+#define SRE_ASYNC_H
+
+// 异步求值：异步函数（SreRuleEngine::registerAsyncFunction）可以挂起求值，等结果到达后再继续，
+// 少量线程同时推进大量求值；各个求值中对同一个异步函数的调用合并成批次一起发出
+// 求值遇到结果未知的异步调用时中止，结果到达后从头重新执行，已得到的结果直接使用：
+// 结果与同步求值相同，但挂起之前执行过的同步函数会再次调用，因此它们应当没有副作用
+#include "SreRuleEngine.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <thread>
+
+// 一批异步调用：每个调用的参数已拷贝，批次存活期间有效
+// 每个调用恰好报告一次结果，可以在任意线程、在异步函数返回之后报告；
+// 批次析构时仍未报告的调用按失败处理，等待它们的求值得到异常，不会一直挂起
+class SreAsyncBatch {
+public:
+    ~SreAsyncBatch();
+    SreAsyncBatch(const SreAsyncBatch &) = delete;
+    SreAsyncBatch &operator=(const SreAsyncBatch &) = delete;
+
+    size_t size() const { return calls_.size(); }
+    SreArgs args(size_t i) const { return SreArgs(calls_[i].views.data(), calls_[i].views.size()); }
+
+    // 第 i 个调用的结果；重复报告抛异常
+    void complete(size_t i, bool result);
+    // 第 i 个调用失败，求值时与同步函数抛出 error 相同
+    void fail(size_t i, std::exception_ptr error);
+
+private:
+    friend class SreAsyncEvaluator;
+    using Reply = std::function<void(size_t index, bool result, std::exception_ptr error)>;
+
+    struct Call {
+        std::vector<std::string> values;
+        std::vector<std::string_view> views;
+    };
+
+    explicit SreAsyncBatch(Reply reply) : reply_(std::move(reply)) {}
+    void add(std::vector<std::string> values);
+    // 报告结果，调用已经报告过时返回 false
+    bool report(size_t i, bool result, std::exception_ptr error);
+
+    std::vector<Call> calls_;
+    Reply reply_;
+    std::mutex mutex_;                // 保护 reported_
+    std::vector<uint8_t> reported_;
+};
+
+// 异步求值器：自带少量线程，submit 之后立即返回，结果通过回调或 future 交付
+// 调度：线程依次执行就绪的求值，直到它们全部挂起或完成，再把积累的调用按函数发出，
+// 一个批次达到 maxBatch 个调用时立即发出；同一个批次中参数相同的调用只发出一次
+// 线程安全：submit/wait 可以在任意线程调用；引擎和规则在求值器析构之前必须保持存活
+class SreAsyncEvaluator {
+public:
+    struct Options {
+        size_t threads = 1;     // 执行求值的线程数
+        size_t maxBatch = 256;  // 一个批次最多的调用数
+        // 没有就绪的求值时，批次从第一个调用算起最多再等待多久以积累更多调用；0 表示立即发出
+        std::chrono::microseconds linger{ 0 };
+    };
+    // 求值结果；error 不为空时求值抛出了异常（变量不存在、函数失败等），matched 无意义
+    // 回调在求值器的线程上执行，不要在其中阻塞等待其它求值
+    using Callback = std::function<void(bool matched, std::exception_ptr error)>;
+
+    explicit SreAsyncEvaluator(const SreRuleEngine &engine);
+    SreAsyncEvaluator(const SreRuleEngine &engine, const Options &options);
+    // 等待已提交的求值全部完成
+    ~SreAsyncEvaluator();
+    SreAsyncEvaluator(const SreAsyncEvaluator &) = delete;
+    SreAsyncEvaluator &operator=(const SreAsyncEvaluator &) = delete;
+
+    // 与 SreRuleEngine::evaluate(rule, ctx) 的结果相同
+    void submit(const SreCompiledRule &rule, SreContext ctx, Callback callback);
+    std::future<bool> submit(const SreCompiledRule &rule, SreContext ctx);
+    // 等待目前已提交的求值全部完成
+    void wait();
+
+    // 已发出的批次数和其中的调用数
+    size_t batchCount() const;
+    size_t callCount() const;
+
+private:
+    friend class SreRuleEngine;  // 异步函数的调用入口
+    struct Task;
+    struct Result;
+    struct Open;
+    struct Flight;
+    struct Suspend {};  // 挂起求值，只在求值器内部抛出和捕获
+
+    // 异步函数的调用：在求值器的线程上查找或登记结果，其它地方单独成批并阻塞等待
+    static bool call(const std::shared_ptr<const SreAsyncFunction> &function, SreArgs args);
+
+    void workerLoop();
+    void run(Task *task);
+    // 把挂起的求值登记到对应函数的批次中，调用方持有 mutex_
+    void suspend(Task *task, std::vector<std::shared_ptr<Open>> &full);
+    void dispatch(const std::shared_ptr<Open> &open);
+    // 批次中第 index 个调用有了结果，等待它的求值重新就绪
+    void resolve(const std::shared_ptr<Flight> &flight, size_t index, bool result, std::exception_ptr error);
+
+    static thread_local Task *current_;  // 当前线程正在执行的求值
+
+    const SreRuleEngine &engine_;
+    Options options_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;  // 有就绪的求值或可以发出的批次
+    std::condition_variable idle_;  // 已提交的求值全部完成
+    std::deque<Task *> ready_;
+    std::unordered_map<const SreAsyncFunction *, std::shared_ptr<Open>> open_;  // 尚未发出的批次
+    size_t inflight_ = 0;           // 已提交、尚未完成的求值
+    size_t batches_ = 0;
+    size_t calls_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+};
+
+#endif // SRE_ASYNC_H
@@ -0,0 +1,316 @@
+// SreAsyncEvaluator 的行为测试：挂起后重新执行的结果与同步求值相同，同一批次中参数相同的调用只发出一次，
+// 批次在达到 maxBatch 时立即发出、否则等满 linger，异步函数抛异常、批次析构时仍未报告的调用按失败处理，
+// 以及求值器在仍有调用未返回时析构会等待它们完成
+// 用法：sre_async_test [种子]；返回值非 0 表示失败
+#include "SreAsync.h"
+#include "SreTest.h"
+#include <cstdlib>
+#include <random>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// 死锁时进程不会结束，超时后直接报告失败
+void sreWatchdog(std::chrono::seconds limit) {
+    std::thread([limit] {
+        std::this_thread::sleep_for(limit);
+        std::cerr << "timed out after " << limit.count() << " s, probably deadlocked\n";
+        std::_Exit(2);
+    }).detach();
+}
+
+// 一个批次中的参数，按发出的顺序记录
+class SreBatchLog {
+public:
+    void add(const SreAsyncBatch &batch) {
+        std::vector<std::string> args;
+        for (size_t i = 0; i < batch.size(); ++i) args.emplace_back(batch.args(i)[0]);
+        std::lock_guard<std::mutex> lock(mutex_);
+        batches_.push_back(std::move(args));
+    }
+
+    std::vector<std::vector<std::string>> batches() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return batches_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::vector<std::string>> batches_;
+};
+
+// 让求值器唯一的线程停在一个同步函数里，其间提交的求值都排进就绪队列，
+// 放开之后它们依次执行、全部挂起，之后才发出批次，批次的内容因此是确定的
+class SreGate {
+public:
+    bool pass() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        entered_ = true;
+        changed_.notify_all();
+        changed_.wait(lock, [this] { return open_; });
+        return true;
+    }
+
+    void waitEntered() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] { return entered_; });
+    }
+
+    void open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        open_ = true;
+        changed_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool entered_ = false;
+    bool open_ = false;
+};
+
+std::string sreErrorOf(std::future<bool> &future) {
+    try {
+        future.get();
+    } catch (const std::exception &e) {
+        return e.what();
+    }
+    return "<no error>";
+}
+
+// 挂起后从头重新执行：结果与同步求值相同，挂起之前的同步函数再次调用
+void sreTestRerun(std::mt19937 &rng) {
+    SreRuleEngine engine;
+    std::atomic<int> counted{ 0 };
+    SreBatchLog log;
+    engine.registerFunction("count", [&counted](SreArgs) {
+        ++counted;
+        return true;
+    });
+    // 参数以 'y' 开头时为真，异步函数在返回之前报告
+    engine.registerAsyncFunction("remote", [&log](const std::shared_ptr<SreAsyncBatch> &batch) {
+        log.add(*batch);
+        for (size_t i = 0; i < batch->size(); ++i) batch->complete(i, batch->args(i)[0].substr(0, 1) == "y");
+    });
+    SreCompiledRule rule = engine.compile("count() and remote(#{a}) and (remote(#{b}) or #{c} == '1')");
+
+    {
+        SreAsyncEvaluator async(engine);
+        std::future<bool> matched = async.submit(rule, { { "a", "yes" }, { "b", "yep" }, { "c", "0" } });
+        SRE_CHECK(matched.get(), "two async calls");
+        SRE_CHECK(counted == 3, "count() runs once per suspension plus the final run: " + std::to_string(counted));
+        SRE_CHECK(async.batchCount() == 2 && async.callCount() == 2, "one batch per suspension: " + std::to_string(async.batchCount()));
+    }
+
+    SreAsyncEvaluator::Options options;
+    options.threads = 2;
+    options.maxBatch = 3;
+    SreAsyncEvaluator async(engine, options);
+    const char *values[] = { "yes", "no", "y", "" };
+    std::vector<SreContext> contexts;
+    std::vector<std::future<bool>> futures;
+    for (int i = 0; i < 300; ++i) {
+        contexts.push_back({ { "a", values[rng() % 4] }, { "b", values[rng() % 4] }, { "c", rng() % 2 ? "1" : "0" } });
+        futures.push_back(async.submit(rule, contexts.back()));
+    }
+    for (size_t i = 0; i < futures.size(); ++i) {
+        // 不在求值器中调用时异步函数单独成批，阻塞到结果到达：与同步求值相同
+        SRE_CHECK(futures[i].get() == engine.evaluate(rule, contexts[i]), "async matches synchronous evaluation");
+    }
+    async.wait();
+    for (const auto &batch : log.batches()) SRE_CHECK(batch.size() <= 3, "batch larger than maxBatch");
+}
+
+// 同一批次中参数相同的调用只发出一次；达到 maxBatch 时立即发出
+void sreTestDedupe() {
+    for (size_t maxBatch : { 256, 4 }) {
+        SreRuleEngine engine;
+        SreGate gate;
+        SreBatchLog log;
+        engine.registerFunction("hold", [&gate](SreArgs args) { return args[0] != "gate" || gate.pass(); });
+        engine.registerAsyncFunction("remote", [&log](const std::shared_ptr<SreAsyncBatch> &batch) {
+            log.add(*batch);
+            for (size_t i = 0; i < batch->size(); ++i) batch->complete(i, batch->args(i)[0] == "x");
+        });
+        SreCompiledRule rule = engine.compile("hold(#{a}) and remote(#{a})");
+
+        SreAsyncEvaluator::Options options;
+        options.maxBatch = maxBatch;
+        SreAsyncEvaluator async(engine, options);
+        std::future<bool> held = async.submit(rule, { { "a", "gate" } });
+        gate.waitEntered();
+        std::vector<std::future<bool>> futures;
+        std::vector<std::string> args;
+        for (int i = 0; i < 30; ++i) {
+            // maxBatch = 256：10 个 x、10 个 y、10 个 z；maxBatch = 4：a 到 j 重复 3 遍
+            args.push_back(maxBatch == 4 ? std::string(1, static_cast<char>('a' + i % 10)) : std::string(1, "xyz"[i % 3]));
+            futures.push_back(async.submit(rule, { { "a", args.back() } }));
+        }
+        gate.open();
+        SRE_CHECK(!held.get(), "gate call");
+        for (size_t i = 0; i < futures.size(); ++i) SRE_CHECK(futures[i].get() == (args[i] == "x"), "deduplicated result");
+
+        std::vector<std::vector<std::string>> batches = log.batches();
+        if (maxBatch == 256) {
+            SRE_CHECK(batches.size() == 1, "all calls in one batch");
+            SRE_CHECK(async.callCount() == 4, "equal arguments sent once");
+            if (batches.size() == 1) {
+                SRE_CHECK(batches[0] == std::vector<std::string>({ "gate", "x", "y", "z" }), "batch content");
+            }
+        } else {
+            // 批次发出之后再出现的参数进入下一个批次；已有结果的求值重新执行时不再发出调用
+            std::string shown;
+            for (const auto &batch : batches) {
+                if (!shown.empty()) shown += " ";
+                for (const auto &arg : batch) shown += arg;
+            }
+            SRE_CHECK(shown == "gateabc defg hija bcde fghi jabc defg hij", "batches cut at maxBatch: " + shown);
+            SRE_CHECK(async.callCount() == 31, "callCount");
+        }
+        SRE_CHECK(async.batchCount() == batches.size(), "batchCount");
+    }
+}
+
+// linger：没有就绪的求值时批次等满 linger 再发出，期间到达的调用并入同一批次；满 maxBatch 时不等待
+void sreTestLinger() {
+    SreRuleEngine engine;
+    SreBatchLog log;
+    engine.registerAsyncFunction("remote", [&log](const std::shared_ptr<SreAsyncBatch> &batch) {
+        log.add(*batch);
+        for (size_t i = 0; i < batch->size(); ++i) batch->complete(i, true);
+    });
+    SreCompiledRule rule = engine.compile("remote(#{a})");
+
+    const std::chrono::milliseconds linger(300);
+    {
+        SreAsyncEvaluator::Options options;
+        options.linger = linger;
+        SreAsyncEvaluator async(engine, options);
+        auto start = Clock::now();
+        std::future<bool> first = async.submit(rule, { { "a", "1" } });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::future<bool> second = async.submit(rule, { { "a", "2" } });
+        SRE_CHECK(first.get() && second.get(), "linger results");
+        SRE_CHECK(Clock::now() - start >= linger, "batch sent before linger elapsed");
+        SRE_CHECK(log.batches().size() == 1 && log.batches()[0].size() == 2, "calls within linger share a batch");
+    }
+    {
+        SreAsyncEvaluator::Options options;
+        options.linger = std::chrono::seconds(30);
+        options.maxBatch = 2;
+        SreAsyncEvaluator async(engine, options);
+        auto start = Clock::now();
+        std::future<bool> first = async.submit(rule, { { "a", "1" } });
+        std::future<bool> second = async.submit(rule, { { "a", "2" } });
+        SRE_CHECK(first.get() && second.get(), "maxBatch results");
+        SRE_CHECK(Clock::now() - start < std::chrono::seconds(20), "full batch waited for linger");
+    }
+}
+
+// 异步函数抛异常、fail、未报告就析构的批次、重复报告
+void sreTestErrors() {
+    SreRuleEngine engine;
+    std::mutex keptMutex;
+    std::shared_ptr<SreAsyncBatch> kept;
+    engine.registerAsyncFunction("boom", [](const std::shared_ptr<SreAsyncBatch> &batch) {
+        if (batch->size()) batch->complete(0, true);  // 已报告的调用不受之后的异常影响
+        throw std::runtime_error("boom");
+    });
+    engine.registerAsyncFunction("refuse", [](const std::shared_ptr<SreAsyncBatch> &batch) {
+        for (size_t i = 0; i < batch->size(); ++i) batch->fail(i, std::make_exception_ptr(std::runtime_error("refused")));
+    });
+    engine.registerAsyncFunction("drop", [](const std::shared_ptr<SreAsyncBatch> &) {});
+    engine.registerAsyncFunction("keep", [&](const std::shared_ptr<SreAsyncBatch> &batch) {
+        std::lock_guard<std::mutex> lock(keptMutex);
+        kept = batch;
+    });
+
+    SreAsyncEvaluator::Options options;
+    options.linger = std::chrono::milliseconds(100);  // 两个调用落在同一批次
+    SreAsyncEvaluator async(engine, options);
+    std::future<bool> boomFirst = async.submit(engine.compile("boom(#{a})"), { { "a", "1" } });
+    std::future<bool> boomSecond = async.submit(engine.compile("boom(#{a})"), { { "a", "2" } });
+    std::future<bool> refused = async.submit(engine.compile("refuse(#{a}) or true"), { { "a", "1" } });
+    std::future<bool> dropped = async.submit(engine.compile("drop(#{a})"), { { "a", "1" } });
+    std::future<bool> missing = async.submit(engine.compile("drop(#{nope})"), {});
+    SRE_CHECK(boomFirst.get(), "call reported before the throw");
+    SRE_CHECK(sreErrorOf(boomSecond) == "boom", "async function throws");
+    SRE_CHECK(sreErrorOf(refused) == "refused", "fail() is rethrown by the evaluation");
+    SRE_CHECK(sreErrorOf(dropped) == "Async call was not completed", "batch dropped without reporting");
+    SRE_CHECK(sreErrorOf(missing) == "Variable not found: nope", "missing variable");
+
+    // 异步函数保留批次，之后在别的线程报告一部分：批次析构时其余的调用失败
+    std::future<bool> keptFirst = async.submit(engine.compile("keep(#{a})"), { { "a", "1" } });
+    std::future<bool> keptSecond = async.submit(engine.compile("keep(#{a})"), { { "a", "2" } });
+    std::shared_ptr<SreAsyncBatch> batch;
+    while (!batch) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        std::lock_guard<std::mutex> lock(keptMutex);
+        batch = std::move(kept);
+    }
+    SRE_CHECK(batch->size() == 2, "kept batch");
+    std::thread([batch = std::move(batch)] {
+        batch->complete(0, true);
+        bool threw = false;
+        try {
+            batch->complete(0, false);
+        } catch (const std::runtime_error &) {
+            threw = true;
+        }
+        SRE_CHECK(threw, "reporting a call twice throws");
+    }).join();
+    SRE_CHECK(keptFirst.get(), "call completed from another thread");
+    SRE_CHECK(sreErrorOf(keptSecond) == "Async call was not completed", "unreported call fails with its batch");
+}
+
+// 析构时仍有调用在别的线程上进行：析构等待它们报告，回调全部执行之后才返回
+void sreTestDestroyInFlight() {
+    SreRuleEngine engine;
+    std::mutex threadsMutex;
+    std::vector<std::thread> threads;
+    engine.registerAsyncFunction("slow", [&](const std::shared_ptr<SreAsyncBatch> &batch) {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        threads.emplace_back([batch] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            for (size_t i = 0; i < batch->size(); ++i) batch->complete(i, batch->args(i)[0] != "0");
+        });
+    });
+    SreCompiledRule rule = engine.compile("slow(#{a}) and slow(#{b})");
+    std::atomic<int> callbacks{ 0 };
+    std::atomic<int> matched{ 0 };
+    {
+        SreAsyncEvaluator::Options options;
+        options.threads = 2;
+        options.maxBatch = 8;
+        SreAsyncEvaluator async(engine, options);
+        for (int i = 0; i < 100; ++i) {
+            SreContext ctx = { { "a", std::to_string(i % 7) }, { "b", std::to_string(i % 5) } };
+            async.submit(rule, ctx, [&](bool result, std::exception_ptr error) {
+                SRE_CHECK(!error, "in-flight evaluation failed");
+                if (result) ++matched;
+                ++callbacks;
+            });
+        }
+    }
+    SRE_CHECK(callbacks == 100, "destructor returned before every callback ran");
+    int expected = 0;
+    for (int i = 0; i < 100; ++i) expected += i % 7 != 0 && i % 5 != 0;
+    SRE_CHECK(matched == expected, "in-flight results");
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    for (auto &thread : threads) thread.join();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 29;
+    std::mt19937 rng(seed);
+    sreWatchdog(std::chrono::seconds(120));
+    sreTestRerun(rng);
+    sreTestDedupe();
+    sreTestLinger();
+    sreTestErrors();
+    sreTestDestroyInFlight();
+    return sreTestResult("async test");
+}
@@ -0,0 +1,44 @@
+#ifndef SRE_BATCH_H
+#define SRE_BATCH_H
+
+// 列式批量数据：每个变量一列，布局与 Arrow 的 StringArray 相同
+// 只保存指向调用方内存的视图，不拷贝数据，求值期间调用方需保证数据有效
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// 一列字符串：第 i 行为 data[offsets[i], offsets[i + 1])
+struct SreColumn {
+    const int32_t *offsets = nullptr;  // rows + 1 个偏移
+    const char *data = nullptr;
+    const uint8_t *validity = nullptr; // 有效位图，低位在前，置位表示有值；为空表示全部有值
+
+    bool valid(size_t row) const {
+        return !validity || (validity[row >> 3] >> (row & 7)) & 1;
+    }
+    std::string_view value(size_t row) const {
+        return std::string_view(data + offsets[row], static_cast<size_t>(offsets[row + 1] - offsets[row]));
+    }
+};
+
+// 一批事件：行数固定，按变量名挂接列
+// 批中没有的列、以及有效位为 0 的行视为变量不存在
+class SreBatch {
+public:
+    explicit SreBatch(size_t rows) : rows_(rows) {}
+
+    size_t rows() const { return rows_; }
+    void setColumn(const std::string &name, const SreColumn &column) { columns_[name] = column; }
+    // 不存在时返回空
+    const SreColumn *column(const std::string &name) const {
+        auto it = columns_.find(name);
+        return it == columns_.end() ? nullptr : &it->second;
+    }
+
+private:
+    size_t rows_;
+    std::unordered_map<std::string, SreColumn> columns_;
+};
+
+#endif // SRE_BATCH_H
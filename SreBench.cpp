@@ -0,0 +1,385 @@
+// 基准测试（Google Benchmark）：词法分析、语法分析、单条规则求值、内置函数、规则集和日志流
+// 规则语料和上下文都由固定种子生成，不同提交之间的结果可以直接比较：
+//   ./sre_bench --benchmark_filter=RuleSet --benchmark_repetitions=5
+#include "SreAST.h"
+#include "SreRuleEngine.h"
+#include "SreRuleSet.h"
+#include "SreSearch.h"
+#include "SreStream.h"
+#include "SreThreadPool.h"
+#include <benchmark/benchmark.h>
+#include <random>
+
+namespace {
+
+// 语料中的词：中英文混合，字面量和字段内容都从这里取
+const char *const kWords[] = { "你好", "世界", "登录", "超时", "支付", "订单", "error", "timeout", "login", "db",
+                               "cache", "user", "payment", "retry", "refused", "503" };
+const size_t kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+const char *const kFields[] = { "msg", "user", "host", "path" };
+const size_t kFieldCount = sizeof(kFields) / sizeof(kFields[0]);
+
+std::string sreWord(std::mt19937 &rng) {
+    return kWords[rng() % kWordCount];
+}
+
+std::string sreVar(std::mt19937 &rng) {
+    return std::string("#{") + kFields[rng() % kFieldCount] + "}";
+}
+
+// 长 UTF-8 字段：中英文词用空格分隔，至少 bytes 字节
+std::string sreText(std::mt19937 &rng, size_t bytes) {
+    std::string text;
+    while (text.size() < bytes) {
+        text += sreWord(rng);
+        text += rng() % 4 ? " " : std::to_string(rng() % 1000) + " ";
+    }
+    return text;
+}
+
+// 单个检查：内置函数、比较和 in
+std::string sreLeaf(std::mt19937 &rng) {
+    switch (rng() % 6) {
+        case 0: return "contains(" + sreVar(rng) + ", '" + sreWord(rng) + "')";
+        case 1: return "containsAny(" + sreVar(rng) + ", '" + sreWord(rng) + "', '" + sreWord(rng) + "', '" + sreWord(rng) + "')";
+        case 2: return "#{latency} > " + std::to_string(rng() % 1000);
+        case 3: return "#{status} in (500, 502, 503)";
+        case 4: return "matches(" + sreVar(rng) + ", '^" + sreWord(rng) + "[0-9]+')";
+        default: return "like(#{path}, '*/" + sreWord(rng) + "/*')";
+    }
+}
+
+enum SreShape { Deep, Wide, Mixed };
+const char *const kShapeNames[] = { "deep", "wide", "mixed" };
+
+// deep：and/or/not 交替嵌套 16 层；wide：64 项的 or 链；mixed：2 到 6 项的常见规则
+std::string sreRule(std::mt19937 &rng, SreShape shape) {
+    switch (shape) {
+        case Deep: {
+            std::string rule = sreLeaf(rng);
+            for (int level = 0; level < 16; ++level) {
+                switch (level % 3) {
+                    case 0: rule = "(" + sreLeaf(rng) + " and " + rule + ")"; break;
+                    case 1: rule = "(" + rule + " or " + sreLeaf(rng) + ")"; break;
+                    default: rule = "not " + rule; break;
+                }
+            }
+            return rule;
+        }
+        case Wide: {
+            std::string rule = sreLeaf(rng);
+            for (int i = 1; i < 64; ++i) rule += " or " + sreLeaf(rng);
+            return rule;
+        }
+        case Mixed:
+            break;
+    }
+    std::string rule = sreLeaf(rng);
+    for (size_t i = 1, n = 2 + rng() % 5; i < n; ++i) {
+        rule = rng() % 2 ? rule + " and " + sreLeaf(rng) : "(" + rule + ") or " + sreLeaf(rng);
+    }
+    return rule;
+}
+
+std::vector<std::string> sreCorpus(SreShape shape, size_t count) {
+    std::mt19937 rng(42 + shape);
+    std::vector<std::string> rules;
+    for (size_t i = 0; i < count; ++i) rules.push_back(sreRule(rng, shape));
+    return rules;
+}
+
+SreContext sreEvent(std::mt19937 &rng, size_t msgBytes = 512) {
+    return { { "msg", sreText(rng, msgBytes) },
+             { "user", "user-" + std::to_string(rng() % 10000) + " " + sreWord(rng) },
+             { "host", "db" + std::to_string(rng() % 32) + ".example.com" },
+             { "path", "/api/" + sreWord(rng) + "/" + std::to_string(rng() % 100) },
+             { "latency", std::to_string(rng() % 1200) },
+             { "status", std::to_string(rng() % 4 ? 200 : 503) } };
+}
+
+std::vector<SreContext> sreEvents(size_t count) {
+    std::mt19937 rng(7);
+    std::vector<SreContext> events;
+    for (size_t i = 0; i < count; ++i) events.push_back(sreEvent(rng));
+    return events;
+}
+
+// 解析只需要按名字找到函数，不会调用
+const SreFunctionTable &sreParseFunctions() {
+    static const SreFunctionTable table = [] {
+        SreFunctionTable functions;
+        const std::pair<const char *, SreBuiltin> names[] = { { "contains", SreBuiltin::Contains },
+                                                              { "containsany", SreBuiltin::ContainsAny },
+                                                              { "matches", SreBuiltin::Matches },
+                                                              { "like", SreBuiltin::Like } };
+        for (auto &name : names) {
+            functions[name.first] = std::make_shared<const SreFunctionEntry>(
+                SreFunctionEntry{ [](SreArgs) { return false; }, name.second, false });
+        }
+        return functions;
+    }();
+    return table;
+}
+
+// =============================
+// 词法分析与语法分析
+// =============================
+void BM_Lexer(benchmark::State &state) {
+    std::vector<std::string> rules = sreCorpus(static_cast<SreShape>(state.range(0)), 256);
+    size_t tokens = 0;
+    size_t bytes = 0;
+    for (auto _ : state) {
+        for (auto &rule : rules) {
+            SreLexer lexer(rule);
+            while (lexer.nextToken().type != SreTokenType::End) ++tokens;
+            bytes += rule.size();
+        }
+    }
+    state.SetItemsProcessed(tokens);  // tokens/s
+    state.SetBytesProcessed(bytes);
+    state.SetLabel(kShapeNames[state.range(0)]);
+}
+
+void BM_Parser(benchmark::State &state) {
+    std::vector<std::string> rules = sreCorpus(static_cast<SreShape>(state.range(0)), 256);
+    size_t parsed = 0;
+    for (auto _ : state) {
+        for (auto &rule : rules) {
+            SreArena arena;
+            SreLexer lexer(rule);
+            SreParser parser(lexer, sreParseFunctions(), arena);
+            benchmark::DoNotOptimize(parser.parseExpression());
+            ++parsed;
+        }
+    }
+    state.SetItemsProcessed(parsed);  // rules/s
+    state.SetLabel(kShapeNames[state.range(0)]);
+}
+
+// 完整编译：解析、常量折叠和化简
+void BM_Compile(benchmark::State &state) {
+    std::vector<std::string> rules = sreCorpus(static_cast<SreShape>(state.range(0)), 256);
+    SreRuleEngine engine;
+    size_t compiled = 0;
+    for (auto _ : state) {
+        for (auto &rule : rules) {
+            benchmark::DoNotOptimize(engine.compile(rule));
+            ++compiled;
+        }
+    }
+    state.SetItemsProcessed(compiled);
+    state.SetLabel(kShapeNames[state.range(0)]);
+}
+
+// =============================
+// 单条规则求值：按文本（走编译缓存）与预编译的各个后端
+// =============================
+void BM_EvaluateText(benchmark::State &state) {
+    std::vector<std::string> rules = sreCorpus(static_cast<SreShape>(state.range(0)), 64);
+    std::vector<SreContext> events = sreEvents(16);
+    SreRuleEngine engine;
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(engine.evaluate(rules[i % rules.size()], events[i % events.size()]));
+        ++i;
+    }
+    state.SetItemsProcessed(i);
+    state.SetLabel(kShapeNames[state.range(0)]);
+}
+
+void sreEvaluateCompiled(benchmark::State &state, SreBackend backend) {
+    std::vector<std::string> texts = sreCorpus(static_cast<SreShape>(state.range(0)), 64);
+    std::vector<SreContext> events = sreEvents(16);
+    SreRuleEngine engine;
+    engine.setBackend(backend);
+    std::vector<SreCompiledRule> rules;
+    for (auto &text : texts) rules.push_back(engine.compile(text));
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(engine.evaluate(rules[i % rules.size()], events[i % events.size()]));
+        ++i;
+    }
+    state.SetItemsProcessed(i);
+    state.SetLabel(kShapeNames[state.range(0)]);
+}
+
+void BM_EvaluateCompiledTree(benchmark::State &state) {
+    sreEvaluateCompiled(state, SreBackend::Tree);
+}
+
+void BM_EvaluateCompiledBytecode(benchmark::State &state) {
+    sreEvaluateCompiled(state, SreBackend::Bytecode);
+}
+
+// =============================
+// 内置函数：不同长度的 UTF-8 字段，字面量都不出现，需要扫描整个字段
+// =============================
+void sreScan(benchmark::State &state, const std::string &expr) {
+    std::mt19937 rng(3);
+    SreRuleEngine engine;
+    SreCompiledRule rule = engine.compile(expr);
+    SreContext ctx = { { "msg", sreText(rng, static_cast<size_t>(state.range(0))) } };
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(engine.evaluate(rule, ctx));
+    }
+    state.SetBytesProcessed(state.iterations() * ctx["msg"].size());
+}
+
+void BM_Contains(benchmark::State &state) {
+    sreScan(state, "contains(#{msg}, '数据库连接失败')");
+}
+
+void BM_ContainsAny(benchmark::State &state) {
+    sreScan(state, "containsAny(#{msg}, '数据库', 'deadlock', 'OOM', '内存不足', 'panic', 'segfault', '磁盘已满', 'killed')");
+}
+
+// 忽略大小写：字段含中文，走折叠后查找的路径
+void BM_IContains(benchmark::State &state) {
+    sreScan(state, "icontains(#{msg}, 'Deadlock Detected')");
+}
+
+void BM_IContainsAny(benchmark::State &state) {
+    sreScan(state, "icontainsAny(#{msg}, 'Deadlock', 'OOM', 'Panic', 'SegFault', 'Killed')");
+}
+
+// 子串查找内核与标量 std::string_view::find 的对比：同一段文本和 needle，不经过规则求值
+void sreSearch(benchmark::State &state, bool kernel) {
+    std::mt19937 rng(3);
+    std::string haystack = sreText(rng, static_cast<size_t>(state.range(0)));
+    std::string_view needle = "数据库连接失败";
+    benchmark::DoNotOptimize(needle);  // 标量版本不能按编译期已知的字面量展开比较
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(kernel ? SreStringSearch::contains(haystack, needle)
+                                        : std::string_view(haystack).find(needle) != std::string_view::npos);
+    }
+    state.SetBytesProcessed(state.iterations() * haystack.size());
+    state.SetLabel(kernel ? SreStringSearch::kernelName() : "scalar");
+}
+
+void BM_SearchKernel(benchmark::State &state) {
+    sreSearch(state, true);
+}
+
+void BM_SearchScalar(benchmark::State &state) {
+    sreSearch(state, false);
+}
+
+// =============================
+// 规则集：一次求值所有规则
+// =============================
+SreRuleSet::Rules sreRuleSetRules(SreRuleEngine &engine, size_t count) {
+    std::vector<std::string> texts = sreCorpus(Mixed, count);
+    SreRuleSet::Rules rules;
+    for (size_t i = 0; i < texts.size(); ++i) rules.push_back({ i, engine.compile(texts[i]) });
+    return rules;
+}
+
+void BM_RuleSet(benchmark::State &state) {
+    SreRuleEngine engine;
+    SreRuleSet set;
+    set.reload(sreRuleSetRules(engine, static_cast<size_t>(state.range(0))));
+    std::vector<SreContext> events = sreEvents(64);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(set.evaluate(events[i++ % events.size()]));
+    }
+    state.SetItemsProcessed(i);  // events/s
+    state.counters["rules"] = static_cast<double>(set.size());
+    state.counters["predicates"] = static_cast<double>(set.sharedPredicateCount());
+    state.counters["prefiltered"] = static_cast<double>(set.prefilteredRuleCount());
+}
+
+// 每条规则都以一个少见的错误码为前提，例如 contains(#{msg}, 'code=42;') and (...)，大部分规则由预过滤跳过
+void BM_RuleSetGuarded(benchmark::State &state) {
+    size_t count = static_cast<size_t>(state.range(0));
+    std::mt19937 rng(11);
+    auto code = [&] { return "code=" + std::to_string(rng() % count) + ";"; };
+    SreRuleEngine engine;
+    SreRuleSet set;
+    std::vector<std::string> texts = sreCorpus(Mixed, count);
+    SreRuleSet::Rules rules;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        rules.push_back({ i, engine.compile("contains(#{msg}, '" + code() + "') and (" + texts[i] + ")") });
+    }
+    set.reload(rules);
+    std::vector<SreContext> events = sreEvents(64);
+    for (auto &event : events) {
+        for (int k = 0; k < 4; ++k) event["msg"] += " " + code();
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(set.evaluate(events[i++ % events.size()]));
+    }
+    state.SetItemsProcessed(i);
+    state.counters["rules"] = static_cast<double>(set.size());
+    state.counters["prefiltered"] = static_cast<double>(set.prefilteredRuleCount());
+}
+
+// 参数依次为规则数、线程数（含调用线程）和是否绑核，用于测量 1 到 64 核上的扩展性；
+// 线程数超过 CPU 数时结果没有意义
+void BM_RuleSetParallel(benchmark::State &state) {
+    SreRuleEngine engine;
+    SreRuleSet set;
+    set.reload(sreRuleSetRules(engine, static_cast<size_t>(state.range(0))));
+    std::vector<SreContext> events = sreEvents(1024);
+    SreThreadPool::Options options;
+    options.threads = static_cast<size_t>(state.range(1));
+    options.pinThreads = state.range(2) != 0;
+    SreThreadPool pool(options);
+    std::vector<std::vector<SreRuleId>> results;
+    for (auto _ : state) {
+        set.evaluate(events, results, pool);
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * events.size());
+    state.counters["rules"] = static_cast<double>(set.size());
+    state.counters["cpus"] = static_cast<double>(std::thread::hardware_concurrency());
+}
+
+// 日志流：事件写成 NDJSON，另外带一个规则不引用的嵌套字段
+void BM_StreamNdjson(benchmark::State &state) {
+    SreRuleEngine engine;
+    SreRuleSet set;
+    set.reload(sreRuleSetRules(engine, static_cast<size_t>(state.range(0))));
+    std::string input;
+    for (const SreContext &event : sreEvents(1024)) {
+        input += "{\"trace\":{\"id\":[1,2,3],\"tag\":\"x\"}";
+        for (auto &field : event) input += ",\"" + field.first + "\":\"" + field.second + "\"";
+        input += "}\n";
+    }
+    size_t hits = 0;
+    SreStream stream(set, SreStreamFormat::Ndjson,
+                     [&](std::string_view, const std::vector<SreRuleId> &ids) { hits += ids.size(); });
+    for (auto _ : state) {
+        stream.feed(input);
+    }
+    benchmark::DoNotOptimize(hits);
+    state.SetItemsProcessed(state.iterations() * 1024);  // lines/s
+    state.SetBytesProcessed(state.iterations() * input.size());
+    state.counters["rules"] = static_cast<double>(set.size());
+}
+
+}  // namespace
+
+BENCHMARK(BM_Lexer)->DenseRange(Deep, Mixed);
+BENCHMARK(BM_Parser)->DenseRange(Deep, Mixed);
+BENCHMARK(BM_Compile)->DenseRange(Deep, Mixed);
+BENCHMARK(BM_EvaluateText)->DenseRange(Deep, Mixed);
+BENCHMARK(BM_EvaluateCompiledTree)->DenseRange(Deep, Mixed);
+BENCHMARK(BM_EvaluateCompiledBytecode)->DenseRange(Deep, Mixed);
+BENCHMARK(BM_Contains)->Arg(16)->Arg(64)->Arg(1024)->Arg(8 << 10)->Arg(64 << 10);
+BENCHMARK(BM_ContainsAny)->Arg(16)->Arg(64)->Arg(1024)->Arg(8 << 10)->Arg(64 << 10);
+BENCHMARK(BM_IContains)->Arg(16)->Arg(64)->Arg(1024)->Arg(8 << 10)->Arg(64 << 10);
+BENCHMARK(BM_IContainsAny)->Arg(16)->Arg(64)->Arg(1024)->Arg(8 << 10)->Arg(64 << 10);
+BENCHMARK(BM_SearchKernel)->Arg(64)->Arg(128)->Arg(256)->Arg(1024)->Arg(64 << 10);
+BENCHMARK(BM_SearchScalar)->Arg(64)->Arg(128)->Arg(256)->Arg(1024)->Arg(64 << 10);
+BENCHMARK(BM_RuleSet)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RuleSetGuarded)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RuleSetParallel)
+    ->ArgsProduct({ { 1000, 10000 }, { 1, 2, 4, 8, 16, 32, 64 }, { 0, 1 } })
+    ->ArgNames({ "rules", "threads", "pin" })
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_StreamNdjson)->Arg(100)->Arg(1000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
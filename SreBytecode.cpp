@@ -0,0 +1,1318 @@
+#include "SreBytecode.h"
+#include "SreSerialize.h"
+#include "SreMemory.h"
+#include <cstring>
+#include <new>
+#include <unordered_set>
+
+// =============================
+// 符号表
+// =============================
+static uint32_t sreCheckIndex(size_t size) {
+    if (size >= UINT32_MAX) {
+        throw std::runtime_error("Too many symbols for bytecode");
+    }
+    return static_cast<uint32_t>(size);
+}
+
+// 从按哈希值的索引中删除一项
+static void sreUnindex(std::unordered_multimap<size_t, uint32_t> &index, size_t hash, uint32_t value) {
+    auto range = index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == value) {
+            index.erase(it);
+            return;
+        }
+    }
+}
+
+uint32_t SreSymbols::constant(std::string_view text) {
+    size_t hash = std::hash<std::string_view>()(text);
+    auto range = constantIndex_.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (constants[it->second] == text) return it->second;
+    }
+    uint32_t index = sreCheckIndex(constants.size());
+    constants.emplace_back(text);
+    constantIndex_.emplace(hash, index);
+    return index;
+}
+
+uint32_t SreSymbols::var(const std::string &name, size_t slot) {
+    auto it = varIndex_.find(name);
+    if (it != varIndex_.end()) {
+        if (vars[it->second].slot != slot) {
+            throw std::runtime_error("Variable compiled with a different schema: " + name);
+        }
+        return it->second;
+    }
+    uint32_t index = sreCheckIndex(vars.size());
+    vars.push_back({ name, slot });
+    return varIndex_[name] = index;
+}
+
+uint32_t SreSymbols::function(const SreFunctionNode &call) {
+    const SreFunctionEntry *func = call.function();
+    uint32_t pattern = SreFunctionRef::npos;
+    if ((func->builtin == SreBuiltin::Matches || func->builtin == SreBuiltin::Like) && call.args().size() == 2 &&
+        call.args()[1]->kind() == SreNodeKind::Value) {
+        const SreValueNode &value = static_cast<const SreValueNode &>(*call.args()[1]);
+        if (!value.isVariable()) pattern = constant(value.value());
+    }
+    std::string name(call.name());
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    return function(func, SreFunctionRef{ name, func->builtin, pattern, func->folded });
+}
+
+uint32_t SreSymbols::function(const SreFunctionEntry *func, const SreFunctionRef &ref) {
+    auto key = std::make_pair(func, ref.pattern);
+    auto it = functionIndex_.find(key);
+    if (it != functionIndex_.end()) return it->second;
+    uint32_t index = sreCheckIndex(functions.size());
+    functions.push_back(func);
+    functionRefs.push_back(ref);
+    return functionIndex_[key] = index;
+}
+
+uint32_t SreSymbols::error(const std::string &message) {
+    for (size_t i = 0; i < errors.size(); ++i) {
+        if (errors[i] == message) return static_cast<uint32_t>(i);
+    }
+    uint32_t index = sreCheckIndex(errors.size());
+    errors.push_back(message);
+    return index;
+}
+
+std::string SreSymbols::predicateKey(const SrePredicate &pred) {
+    // 以函数下标和参数序列的原始字节作为去重键
+    std::string key(reinterpret_cast<const char *>(&pred.function), sizeof(pred.function));
+    for (auto &arg : pred.args) {
+        key.push_back(static_cast<char>(arg.kind));
+        key.append(reinterpret_cast<const char *>(&arg.index), sizeof(arg.index));
+    }
+    return key;
+}
+
+uint32_t SreSymbols::predicate(const SrePredicate &pred) {
+    std::string key = predicateKey(pred);
+    auto it = predicateIndex_.find(key);
+    if (it != predicateIndex_.end()) return it->second;
+    uint32_t index = sreCheckIndex(predicates.size());
+    predicates.push_back(pred);
+    return predicateIndex_[key] = index;
+}
+
+uint32_t SreSymbols::compare(const SreCompareNode &node) {
+    std::vector<SreCompareRef::Arg> args;
+    args.reserve(node.operandCount());
+    for (size_t i = 0; i < node.operandCount(); ++i) {
+        const SreCompareOperand &operand = node.operand(i);
+        SreCompareRef::Arg arg = { SreCompareRef::Arg::npos, operand.memo, 0, SreScalar::Unset, SreScalar::Unparsed, 0, 0 };
+        if (operand.var) {
+            arg.var = var(operand.var->name(), operand.var->slot());
+        } else {
+            arg.constant = constant(operand.literal.text);
+            arg.type = operand.literal.type;
+            arg.numeric = operand.literal.numeric;
+            arg.i = operand.literal.i;
+            arg.d = operand.literal.d;
+        }
+        args.push_back(arg);
+    }
+    return compare(node.op(), args.data(), args.size());
+}
+
+uint32_t SreSymbols::compare(SreCompareNode::Operator op, const SreCompareRef::Arg *args, size_t count) {
+    size_t hash = compareHash(op, args, count);
+    auto range = compareIndex_.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (sameCompare(it->second, op, args, count)) return it->second;
+    }
+    uint32_t index = sreCheckIndex(compares.size());
+    uint32_t first = sreCheckIndex(compareArgs.size());
+    sreCheckIndex(compareArgs.size() + count);
+    compareArgs.insert(compareArgs.end(), args, args + count);
+    compares.push_back({ op, first, static_cast<uint32_t>(count) });
+    compareIndex_.emplace(hash, index);
+    return index;
+}
+
+// 逐个字段计算，结构体中的填充字节不参与
+size_t SreSymbols::compareHash(SreCompareNode::Operator op, const SreCompareRef::Arg *args, size_t count) {
+    uint64_t hash = static_cast<uint64_t>(op) * 0x9E3779B97F4A7C15ull;
+    auto mix = [&hash](uint64_t value) { hash = (hash ^ value) * 0x100000001B3ull; hash ^= hash >> 29; };
+    for (size_t i = 0; i < count; ++i) {
+        const SreCompareRef::Arg &arg = args[i];
+        uint64_t bits;
+        std::memcpy(&bits, &arg.d, sizeof(bits));
+        mix(arg.var);
+        mix(arg.memo);
+        mix(arg.constant);
+        mix(static_cast<uint64_t>(arg.type) << 8 | arg.numeric);
+        mix(static_cast<uint64_t>(arg.i));
+        mix(bits);
+    }
+    return static_cast<size_t>(hash);
+}
+
+bool SreSymbols::sameCompare(uint32_t index, SreCompareNode::Operator op, const SreCompareRef::Arg *args,
+                             size_t count) const {
+    const SreCompareRef &ref = compares[index];
+    if (ref.op != op || ref.count != count) return false;
+    const SreCompareRef::Arg *own = this->args(ref);
+    for (size_t i = 0; i < count; ++i) {
+        const SreCompareRef::Arg &a = own[i], &b = args[i];
+        if (a.var != b.var || a.memo != b.memo || a.constant != b.constant || a.type != b.type ||
+            a.numeric != b.numeric || a.i != b.i || std::memcmp(&a.d, &b.d, sizeof(a.d)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SreSymbols::indexCompare(uint32_t index) {
+    const SreCompareRef &ref = compares[index];
+    compareIndex_.emplace(compareHash(ref.op, args(ref), ref.count), index);
+}
+
+void SreSymbols::bindFunction(uint32_t index, const SreFunctionEntry *func) {
+    functions[index] = func;
+    functionIndex_[std::make_pair(func, functionRefs[index].pattern)] = index;
+}
+
+SreSymbols::Mark SreSymbols::mark() const {
+    return { constants.size(), vars.size(), functions.size(), errors.size(), predicates.size(), compares.size(),
+             compareArgs.size(), sites.size() };
+}
+
+void SreSymbols::truncate(const Mark &mark) {
+    for (size_t i = mark.constants; i < constants.size(); ++i) {
+        sreUnindex(constantIndex_, std::hash<std::string_view>()(constants[i]), static_cast<uint32_t>(i));
+    }
+    for (size_t i = mark.vars; i < vars.size(); ++i) varIndex_.erase(vars[i].name);
+    for (size_t i = mark.functions; i < functions.size(); ++i) {
+        functionIndex_.erase(std::make_pair(functions[i], functionRefs[i].pattern));
+    }
+    for (size_t i = mark.predicates; i < predicates.size(); ++i) predicateIndex_.erase(predicateKey(predicates[i]));
+    for (size_t i = mark.compares; i < compares.size(); ++i) {
+        const SreCompareRef &ref = compares[i];
+        sreUnindex(compareIndex_, compareHash(ref.op, args(ref), ref.count), static_cast<uint32_t>(i));
+    }
+    constants.resize(mark.constants);
+    vars.resize(mark.vars);
+    functions.resize(mark.functions);
+    functionRefs.resize(mark.functions);
+    errors.resize(mark.errors);
+    predicates.resize(mark.predicates);
+    compares.resize(mark.compares);
+    compareArgs.resize(mark.compareArgs);
+    sites.resize(std::min(sites.size(), mark.sites));
+}
+
+size_t SreSymbols::memoryUsage() const {
+    size_t bytes = sreHeapBytes(constants) + sreHeapBytes(vars) + sreHeapBytes(functions) + sreHeapBytes(functionRefs) +
+                   sreHeapBytes(errors) + sreHeapBytes(predicates) + sreHeapBytes(compares) + sreHeapBytes(sites);
+    for (auto &var : vars) bytes += sreHeapBytes(var.name);
+    for (auto &ref : functionRefs) bytes += sreHeapBytes(ref.name);
+    for (auto &pred : predicates) bytes += sreHeapBytes(pred.args);
+    return bytes + sreHeapBytes(compareArgs) + sreHeapBytes(constantIndex_) + sreHeapBytes(varIndex_) +
+           sreHeapBytes(functionIndex_) + sreHeapBytes(predicateIndex_) + sreHeapBytes(compareIndex_);
+}
+
+SreSymbols SreSymbols::withoutIndex() const {
+    SreSymbols copy;
+    copy.constants = constants;
+    copy.vars = vars;
+    copy.functions = functions;
+    copy.functionRefs = functionRefs;
+    copy.errors = errors;
+    copy.predicates = predicates;
+    copy.compares = compares;
+    copy.compareArgs = compareArgs;
+    copy.sites = sites;
+    return copy;
+}
+
+void SreSymbols::save(SreBinaryWriter &out) const {
+    out.pod<uint64_t>(constants.size());
+    for (auto &text : constants) out.string(text);
+    out.pod<uint64_t>(vars.size());
+    for (auto &var : vars) {
+        out.string(var.name);
+        out.pod<uint64_t>(var.slot);
+    }
+    out.pod<uint64_t>(functionRefs.size());
+    for (auto &ref : functionRefs) {
+        out.string(ref.name);
+        out.pod(static_cast<uint8_t>(ref.builtin));
+        out.pod(ref.pattern);
+        out.pod<uint8_t>(ref.folded);
+    }
+    out.pod<uint64_t>(errors.size());
+    for (auto &message : errors) out.string(message);
+    out.pod<uint64_t>(predicates.size());
+    for (auto &pred : predicates) {
+        out.pod(pred.function);
+        out.pod<uint64_t>(pred.args.size());
+        for (auto &arg : pred.args) {
+            out.pod(static_cast<uint8_t>(arg.kind));
+            out.pod(arg.index);
+        }
+    }
+    out.pod<uint64_t>(compares.size());
+    for (auto &ref : compares) {
+        out.pod(static_cast<uint8_t>(ref.op));
+        out.pod<uint64_t>(ref.count);
+        for (const SreCompareRef::Arg *arg = args(ref), *end = arg + ref.count; arg != end; ++arg) {
+            out.pod(arg->var);
+            out.pod(arg->memo);
+            out.pod(arg->constant);
+            out.pod(static_cast<uint8_t>(arg->type));
+            out.pod(static_cast<uint8_t>(arg->numeric));
+            out.pod(arg->i);
+            out.pod(arg->d);
+        }
+    }
+}
+
+void SreSymbols::load(SreBinaryReader &in) {
+    *this = SreSymbols();
+    for (size_t n = in.count(), i = 0; i < n; ++i) {
+        constants.push_back(in.string());
+        constantIndex_.emplace(std::hash<std::string_view>()(constants.back()), static_cast<uint32_t>(i));
+    }
+    for (size_t n = in.count(), i = 0; i < n; ++i) {
+        std::string name = in.string();
+        size_t slot = static_cast<size_t>(in.pod<uint64_t>());
+        varIndex_[name] = static_cast<uint32_t>(i);
+        vars.push_back({ name, slot });
+    }
+    for (size_t n = in.count(), i = 0; i < n; ++i) {
+        SreFunctionRef ref;
+        ref.name = in.string();
+        uint8_t builtin = in.pod<uint8_t>();
+        if (builtin > static_cast<uint8_t>(SreBuiltin::IContainsAny)) SreBinaryReader::fail();
+        ref.builtin = static_cast<SreBuiltin>(builtin);
+        ref.pattern = in.pod<uint32_t>();
+        if (ref.pattern != SreFunctionRef::npos) SreBinaryReader::check(ref.pattern, constants.size());
+        ref.folded = in.pod<uint8_t>() != 0;
+        if (ref.folded && ref.builtin != SreBuiltin::IContains && ref.builtin != SreBuiltin::IContainsAny) {
+            SreBinaryReader::fail();
+        }
+        functionRefs.push_back(ref);
+    }
+    functions.assign(functionRefs.size(), nullptr);
+    for (size_t n = in.count(), i = 0; i < n; ++i) {
+        errors.push_back(in.string());
+    }
+    for (size_t n = in.count(), i = 0; i < n; ++i) {
+        SrePredicate pred;
+        pred.function = in.pod<uint32_t>();
+        SreBinaryReader::check(pred.function, functions.size());
+        for (size_t argc = in.count(), a = 0; a < argc; ++a) {
+            SrePredicate::Arg arg;
+            uint8_t kind = in.pod<uint8_t>();
+            arg.index = in.pod<uint32_t>();
+            switch (kind) {
+                case SrePredicate::Arg::Const: SreBinaryReader::check(arg.index, constants.size()); break;
+                case SrePredicate::Arg::Var:   SreBinaryReader::check(arg.index, vars.size()); break;
+                case SrePredicate::Arg::Fail:  SreBinaryReader::check(arg.index, errors.size()); break;
+                default: SreBinaryReader::fail();
+            }
+            arg.kind = static_cast<SrePredicate::Arg::Kind>(kind);
+            pred.args.push_back(arg);
+        }
+        predicateIndex_[predicateKey(pred)] = static_cast<uint32_t>(i);
+        predicates.push_back(std::move(pred));
+    }
+    for (size_t n = in.count(), i = 0; i < n; ++i) {
+        SreCompareRef ref;
+        uint8_t op = in.pod<uint8_t>();
+        if (op > SreCompareNode::In) SreBinaryReader::fail();
+        ref.op = static_cast<SreCompareNode::Operator>(op);
+        size_t argc = in.count();
+        if (ref.op == SreCompareNode::In ? argc < 2 : argc != 2) SreBinaryReader::fail();
+        ref.first = sreCheckIndex(compareArgs.size());
+        ref.count = sreCheckIndex(argc);
+        for (size_t a = 0; a < argc; ++a) {
+            SreCompareRef::Arg arg;
+            arg.var = in.pod<uint32_t>();
+            arg.memo = in.pod<uint32_t>();
+            arg.constant = in.pod<uint32_t>();
+            uint8_t type = in.pod<uint8_t>();
+            uint8_t numeric = in.pod<uint8_t>();
+            arg.i = in.pod<int64_t>();
+            arg.d = in.pod<double>();
+            if (type > SreScalar::Bool || numeric > SreScalar::NotNumber) SreBinaryReader::fail();
+            arg.type = static_cast<SreScalar::Type>(type);
+            arg.numeric = static_cast<SreScalar::Numeric>(numeric);
+            if (arg.var != SreCompareRef::Arg::npos) {
+                SreBinaryReader::check(arg.var, vars.size());
+            } else {
+                SreBinaryReader::check(arg.constant, constants.size());
+            }
+            compareArgs.push_back(arg);
+        }
+        sreCheckIndex(compareArgs.size());
+        compares.push_back(ref);
+        indexCompare(static_cast<uint32_t>(i));
+    }
+}
+
+// =============================
+// 降级：语法树 -> 字节码
+// 布尔上下文的节点结果放在累加器中，字符串上下文的节点结果压入值栈
+// =============================
+size_t SreProgramBuilder::lowerRule(const SreASTNode &root) {
+    size_t start = code_.size();
+    depth_ = 0;
+    emitBool(root);
+    emit(SreOpCode::Return);
+    return start;
+}
+
+void SreProgramBuilder::emitBool(const SreASTNode &node) {
+    switch (node.kind()) {
+        case SreNodeKind::Logical: {
+            const SreLogicalNode &logical = static_cast<const SreLogicalNode &>(node);
+            const SreNodeList &operands = logical.operands();
+            if (logical.op() == SreLogicalNode::Not) {
+                emitBool(*operands[0]);
+                emit(SreOpCode::Not);
+                return;
+            }
+            // 某一项已经决定结果时跳到末尾，累加器保留该项的值
+            SreOpCode jumpOp = logical.op() == SreLogicalNode::And ? SreOpCode::JumpIfFalse : SreOpCode::JumpIfTrue;
+            std::vector<size_t> jumps;
+            for (size_t i = 0; i + 1 < operands.size(); ++i) {
+                emitBool(*operands[i]);
+                jumps.push_back(emit(jumpOp));
+                setSite(jumps.back(), sreProfileSite(operands[i]));
+            }
+            emitBool(*operands[operands.size() - 1]);
+            uint32_t end = sreCheckIndex(code_.size());
+            for (size_t jump : jumps) {
+                code_[jump].operand = end;
+            }
+            return;
+        }
+        case SreNodeKind::Value:
+            emitValue(node);
+            emit(SreOpCode::Truthy);
+            --depth_;
+            return;
+        case SreNodeKind::Function: {
+            const SreFunctionNode &func = static_cast<const SreFunctionNode &>(node);
+            if (sharePredicates_) {
+                emitPredicate(func);
+            } else {
+                emitCall(func);
+            }
+            return;
+        }
+        case SreNodeKind::Compare:
+            emit(SreOpCode::Compare, symbols_.compare(static_cast<const SreCompareNode &>(node)));
+            return;
+    }
+}
+
+void SreProgramBuilder::emitValue(const SreASTNode &node) {
+    if (node.kind() != SreNodeKind::Value) {
+        // 与 SreASTNode::evalString 一致：执行到这里才报错，短路跳过时不报错
+        // 仍按压入一个值计算栈深度，保持后续 Call 的出栈数一致
+        emit(SreOpCode::Fail, symbols_.error("Not a string expression node"));
+    } else {
+        const SreValueNode &value = static_cast<const SreValueNode &>(node);
+        if (value.isVariable()) {
+            emit(SreOpCode::PushVar, symbols_.var(value.name(), value.slot()));
+        } else {
+            emit(SreOpCode::PushConst, symbols_.constant(value.value()));
+        }
+    }
+    maxStack_ = std::max(maxStack_, ++depth_);
+}
+
+void SreProgramBuilder::emitCall(const SreFunctionNode &func) {
+    if (func.args().size() > UINT16_MAX) {
+        throw std::runtime_error("Too many arguments for function: " + std::string(func.name()));
+    }
+    for (auto &arg : func.args()) {
+        emitValue(*arg);
+    }
+    setSite(emit(SreOpCode::Call, symbols_.function(func), static_cast<uint16_t>(func.args().size())), func.profileSite());
+    depth_ -= func.args().size();
+}
+
+void SreProgramBuilder::emitPredicate(const SreFunctionNode &func) {
+    SrePredicate pred;
+    pred.function = symbols_.function(func);
+    for (auto &arg : func.args()) {
+        SrePredicate::Arg ref;
+        if (arg->kind() != SreNodeKind::Value) {
+            ref.kind = SrePredicate::Arg::Fail;
+            ref.index = symbols_.error("Not a string expression node");
+        } else {
+            const SreValueNode &value = static_cast<const SreValueNode &>(*arg);
+            if (value.isVariable()) {
+                ref.kind = SrePredicate::Arg::Var;
+                ref.index = symbols_.var(value.name(), value.slot());
+            } else {
+                ref.kind = SrePredicate::Arg::Const;
+                ref.index = symbols_.constant(value.value());
+            }
+        }
+        pred.args.push_back(ref);
+    }
+    setSite(emit(SreOpCode::Predicate, symbols_.predicate(pred)), func.profileSite());
+}
+
+size_t SreProgramBuilder::emit(SreOpCode op, size_t operand, uint16_t argc) {
+    sreCheckIndex(code_.size());
+    SreInstr instr = { op, 0, argc, static_cast<uint32_t>(operand) };
+    code_.push_back(instr);
+    return code_.size() - 1;
+}
+
+void SreProgramBuilder::setSite(size_t pc, uint32_t site) {
+    if (site == SreProfiler::npos) return;
+    if (symbols_.sites.size() <= pc) symbols_.sites.resize(pc + 1, SreProfiler::npos);
+    symbols_.sites[pc] = site;
+}
+
+std::shared_ptr<const SreProgram> SreProgram::lower(const SreASTNode &root) {
+    std::shared_ptr<SreProgram> program = std::make_shared<SreProgram>();
+    SreProgramBuilder builder(program->symbols_, program->code_, false);
+    builder.lowerRule(root);
+    program->maxStack_ = builder.maxStack();
+    program->code_.shrink_to_fit();
+    return program;
+}
+
+// =============================
+// 重定位：规则集压缩
+// =============================
+size_t SreRelocator::copyRule(const std::vector<SreInstr> &source, size_t start) {
+    size_t target = code_.size();
+    for (size_t pc = start;; ++pc) {
+        SreInstr instr = source[pc];
+        switch (instr.op) {
+            case SreOpCode::PushConst:
+                instr.operand = map(constants_, instr.operand, &SreRelocator::copyConstant);
+                break;
+            case SreOpCode::PushVar:
+                instr.operand = map(vars_, instr.operand, &SreRelocator::copyVar);
+                break;
+            case SreOpCode::Call:
+                instr.operand = map(functions_, instr.operand, &SreRelocator::copyFunction);
+                break;
+            case SreOpCode::Predicate:
+                instr.operand = map(predicates_, instr.operand, &SreRelocator::copyPredicate);
+                break;
+            case SreOpCode::Compare:
+                instr.operand = map(compares_, instr.operand, &SreRelocator::copyCompare);
+                break;
+            case SreOpCode::Fail:
+                instr.operand = map(errors_, instr.operand, &SreRelocator::copyError);
+                break;
+            case SreOpCode::JumpIfFalse:
+            case SreOpCode::JumpIfTrue:
+                instr.operand = sreCheckIndex(instr.operand - start + target);
+                break;
+            case SreOpCode::Truthy:
+            case SreOpCode::Not:
+            case SreOpCode::Return:
+                break;
+        }
+        sreCheckIndex(code_.size());
+        uint32_t site = from_.site(pc);
+        if (site != SreProfiler::npos) {
+            to_.sites.resize(code_.size() + 1, SreProfiler::npos);
+            to_.sites[code_.size()] = site;
+        }
+        code_.push_back(instr);
+        if (instr.op == SreOpCode::Return) return target;
+    }
+}
+
+uint32_t SreRelocator::map(std::vector<uint32_t> &cache, uint32_t index, uint32_t (SreRelocator::*copy)(uint32_t)) {
+    if (cache[index] == npos) cache[index] = (this->*copy)(index);
+    return cache[index];
+}
+
+uint32_t SreRelocator::copyConstant(uint32_t index) {
+    return to_.constant(from_.constants[index]);
+}
+
+uint32_t SreRelocator::copyVar(uint32_t index) {
+    return to_.var(from_.vars[index].name, from_.vars[index].slot);
+}
+
+uint32_t SreRelocator::copyFunction(uint32_t index) {
+    SreFunctionRef ref = from_.functionRefs[index];
+    if (ref.pattern != SreFunctionRef::npos) ref.pattern = map(constants_, ref.pattern, &SreRelocator::copyConstant);
+    return to_.function(from_.functions[index], ref);
+}
+
+uint32_t SreRelocator::copyError(uint32_t index) {
+    return to_.error(from_.errors[index]);
+}
+
+uint32_t SreRelocator::copyPredicate(uint32_t index) {
+    SrePredicate pred = from_.predicates[index];
+    pred.function = map(functions_, pred.function, &SreRelocator::copyFunction);
+    for (auto &arg : pred.args) {
+        switch (arg.kind) {
+            case SrePredicate::Arg::Const: arg.index = map(constants_, arg.index, &SreRelocator::copyConstant); break;
+            case SrePredicate::Arg::Var:   arg.index = map(vars_, arg.index, &SreRelocator::copyVar); break;
+            case SrePredicate::Arg::Fail:  arg.index = map(errors_, arg.index, &SreRelocator::copyError); break;
+        }
+    }
+    return to_.predicate(pred);
+}
+
+uint32_t SreRelocator::copyCompare(uint32_t index) {
+    const SreCompareRef &ref = from_.compares[index];
+    std::vector<SreCompareRef::Arg> args(from_.args(ref), from_.args(ref) + ref.count);
+    for (auto &arg : args) {
+        if (arg.var != SreCompareRef::Arg::npos) {
+            arg.var = map(vars_, arg.var, &SreRelocator::copyVar);
+        } else {
+            arg.constant = map(constants_, arg.constant, &SreRelocator::copyConstant);
+        }
+    }
+    return to_.compare(ref.op, args.data(), args.size());
+}
+
+// =============================
+// 解释执行
+// =============================
+// 不经过事件缓存取变量的值
+static std::string_view sreFetch(uint32_t index, const SreSymbols &symbols, const SreEvalContext &ctx) {
+    const SreVarRef &var = symbols.vars[index];
+    return ctx.fields ? ctx.field(index, var.name) : ctx.lookup(var.name, var.slot);
+}
+
+std::string_view SreInterpreter::loadVar(uint32_t index, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState *state) {
+    if (!state) {
+        return sreFetch(index, symbols, ctx);
+    }
+    if (!state->varLoaded[index]) {
+        state->vars[index] = sreFetch(index, symbols, ctx);
+        state->varLoaded[index] = 1;
+    }
+    return state->vars[index];
+}
+
+// 单条规则一次求值内的变量缓存：前 kCached 个变量第一次读到时查找，之后直接使用，其余变量每次都查找
+// 规则集的求值由 SreEvalState 缓存
+struct SreVarCache {
+    static const uint32_t kCached = 64;
+
+    std::string_view load(uint32_t index, const SreSymbols &symbols, const SreEvalContext &ctx) {
+        if (index >= kCached) return sreFetch(index, symbols, ctx);
+        std::string_view *values = reinterpret_cast<std::string_view *>(storage);
+        if (!(loaded >> index & 1)) {
+            new (values + index) std::string_view(sreFetch(index, symbols, ctx));
+            loaded |= uint64_t(1) << index;
+        }
+        return values[index];
+    }
+
+    uint64_t loaded = 0;
+    // 不做初始化，只有 loaded 中的位对应的元素有效
+    alignas(std::string_view) unsigned char storage[kCached * sizeof(std::string_view)];
+};
+
+// 调用函数：内置的 contains/containsAny 和字面量已折叠的 icontains/icontainsAny 直接调用查找算法，
+// 不经过 std::function；参数个数不对时仍调用函数本身，由它报错。按函数项本身判断，读取文件后绑定的
+// 同名自定义函数照常调用
+static bool sreCall(const SreFunctionEntry &func, const std::string_view *args, size_t argc) {
+    switch (func.builtin) {
+        case SreBuiltin::Contains:
+            if (argc == 2) return SreStringSearch::contains(args[0], args[1]);
+            break;
+        case SreBuiltin::ContainsAny:
+            if (argc < 2) break;
+            for (size_t i = 1; i < argc; ++i) {
+                if (SreStringSearch::contains(args[0], args[i])) return true;
+            }
+            return false;
+        case SreBuiltin::IContains:
+            if (func.folded && argc == 2) return SreCaseFold::contains(args[0], args[1]);
+            break;
+        case SreBuiltin::IContainsAny:
+            if (func.folded && argc >= 2) return SreCaseFold::containsAny(args[0], args + 1, argc - 1);
+            break;
+        default:
+            break;
+    }
+    return func.call(SreArgs(args, argc));
+}
+
+template<bool Checked>
+bool SreInterpreter::evalPredicate(uint32_t index, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState *state) {
+    if (state && state->predicates[index] != SreEvalState::Unknown) {
+        return state->predicates[index] == SreEvalState::True;
+    }
+    // 不抛异常的求值中出错之后不再缓存：Error 语义下读到缺失变量的谓词要在每条规则中各自报错
+    if (state && state->patterns && state->patterns->covers(index)) {
+        bool result = state->patterns->eval(index, symbols, ctx, *state);
+        if (!Checked || ctx.status->error == SreError::None) {
+            state->predicates[index] = result ? SreEvalState::True : SreEvalState::False;
+        }
+        return result;
+    }
+    const SrePredicate &pred = symbols.predicates[index];
+    const size_t kInlineArgs = 8;
+    std::string_view inlineArgs[kInlineArgs];
+    std::vector<std::string_view> heapArgs;
+    std::string_view *args = inlineArgs;
+    if (pred.args.size() > kInlineArgs) {
+        heapArgs.resize(pred.args.size());
+        args = heapArgs.data();
+    }
+    // 按参数顺序取值，与语法树遍历的报错顺序一致
+    for (size_t i = 0; i < pred.args.size(); ++i) {
+        const SrePredicate::Arg &arg = pred.args[i];
+        switch (arg.kind) {
+            case SrePredicate::Arg::Const:
+                args[i] = symbols.constants[arg.index];
+                break;
+            case SrePredicate::Arg::Var:
+                args[i] = loadVar(arg.index, symbols, ctx, state);
+                break;
+            case SrePredicate::Arg::Fail:
+                if (!Checked) throw std::runtime_error(symbols.errors[arg.index]);
+                args[i] = ctx.status->invalid();
+                break;
+        }
+    }
+    bool result;
+    if (Checked && std::any_of(args, args + pred.args.size(), SreEvalStatus::isMissing)) {
+        result = ctx.status->consume();
+    } else {
+        result = sreCall(*symbols.functions[pred.function], args, pred.args.size());
+    }
+    if (state && (!Checked || ctx.status->error == SreError::None)) {
+        state->predicates[index] = result ? SreEvalState::True : SreEvalState::False;
+    }
+    return result;
+}
+
+template<bool Checked>
+bool SreInterpreter::evalCompare(uint32_t index, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState *state) {
+    const SreCompareRef &ref = symbols.compares[index];
+    const SreCompareRef::Arg *args = symbols.args(ref);
+    bool missing = false;
+    bool result = SreCompareNode::evaluate(ref.op, ref.count, [&](size_t i, SreScalar &local) -> SreScalar & {
+        const SreCompareRef::Arg &arg = args[i];
+        if (arg.var == SreCompareRef::Arg::npos) {
+            local.type = arg.type;
+            local.numeric = arg.numeric;
+            local.i = arg.i;
+            local.d = arg.d;
+            local.text = symbols.constants[arg.constant];
+            return local;
+        }
+        // 规则集按符号表的变量下标缓存，单条规则使用求值上下文中的缓存
+        SreScalar *cached = state ? &state->scalars[arg.var] : ctx.memoSlot(arg.memo);
+        SreScalar &target = cached ? *cached : local;
+        if (target.type == SreScalar::Unset) {
+            const SreVarRef &var = symbols.vars[arg.var];
+            target = ctx.typed ? ctx.scalar(var.name, var.slot)
+                               : SreScalar::ofText(loadVar(arg.var, symbols, ctx, state));
+        }
+        missing = missing || (Checked && SreEvalStatus::isMissing(target.text));
+        return target;
+    });
+    return Checked && missing ? ctx.status->consume() : result;
+}
+
+template<bool Checked>
+bool SreInterpreter::execute(const SreInstr *code, size_t start, size_t maxStack, const SreSymbols &symbols,
+                             const SreEvalContext &ctx, SreEvalState *state) {
+    // 值栈只用于存放函数参数，深度在编译期已知
+    // 栈上缓冲区不做初始化，每个槽位都是先写后读
+    const size_t kInlineStack = 16;
+    alignas(std::string_view) unsigned char inlineStack[kInlineStack * sizeof(std::string_view)];
+    std::vector<std::string_view> heapStack;
+    std::string_view *stack = reinterpret_cast<std::string_view *>(inlineStack);
+    if (maxStack > kInlineStack) {
+        heapStack.resize(maxStack);
+        stack = heapStack.data();
+    }
+
+    SreVarCache cache;
+
+    size_t pc = start;
+    size_t sp = 0;
+    bool acc = false;
+    for (;;) {
+        const SreInstr &instr = code[pc++];
+        switch (instr.op) {
+            case SreOpCode::PushConst:
+                stack[sp++] = symbols.constants[instr.operand];
+                break;
+            case SreOpCode::PushVar:
+                stack[sp++] = state ? loadVar(instr.operand, symbols, ctx, state) : cache.load(instr.operand, symbols, ctx);
+                break;
+            case SreOpCode::Call: {
+                sp -= instr.argc;
+#if SRE_PROFILING
+                SreProfileScope scope(symbols.site(pc - 1));
+#endif
+                if (Checked && std::any_of(stack + sp, stack + sp + instr.argc, SreEvalStatus::isMissing)) {
+                    acc = ctx.status->consume();
+                } else {
+                    acc = sreCall(*symbols.functions[instr.operand], stack + sp, instr.argc);
+                }
+#if SRE_PROFILING
+                scope.finish(acc);
+#endif
+                break;
+            }
+            case SreOpCode::Predicate:
+#if SRE_PROFILING
+                // 只统计实际计算，同一事件内复用的结果不计
+                if (!state || state->predicates[instr.operand] == SreEvalState::Unknown) {
+                    SreProfileScope scope(symbols.site(pc - 1));
+                    acc = scope.finish(evalPredicate<Checked>(instr.operand, symbols, ctx, state));
+                    break;
+                }
+#endif
+                acc = evalPredicate<Checked>(instr.operand, symbols, ctx, state);
+                break;
+            case SreOpCode::Compare:
+                acc = evalCompare<Checked>(instr.operand, symbols, ctx, state);
+                break;
+            case SreOpCode::Truthy:
+                --sp;
+                acc = Checked && SreEvalStatus::isMissing(stack[sp]) ? ctx.status->consume() : !stack[sp].empty();
+                break;
+            case SreOpCode::Not:
+                acc = !acc;
+                break;
+            case SreOpCode::JumpIfFalse:
+                if (!acc) {
+#if SRE_PROFILING
+                    SreProfileThread::current().shortCircuit(symbols.site(pc - 1));
+#endif
+                    pc = instr.operand;
+                }
+                break;
+            case SreOpCode::JumpIfTrue:
+                if (acc) {
+#if SRE_PROFILING
+                    SreProfileThread::current().shortCircuit(symbols.site(pc - 1));
+#endif
+                    pc = instr.operand;
+                }
+                break;
+            case SreOpCode::Fail:
+                if (!Checked) throw std::runtime_error(symbols.errors[instr.operand]);
+                // 与抛异常时一样按压入一个值计算，后续的 Call 照常出栈
+                stack[sp++] = ctx.status->invalid();
+                break;
+            case SreOpCode::Return:
+                return acc;
+        }
+    }
+}
+
+template bool SreInterpreter::execute<false>(const SreInstr *, size_t, size_t, const SreSymbols &,
+                                            const SreEvalContext &, SreEvalState *);
+template bool SreInterpreter::execute<true>(const SreInstr *, size_t, size_t, const SreSymbols &,
+                                           const SreEvalContext &, SreEvalState *);
+
+size_t SreInterpreter::verify(const std::vector<SreInstr> &code, const SreSymbols &symbols) {
+    // 降级时跳转只出现在值栈为空的位置，且都是向前跳转，因此按顺序模拟一遍栈深度即可
+    std::vector<uint8_t> atEmpty(code.size(), 0);
+    size_t depth = 0;
+    size_t maxStack = 0;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        const SreInstr &instr = code[pc];
+        atEmpty[pc] = depth == 0;
+        switch (instr.op) {
+            case SreOpCode::PushConst:
+                SreBinaryReader::check(instr.operand, symbols.constants.size());
+                depth++;
+                break;
+            case SreOpCode::PushVar:
+                SreBinaryReader::check(instr.operand, symbols.vars.size());
+                depth++;
+                break;
+            case SreOpCode::Fail:
+                SreBinaryReader::check(instr.operand, symbols.errors.size());
+                depth++;
+                break;
+            case SreOpCode::Call:
+                SreBinaryReader::check(instr.operand, symbols.functions.size());
+                if (instr.argc > depth) SreBinaryReader::fail();
+                depth -= instr.argc;
+                break;
+            case SreOpCode::Truthy:
+                if (depth == 0) SreBinaryReader::fail();
+                depth--;
+                break;
+            case SreOpCode::Predicate:
+                SreBinaryReader::check(instr.operand, symbols.predicates.size());
+                break;
+            case SreOpCode::Compare:
+                SreBinaryReader::check(instr.operand, symbols.compares.size());
+                break;
+            case SreOpCode::Not:
+                break;
+            case SreOpCode::JumpIfFalse:
+            case SreOpCode::JumpIfTrue:
+                if (depth != 0 || instr.operand <= pc || instr.operand >= code.size()) SreBinaryReader::fail();
+                break;
+            case SreOpCode::Return:
+                if (depth != 0) SreBinaryReader::fail();
+                break;
+            default:
+                SreBinaryReader::fail();
+        }
+        maxStack = std::max(maxStack, depth);
+    }
+    if (!code.empty() && code.back().op != SreOpCode::Return) SreBinaryReader::fail();
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        const SreInstr &instr = code[pc];
+        if ((instr.op == SreOpCode::JumpIfFalse || instr.op == SreOpCode::JumpIfTrue) && !atEmpty[instr.operand]) {
+            SreBinaryReader::fail();
+        }
+    }
+    return maxStack;
+}
+
+// =============================
+// 多模式索引
+// =============================
+bool SrePatternIndex::indexable(const SrePredicate &pred, const SreSymbols &symbols) {
+    SreBuiltin builtin = symbols.functionRefs[pred.function].builtin;
+    bool arity = (builtin == SreBuiltin::Contains && pred.args.size() == 2) ||
+                 (builtin == SreBuiltin::ContainsAny && pred.args.size() >= 2);
+    if (!arity || pred.args[0].kind != SrePredicate::Arg::Var) return false;
+    for (size_t i = 1; i < pred.args.size(); ++i) {
+        if (pred.args[i].kind != SrePredicate::Arg::Const) return false;
+    }
+    return true;
+}
+
+void SrePatternIndex::bind(uint32_t predicate, uint32_t group, SreAhoCorasick &automaton, const SreSymbols &symbols) {
+    const SrePredicate &pred = symbols.predicates[predicate];
+    Binding &binding = bindings_[predicate];
+    binding.group = group;
+    binding.first = static_cast<uint32_t>(patternList_.size());
+    binding.count = static_cast<uint32_t>(pred.args.size() - 1);
+    // 已有的模式下标不变，旧绑定继续有效
+    for (size_t i = 1; i < pred.args.size(); ++i) {
+        patternList_.push_back(automaton.add(symbols.constants[pred.args[i].index]));
+    }
+}
+
+void SrePatternIndex::layout() {
+    foundBase_.clear();
+    foundSize_ = 0;
+    for (auto &group : groups_) {
+        foundBase_.push_back(static_cast<uint32_t>(foundSize_));
+        foundSize_ += group->automaton.patternCount();
+    }
+}
+
+void SrePatternIndex::extend(const SrePatternIndex &previous, const SreSymbols &symbols) {
+    if (this != &previous) *this = previous;
+    uint32_t first = static_cast<uint32_t>(bindings_.size());
+    bindings_.resize(symbols.predicates.size(), Binding{ npos, 0, 0 });
+
+    std::unordered_map<uint32_t, uint32_t> groupOfVar;
+    for (uint32_t g = 0; g < groups_.size(); ++g) {
+        groupOfVar[groups_[g]->var] = g;
+    }
+    // 本次新增了模式的组：先复制一份再修改，其余组与 previous 共用
+    std::unordered_map<uint32_t, std::shared_ptr<Group>> changed;
+    auto edit = [&](uint32_t g) -> SreAhoCorasick & {
+        std::shared_ptr<Group> &copy = changed[g];
+        if (!copy) copy = std::make_shared<Group>(*groups_[g]);
+        return copy->automaton;
+    };
+
+    for (uint32_t p = first; p < symbols.predicates.size(); ++p) {
+        const SrePredicate &pred = symbols.predicates[p];
+        if (!indexable(pred, symbols)) continue;
+        uint32_t var = pred.args[0].index;
+        auto it = groupOfVar.find(var);
+        if (it != groupOfVar.end()) {
+            bind(p, it->second, edit(it->second), symbols);
+            continue;
+        }
+        // 字面量太少时先记下，之后凑够了再把这些谓词一起加入新组
+        std::vector<uint32_t> &waiting = pending_[var];
+        waiting.push_back(p);
+        std::unordered_set<uint32_t> needles;
+        for (uint32_t q : waiting) {
+            for (size_t i = 1; i < symbols.predicates[q].args.size(); ++i) {
+                needles.insert(symbols.predicates[q].args[i].index);
+            }
+        }
+        if (needles.size() < kMinPatterns) continue;
+        uint32_t g = static_cast<uint32_t>(groups_.size());
+        std::shared_ptr<Group> group = std::make_shared<Group>();
+        group->var = var;
+        groups_.push_back(group);
+        changed[g] = group;
+        groupOfVar[var] = g;
+        for (uint32_t q : waiting) {
+            bind(q, g, group->automaton, symbols);
+        }
+        pending_.erase(var);
+    }
+
+    for (auto &item : changed) {
+        item.second->automaton.build();
+        groups_[item.first] = item.second;
+    }
+    layout();
+}
+
+bool SrePatternIndex::eval(uint32_t predicate, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState &state) const {
+    const Binding &binding = bindings_[predicate];
+    const Group &group = *groups_[binding.group];
+    uint8_t *found = state.found.data() + foundBase_[binding.group];
+    if (!state.scanned[binding.group]) {
+        std::string_view text = SreInterpreter::loadVar(group.var, symbols, ctx, &state);
+        // 变量缺失时不标记为已扫描，同组的其它谓词同样按缺失处理
+        if (ctx.missing(text)) return ctx.status->consume();
+        group.automaton.scan(text, found);
+        state.scanned[binding.group] = 1;
+    }
+    for (uint32_t i = 0; i < binding.count; ++i) {
+        if (found[patternList_[binding.first + i]]) return true;
+    }
+    return false;
+}
+
+void SrePatternIndex::foundSlots(uint32_t predicate, std::vector<uint32_t> &out) const {
+    const Binding &binding = bindings_[predicate];
+    for (uint32_t i = 0; i < binding.count; ++i) {
+        out.push_back(foundBase_[binding.group] + patternList_[binding.first + i]);
+    }
+}
+
+bool SrePatternIndex::scan(uint32_t group, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState &state,
+                           std::vector<uint32_t> &newly) const {
+    if (state.scanned[group]) return true;
+    std::string_view text = SreInterpreter::loadVar(groups_[group]->var, symbols, ctx, &state);
+    if (ctx.missing(text)) return false;
+    size_t first = newly.size();
+    uint32_t base = foundBase_[group];
+    groups_[group]->automaton.scan(text, state.found.data() + base, newly);
+    for (size_t i = first; i < newly.size(); ++i) {
+        newly[i] += base;
+    }
+    state.scanned[group] = 1;
+    return true;
+}
+
+size_t SrePatternIndex::memoryUsage() const {
+    size_t bytes = sreHeapBytes(groups_) + sreHeapBytes(foundBase_) + sreHeapBytes(bindings_) + sreHeapBytes(patternList_) +
+                   sreHeapBytes(pending_);
+    for (auto &group : groups_) bytes += sizeof(Group) + group->automaton.memoryUsage();
+    for (auto &entry : pending_) bytes += sreHeapBytes(entry.second);
+    return bytes;
+}
+
+void SrePatternIndex::save(SreBinaryWriter &out) const {
+    out.pod<uint64_t>(groups_.size());
+    for (auto &group : groups_) {
+        out.pod(group->var);
+        group->automaton.save(out);
+    }
+    out.array(bindings_);
+    out.array(patternList_);
+}
+
+void SrePatternIndex::load(SreBinaryReader &in, const SreSymbols &symbols) {
+    *this = SrePatternIndex();
+    for (size_t n = in.count(), i = 0; i < n; ++i) {
+        std::shared_ptr<Group> group = std::make_shared<Group>();
+        group->var = in.pod<uint32_t>();
+        group->automaton.load(in);
+        SreBinaryReader::check(group->var, symbols.vars.size());
+        groups_.push_back(group);
+    }
+    in.array(bindings_);
+    in.array(patternList_);
+    layout();
+
+    if (bindings_.size() != symbols.predicates.size()) SreBinaryReader::fail();
+    for (uint32_t p = 0; p < bindings_.size(); ++p) {
+        const Binding &binding = bindings_[p];
+        if (binding.group == npos) {
+            // 没有建组的谓词重新登记，之后追加规则时照常建组
+            const SrePredicate &pred = symbols.predicates[p];
+            if (indexable(pred, symbols)) pending_[pred.args[0].index].push_back(p);
+            continue;
+        }
+        SreBinaryReader::check(binding.group, groups_.size());
+        if (binding.first > patternList_.size() || binding.count > patternList_.size() - binding.first) SreBinaryReader::fail();
+        for (uint32_t i = 0; i < binding.count; ++i) {
+            SreBinaryReader::check(patternList_[binding.first + i], groups_[binding.group]->automaton.patternCount());
+        }
+    }
+}
+
+// =============================
+// 预过滤
+// =============================
+// 可以作为必要谓词：可索引的 contains/containsAny，字面量都不为空（空串总是出现）
+static bool sreRequirable(const SreSymbols &symbols, uint32_t predicate) {
+    const SrePredicate &pred = symbols.predicates[predicate];
+    if (!SrePatternIndex::indexable(pred, symbols)) return false;
+    for (size_t i = 1; i < pred.args.size(); ++i) {
+        if (symbols.constants[pred.args[i].index].empty()) return false;
+    }
+    return true;
+}
+
+// 被跳过的规则不会执行，路径上只允许不会抛异常、没有副作用的内置函数；自定义函数一律不行
+static bool sreSafeCall(const SreSymbols &symbols, uint32_t function, size_t argc) {
+    const SreFunctionRef &ref = symbols.functionRefs[function];
+    switch (ref.builtin) {
+        case SreBuiltin::Contains:
+        case SreBuiltin::IContains: return argc == 2;
+        case SreBuiltin::ContainsAny:
+        case SreBuiltin::IContainsAny: return argc >= 2;
+        case SreBuiltin::Matches:
+        case SreBuiltin::Like: return ref.pattern != SreFunctionRef::npos;  // 常量模式在编译期已经校验
+        default: return false;
+    }
+}
+
+static void sreAddVar(std::vector<uint32_t> *vars, uint32_t var) {
+    if (vars && std::find(vars->begin(), vars->end(), var) == vars->end()) vars->push_back(var);
+}
+
+// 假设 required 中的谓词都为 false，沿所有可能的路径执行 code[start, end]，累加器取 false/true/未知三种值：
+// 每条路径都返回 false、且只调用安全的函数时返回 true；vars 不为空时写入这些路径上读取的变量
+// 跳转只会向前，按下标顺序处理一遍即可
+static bool srePrunes(const std::vector<SreInstr> &code, size_t start, size_t end, const SreSymbols &symbols,
+                      const std::vector<uint32_t> &required, std::vector<uint32_t> *vars) {
+    enum : uint8_t { False = 1, True = 2, Unknown = 4 };
+    std::vector<uint8_t> reach(end - start + 1, 0);
+    reach[0] = Unknown;
+    for (size_t pc = start; pc <= end; ++pc) {
+        uint8_t in = reach[pc - start];
+        if (!in) continue;
+        const SreInstr &instr = code[pc];
+        uint8_t out = in;
+        switch (instr.op) {
+            case SreOpCode::PushConst:
+                break;
+            case SreOpCode::PushVar:
+                sreAddVar(vars, instr.operand);
+                break;
+            case SreOpCode::Fail:
+                return false;
+            case SreOpCode::Call:
+                if (!sreSafeCall(symbols, instr.operand, instr.argc)) return false;
+                out = Unknown;
+                break;
+            case SreOpCode::Predicate: {
+                const SrePredicate &pred = symbols.predicates[instr.operand];
+                if (!sreSafeCall(symbols, pred.function, pred.args.size())) return false;
+                for (auto &arg : pred.args) {
+                    if (arg.kind == SrePredicate::Arg::Fail) return false;
+                    if (arg.kind == SrePredicate::Arg::Var) sreAddVar(vars, arg.index);
+                }
+                bool isRequired = std::find(required.begin(), required.end(), instr.operand) != required.end();
+                out = isRequired ? False : Unknown;
+                break;
+            }
+            case SreOpCode::Compare:
+            {
+                const SreCompareRef &ref = symbols.compares[instr.operand];
+                for (const SreCompareRef::Arg *arg = symbols.args(ref), *end = arg + ref.count; arg != end; ++arg) {
+                    if (arg->var != SreCompareRef::Arg::npos) sreAddVar(vars, arg->var);
+                }
+            }
+                out = Unknown;
+                break;
+            case SreOpCode::Truthy:
+                out = Unknown;
+                break;
+            case SreOpCode::Not:
+                out = static_cast<uint8_t>(((in & False) ? True : 0) | ((in & True) ? False : 0) | (in & Unknown));
+                break;
+            case SreOpCode::JumpIfFalse:
+            case SreOpCode::JumpIfTrue: {
+                // 跳转时累加器的值已知，没有跳转时为另一个值
+                uint8_t taken = instr.op == SreOpCode::JumpIfFalse ? False : True;
+                uint8_t other = taken == False ? True : False;
+                if (instr.operand <= pc || instr.operand > end) return false;
+                if (in & (taken | Unknown)) reach[instr.operand - start] |= taken;
+                out = (in & (other | Unknown)) ? other : 0;
+                break;
+            }
+            case SreOpCode::Return:
+                if (in & (True | Unknown)) return false;
+                continue;
+        }
+        if (out) reach[pc + 1 - start] |= out;
+    }
+    return true;
+}
+
+SrePrefilter::Signature SrePrefilter::analyze(const std::vector<SreInstr> &code, size_t start, const SreSymbols &symbols) {
+    Signature sig;
+    size_t end = start;
+    while (end < code.size() && code[end].op != SreOpCode::Return) ++end;
+    if (end == code.size()) return sig;
+    std::vector<uint32_t> required;
+    for (size_t pc = start; pc < end; ++pc) {
+        uint32_t predicate = code[pc].operand;
+        if (code[pc].op == SreOpCode::Predicate && sreRequirable(symbols, predicate) &&
+            std::find(required.begin(), required.end(), predicate) == required.end()) {
+            required.push_back(predicate);
+        }
+    }
+    if (required.empty() || !srePrunes(code, start, end, symbols, required, nullptr)) return sig;
+
+    // 逐个去掉容易出现的谓词（字面量多的、字面量短的在前），去掉之后仍然成立就不再要求它，候选规则越少越好
+    auto weakness = [&](uint32_t predicate) {
+        const SrePredicate &pred = symbols.predicates[predicate];
+        size_t shortest = SIZE_MAX;
+        for (size_t i = 1; i < pred.args.size(); ++i) {
+            shortest = std::min(shortest, symbols.constants[pred.args[i].index].size());
+        }
+        return std::make_pair(pred.args.size(), SIZE_MAX - shortest);
+    };
+    std::vector<uint32_t> order = required;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return weakness(a) > weakness(b); });
+    for (uint32_t predicate : order) {
+        if (required.size() == 1) break;
+        std::vector<uint32_t> fewer;
+        for (uint32_t p : required) {
+            if (p != predicate) fewer.push_back(p);
+        }
+        if (srePrunes(code, start, end, symbols, fewer, nullptr)) required.swap(fewer);
+    }
+    srePrunes(code, start, end, symbols, required, &sig.vars);
+    sig.required = std::move(required);
+    return sig;
+}
+
+void SrePrefilter::Postings::build(size_t keys, const std::vector<std::pair<uint32_t, uint32_t>> &pairs) {
+    start.assign(keys + 1, 0);
+    for (auto &pair : pairs) ++start[pair.first + 1];
+    for (size_t k = 0; k < keys; ++k) start[k + 1] += start[k];
+    rules.resize(pairs.size());
+    std::vector<uint32_t> next(start.begin(), start.end() - 1);
+    for (auto &pair : pairs) rules[next[pair.first]++] = pair.second;
+}
+
+size_t SrePrefilter::memoryUsage() const {
+    return sreHeapBytes(always_) + sreHeapBytes(groups_) + sreHeapBytes(byFound_.start) + sreHeapBytes(byFound_.rules) +
+           sreHeapBytes(direct_) + sreHeapBytes(byDirect_.start) + sreHeapBytes(byDirect_.rules) + sreHeapBytes(vars_) +
+           sreHeapBytes(byVar_.start) + sreHeapBytes(byVar_.rules);
+}
+
+void SrePrefilter::build(const std::vector<const Signature *> &rules, const SrePatternIndex &patterns) {
+    *this = SrePrefilter();
+    ruleCount_ = rules.size();
+    std::vector<std::pair<uint32_t, uint32_t>> found, direct, vars;
+    std::unordered_map<uint32_t, uint32_t> directIndex, varIndex;
+    std::vector<uint8_t> grouped(patterns.groupCount(), 0);
+    std::vector<uint32_t> slots;
+    for (uint32_t r = 0; r < rules.size(); ++r) {
+        const Signature &sig = *rules[r];
+        if (sig.required.empty()) {
+            always_.push_back(r);
+            continue;
+        }
+        ++filtered_;
+        for (uint32_t predicate : sig.required) {
+            uint32_t group = patterns.groupOf(predicate);
+            if (group != SrePatternIndex::npos) {
+                if (!grouped[group]) {
+                    grouped[group] = 1;
+                    groups_.push_back(group);
+                }
+                slots.clear();
+                patterns.foundSlots(predicate, slots);
+                for (uint32_t slot : slots) found.emplace_back(slot, r);
+            } else {
+                auto it = directIndex.emplace(predicate, static_cast<uint32_t>(direct_.size()));
+                if (it.second) direct_.push_back(predicate);
+                direct.emplace_back(it.first->second, r);
+            }
+        }
+        for (uint32_t var : sig.vars) {
+            auto it = varIndex.emplace(var, static_cast<uint32_t>(vars_.size()));
+            if (it.second) vars_.push_back(var);
+            vars.emplace_back(it.first->second, r);
+        }
+    }
+    byFound_.build(patterns.foundSize(), found);
+    byDirect_.build(direct_.size(), direct);
+    byVar_.build(vars_.size(), vars);
+}
+
+// 变量是否存在：存在时顺便写入事件缓存；缺失时不写，之后执行规则时照常按缺失处理
+bool SrePrefilter::probe(uint32_t var, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState &state) const {
+    if (state.varLoaded[var]) return true;
+    SreEvalStatus quiet(SreMissing::Error);
+    SreEvalContext probing = ctx;
+    probing.status = &quiet;
+    std::string_view value = sreFetch(var, symbols, probing);
+    if (SreEvalStatus::isMissing(value)) return false;
+    state.vars[var] = value;
+    state.varLoaded[var] = 1;
+    return true;
+}
+
+bool SrePrefilter::select(const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState &state) const {
+    // 缺失变量只在需要报错时影响结果：先探测变量，缺失的变量不扫描，读取它的规则照常执行
+    bool probing = !ctx.status || ctx.status->missing == SreMissing::Error;
+    if (probing && ctx.lazy) return false;
+    const SrePatternIndex &patterns = *state.patterns;
+    std::vector<uint32_t> &triggered = state.triggered;
+    triggered.clear();
+    if (state.marks.size() < ruleCount_) state.marks.resize(ruleCount_, 0);
+    auto add = [&](const Postings &postings, size_t key) {
+        for (uint32_t k = postings.start[key]; k < postings.start[key + 1]; ++k) {
+            uint32_t rule = postings.rules[k];
+            if (!state.marks[rule]) {
+                state.marks[rule] = 1;
+                triggered.push_back(rule);
+            }
+        }
+    };
+    try {
+        if (probing) {
+            for (size_t k = 0; k < vars_.size(); ++k) {
+                if (!probe(vars_[k], symbols, ctx, state)) add(byVar_, k);
+            }
+        }
+        for (uint32_t group : groups_) {
+            if (probing && !state.varLoaded[patterns.groupVar(group)]) continue;
+            state.newly.clear();
+            patterns.scan(group, symbols, ctx, state, state.newly);
+            for (uint32_t slot : state.newly) add(byFound_, slot);
+        }
+        for (size_t k = 0; k < direct_.size(); ++k) {
+            uint32_t predicate = direct_[k];
+            if (probing && !state.varLoaded[symbols.predicates[predicate].args[0].index]) continue;
+            bool hit = ctx.status ? SreInterpreter::evalPredicate<true>(predicate, symbols, ctx, &state)
+                                  : SreInterpreter::evalPredicate<false>(predicate, symbols, ctx, &state);
+            if (hit) add(byDirect_, k);
+        }
+    } catch (...) {
+        for (uint32_t rule : triggered) state.marks[rule] = 0;
+        throw;
+    }
+    for (uint32_t rule : triggered) state.marks[rule] = 0;
+    std::sort(triggered.begin(), triggered.end());
+    state.candidates.resize(always_.size() + triggered.size());
+    std::merge(always_.begin(), always_.end(), triggered.begin(), triggered.end(), state.candidates.begin());
+    return true;
+}
@@ -0,0 +1,387 @@
+#ifndef SRE_BYTECODE_H
+#define SRE_BYTECODE_H
+
+// 内部头文件：字节码后端
+// 把语法树降级为连续存放的定长指令，由一个 switch 循环解释执行，
+// and/or/not 通过跳转实现短路，求值结果与语法树遍历完全一致；
+// 内置的 contains/containsAny/icontains/icontainsAny 直接调用查找算法，单条规则一次求值中同一个变量只查找一次
+#include "SreAST.h"
+#include "SreSearch.h"
+#include <cstdint>
+#include <map>
+
+enum class SreOpCode : uint8_t {
+    PushConst,    // 压入常量 constants[operand]
+    PushVar,      // 压入变量 vars[operand] 的值
+    Call,         // 弹出 argc 个参数调用 functions[operand]，结果写入累加器
+    Predicate,    // 求共享谓词 predicates[operand]，结果写入累加器；同一事件内只计算一次
+    Compare,      // 求比较 compares[operand]，结果写入累加器
+    Truthy,       // 弹出一个值，累加器 = 值非空
+    Not,          // 累加器取反
+    JumpIfFalse,  // 累加器为 false 时跳转到 operand
+    JumpIfTrue,   // 累加器为 true 时跳转到 operand
+    Fail,         // 抛出异常，消息为 errors[operand]
+    Return        // 返回累加器
+};
+
+// 定长 8 字节指令，跳转目标为指令下标
+struct SreInstr {
+    SreOpCode op;
+    uint8_t reserved;
+    uint16_t argc;
+    uint32_t operand;
+};
+
+struct SreVarRef {
+    std::string name;
+    size_t slot;
+};
+
+// 共享谓词：函数及其参数都相同的调用，参数只能是常量或变量
+struct SrePredicate {
+    struct Arg {
+        enum Kind : uint8_t { Const, Var, Fail } kind;
+        uint32_t index;  // 常量、变量或错误消息的下标
+    };
+    uint32_t function;
+    std::vector<Arg> args;
+};
+
+// 比较运算：不引用语法树，规则集序列化后仍可求值
+// 操作数连续存放在 SreSymbols::compareArgs 中，每个比较只记录范围，不单独分配内存
+struct SreCompareRef {
+    struct Arg {
+        static const uint32_t npos = UINT32_MAX;
+        uint32_t var;       // 变量下标，常量为 npos
+        uint32_t memo;      // 仅变量：单条规则求值时比较缓存的下标
+        uint32_t constant;  // 仅常量：文本在 constants 中的下标
+        // 仅常量：编译期解析的结果（SreScalar 去掉文本），文本在求值时取 constants[constant]
+        SreScalar::Type type;
+        SreScalar::Numeric numeric;
+        int64_t i;
+        double d;
+    };
+    SreCompareNode::Operator op;
+    uint32_t first;  // 操作数为 compareArgs[first, first + count)
+    uint32_t count;
+};
+
+// 函数的绑定信息：序列化时只保存这些，读取时按名字重新绑定到引擎的函数表
+struct SreFunctionRef {
+    static const uint32_t npos = UINT32_MAX;
+    std::string name;     // 小写函数名
+    SreBuiltin builtin;
+    uint32_t pattern;     // matches/like 在编译期绑定的常量模式在 constants 中的下标，没有为 npos
+    bool folded = false;  // icontains/icontainsAny 的字面量已在编译期折叠（见 SreFunctionEntry::folded）
+};
+
+class SreBinaryWriter;
+class SreBinaryReader;
+
+// 符号表：常量、变量、函数和共享谓词，全部去重
+// 单条规则的字节码独占一份，规则集中的所有规则共用一份
+class SreSymbols {
+public:
+    uint32_t constant(std::string_view text);
+    uint32_t var(const std::string &name, size_t slot);
+    // 函数项不由符号表持有：单条规则由编译结果的内存池、规则集由 SreRuleSetProgram 保证存活
+    uint32_t function(const SreFunctionNode &call);
+    uint32_t function(const SreFunctionEntry *func, const SreFunctionRef &ref);
+    uint32_t error(const std::string &message);
+    uint32_t predicate(const SrePredicate &pred);
+    uint32_t compare(const SreCompareNode &node);
+    // 操作数的下标已经属于本符号表
+    uint32_t compare(SreCompareNode::Operator op, const SreCompareRef::Arg *args, size_t count);
+
+    std::vector<std::string> constants;
+    std::vector<SreVarRef> vars;
+    std::vector<const SreFunctionEntry *> functions;
+    std::vector<SreFunctionRef> functionRefs;
+    std::vector<std::string> errors;
+    std::vector<SrePredicate> predicates;
+    std::vector<SreCompareRef> compares;
+    std::vector<SreCompareRef::Arg> compareArgs;
+    // 性能分析：下标为指令下标，Call/Predicate 为函数调用点，紧跟函数调用的跳转为决定短路的调用点；
+    // 只在 SRE_PROFILING 时填写，不保存到文件，长度可以小于字节码
+    std::vector<uint32_t> sites;
+    uint32_t site(size_t pc) const { return pc < sites.size() ? sites[pc] : SreProfiler::npos; }
+    const SreCompareRef::Arg *args(const SreCompareRef &ref) const { return compareArgs.data() + ref.first; }
+
+    // 序列化（见 SreSerialize.h）：读取后 functions 全为空，由调用方按 functionRefs 绑定；
+    // 读取时校验符号之间的下标引用，去重用的索引会重建，之后可以继续追加
+    void save(SreBinaryWriter &out) const;
+    void load(SreBinaryReader &in);
+    // 读取后绑定第 index 个函数
+    void bindFunction(uint32_t index, const SreFunctionEntry *func);
+
+    // 追加前记下各表的长度，出错时用 truncate 撤销之后追加的符号（连同去重索引）
+    struct Mark {
+        size_t constants, vars, functions, errors, predicates, compares, compareArgs, sites;
+    };
+    Mark mark() const;
+    void truncate(const Mark &mark);
+    // 只复制求值用到的表，不含去重索引，结果不能再追加符号
+    SreSymbols withoutIndex() const;
+    // 堆上占用的字节数（含去重索引），不含对象本身
+    size_t memoryUsage() const;
+
+private:
+    static std::string predicateKey(const SrePredicate &pred);
+    static size_t compareHash(SreCompareNode::Operator op, const SreCompareRef::Arg *args, size_t count);
+    bool sameCompare(uint32_t index, SreCompareNode::Operator op, const SreCompareRef::Arg *args, size_t count) const;
+    void indexCompare(uint32_t index);
+
+    // 常量和比较按哈希值索引到表中的下标，不另存一份键，哈希相同时再与表中的内容比较
+    std::unordered_multimap<size_t, uint32_t> constantIndex_;
+    std::unordered_map<std::string, uint32_t> varIndex_;
+    // 键为函数项和常量模式：未绑定模式的 matches/like 用不同的常量模式调用时分别记录
+    std::map<std::pair<const SreFunctionEntry *, uint32_t>, uint32_t> functionIndex_;
+    std::unordered_map<std::string, uint32_t> predicateIndex_;
+    std::unordered_multimap<size_t, uint32_t> compareIndex_;
+};
+
+struct SreEvalState;
+
+// 规则集的多模式索引：同一变量上内置 contains/containsAny 的字面量合并为一个 Aho-Corasick 自动机
+// 第一次求到某个变量上的这类谓词时把该变量扫描一遍，同组的其它谓词直接查表
+class SrePatternIndex {
+public:
+    static const uint32_t npos = UINT32_MAX;
+    // 同一变量上至少有这么多个不同的字面量才建索引，否则直接查找更快
+    static const size_t kMinPatterns = 2;
+
+    void build(const SreSymbols &symbols) { extend(SrePatternIndex(), symbols); }
+    // 在 previous 的基础上给之后新增的谓词建索引：previous 中的绑定不变，未变化的组直接共用，
+    // 只重建新增了字面量的组。symbols 必须是 previous 所用符号表追加之后的结果
+    void extend(const SrePatternIndex &previous, const SreSymbols &symbols);
+
+    bool covers(uint32_t predicate) const {
+        return predicate < bindings_.size() && bindings_[predicate].group != npos;
+    }
+    bool eval(uint32_t predicate, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState &state) const;
+
+    // 只处理第一个参数为变量、其余参数全为常量的内置调用，参数个数错误的调用保持原样以便照常报错
+    static bool indexable(const SrePredicate &pred, const SreSymbols &symbols);
+    // 以下供预过滤（SrePrefilter）使用
+    uint32_t groupOf(uint32_t predicate) const { return covers(predicate) ? bindings_[predicate].group : npos; }
+    uint32_t groupVar(uint32_t group) const { return groups_[group]->var; }
+    // 谓词关心的模式在 SreEvalState::found 中的下标，追加到 out
+    void foundSlots(uint32_t predicate, std::vector<uint32_t> &out) const;
+    // 扫描一组的变量，已扫描时直接返回；新出现的模式在 SreEvalState::found 中的下标追加到 newly
+    // 变量缺失时返回 false，不标记为已扫描
+    bool scan(uint32_t group, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState &state,
+              std::vector<uint32_t> &newly) const;
+
+    // 序列化已构建的索引，symbols 用于校验下标
+    void save(SreBinaryWriter &out) const;
+    void load(SreBinaryReader &in, const SreSymbols &symbols);
+
+    size_t groupCount() const { return groups_.size(); }
+    size_t foundSize() const { return foundSize_; }
+    // 堆上占用的字节数，不含对象本身；各组的自动机可能与其它版本共用，同样计入
+    size_t memoryUsage() const;
+
+private:
+    struct Group {
+        uint32_t var;
+        SreAhoCorasick automaton;
+    };
+    // 谓词对应的组，以及它关心的模式 patternList_[first, first + count)
+    struct Binding {
+        uint32_t group;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    void bind(uint32_t predicate, uint32_t group, SreAhoCorasick &automaton, const SreSymbols &symbols);
+    void layout();
+
+    std::vector<std::shared_ptr<const Group>> groups_;  // 组建好后不再修改，多个版本共用
+    std::vector<uint32_t> foundBase_;  // 各组的模式在 SreEvalState::found 中的起始下标
+    std::vector<Binding> bindings_;
+    std::vector<uint32_t> patternList_;
+    // 还没有建组的变量上可索引的谓词，字面量凑够 kMinPatterns 个时建组
+    std::unordered_map<uint32_t, std::vector<uint32_t>> pending_;
+    size_t foundSize_ = 0;
+};
+
+// 规则集求值时单个事件的缓存：每个变量只查找一次，每个共享谓词只计算一次，
+// 比较运算中的每个变量最多转换一次
+struct SreEvalState {
+    enum : uint8_t { Unknown = 0, False = 1, True = 2 };
+
+    void reset(const SreSymbols &symbols, const SrePatternIndex *index = nullptr) {
+        vars.resize(symbols.vars.size());
+        varLoaded.assign(symbols.vars.size(), 0);
+        predicates.assign(symbols.predicates.size(), Unknown);
+        scalars.assign(symbols.compares.empty() ? 0 : symbols.vars.size(), SreScalar());
+        patterns = index;
+        if (index) {
+            scanned.assign(index->groupCount(), 0);
+            found.assign(index->foundSize(), 0);
+        }
+    }
+
+    std::vector<std::string_view> vars;
+    std::vector<uint8_t> varLoaded;
+    std::vector<uint8_t> predicates;
+    std::vector<SreScalar> scalars;  // 按变量下标，没有比较运算时为空
+
+    const SrePatternIndex *patterns = nullptr;
+    std::vector<uint8_t> scanned;  // 每组是否已扫描
+    std::vector<uint8_t> found;    // 每个模式是否出现
+
+    // 预过滤（SrePrefilter）选出的规则和它的临时数据，reset 时不清空，连续求值多个事件时复用
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> triggered;
+    std::vector<uint32_t> newly;
+    std::vector<uint8_t> marks;  // 按规则下标，只在 select 期间非零
+};
+
+// 规则集的预过滤：为每条规则找一组必要谓词（内置 contains/containsAny 调用），它们都为 false 时规则必然为 false
+// 求值时先扫描这些谓词所在的变量（同一变量上的字面量由多模式索引一次扫完），只执行至少有一个必要谓词为真的规则，
+// 其余规则直接视为不命中。只有在必要谓词都为 false 的每一条执行路径上规则都只调用不会出错的内置函数、
+// 也不会执行 Fail 时才做预过滤；这些路径上读取的变量缺失时照常执行规则，因此跳过与否结果和报错都不变
+class SrePrefilter {
+public:
+    // 一条规则的分析结果，required 为空表示不能预过滤
+    struct Signature {
+        std::vector<uint32_t> required;  // 必要谓词
+        std::vector<uint32_t> vars;      // 必要谓词都为 false 时会读取的变量
+    };
+    // 分析从 code[start] 开始的一条规则
+    static Signature analyze(const std::vector<SreInstr> &code, size_t start, const SreSymbols &symbols);
+
+    // rules[i] 为规则集中第 i 条规则的分析结果
+    void build(const std::vector<const Signature *> &rules, const SrePatternIndex &patterns);
+
+    // 可以预过滤的规则个数
+    size_t filteredCount() const { return filtered_; }
+    // 堆上占用的字节数，不含对象本身
+    size_t memoryUsage() const;
+    // 选出本事件需要执行的规则，按下标升序写入 state.candidates；state 必须已经 reset
+    // 返回 false 表示这次不能预过滤，所有规则都要执行：上下文按需取值、且缺失变量需要报错时，
+    // 探测变量是否存在会提前触发取值
+    bool select(const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState &state) const;
+
+private:
+    // 倒排表：键 k 对应的规则为 rules[start[k], start[k + 1])，升序
+    struct Postings {
+        std::vector<uint32_t> start;
+        std::vector<uint32_t> rules;
+        // pairs 为（键，规则）对，规则按升序给出
+        void build(size_t keys, const std::vector<std::pair<uint32_t, uint32_t>> &pairs);
+    };
+
+    bool probe(uint32_t var, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState &state) const;
+
+    size_t ruleCount_ = 0;
+    size_t filtered_ = 0;
+    std::vector<uint32_t> always_;  // 不能预过滤的规则，升序
+    std::vector<uint32_t> groups_;  // 必要谓词所在的多模式索引组
+    Postings byFound_;              // SreEvalState::found 的下标 -> 规则
+    std::vector<uint32_t> direct_;  // 没有建组的必要谓词
+    Postings byDirect_;             // direct_ 的下标 -> 规则
+    std::vector<uint32_t> vars_;    // 缺失时需要照常执行规则的变量
+    Postings byVar_;                // vars_ 的下标 -> 规则
+};
+
+// 降级：语法树 -> 字节码，追加到 code 末尾，常量等符号写入 symbols
+// sharePredicates 为 true 时函数调用编译为共享谓词，供规则集做公共子表达式消除
+class SreProgramBuilder {
+public:
+    SreProgramBuilder(SreSymbols &symbols, std::vector<SreInstr> &code, bool sharePredicates)
+        : symbols_(symbols), code_(code), sharePredicates_(sharePredicates), depth_(0), maxStack_(0) {}
+
+    // 编译一条完整的规则（以 Return 结尾），返回起始指令下标
+    size_t lowerRule(const SreASTNode &root);
+    // 值栈的最大深度
+    size_t maxStack() const { return maxStack_; }
+
+private:
+    void emitBool(const SreASTNode &node);
+    void emitValue(const SreASTNode &node);
+    void emitCall(const SreFunctionNode &func);
+    void emitPredicate(const SreFunctionNode &func);
+    size_t emit(SreOpCode op, size_t operand = 0, uint16_t argc = 0);
+    void setSite(size_t pc, uint32_t site);
+
+    SreSymbols &symbols_;
+    std::vector<SreInstr> &code_;
+    bool sharePredicates_;
+    size_t depth_;
+    size_t maxStack_;
+};
+
+// 把规则的字节码连同用到的符号复制到另一份符号表，跳转目标随之平移
+// 规则集压缩时用它丢掉已删除规则留下的代码和符号，不需要语法树
+class SreRelocator {
+public:
+    SreRelocator(const SreSymbols &from, SreSymbols &to, std::vector<SreInstr> &code)
+        : from_(from), to_(to), code_(code),
+          constants_(from.constants.size(), npos), vars_(from.vars.size(), npos), functions_(from.functions.size(), npos),
+          errors_(from.errors.size(), npos), predicates_(from.predicates.size(), npos),
+          compares_(from.compares.size(), npos) {}
+
+    // 复制从 source[start] 开始到第一个 Return 为止的一条规则，返回新的起始下标
+    size_t copyRule(const std::vector<SreInstr> &source, size_t start);
+
+private:
+    static constexpr uint32_t npos = UINT32_MAX;
+    uint32_t map(std::vector<uint32_t> &cache, uint32_t index, uint32_t (SreRelocator::*copy)(uint32_t));
+    uint32_t copyConstant(uint32_t index);
+    uint32_t copyVar(uint32_t index);
+    uint32_t copyFunction(uint32_t index);
+    uint32_t copyError(uint32_t index);
+    uint32_t copyPredicate(uint32_t index);
+    uint32_t copyCompare(uint32_t index);
+
+    const SreSymbols &from_;
+    SreSymbols &to_;
+    std::vector<SreInstr> &code_;
+    // 旧下标 -> 新下标，npos 表示还没有复制
+    std::vector<uint32_t> constants_, vars_, functions_, errors_, predicates_, compares_;
+};
+
+// 解释器：从 code[start] 开始执行到 Return
+// state 不为空时变量和共享谓词的结果在多次调用间复用
+// Checked 为 true 时是不抛异常的求值（ctx.status 不为空），两种求值分别实例化，普通求值的路径上没有额外的判断
+class SreInterpreter {
+public:
+    static bool run(const SreInstr *code, size_t start, size_t maxStack, const SreSymbols &symbols,
+                    const SreEvalContext &ctx, SreEvalState *state) {
+        return ctx.status ? execute<true>(code, start, maxStack, symbols, ctx, state)
+                          : execute<false>(code, start, maxStack, symbols, ctx, state);
+    }
+    template<bool Checked>
+    static bool execute(const SreInstr *code, size_t start, size_t maxStack, const SreSymbols &symbols,
+                        const SreEvalContext &ctx, SreEvalState *state);
+    template<bool Checked>
+    static bool evalPredicate(uint32_t index, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState *state);
+    template<bool Checked>
+    static bool evalCompare(uint32_t index, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState *state);
+    static std::string_view loadVar(uint32_t index, const SreSymbols &symbols, const SreEvalContext &ctx, SreEvalState *state);
+    // 校验从文件读取的字节码：操作数下标、值栈深度和跳转目标都合法，且每段代码都以 Return 结束，
+    // 解释器执行时不再检查；不合法时抛异常。返回值栈的最大深度
+    static size_t verify(const std::vector<SreInstr> &code, const SreSymbols &symbols);
+};
+
+// 单条规则的字节码程序
+class SreProgram {
+public:
+    // 把语法树降级为字节码
+    static std::shared_ptr<const SreProgram> lower(const SreASTNode &root);
+
+    bool run(const SreEvalContext &ctx) const {
+        return SreInterpreter::run(code_.data(), 0, maxStack_, symbols_, ctx, nullptr);
+    }
+
+    const std::vector<SreInstr> &code() const { return code_; }
+
+private:
+    SreSymbols symbols_;
+    std::vector<SreInstr> code_;
+    size_t maxStack_ = 0;
+};
+
+#endif // SRE_BYTECODE_H
@@ -0,0 +1,234 @@
+// 并发压力测试：add/replace/update/reload/registerFunction 与单个求值、批量求值、流式求值同时进行
+// 检查每次求值都看到某一个完整的版本，并检查写者不会等待其它引擎或规则集上的读者
+// 用 ThreadSanitizer 运行的方法见 readme 中的“测试”一段；返回值非 0 表示失败
+#include "SreRuleEngine.h"
+#include "SreRuleSet.h"
+#include "SreStream.h"
+#include "SreTest.h"
+#include "SreThreadPool.h"
+#include <chrono>
+#include <cstdlib>
+#include <set>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// 死锁时进程不会结束，超时后直接报告失败
+void sreWatchdog(std::chrono::seconds limit) {
+    std::thread([limit] {
+        std::this_thread::sleep_for(limit);
+        std::cerr << "timed out after " << limit.count() << " s, probably deadlocked\n";
+        std::_Exit(2);
+    }).detach();
+}
+
+// 第 generation 代的规则：id 为 generation * 1000 + i，全部命中 sreEvent()；规则数随代变化
+SreRuleSet::Rules sreGeneration(const SreRuleEngine &engine, uint64_t generation) {
+    SreRuleSet::Rules rules;
+    size_t count = 5 + generation % 7;
+    for (size_t i = 0; i < count; ++i) {
+        std::string expression = i % 3 == 0   ? "probe(#{user}) and #{level} >= 3"
+                                 : i % 3 == 1 ? "contains(#{path}, '/admin') or #{level} == 99"
+                                              : "#{user} == 'alice' and not (#{level} < 1)";
+        rules.emplace_back(generation * 1000 + i, engine.compile(expression));
+    }
+    return rules;
+}
+
+SreContext sreEvent() {
+    return { { "user", "alice" }, { "level", "5" }, { "path", "/admin/users" } };
+}
+
+// 一次求值的结果必须恰好是某一代的全部规则
+void sreCheckGeneration(const std::vector<SreRuleId> &ids) {
+    SRE_CHECK(!ids.empty(), "empty result");
+    if (ids.empty()) return;
+    uint64_t generation = ids[0] / 1000;
+    SRE_CHECK(ids.size() == 5 + generation % 7, "result is not a whole generation");
+    for (size_t i = 0; i < ids.size(); ++i) {
+        SRE_CHECK(ids[i] == generation * 1000 + i, "result mixes generations or is out of order");
+    }
+}
+
+// reload 与各种求值并发：每次求值看到的都是某一代完整的规则
+void sreReloadRace(std::chrono::milliseconds duration) {
+    SreRuleEngine engine;
+    engine.registerFunction("probe", [](SreArgs args) { return !args[0].empty(); });
+    SreRuleSet set;
+    set.reload(sreGeneration(engine, 0));
+
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    threads.emplace_back([&] {
+        for (uint64_t generation = 1; !stop; ++generation) set.reload(sreGeneration(engine, generation));
+    });
+    // 替换函数不影响已编译的规则，与编译和求值并发
+    threads.emplace_back([&] {
+        while (!stop) engine.registerFunction("probe", [](SreArgs args) { return !args[0].empty(); });
+    });
+    for (int t = 0; t < 2; ++t) {
+        threads.emplace_back([&] {
+            SreContext event = sreEvent();
+            while (!stop) sreCheckGeneration(set.evaluate(event));
+        });
+    }
+    threads.emplace_back([&] {
+        SreContext event = sreEvent();
+        while (!stop) sreCheckGeneration(set.tryEvaluate(event, SreMissing::Error));
+    });
+    threads.emplace_back([&] {
+        SreThreadPool pool(SreThreadPool::Options{ 3, false });
+        std::vector<SreContext> events(200, sreEvent());
+        std::vector<std::vector<SreRuleId>> results;
+        while (!stop) {
+            set.evaluate(events, results, pool);
+            // 整批使用同一个版本
+            for (auto &ids : results) {
+                sreCheckGeneration(ids);
+                SRE_CHECK(ids == results[0], "batch used more than one version");
+            }
+        }
+    });
+    threads.emplace_back([&] {
+        std::string input;
+        for (int i = 0; i < 300; ++i) input += "{\"user\":\"alice\",\"level\":5,\"path\":\"/admin/users\"}\n";
+        size_t lines = 0;
+        SreStream stream(set, SreStreamFormat::Ndjson, [&](std::string_view, const std::vector<SreRuleId> &hits) {
+            sreCheckGeneration(hits);
+            ++lines;
+        });
+        while (!stop) stream.feed(input);
+        SRE_CHECK(lines == stream.lines(), "stream skipped callbacks");
+    });
+    threads.emplace_back([&] {
+        while (!stop) {
+            SreCompiledRule rule = engine.compile("probe(#{user}) and #{level} > 1");
+            SRE_CHECK(engine.evaluate(rule, sreEvent()), "compiled rule does not match");
+        }
+    });
+
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto &thread : threads) thread.join();
+}
+
+// add/replace/update/remove 与求值并发：结果按位置排列、没有重复，且只含曾经加入过的 id
+void sreIncrementalRace(std::chrono::milliseconds duration) {
+    SreRuleEngine engine;
+    SreRuleSet set;
+    SreCompiledRule hit = engine.compile("#{level} >= 3");
+    SreCompiledRule miss = engine.compile("#{level} > 100");
+    const SreRuleId kRules = 64;
+    for (SreRuleId id = 0; id < kRules; ++id) set.add(id, hit);
+
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    threads.emplace_back([&] {
+        // 偶数 id 始终存在且命中，奇数 id 依次删除、加回、替换、与新 id 一起写入
+        for (uint64_t round = 0; !stop; ++round) {
+            SreRuleId id = 1 + 2 * (round / 4 % (kRules / 2));
+            switch (round % 4) {
+                case 0: set.remove(id); break;
+                case 1: set.add(id, miss); break;
+                case 2: set.replace(id, hit); break;
+                default: set.update({ { id, hit }, { id + kRules, miss } }); break;
+            }
+            if (round % 64 == 63) {
+                SreRuleSet::Rules rules;
+                for (SreRuleId id = 0; id < kRules; ++id) rules.emplace_back(id, hit);
+                set.reload(rules);
+            }
+        }
+    });
+    for (int t = 0; t < 3; ++t) {
+        threads.emplace_back([&] {
+            SreContext event = sreEvent();
+            while (!stop) {
+                std::vector<SreRuleId> ids = set.evaluate(event);
+                std::set<SreRuleId> unique(ids.begin(), ids.end());
+                SRE_CHECK(unique.size() == ids.size(), "duplicate id in result");
+                size_t even = 0;
+                for (SreRuleId id : ids) {
+                    SRE_CHECK(id < 2 * kRules, "unknown id in result");
+                    if (id < kRules && id % 2 == 0) ++even;
+                }
+                SRE_CHECK(even == kRules / 2, "stable rule missing from result");
+                (void)set.size();
+                (void)set.memoryUsage();
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto &thread : threads) thread.join();
+}
+
+// 写者只等待同一个对象上的读者：一个规则集上长时间的求值不拖住其它规则集和引擎的写者，
+// 也不拖住新线程的第一次编译；在读临界区内修改其它规则集、构造引擎、注册函数不会死锁
+void sreIndependentDomains() {
+    SreRuleEngine engine;
+    SreRuleSet slow;
+    SreRuleSet other;
+    std::atomic<bool> entered{false};
+    std::atomic<bool> release{false};
+    engine.registerFunction("hold", [&](SreArgs) {
+        entered = true;
+        while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return true;
+    });
+    slow.add(1, engine.compile("hold()"));
+    std::thread reader([&] { slow.evaluate(SreContext()); });
+    while (!entered) std::this_thread::yield();
+
+    Clock::time_point start = Clock::now();
+    engine.registerFunction("other", [](SreArgs) { return true; });
+    other.add(1, engine.compile("other()"));
+    other.reload({ { 2, engine.compile("#{a} == 'b'") } });
+    std::thread fresh([&] { SRE_CHECK(engine.evaluate(engine.compile("other()"), SreContext()), "fresh thread"); });
+    fresh.join();
+    SreRuleEngine constructed;
+    constructed.registerFunction("x", [](SreArgs) { return true; });
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+    SRE_CHECK(elapsed.count() < 1000, "writer waited for a reader of another rule set");
+    release = true;
+    reader.join();
+
+    // 在规则集 A 的读临界区内（规则调用的函数、流的回调）修改规则集 B、注册函数、构造新引擎
+    SreRuleSet nested;
+    engine.registerFunction("mutate", [&](SreArgs) {
+        other.add(100 + other.size(), engine.compile("#{a} == 'b'"));
+        engine.registerFunction("other", [](SreArgs) { return true; });
+        SreRuleEngine local;
+        return true;
+    });
+    nested.add(1, engine.compile("mutate()"));
+    SRE_CHECK(nested.evaluate(SreContext()) == std::vector<SreRuleId>{ 1 }, "nested writer result");
+    SreStream stream(slow, SreStreamFormat::KeyValue, [&](std::string_view, const std::vector<SreRuleId> &) {
+        other.remove(other.evaluate(SreContext{ { "a", "b" } }).back());
+    });
+    slow.reload({ { 7, engine.compile("#{a} == 'b'") } });
+    stream.feed("a=b\na=b\n");
+    SRE_CHECK(stream.lines() == 2, "stream with writer callback");
+
+    // 流的回调修改正在求值的规则集本身，修改从下一行开始生效
+    std::vector<size_t> counts;
+    SreStream self(slow, SreStreamFormat::KeyValue, [&](std::string_view, const std::vector<SreRuleId> &hits) {
+        counts.push_back(hits.size());
+        slow.add(1000 + slow.size(), engine.compile("#{a} == 'b'"));
+    });
+    self.feed("a=b\na=b\na=b\n");
+    SRE_CHECK((counts == std::vector<size_t>{ 1, 2, 3 }), "stream callback modifying its own rule set");
+}
+
+}  // namespace
+
+int main() {
+    sreWatchdog(std::chrono::seconds(120));
+    sreIndependentDomains();
+    sreReloadRace(std::chrono::milliseconds(1500));
+    sreIncrementalRace(std::chrono::milliseconds(1500));
+    return sreTestResult("concurrency test");
+}
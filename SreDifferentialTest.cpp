@@ -0,0 +1,321 @@
+// 后端差分测试：随机生成规则和事件，以遍历语法树（Tree）为参照，比较 Bytecode 后端的结果；
+// 覆盖 SreContext、SreSlotContext、SreTypedContext、SreLazyContext，
+// 抛出的异常（比较消息）以及 tryEvaluate 的三种缺失处理方式；
+// 另外以逐行求值为参照比较列式批量求值（SreBatch），包括出错时抛出的是哪一行的异常
+// 用法：sre_differential_test [种子]；返回值非 0 表示失败
+#include "SreRuleEngine.h"
+#include "SreBatch.h"
+#include "SreTest.h"
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <random>
+
+namespace {
+
+std::string sreWord(std::mt19937 &rng) {
+    static const char *words[] = { "err", "ERR", "warn", "timeout", "db", "api", "x1", "好", "503", "", "Σ", "σ", "-7", "2.5" };
+    return words[rng() % 14];
+}
+
+std::string sreVar(std::mt19937 &rng) {
+    return std::string("#{") + "abcde"[rng() % 5] + "}";
+}
+
+// 随机规则：内置函数、自定义的纯函数/非纯函数/会抛异常的函数、各种比较和嵌套的 and/or/not，
+// 以及参数个数不对等编译能通过、求值时才出错的调用
+std::string sreRule(std::mt19937 &rng, int depth = 0) {
+    std::string v = sreVar(rng);
+    switch (rng() % (depth > 2 ? 15 : 18)) {
+        case 0: return "contains(" + v + ", '" + sreWord(rng) + "')";
+        case 1: {
+            std::string rule = "containsAny(" + v;
+            for (int n = 1 + rng() % 10; n; --n) rule += ", '" + sreWord(rng) + "'";
+            return rule + ")";
+        }
+        case 2: return "matches(" + v + ", '^" + sreWord(rng) + "[0-9]*')";
+        case 3: return "like(" + v + ", '*" + sreWord(rng) + "*')";
+        case 4: return v + (rng() % 2 ? " > " : " <= ") + std::to_string(static_cast<int>(rng() % 1000) - 100);
+        case 5: return v + " in ('" + sreWord(rng) + "', 503, true, 2.5)";
+        case 6: return "isLong(" + v + ")";
+        case 7: return rng() % 2 ? v : "not " + v;
+        case 8: return "icontains(" + v + ", '" + sreWord(rng) + "')";
+        case 9: {
+            std::string rule = "icontainsAny(" + v;
+            for (int n = 1 + rng() % 3; n; --n) rule += ", " + (rng() % 4 ? "'" + sreWord(rng) + "'" : sreVar(rng));
+            return rule + ")";
+        }
+        case 10: return "contains(" + v + ", " + sreVar(rng) + ")";
+        case 11: {
+            std::string rule = "many(" + v;
+            for (int n = rng() % 12; n; --n) rule += ", " + (rng() % 2 ? "'" + sreWord(rng) + "'" : sreVar(rng));
+            return rule + ")";
+        }
+        case 12: {
+            static const char *odd[] = { "contains(#{a})", "containsAny(#{b})", "icontains(#{a}, 'x', 'y')",
+                                         "contains(contains(#{a}, 'x'), 'y')", "'lit'", "''", "contains('err', #{c})",
+                                         "boom(#{d})", "#{a} == 'true'", "#{b} != 3" };
+            return odd[rng() % 10];
+        }
+        case 13: return v + (rng() % 2 ? " == " : " < ") + sreVar(rng);
+        case 14: return "boom(" + v + ") or " + v + " >= 10";
+        case 15: return "(" + sreRule(rng, depth + 1) + " and " + sreRule(rng, depth + 1) + " and " + sreRule(rng, depth + 1) + ")";
+        case 16: return "(" + sreRule(rng, depth + 1) + " or " + sreRule(rng, depth + 1) + ")";
+        default: return "not (" + sreRule(rng, depth + 1) + " or " + sreRule(rng, depth + 1) + ")";
+    }
+}
+
+void sreRegister(SreRuleEngine &engine) {
+    engine.registerFunction("isLong", [](SreArgs args) { return !args.empty() && args[0].size() > 4; }, true);
+    engine.registerFunction("many", [](SreArgs args) {
+        size_t size = 0;
+        for (auto arg : args) size += arg.size();
+        return size % 3 == 0;
+    });
+    engine.registerFunction("boom", [](SreArgs args) -> bool {
+        if (args.empty() || args[0].size() % 2) throw std::runtime_error("boom");
+        return true;
+    });
+}
+
+// 求值结果：0/1 表示真假，2 表示抛异常，message 为异常消息
+struct SreResultOf {
+    int value;
+    std::string message;
+
+    bool operator==(const SreResultOf &other) const { return value == other.value && message == other.message; }
+};
+
+SreResultOf sreRun(const std::function<bool()> &evaluate) {
+    try {
+        return { evaluate() ? 1 : 0, std::string() };
+    } catch (const std::exception &e) {
+        return { 2, e.what() };
+    }
+}
+
+bool sreSame(const SreOutcome &a, const SreOutcome &b) {
+    return a.result == b.result && a.error == b.error && a.variable == b.variable;
+}
+
+// 一个后端：各自的引擎，按表达式文本和按 schema 编译的规则
+struct SreBackendUnderTest {
+    SreBackendUnderTest(const char *name, SreBackend backend) : name(name) {
+        engine.setBackend(backend);
+        sreRegister(engine);
+    }
+
+    const char *name;
+    SreRuleEngine engine;
+    SreSchema schema;
+    std::vector<SreCompiledRule> rules;
+    std::vector<SreCompiledRule> slotRules;
+};
+
+struct SreEvent {
+    SreContext map;
+    SreTypedContext typed;
+    std::vector<std::pair<std::string, std::string>> values;  // 出现的变量和文本
+    std::vector<bool> resolvable;                             // 按需取值时取值函数是否返回 true
+};
+
+SreSlotContext sreSlots(const SreEvent &event, const SreSchema &schema) {
+    SreSlotContext slots(schema.size());
+    for (auto &value : event.values) {
+        size_t index = schema.indexOf(value.first);
+        if (index != SreSchema::npos) slots[index] = value.second;
+    }
+    return slots;
+}
+
+SreLazyContext sreLazy(const SreEvent &event) {
+    SreLazyContext lazy;
+    for (size_t i = 0; i < event.values.size(); ++i) {
+        std::string value = event.values[i].second;
+        bool present = event.resolvable[i];
+        lazy.define(event.values[i].first, [value, present](std::string &out) {
+            out = value;
+            return present;
+        });
+    }
+    return lazy;
+}
+
+SreEvent sreEvent(std::mt19937 &rng) {
+    SreEvent event;
+    for (char c : std::string("abcde")) {
+        if (rng() % 4 == 0) continue;  // 缺失的变量
+        std::string name(1, c);
+        std::string value;
+        for (int n = rng() % 3; n > 0; --n) value += sreWord(rng) + (rng() % 2 ? std::to_string(rng() % 100) : "");
+        if (rng() % 5 == 0) value = std::to_string(static_cast<int>(rng() % 2000) - 500);
+        event.map[name] = value;
+        switch (rng() % 4) {
+            case 0: event.typed[name] = SreValue(static_cast<int64_t>(rng() % 1000)); break;
+            case 1: event.typed[name] = SreValue(static_cast<double>(rng() % 1000) / 4); break;
+            case 2: event.typed[name] = SreValue(rng() % 2 == 0); break;
+            default: event.typed[name] = SreValue(value); break;
+        }
+        event.values.emplace_back(name, value);
+        event.resolvable.push_back(rng() % 5 != 0);
+    }
+    return event;
+}
+
+// 由一组事件构造的列：缺失的变量对应有效位为 0 的行，rows 大于一块以覆盖跨块的情况
+struct SreColumns {
+    std::vector<std::vector<int32_t>> offsets;
+    std::vector<std::string> data;
+    std::vector<std::vector<uint8_t>> validity;
+
+    SreBatch build(const std::vector<SreEvent> &events, const std::string &absent) {
+        SreBatch batch(events.size());
+        const std::string names = "abcde";
+        offsets.assign(names.size(), std::vector<int32_t>(1, 0));
+        data.assign(names.size(), std::string());
+        validity.assign(names.size(), std::vector<uint8_t>((events.size() + 7) / 8, 0));
+        for (size_t c = 0; c < names.size(); ++c) {
+            for (size_t row = 0; row < events.size(); ++row) {
+                auto it = events[row].map.find(std::string(1, names[c]));
+                if (it != events[row].map.end()) {
+                    data[c] += it->second;
+                    validity[c][row >> 3] |= static_cast<uint8_t>(1u << (row & 7));
+                }
+                offsets[c].push_back(static_cast<int32_t>(data[c].size()));
+            }
+            if (absent.find(names[c]) != std::string::npos) continue;
+            batch.setColumn(std::string(1, names[c]), SreColumn{ offsets[c].data(), data[c].data(), validity[c].data() });
+        }
+        return batch;
+    }
+};
+
+// 批量求值与逐行求值比较：Error 语义下逐行调用 evaluate，应抛出第一个出错行的异常；
+// 其它语义下逐行调用 tryEvaluate，有出错的行时批量求值应抛异常，否则结果逐行相同
+void sreCheckBatch(const SreRuleEngine &engine, const SreCompiledRule &rule, const std::vector<SreContext> &rows,
+                   const SreBatch &batch, SreMissing missing, const std::string &what) {
+    std::vector<bool> expected(rows.size(), false);
+    SreResultOf expectedError{ 0, std::string() };
+    for (size_t row = 0; row < rows.size() && !expectedError.value; ++row) {
+        if (missing == SreMissing::Error) {
+            SreResultOf result = sreRun([&] { return engine.evaluate(rule, rows[row]); });
+            if (result.value == 2) expectedError = result;
+            expected[row] = result.value == 1;
+        } else {
+            SreOutcome outcome = engine.tryEvaluate(rule, rows[row], missing);
+            if (outcome.result == SreResult::Error) expectedError = { 2, std::string() };
+            expected[row] = outcome.matched();
+        }
+    }
+    std::vector<bool> matched;
+    SreResultOf actual = sreRun([&] {
+        engine.evaluate(rule, batch, matched, missing);
+        return false;
+    });
+    if (expectedError.value) {
+        SRE_CHECK(actual.value == 2, what + " (batch should throw)");
+        if (missing == SreMissing::Error) SRE_CHECK(actual.message == expectedError.message, what + " (batch error)");
+    } else {
+        SRE_CHECK(actual.value == 0 && matched == expected, what + " (batch)");
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 28;
+    std::mt19937 rng(seed);
+
+    SreBackendUnderTest backends[2] = { { "tree", SreBackend::Tree }, { "bytecode", SreBackend::Bytecode } };
+
+    std::vector<std::string> texts;
+    for (int i = 0; i < 400; ++i) texts.push_back(sreRule(rng));
+    for (auto &backend : backends) {
+        for (auto &text : texts) {
+            backend.rules.push_back(backend.engine.compile(text));
+            backend.slotRules.push_back(backend.engine.compile(text, backend.schema));
+        }
+    }
+
+    const SreBackendUnderTest &reference = backends[0];
+    const SreMissing modes[] = { SreMissing::Error, SreMissing::Empty, SreMissing::False };
+    size_t checks = 0;
+    for (int e = 0; e < 150; ++e) {
+        SreEvent event = sreEvent(rng);
+        SreSlotContext referenceSlots = sreSlots(event, reference.schema);
+        SreLazyContext lazy = sreLazy(event);
+        for (size_t b = 1; b < std::size(backends); ++b) {
+            const SreBackendUnderTest &backend = backends[b];
+            SreSlotContext slots = sreSlots(event, backend.schema);
+            for (size_t i = 0; i < texts.size(); ++i) {
+                const SreCompiledRule &expected = reference.rules[i];
+                const SreCompiledRule &actual = backend.rules[i];
+                std::string what = std::string(backend.name) + ": " + texts[i];
+                const SreRuleEngine &ref = reference.engine;
+                const SreRuleEngine &engine = backend.engine;
+                SRE_CHECK(sreRun([&] { return ref.evaluate(expected, event.map); }) ==
+                              sreRun([&] { return engine.evaluate(actual, event.map); }), what + " (map)");
+                SRE_CHECK(sreRun([&] { return ref.evaluate(expected, event.typed); }) ==
+                              sreRun([&] { return engine.evaluate(actual, event.typed); }), what + " (typed)");
+                SRE_CHECK(sreRun([&] { return ref.evaluate(expected, lazy); }) ==
+                              sreRun([&] { return engine.evaluate(actual, lazy); }), what + " (lazy)");
+                SRE_CHECK(sreRun([&] { return ref.evaluate(reference.slotRules[i], referenceSlots); }) ==
+                              sreRun([&] { return engine.evaluate(backend.slotRules[i], slots); }), what + " (slots)");
+                for (SreMissing missing : modes) {
+                    SRE_CHECK(sreSame(ref.tryEvaluate(expected, event.map, missing), engine.tryEvaluate(actual, event.map, missing)),
+                              what + " (try map)");
+                    SRE_CHECK(sreSame(ref.tryEvaluate(expected, event.typed, missing),
+                                      engine.tryEvaluate(actual, event.typed, missing)), what + " (try typed)");
+                    SRE_CHECK(sreSame(ref.tryEvaluate(expected, lazy, missing), engine.tryEvaluate(actual, lazy, missing)),
+                              what + " (try lazy)");
+                    SRE_CHECK(sreSame(ref.tryEvaluate(reference.slotRules[i], referenceSlots, missing),
+                                      engine.tryEvaluate(backend.slotRules[i], slots, missing)), what + " (try slots)");
+                }
+                checks += 16;
+            }
+        }
+    }
+
+    // 批量求值：一批有缺失值的行，以及另一批整列缺失的情况
+    std::vector<SreEvent> events;
+    for (int e = 0; e < 2100; ++e) events.push_back(sreEvent(rng));
+    std::vector<SreContext> rows;
+    for (auto &event : events) rows.push_back(event.map);
+    std::vector<SreContext> rowsWithoutE = rows;
+    for (auto &row : rowsWithoutE) row.erase("e");
+    SreColumns columns;
+    SreColumns columnsWithoutE;
+    SreBatch batch = columns.build(events, "");
+    SreBatch batchWithoutE = columnsWithoutE.build(events, "e");
+    for (size_t i = 0; i < texts.size(); ++i) {
+        for (SreMissing missing : modes) {
+            sreCheckBatch(reference.engine, reference.rules[i], rows, batch, missing, "batch: " + texts[i]);
+            sreCheckBatch(reference.engine, reference.rules[i], rowsWithoutE, batchWithoutE, missing, "batch -e: " + texts[i]);
+            checks += 2;
+        }
+    }
+
+    // 第 0 行缺 b、第 1 行缺 a：逐行求值先在第 0 行出错
+    {
+        std::vector<SreEvent> pair(2);
+        pair[0].map = { { "a", "" } };
+        pair[1].map = { { "b", "" } };
+        std::vector<SreContext> pairRows = { pair[0].map, pair[1].map };
+        SreColumns pairColumns;
+        SreBatch pairBatch = pairColumns.build(pair, "");
+        for (SreMissing missing : modes) {
+            sreCheckBatch(reference.engine, reference.engine.compile("#{a} or #{b}"), pairRows, pairBatch, missing, "#{a} or #{b}");
+        }
+        std::vector<bool> matched;
+        SreResultOf result = sreRun([&] {
+            reference.engine.evaluate(reference.engine.compile("#{a} or #{b}"), pairBatch, matched);
+            return false;
+        });
+        SRE_CHECK(result.message == "Variable not found: b", "#{a} or #{b}: " + result.message);
+    }
+
+    // 字节码后端确实生效，否则比较的只是语法树
+    for (auto &rule : backends[1].rules) SRE_CHECK(rule.backend() == SreBackend::Bytecode, "rule was not lowered");
+    std::cout << checks << " checks, seed " << seed << "\n";
+    return sreTestResult("differential test");
+}
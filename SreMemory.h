@@ -0,0 +1,63 @@
+#ifndef SRE_MEMORY_H
+#define SRE_MEMORY_H
+
+// 内部头文件：内存占用估算
+// 只计算容器在堆上分配的字节数，对象本身由所在的对象或数组计入；不含分配器的额外开销
+// 哈希表和有序表按常见实现估算：每个桶一个指针，每个元素一个单独分配的节点
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+inline size_t sreHeapBytes(const std::string &text) {
+    // 短字符串存放在对象内部，空字符串的容量即内部缓冲区的大小
+    static const size_t inlineCapacity = std::string().capacity();
+    return text.capacity() > inlineCapacity ? text.capacity() + 1 : 0;
+}
+
+template<typename T>
+size_t sreHeapBytes(const std::vector<T> &items) {
+    return items.capacity() * sizeof(T);
+}
+
+inline size_t sreHeapBytes(const std::vector<std::string> &items) {
+    size_t bytes = items.capacity() * sizeof(std::string);
+    for (auto &item : items) bytes += sreHeapBytes(item);
+    return bytes;
+}
+
+template<typename V>
+size_t sreHeapBytes(const std::vector<std::vector<V>> &items) {
+    size_t bytes = items.capacity() * sizeof(std::vector<V>);
+    for (auto &item : items) bytes += sreHeapBytes(item);
+    return bytes;
+}
+
+// 节点：下一个节点的指针、缓存的哈希值和元素
+template<typename K, typename V, typename H>
+size_t sreHeapBytes(const std::unordered_map<K, V, H> &table) {
+    return table.bucket_count() * sizeof(void *) +
+           table.size() * (sizeof(std::pair<const K, V>) + sizeof(void *) + sizeof(size_t));
+}
+
+template<typename V, typename H>
+size_t sreHeapBytes(const std::unordered_map<std::string, V, H> &table) {
+    size_t bytes = table.bucket_count() * sizeof(void *) +
+                   table.size() * (sizeof(std::pair<const std::string, V>) + sizeof(void *) + sizeof(size_t));
+    for (auto &entry : table) bytes += sreHeapBytes(entry.first);
+    return bytes;
+}
+
+template<typename K, typename V>
+size_t sreHeapBytes(const std::unordered_multimap<K, V> &table) {
+    return table.bucket_count() * sizeof(void *) +
+           table.size() * (sizeof(std::pair<const K, V>) + sizeof(void *) + sizeof(size_t));
+}
+
+// 节点：颜色、父节点和左右子节点，再加上元素
+template<typename K, typename V>
+size_t sreHeapBytes(const std::map<K, V> &table) {
+    return table.size() * (sizeof(std::pair<const K, V>) + 4 * sizeof(void *));
+}
+
+#endif // SRE_MEMORY_H
@@ -0,0 +1,307 @@
+#include "SreOptimizer.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+// 布尔上下文中的常量：字符串常量，非空为真
+static bool sreIsConstant(SreASTNodePtr node, bool &value) {
+    if (node->kind() != SreNodeKind::Value) return false;
+    const SreValueNode &v = static_cast<const SreValueNode &>(*node);
+    if (v.isVariable()) return false;
+    value = !v.value().empty();
+    return true;
+}
+
+// 纯表达式：同一事件内求值多次结果相同且没有副作用（包括抛出相同的异常）
+static bool sreIsPure(SreASTNodePtr node) {
+    switch (node->kind()) {
+        case SreNodeKind::Value:
+            return true;
+        case SreNodeKind::Function: {
+            const SreFunctionNode &func = static_cast<const SreFunctionNode &>(*node);
+            if (!func.function()->pure) return false;
+            for (auto arg : func.args()) {
+                if (!sreIsPure(arg)) return false;
+            }
+            return true;
+        }
+        case SreNodeKind::Logical: {
+            const SreLogicalNode &logical = static_cast<const SreLogicalNode &>(*node);
+            for (auto operand : logical.operands()) {
+                if (!sreIsPure(operand)) return false;
+            }
+            return true;
+        }
+        case SreNodeKind::Compare:
+            return true;
+    }
+    return false;
+}
+
+static bool sreSameNodes(const SreNodeList &a, const SreNodeList &b);
+
+// 结构相同的两棵子树
+static bool sreSameNode(SreASTNodePtr a, SreASTNodePtr b) {
+    if (a == b) return true;
+    if (a->kind() != b->kind()) return false;
+    switch (a->kind()) {
+        case SreNodeKind::Value: {
+            const SreValueNode &x = static_cast<const SreValueNode &>(*a);
+            const SreValueNode &y = static_cast<const SreValueNode &>(*b);
+            return x.isVariable() == y.isVariable() && x.value() == y.value() && x.slot() == y.slot();
+        }
+        case SreNodeKind::Function: {
+            const SreFunctionNode &x = static_cast<const SreFunctionNode &>(*a);
+            const SreFunctionNode &y = static_cast<const SreFunctionNode &>(*b);
+            return x.function() == y.function() && sreSameNodes(x.args(), y.args());
+        }
+        case SreNodeKind::Logical: {
+            const SreLogicalNode &x = static_cast<const SreLogicalNode &>(*a);
+            const SreLogicalNode &y = static_cast<const SreLogicalNode &>(*b);
+            return x.op() == y.op() && sreSameNodes(x.operands(), y.operands());
+        }
+        case SreNodeKind::Compare: {
+            const SreCompareNode &x = static_cast<const SreCompareNode &>(*a);
+            const SreCompareNode &y = static_cast<const SreCompareNode &>(*b);
+            if (x.op() != y.op() || x.operandCount() != y.operandCount()) return false;
+            for (size_t i = 0; i < x.operandCount(); ++i) {
+                const SreCompareOperand &p = x.operand(i);
+                const SreCompareOperand &q = y.operand(i);
+                if (p.var || q.var) {
+                    if (!p.var || !q.var || !sreSameNode(p.var, q.var)) return false;
+                } else if (p.literal.type != q.literal.type || p.literal.text != q.literal.text) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool sreSameNodes(const SreNodeList &a, const SreNodeList &b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (!sreSameNode(a[i], b[i])) return false;
+    }
+    return true;
+}
+
+SreASTNodePtr SreOptimizer::optimizeBool(SreASTNodePtr node) {
+    switch (node->kind()) {
+        case SreNodeKind::Logical:
+            return optimizeLogical(static_cast<const SreLogicalNode &>(*node));
+        case SreNodeKind::Function:
+            return foldFunction(static_cast<const SreFunctionNode &>(*node));
+        case SreNodeKind::Value:
+            return node;
+        case SreNodeKind::Compare:
+            return foldCompare(static_cast<const SreCompareNode &>(*node));
+    }
+    return node;
+}
+
+SreASTNodePtr SreOptimizer::optimizeLogical(const SreLogicalNode &logical) {
+    const SreNodeList &operands = logical.operands();
+    if (logical.op() == SreLogicalNode::Not) {
+        SreASTNodePtr operand = optimizeBool(operands[0]);
+        bool value;
+        if (sreIsConstant(operand, value)) return constant(!value);
+        if (operand->kind() == SreNodeKind::Logical &&
+            static_cast<const SreLogicalNode &>(*operand).op() == SreLogicalNode::Not) {
+            // not not x 与 x 在布尔上下文中等价
+            return static_cast<const SreLogicalNode &>(*operand).operands()[0];
+        }
+        if (operand == operands[0]) return &logical;
+        return arena_.make<SreLogicalNode>(SreLogicalNode::Not, arena_.copyArray(&operand, 1), 1);
+    }
+
+    size_t base = operandStack_.size();
+    for (auto original : operands) {
+        SreASTNodePtr operand = optimizeBool(original);
+        bool more = true;
+        if (operand->kind() == SreNodeKind::Logical &&
+            static_cast<const SreLogicalNode &>(*operand).op() == logical.op()) {
+            // 展开同类的子节点，它们已经优化过
+            for (auto nested : static_cast<const SreLogicalNode &>(*operand).operands()) {
+                if (!(more = appendOperand(logical.op(), base, nested))) break;
+            }
+        } else {
+            more = appendOperand(logical.op(), base, operand);
+        }
+        if (!more) break;
+    }
+
+    size_t count = operandStack_.size() - base;
+    SreASTNodePtr result;
+    if (count == 0) {
+        // 所有项都被去掉：and 恒真，or 恒假
+        result = constant(logical.op() == SreLogicalNode::And);
+    } else if (count == 1) {
+        result = operandStack_[base];
+    } else if (count == operands.size() && std::equal(operands.begin(), operands.end(), operandStack_.begin() + base)) {
+        result = &logical;
+    } else {
+        result = arena_.make<SreLogicalNode>(logical.op(), arena_.copyArray(operandStack_.data() + base, count), count);
+    }
+    operandStack_.resize(base);
+    return result;
+}
+
+bool SreOptimizer::appendOperand(SreLogicalNode::Operator op, size_t base, SreASTNodePtr operand) {
+    // and 遇假、or 遇真即决定结果
+    bool decisive = (op == SreLogicalNode::Or);
+    bool value;
+    if (sreIsConstant(operand, value)) {
+        if (value != decisive) return true;  // 不影响结果的常量直接去掉
+        // 前面的项仍要求值（可能抛异常），保留该常量作为最后一项
+        operandStack_.push_back(operand);
+        return false;
+    }
+    if (sreIsPure(operand)) {
+        // 前面已经出现过的纯子表达式：执行到这里时它的值必然已经确定且不决定结果
+        for (size_t i = base; i < operandStack_.size(); ++i) {
+            if (sreSameNode(operandStack_[i], operand)) return true;
+        }
+    }
+    operandStack_.push_back(operand);
+    return true;
+}
+
+SreASTNodePtr SreOptimizer::foldFunction(const SreFunctionNode &func) {
+    if (!func.function()->pure) return &func;
+    std::vector<std::string_view> args;
+    args.reserve(func.args().size());
+    for (auto arg : func.args()) {
+        if (arg->kind() != SreNodeKind::Value) return &func;
+        const SreValueNode &value = static_cast<const SreValueNode &>(*arg);
+        if (value.isVariable()) return &func;
+        args.push_back(value.value());
+    }
+    bool result;
+    try {
+        result = func.function()->call(SreArgs(args.data(), args.size()));
+    } catch (...) {
+        // 保留原调用，异常仍在求值时抛出
+        return &func;
+    }
+    return constant(result);
+}
+
+SreASTNodePtr SreOptimizer::foldCompare(const SreCompareNode &compare) {
+    for (size_t i = 0; i < compare.operandCount(); ++i) {
+        if (compare.operand(i).var) return &compare;
+    }
+    // 操作数全为常量，求值不会访问上下文
+    SreEvalContext empty = { nullptr, nullptr };
+    return constant(compare.evalBool(empty));
+}
+
+SreASTNodePtr SreOptimizer::constant(bool value) {
+    return arena_.make<SreValueNode>(value ? std::string_view("true") : std::string_view());
+}
+
+// =============================
+// 按样本统计重排 and/or 子项
+// =============================
+SreASTNodePtr SreOptimizer::reorder(SreASTNodePtr root, const std::vector<SreEvalContext> &samples) {
+    if (samples.empty()) return root;
+    stats_.clear();
+    for (auto &ctx : samples) {
+        profile(root, ctx);
+    }
+    double cost, trueRate;
+    return rebuild(root, cost, trueRate);
+}
+
+int SreOptimizer::record(SreASTNodePtr node, int result) {
+    Stat &stat = stats_[node];
+    stat.count++;
+    if (result > 0) stat.trues++;
+    if (result < 0) stat.failed = true;
+    return result;
+}
+
+int SreOptimizer::profile(SreASTNodePtr node, const SreEvalContext &ctx) {
+    if (node->kind() != SreNodeKind::Logical) {
+        auto start = std::chrono::steady_clock::now();
+        int result;
+        try {
+            result = node->evalBool(ctx) ? 1 : 0;
+        } catch (...) {
+            result = -1;
+        }
+        stats_[node].nanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return record(node, result);
+    }
+    const SreLogicalNode &logical = static_cast<const SreLogicalNode &>(*node);
+    if (logical.op() == SreLogicalNode::Not) {
+        int result = profile(logical.operands()[0], ctx);
+        return record(node, result < 0 ? -1 : !result);
+    }
+    // 结果按原顺序短路计算；短路之后的纯子项仍求值一次以获得完整的统计，
+    // 非纯子项（例如异步函数或有副作用的函数）只在原顺序会求值到时求值，短路之后不求值、不统计
+    int decisive = (logical.op() == SreLogicalNode::Or) ? 1 : 0;
+    int result = -2;
+    for (auto operand : logical.operands()) {
+        if (result != -2 && !sreIsPure(operand)) continue;
+        int r = profile(operand, ctx);
+        if (result == -2 && (r < 0 || r == decisive)) result = r;
+    }
+    return record(node, result == -2 ? !decisive : result);
+}
+
+SreASTNodePtr SreOptimizer::rebuild(SreASTNodePtr node, double &cost, double &trueRate) {
+    const Stat &stat = stats_[node];
+    trueRate = stat.count ? static_cast<double>(stat.trues) / stat.count : 0;
+    if (node->kind() != SreNodeKind::Logical) {
+        cost = stat.count ? stat.nanos / stat.count : 0;
+        return node;
+    }
+    const SreLogicalNode &logical = static_cast<const SreLogicalNode &>(*node);
+    const SreNodeList &operands = logical.operands();
+    if (logical.op() == SreLogicalNode::Not) {
+        double childRate;
+        SreASTNodePtr operand = rebuild(operands[0], cost, childRate);
+        if (operand == operands[0]) return node;
+        return arena_.make<SreLogicalNode>(SreLogicalNode::Not, arena_.copyArray(&operand, 1), 1);
+    }
+
+    struct Item {
+        SreASTNodePtr node;
+        double cost;
+        double trueRate;
+        double rank;
+    };
+    bool isAnd = logical.op() == SreLogicalNode::And;
+    bool movable = true;
+    std::vector<Item> items;
+    items.reserve(operands.size());
+    for (auto operand : operands) {
+        Item item;
+        item.node = rebuild(operand, item.cost, item.trueRate);
+        // 继续求值下一项的概率越小、耗时越少，越应该排在前面
+        double passRate = isAnd ? item.trueRate : 1 - item.trueRate;
+        item.rank = passRate < 1 ? item.cost / (1 - passRate) : std::numeric_limits<double>::infinity();
+        movable = movable && !stats_[operand].failed && sreIsPure(operand);
+        items.push_back(item);
+    }
+    if (movable) {
+        std::stable_sort(items.begin(), items.end(), [](const Item &a, const Item &b) { return a.rank < b.rank; });
+    }
+
+    // 假设各子项相互独立估计期望耗时
+    cost = 0;
+    double reach = 1;
+    bool changed = false;
+    std::vector<SreASTNodePtr> ordered;
+    ordered.reserve(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        cost += reach * items[i].cost;
+        reach *= isAnd ? items[i].trueRate : 1 - items[i].trueRate;
+        ordered.push_back(items[i].node);
+        changed = changed || items[i].node != operands[i];
+    }
+    if (!changed) return node;
+    return arena_.make<SreLogicalNode>(logical.op(), arena_.copyArray(ordered.data(), ordered.size()), ordered.size());
+}
@@ -0,0 +1,56 @@
+#ifndef SRE_OPTIMIZER_H
+#define SRE_OPTIMIZER_H
+
+// 内部头文件：语法树优化
+// 在解析之后、求值之前对布尔上下文的节点做等价变换，求值结果和抛出的异常与原表达式一致：
+// - 纯函数的参数全为常量时在编译期求值，结果替换为常量；操作数全为常量的比较同样折叠
+// - not not x 化简为 x，not 常量直接取反
+// - 嵌套的同类 and/or 展开为一个 n 元节点
+// - and 去掉恒真项、or 去掉恒假项；遇到决定结果的常量时丢弃其后永远不会求值的项
+// - 去掉重复出现的纯子表达式，例如 x and x
+// 函数参数处于字符串上下文，不做变换
+// 另外可以按样本统计 and/or 各子项的耗时和为真比例，把可交换的子项按期望代价重排（reorder）
+#include "SreAST.h"
+#include <unordered_map>
+
+class SreOptimizer {
+public:
+    // 新节点分配在 arena 中，原节点保持不变
+    explicit SreOptimizer(SreArena &arena) : arena_(arena) {}
+
+    // 优化规则的根节点，返回优化后的根节点
+    SreASTNodePtr optimize(SreASTNodePtr root) { return optimizeBool(root); }
+
+    // 用样本逐个求值，统计叶子节点（变量、常量、函数调用）的平均耗时和每个节点为真的比例，
+    // 再把 and/or 的子项按期望代价从低到高重排：and 按 耗时/(1-为真比例)，or 按 耗时/为真比例
+    // 只有子项全部是纯表达式、且在样本中都没有抛异常的节点才会重排；样本为空时原样返回
+    SreASTNodePtr reorder(SreASTNodePtr root, const std::vector<SreEvalContext> &samples);
+
+private:
+    // 样本中每个节点的统计
+    struct Stat {
+        size_t count = 0;
+        size_t trues = 0;
+        bool failed = false;  // 至少在一个样本中抛过异常
+        double nanos = 0;     // 叶子节点的累计耗时
+    };
+    // 返回 1/0 表示真假，-1 表示抛异常；and/or 的纯子项全部求值，不短路，非纯子项按原顺序短路
+    int profile(SreASTNodePtr node, const SreEvalContext &ctx);
+    // 按统计重建，cost 为期望耗时（纳秒），trueRate 为为真比例
+    SreASTNodePtr rebuild(SreASTNodePtr node, double &cost, double &trueRate);
+    int record(SreASTNodePtr node, int result);
+
+    SreASTNodePtr optimizeBool(SreASTNodePtr node);
+    SreASTNodePtr optimizeLogical(const SreLogicalNode &logical);
+    SreASTNodePtr foldFunction(const SreFunctionNode &func);
+    SreASTNodePtr foldCompare(const SreCompareNode &compare);
+    // 把一项加入 and/or 的子节点列表，返回 false 表示该项已经决定结果，之后的项不必再加
+    bool appendOperand(SreLogicalNode::Operator op, size_t base, SreASTNodePtr operand);
+    SreASTNodePtr constant(bool value);
+
+    SreArena &arena_;
+    std::vector<SreASTNodePtr> operandStack_;  // 各层 and/or 共用的临时栈
+    std::unordered_map<SreASTNodePtr, Stat> stats_;
+};
+
+#endif // SRE_OPTIMIZER_H
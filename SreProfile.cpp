@@ -0,0 +1,305 @@
+#include "SreProfile.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#if SRE_PROFILING
+namespace {
+
+// 一个编号的累计值，汇总和清零基线都用它
+struct SreProfileTotals {
+    uint64_t evaluations = 0, trueCount = 0, falseCount = 0, shortCircuits = 0, sampled = 0, ticks = 0;
+
+    void add(const SreProfileSlot &slot) {
+        evaluations += slot.evaluations.load(std::memory_order_relaxed);
+        trueCount += slot.trueCount.load(std::memory_order_relaxed);
+        falseCount += slot.falseCount.load(std::memory_order_relaxed);
+        shortCircuits += slot.shortCircuits.load(std::memory_order_relaxed);
+        sampled += slot.sampled.load(std::memory_order_relaxed);
+        ticks += slot.ticks.load(std::memory_order_relaxed);
+    }
+    void subtract(const SreProfileTotals &other) {
+        evaluations -= other.evaluations;
+        trueCount -= other.trueCount;
+        falseCount -= other.falseCount;
+        shortCircuits -= other.shortCircuits;
+        sampled -= other.sampled;
+        ticks -= other.ticks;
+    }
+};
+
+struct SreProfileInfo {
+    SreProfileRecord::Kind kind;
+    std::string name;
+    std::string function;
+    uint32_t rule;
+};
+
+// 全局登记表：编号对应的名字、存活线程的计数和已退出线程的汇总
+// 有意不析构，线程在静态对象析构之后退出时仍可访问
+class SreProfileRegistry {
+public:
+    static SreProfileRegistry &instance() {
+        static SreProfileRegistry *registry = new SreProfileRegistry();
+        return *registry;
+    }
+
+    // key 相同的登记共用一个编号
+    uint32_t add(std::string key, SreProfileInfo info) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = ids_.find(key);
+        if (it != ids_.end()) return it->second;
+        if (infos_.size() >= SreProfileThread::kMaxChunks * SreProfileThread::kChunkSize) {
+            unregistered_++;
+            return SreProfiler::npos;
+        }
+        uint32_t id = static_cast<uint32_t>(infos_.size());
+        infos_.push_back(std::move(info));
+        ids_.emplace(std::move(key), id);
+        return id;
+    }
+
+    void attach(SreProfileThread *thread) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(thread);
+    }
+
+    void detach(SreProfileThread *thread) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.erase(std::find(threads_.begin(), threads_.end(), thread));
+        collect(*thread, retired_);
+    }
+
+    SreProfileSnapshot snapshot() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<SreProfileTotals> totals = current();
+        double seconds = 1 / ticksPerSecond();
+        SreProfileSnapshot snapshot;
+        snapshot.unregistered = unregistered_;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (size_t id = 0; id < totals.size(); ++id) {
+                const SreProfileInfo &info = infos_[id];
+                const SreProfileTotals &t = totals[id];
+                if (info.kind != (pass == 0 ? SreProfileRecord::Rule : SreProfileRecord::Function)) continue;
+                if (t.evaluations == 0 && t.shortCircuits == 0) continue;
+                SreProfileRecord record = { info.kind, static_cast<uint32_t>(id), info.name, info.function, info.rule, {} };
+                record.counters.evaluations = t.evaluations;
+                record.counters.trueCount = t.trueCount;
+                record.counters.falseCount = t.falseCount;
+                record.counters.shortCircuits = t.shortCircuits;
+                record.counters.sampled = t.sampled;
+                record.counters.sampledSeconds = static_cast<double>(t.ticks) * seconds;
+                snapshot.records.push_back(std::move(record));
+            }
+        }
+        return snapshot;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        baseline_ = current();
+        baseline_.resize(infos_.size());
+    }
+
+    std::atomic<uint32_t> interval{ 64 };
+
+private:
+    SreProfileRegistry() : startTicks_(sreProfileTicks()), startTime_(std::chrono::steady_clock::now()) {}
+
+    // 线程的计数加到 totals 上
+    void collect(const SreProfileThread &thread, std::vector<SreProfileTotals> &totals) const {
+        totals.resize(infos_.size());
+        for (uint32_t c = 0; c * SreProfileThread::kChunkSize < totals.size(); ++c) {
+            const SreProfileThread::Chunk *chunk = thread.chunk(c);
+            if (!chunk) continue;
+            size_t end = std::min<size_t>(totals.size() - c * SreProfileThread::kChunkSize, SreProfileThread::kChunkSize);
+            for (size_t i = 0; i < end; ++i) {
+                totals[c * SreProfileThread::kChunkSize + i].add(chunk->slots[i]);
+            }
+        }
+    }
+
+    // 已退出线程 + 存活线程 - 清零基线
+    std::vector<SreProfileTotals> current() const {
+        std::vector<SreProfileTotals> totals = retired_;
+        totals.resize(infos_.size());
+        for (SreProfileThread *thread : threads_) {
+            collect(*thread, totals);
+        }
+        for (size_t i = 0; i < baseline_.size(); ++i) {
+            totals[i].subtract(baseline_[i]);
+        }
+        return totals;
+    }
+
+    // 时间戳频率：第一次 snapshot 时用登记表创建以来经过的时间校准一次，间隔太短时先等待一小段
+    // 之后不再变化，导出的采样耗时才能只增不减
+    double ticksPerSecond() {
+#ifdef SRE_PROFILE_RDTSC
+        if (ticksPerSecond_ > 0) return ticksPerSecond_;
+        using Clock = std::chrono::steady_clock;
+        if (Clock::now() - startTime_ < std::chrono::milliseconds(10)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        uint64_t ticks = sreProfileTicks();
+        double elapsed = std::chrono::duration<double>(Clock::now() - startTime_).count();
+        ticksPerSecond_ = static_cast<double>(ticks - startTicks_) / elapsed;
+        return ticksPerSecond_;
+#else
+        return 1e9;
+#endif
+    }
+
+    std::mutex mutex_;
+    std::vector<SreProfileInfo> infos_;
+    std::unordered_map<std::string, uint32_t> ids_;  // 登记的 key -> 编号
+    uint64_t unregistered_ = 0;
+    std::vector<SreProfileThread *> threads_;
+    std::vector<SreProfileTotals> retired_;
+    std::vector<SreProfileTotals> baseline_;
+    uint64_t startTicks_;
+    std::chrono::steady_clock::time_point startTime_;
+    double ticksPerSecond_ = 0;
+};
+
+}  // namespace
+
+SreProfileThread::SreProfileThread()
+    : random_(reinterpret_cast<uintptr_t>(this) | 1), countdown_(1), shortCircuits_(0) {
+    for (auto &chunk : chunks_) chunk.store(nullptr, std::memory_order_relaxed);
+    SreProfileRegistry::instance().attach(this);
+    countdown_ = nextGap();
+}
+
+SreProfileThread::~SreProfileThread() {
+    SreProfileRegistry::instance().detach(this);
+    for (auto &chunk : chunks_) delete chunk.load(std::memory_order_relaxed);
+}
+
+SreProfileThread::Chunk *SreProfileThread::allocate(uint32_t index) {
+    // 值初始化，计数全为 0
+    Chunk *chunk = new Chunk();
+    chunks_[index].store(chunk, std::memory_order_release);
+    return chunk;
+}
+
+uint32_t SreProfileThread::nextGap() {
+    // xorshift64
+    random_ ^= random_ << 13;
+    random_ ^= random_ >> 7;
+    random_ ^= random_ << 17;
+    uint32_t interval = SreProfileRegistry::instance().interval.load(std::memory_order_relaxed);
+    return interval == 1 ? 1 : 1 + static_cast<uint32_t>(random_ % (2 * static_cast<uint64_t>(interval) - 1));
+}
+
+uint32_t SreProfiler::registerRule(const std::string &expression) {
+    return SreProfileRegistry::instance().add("r" + expression, { SreProfileRecord::Rule, expression, std::string(), npos });
+}
+
+uint32_t SreProfiler::registerSite(uint32_t rule, const std::string &function, const std::string &call, uint32_t occurrence) {
+    // 调用文本中可能有任意字节，放在 key 的最后
+    std::string key = "s" + std::to_string(rule) + "/" + std::to_string(occurrence) + "/" + call;
+    return SreProfileRegistry::instance().add(std::move(key), { SreProfileRecord::Function, call, function, rule });
+}
+
+SreProfileSnapshot SreProfiler::snapshot() {
+    return SreProfileRegistry::instance().snapshot();
+}
+
+void SreProfiler::reset() {
+    SreProfileRegistry::instance().reset();
+}
+
+void SreProfiler::setSampleInterval(uint32_t interval) {
+    SreProfileRegistry::instance().interval.store(std::max<uint32_t>(interval, 1), std::memory_order_relaxed);
+}
+#else
+SreProfileSnapshot SreProfiler::snapshot() {
+    return SreProfileSnapshot();
+}
+
+void SreProfiler::reset() {}
+
+void SreProfiler::setSampleInterval(uint32_t) {}
+#endif // SRE_PROFILING
+
+// 标签值转义：反斜杠、双引号和换行
+static std::string sreLabel(const std::string &value) {
+    std::string escaped;
+    for (char c : value) {
+        switch (c) {
+            case '\\': escaped += "\\\\"; break;
+            case '"': escaped += "\\\""; break;
+            case '\n': escaped += "\\n"; break;
+            default: escaped += c; break;
+        }
+    }
+    return escaped;
+}
+
+std::string SreProfileSnapshot::prometheus(const std::string &prefix) const {
+    // 计数只增不减，是 counter；按采样估算的总耗时会随采样上下浮动，是 gauge
+    struct Metric {
+        const char *name;
+        const char *help;
+        const char *type;
+        SreProfileRecord::Kind kind;
+        double (*value)(const SreProfileCounters &);
+    };
+    static const Metric kMetrics[] = {
+        { "_rule_evaluations_total", "Rule evaluations", "counter", SreProfileRecord::Rule,
+          [](const SreProfileCounters &c) { return static_cast<double>(c.evaluations); } },
+        { "_rule_true_total", "Rule evaluations that matched", "counter", SreProfileRecord::Rule,
+          [](const SreProfileCounters &c) { return static_cast<double>(c.trueCount); } },
+        { "_rule_false_total", "Rule evaluations that did not match", "counter", SreProfileRecord::Rule,
+          [](const SreProfileCounters &c) { return static_cast<double>(c.falseCount); } },
+        { "_rule_short_circuits_total", "and/or operators that stopped early while evaluating the rule", "counter", SreProfileRecord::Rule,
+          [](const SreProfileCounters &c) { return static_cast<double>(c.shortCircuits); } },
+        { "_rule_sampled_total", "Rule evaluations that were timed", "counter", SreProfileRecord::Rule,
+          [](const SreProfileCounters &c) { return static_cast<double>(c.sampled); } },
+        { "_rule_sampled_seconds_total", "Time spent in the timed rule evaluations", "counter", SreProfileRecord::Rule,
+          [](const SreProfileCounters &c) { return c.sampledSeconds; } },
+        { "_rule_estimated_seconds", "Estimated time spent evaluating the rule, extrapolated from the timed evaluations",
+          "gauge", SreProfileRecord::Rule, [](const SreProfileCounters &c) { return c.estimatedSeconds(); } },
+        { "_function_calls_total", "Function calls at the call site", "counter", SreProfileRecord::Function,
+          [](const SreProfileCounters &c) { return static_cast<double>(c.evaluations); } },
+        { "_function_true_total", "Function calls that returned true", "counter", SreProfileRecord::Function,
+          [](const SreProfileCounters &c) { return static_cast<double>(c.trueCount); } },
+        { "_function_false_total", "Function calls that returned false", "counter", SreProfileRecord::Function,
+          [](const SreProfileCounters &c) { return static_cast<double>(c.falseCount); } },
+        { "_function_short_circuits_total", "Calls whose result stopped the enclosing and/or early", "counter", SreProfileRecord::Function,
+          [](const SreProfileCounters &c) { return static_cast<double>(c.shortCircuits); } },
+        { "_function_sampled_total", "Function calls that were timed", "counter", SreProfileRecord::Function,
+          [](const SreProfileCounters &c) { return static_cast<double>(c.sampled); } },
+        { "_function_sampled_seconds_total", "Time spent in the timed function calls", "counter", SreProfileRecord::Function,
+          [](const SreProfileCounters &c) { return c.sampledSeconds; } },
+        { "_function_estimated_seconds", "Estimated time spent in the call, extrapolated from the timed calls",
+          "gauge", SreProfileRecord::Function, [](const SreProfileCounters &c) { return c.estimatedSeconds(); } },
+    };
+    std::string out;
+    for (const Metric &metric : kMetrics) {
+        std::string name = prefix + metric.name;
+        out += "# HELP " + name + " " + metric.help + ".\n";
+        out += "# TYPE " + name + " " + metric.type + "\n";
+        for (const SreProfileRecord &record : records) {
+            if (record.kind != metric.kind) continue;
+            out += name;
+            if (record.kind == SreProfileRecord::Rule) {
+                out += "{rule=\"" + std::to_string(record.id) + "\",expression=\"" + sreLabel(record.name) + "\"} ";
+            } else {
+                out += "{site=\"" + std::to_string(record.id) + "\",function=\"" + sreLabel(record.function) +
+                       "\",call=\"" + sreLabel(record.name) + "\",rule=\"" + std::to_string(record.rule) + "\"} ";
+            }
+            char value[32];
+            snprintf(value, sizeof(value), "%.17g", metric.value(record.counters));
+            out += value;
+            out += "\n";
+        }
+    }
+    out += "# HELP " + prefix + "_unregistered Rules and call sites that are not counted because the profiler ran out of ids.\n";
+    out += "# TYPE " + prefix + "_unregistered gauge\n";
+    out += prefix + "_unregistered " + std::to_string(unregistered) + "\n";
+    return out;
+}
@@ -0,0 +1,202 @@
+#ifndef SRE_PROFILE_H
+#define SRE_PROFILE_H
+
+// 性能分析：按已编译规则和函数调用点统计求值次数、真/假次数、短路次数和耗时
+// 只有定义了 SRE_PROFILING=1（CMake 选项 SRE_ENABLE_PROFILING）才会计数，否则埋点不参与编译，
+// snapshot 返回空结果；库和使用方需要用相同的定义编译
+// 计数按线程存放，写入不加锁也不做原子读改写；snapshot 时汇总所有线程，已退出线程的计数同样保留
+// 耗时按采样估算：每个线程每 sampleInterval 次记录取一次时间戳（x86 上为 rdtsc），
+// 总耗时 = 采样部分的耗时 / 采样次数 × 求值次数
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef SRE_PROFILING
+#define SRE_PROFILING 0
+#endif
+
+struct SreProfileCounters {
+    uint64_t evaluations = 0;    // 求值（调用）次数，抛异常的不计
+    uint64_t trueCount = 0;
+    uint64_t falseCount = 0;
+    // 规则：求值过程中 and/or 提前结束的次数；函数调用点：结果直接让所在的 and/or 提前结束的次数
+    uint64_t shortCircuits = 0;
+    uint64_t sampled = 0;        // 计时的次数
+    double sampledSeconds = 0;   // 计时部分的耗时
+
+    double estimatedSeconds() const { return sampled ? sampledSeconds / sampled * evaluations : 0; }
+};
+
+struct SreProfileRecord {
+    enum Kind { Rule, Function };
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    Kind kind;
+    uint32_t id;           // 规则和调用点各自编号，编译时分配；相同的表达式文本共用编号，见 SreProfiler
+    std::string name;      // 规则为表达式文本；调用点为调用的文本，例如 contains(#{a}, 'x')
+    std::string function;  // 仅调用点：小写的函数名
+    uint32_t rule;         // 仅调用点：所在规则的 id
+    SreProfileCounters counters;
+};
+
+struct SreProfileSnapshot {
+    std::vector<SreProfileRecord> records;  // 只包含有计数的项，规则在前，同类按 id 排列
+    uint64_t unregistered = 0;              // 编号用尽后没能登记、因此不计数的规则和调用点
+
+    // Prometheus 文本格式，指标名以 prefix 开头
+    // 各项计数以及采样次数、采样部分的耗时为 counter；估算的总耗时随采样浮动、可能变小，是 gauge，
+    // 需要随时间求速率时用 rate(sampled_seconds_total) / rate(sampled_total) × rate(evaluations_total)
+    std::string prometheus(const std::string &prefix = "sre") const;
+};
+
+// 统计范围：
+// - 单条规则的 evaluate（各个后端）以及 SreRuleSet 的各个 evaluate，按列批量求值不计数
+// - 规则集中共享谓词只在实际计算时计数，归属第一次计算它的调用点；从文件读取的规则没有编号，不计数
+// - 规则集预过滤跳过的规则不计数，预过滤阶段计算的谓词也不计数
+// - SreAsyncEvaluator 中挂起的求值不计数，恢复后从头重新执行，挂起之前的函数调用点会再次计数
+// - 编号按表达式文本登记：重复编译同一个表达式（包括 reorder 的结果）共用规则编号和调用点，计数累加；
+//   调用点按所在规则、调用的文本和该文本在规则中第几次出现区分。登记表在进程内只增不减，
+//   大小取决于不同表达式的个数，与编译次数无关；超过上限的新表达式不计数，个数见 unregistered
+// - 重排时对样本的求值也计入原规则的调用点
+class SreProfiler {
+public:
+    static constexpr uint32_t npos = SreProfileRecord::npos;
+    static constexpr bool enabled = SRE_PROFILING != 0;
+
+    // 汇总所有线程的计数，可以与求值并发调用
+    static SreProfileSnapshot snapshot();
+    // 之后的 snapshot 从零开始计数
+    static void reset();
+    // 每个线程每 interval 次记录计时一次，默认 64，1 表示每次都计时
+    static void setSampleInterval(uint32_t interval);
+
+#if SRE_PROFILING
+    // 以下供引擎内部使用：编译时登记规则和函数调用点，已登记过的返回原来的编号，编号用尽时返回 npos
+    // occurrence 为相同的调用文本在规则中第几次出现，从 0 开始
+    static uint32_t registerRule(const std::string &expression);
+    static uint32_t registerSite(uint32_t rule, const std::string &function, const std::string &call, uint32_t occurrence);
+#endif
+};
+
+#if SRE_PROFILING
+#include <atomic>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define SRE_PROFILE_RDTSC 1
+#endif
+
+// 性能分析时间戳：x86 上为 TSC，其它平台为 steady_clock 的纳秒数
+inline uint64_t sreProfileTicks() {
+#ifdef SRE_PROFILE_RDTSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// 一个规则或调用点在一个线程中的计数
+// 只有所属线程写入，snapshot 从其它线程读取，因此用原子变量，但写入是普通的读后写
+struct SreProfileSlot {
+    std::atomic<uint64_t> evaluations, trueCount, falseCount, shortCircuits, sampled, ticks;
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+// 每个线程的计数：按编号分块，块在第一次用到时分配，之后地址不变
+class SreProfileThread {
+public:
+    static const uint32_t kChunkBits = 10;
+    static const uint32_t kChunkSize = 1u << kChunkBits;
+    static const uint32_t kMaxChunks = 4096;  // 最多 400 多万个编号
+    struct Chunk {
+        SreProfileSlot slots[kChunkSize];
+    };
+
+    static SreProfileThread &current() {
+        static thread_local SreProfileThread thread;
+        return thread;
+    }
+
+    SreProfileSlot &slot(uint32_t id) {
+        Chunk *chunk = chunks_[id >> kChunkBits].load(std::memory_order_relaxed);
+        if (!chunk) chunk = allocate(id >> kChunkBits);
+        return chunk->slots[id & (kChunkSize - 1)];
+    }
+    // 这一次是否计时：间隔在 [1, 2 * interval) 内随机，平均为 interval
+    // 规则和函数调用交替记录，固定间隔会总是落在同一类上
+    bool sample() {
+        if (--countdown_) return false;
+        countdown_ = nextGap();
+        return true;
+    }
+    // 记录一次 and/or 提前结束，site 为直接决定结果的函数调用点，不是函数调用时为 npos
+    void shortCircuit(uint32_t site) {
+        ++shortCircuits_;
+        if (site != SreProfiler::npos) SreProfileSlot::add(slot(site).shortCircuits);
+    }
+    uint64_t shortCircuits() const { return shortCircuits_; }
+
+    // snapshot 时读取，块不存在返回空
+    const Chunk *chunk(uint32_t index) const { return chunks_[index].load(std::memory_order_acquire); }
+
+    SreProfileThread(const SreProfileThread &) = delete;
+    SreProfileThread &operator=(const SreProfileThread &) = delete;
+
+private:
+    SreProfileThread();
+    ~SreProfileThread();  // 把计数并入已退出线程的汇总
+    Chunk *allocate(uint32_t index);
+    uint32_t nextGap();
+
+    std::atomic<Chunk *> chunks_[kMaxChunks];
+    uint64_t random_;
+    uint32_t countdown_;
+    uint64_t shortCircuits_;
+};
+
+// 一次求值（调用）的计数：构造时开始，finish 时按结果记录；中途抛异常则不记录
+class SreProfileScope {
+public:
+    explicit SreProfileScope(uint32_t id) : id_(id), timed_(false), start_(0), shortCircuits_(0) {
+        if (id_ == SreProfiler::npos) return;
+        SreProfileThread &thread = SreProfileThread::current();
+        shortCircuits_ = thread.shortCircuits();
+        timed_ = thread.sample();
+        if (timed_) start_ = sreProfileTicks();
+    }
+
+    bool finish(bool result) {
+        if (id_ == SreProfiler::npos) return result;
+        uint64_t end = timed_ ? sreProfileTicks() : 0;
+        SreProfileThread &thread = SreProfileThread::current();
+        SreProfileSlot &slot = thread.slot(id_);
+        SreProfileSlot::add(slot.evaluations);
+        SreProfileSlot::add(result ? slot.trueCount : slot.falseCount);
+        // 规则求值期间发生的短路；函数调用内部不会有短路
+        if (thread.shortCircuits() != shortCircuits_) {
+            SreProfileSlot::add(slot.shortCircuits, thread.shortCircuits() - shortCircuits_);
+        }
+        if (timed_) {
+            SreProfileSlot::add(slot.sampled);
+            SreProfileSlot::add(slot.ticks, end - start_);
+        }
+        return result;
+    }
+
+private:
+    uint32_t id_;
+    bool timed_;
+    uint64_t start_;
+    uint64_t shortCircuits_;
+};
+#endif // SRE_PROFILING
+
+#endif // SRE_PROFILE_H
@@ -0,0 +1,46 @@
+#include "SreRcu.h"
+#include <thread>
+
+// 线程使用的计数器下标，第一次进入临界区时轮流分配，所有域共用
+static size_t sreReaderSlot(size_t slots) {
+    static std::atomic<size_t> next{0};
+    thread_local size_t slot = next.fetch_add(1);
+    return slot % slots;
+}
+
+SreRcu::SreRcu() : phase_(0) {
+    for (Slot &slot : slots_) {
+        slot.readers[0].store(0);
+        slot.readers[1].store(0);
+    }
+}
+
+SreRcu::ReadGuard::ReadGuard(SreRcu &rcu) {
+    Slot &slot = rcu.slots_[sreReaderSlot(kSlots)];
+    counter_ = &slot.readers[rcu.phase_.load() & 1];
+    counter_->fetch_add(1);
+}
+
+SreRcu::ReadGuard::~ReadGuard() {
+    counter_->fetch_sub(1);
+}
+
+void SreRcu::synchronize() {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    unsigned phase = phase_.load();
+    // 先等待读到上一个阶段后才计数、还未离开的读者，再切换阶段等待当前阶段的读者；
+    // 计数之后才读取指针，写者没有看到计数的读者只会读到新版本。
+    // 切换之后进入的读者计入另一个计数器，持续进入的读者不会让等待无限延长
+    wait(phase + 1);
+    phase_.store(phase + 1);
+    wait(phase);
+}
+
+void SreRcu::wait(unsigned phase) const {
+    for (;;) {
+        int64_t readers = 0;
+        for (const Slot &slot : slots_) readers += slot.readers[phase & 1].load();
+        if (readers == 0) return;
+        std::this_thread::yield();
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef SRE_RCU_H
+#define SRE_RCU_H
+
+// 内部头文件：读-拷贝-更新（RCU）
+// 每个引擎和每个规则集各有一个 SreRcu 域，写者只等待同一个域的读者，与其它域、其它线程的注册无关；
+// 读者进入和离开时各对一个计数器做一次原子加减，不加锁、不等待；计数器按线程分散到多个缓存行，读者之间不争用
+// 写者用原子指针发布新版本，然后调用 synchronize 等待所有可能还在读旧版本的读者离开，再释放旧版本
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+class SreRcu {
+public:
+    // 读临界区，可以嵌套；临界区内读到的指针在离开之前一直有效
+    class ReadGuard {
+    public:
+        explicit ReadGuard(SreRcu &rcu);
+        ~ReadGuard();
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+
+    private:
+        std::atomic<int64_t> *counter_;
+    };
+
+    SreRcu();
+    SreRcu(const SreRcu &) = delete;
+    SreRcu &operator=(const SreRcu &) = delete;
+
+    // 等待调用之前开始的、本域的所有读临界区结束；多个写者之间自动串行
+    // 不能在本线程持有的本域读临界区内调用，否则会等待自己；其它域的读临界区不受影响
+    void synchronize();
+
+    // 发布新版本并释放旧版本
+    template<typename T>
+    void publish(std::atomic<const T *> &slot, std::unique_ptr<const T> next) {
+        const T *old = slot.exchange(next.release());
+        if (old) {
+            synchronize();
+            delete old;
+        }
+    }
+
+private:
+    static const size_t kSlots = 16;
+
+    // 两个阶段各一个计数器：读者计入进入时所在阶段的计数器
+    struct alignas(64) Slot {
+        std::atomic<int64_t> readers[2];
+    };
+
+    void wait(unsigned phase) const;
+
+    std::atomic<unsigned> phase_;
+    Slot slots_[kSlots];
+    std::mutex writeMutex_;  // 串行化 synchronize
+};
+
+#endif // SRE_RCU_H
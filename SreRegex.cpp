@@ -0,0 +1,639 @@
+#include "SreRegex.h"
+#include "SreSearch.h"
+#include <algorithm>
+#include <cctype>
+#include <memory>
+
+// 上限：避免恶意模式生成过大的自动机
+static const int kMaxRepeat = 1000;
+static const size_t kMaxNfaStates = 100000;
+
+struct SreRegex::Node {
+    enum Type { Empty, Set, Concat, Alt, Repeat, AssertStart, AssertEnd } type;
+    std::bitset<256> set;                     // 仅 Set
+    std::vector<std::unique_ptr<Node>> kids;  // Concat/Alt 的各项，Repeat 的唯一子节点
+    int min = 0;
+    int max = 0;                              // 小于 0 表示无上限
+
+    explicit Node(Type t) : type(t) {}
+};
+
+using SreRegexNode = SreRegex::Node;
+
+static std::unique_ptr<SreRegexNode> sreSetNode(const std::bitset<256> &set) {
+    std::unique_ptr<SreRegexNode> node(new SreRegexNode(SreRegexNode::Set));
+    node->set = set;
+    return node;
+}
+
+static std::unique_ptr<SreRegexNode> sreRepeatNode(std::unique_ptr<SreRegexNode> kid, int min, int max) {
+    std::unique_ptr<SreRegexNode> node(new SreRegexNode(SreRegexNode::Repeat));
+    node->kids.push_back(std::move(kid));
+    node->min = min;
+    node->max = max;
+    return node;
+}
+
+static std::bitset<256> sreByteSet(unsigned char c) {
+    std::bitset<256> set;
+    set.set(c);
+    return set;
+}
+
+static std::bitset<256> sreAnyByte() {
+    std::bitset<256> set;
+    set.set();
+    return set;
+}
+
+// =============================
+// 正则表达式解析器（递归下降）
+// =============================
+class SreRegexParser {
+public:
+    explicit SreRegexParser(std::string_view pattern) : pattern_(pattern), pos_(0) {}
+
+    std::unique_ptr<SreRegexNode> parse() {
+        std::unique_ptr<SreRegexNode> node = parseAlt();
+        if (pos_ != pattern_.size()) fail("unmatched ')'");
+        return node;
+    }
+
+private:
+    [[noreturn]] void fail(const char *message) const {
+        throw std::runtime_error("Invalid regex: " + std::string(message));
+    }
+    bool atEnd() const { return pos_ >= pattern_.size(); }
+    char peek() const { return pattern_[pos_]; }
+
+    std::unique_ptr<SreRegexNode> parseAlt() {
+        std::unique_ptr<SreRegexNode> first = parseConcat();
+        if (atEnd() || peek() != '|') return first;
+        std::unique_ptr<SreRegexNode> alt(new SreRegexNode(SreRegexNode::Alt));
+        alt->kids.push_back(std::move(first));
+        while (!atEnd() && peek() == '|') {
+            pos_++;
+            alt->kids.push_back(parseConcat());
+        }
+        return alt;
+    }
+
+    std::unique_ptr<SreRegexNode> parseConcat() {
+        std::unique_ptr<SreRegexNode> concat(new SreRegexNode(SreRegexNode::Concat));
+        while (!atEnd() && peek() != '|' && peek() != ')') {
+            concat->kids.push_back(parseRepeat());
+        }
+        if (concat->kids.empty()) return std::unique_ptr<SreRegexNode>(new SreRegexNode(SreRegexNode::Empty));
+        if (concat->kids.size() == 1) return std::move(concat->kids[0]);
+        return concat;
+    }
+
+    std::unique_ptr<SreRegexNode> parseRepeat() {
+        char first = peek();
+        std::unique_ptr<SreRegexNode> node = parseAtom();
+        if (first == '^' || first == '$') {
+            // 与 ECMAScript 相同，断言本身不能重复，放在分组里可以
+            if (!atEnd() && std::string_view("*+?{").find(peek()) != std::string_view::npos) fail("nothing to repeat");
+            return node;
+        }
+        while (!atEnd()) {
+            int min, max;
+            char c = peek();
+            if (c == '*') { min = 0; max = -1; pos_++; }
+            else if (c == '+') { min = 1; max = -1; pos_++; }
+            else if (c == '?') { min = 0; max = 1; pos_++; }
+            else if (c == '{') { parseCounts(min, max); }
+            else break;
+            // 非贪婪只影响匹配位置，不影响是否匹配
+            if (!atEnd() && peek() == '?') pos_++;
+            node = sreRepeatNode(std::move(node), min, max);
+        }
+        return node;
+    }
+
+    void parseCounts(int &min, int &max) {
+        pos_++;  // {
+        min = parseNumber();
+        max = min;
+        if (!atEnd() && peek() == ',') {
+            pos_++;
+            max = (!atEnd() && peek() == '}') ? -1 : parseNumber();
+        }
+        if (atEnd() || peek() != '}') fail("bad repeat count");
+        pos_++;
+        if (max >= 0 && max < min) fail("bad repeat count");
+    }
+
+    int parseNumber() {
+        if (atEnd() || !std::isdigit(static_cast<unsigned char>(peek()))) fail("bad repeat count");
+        int value = 0;
+        while (!atEnd() && std::isdigit(static_cast<unsigned char>(peek()))) {
+            value = value * 10 + (peek() - '0');
+            if (value > kMaxRepeat) fail("repeat count too large");
+            pos_++;
+        }
+        return value;
+    }
+
+    std::unique_ptr<SreRegexNode> parseAtom() {
+        char c = peek();
+        switch (c) {
+            case '(': {
+                pos_++;
+                if (pattern_.substr(pos_, 2) == "?:") pos_ += 2;
+                std::unique_ptr<SreRegexNode> node = parseAlt();
+                if (atEnd() || peek() != ')') fail("missing ')'");
+                pos_++;
+                return node;
+            }
+            case '[':
+                pos_++;
+                return sreSetNode(parseClass());
+            case '.': {
+                pos_++;
+                // ECMAScript 的 . 不匹配行结束符
+                std::bitset<256> set = sreAnyByte();
+                set.reset('\n');
+                set.reset('\r');
+                return sreSetNode(set);
+            }
+            case '\\':
+                pos_++;
+                return sreSetNode(parseEscape());
+            case '^':
+                pos_++;
+                return std::unique_ptr<SreRegexNode>(new SreRegexNode(SreRegexNode::AssertStart));
+            case '$':
+                pos_++;
+                return std::unique_ptr<SreRegexNode>(new SreRegexNode(SreRegexNode::AssertEnd));
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                fail("nothing to repeat");
+            default:
+                pos_++;
+                return sreSetNode(sreByteSet(static_cast<unsigned char>(c)));
+        }
+    }
+
+    // 已跳过反斜杠
+    std::bitset<256> parseEscape() {
+        if (atEnd()) fail("trailing backslash");
+        unsigned char c = static_cast<unsigned char>(pattern_[pos_++]);
+        std::bitset<256> set;
+        switch (c) {
+            case 'd': case 'D':
+                for (int b = '0'; b <= '9'; ++b) set.set(b);
+                break;
+            case 'w': case 'W':
+                for (int b = 0; b < 256; ++b) {
+                    if (std::isalnum(b) || b == '_') set.set(b);
+                }
+                break;
+            case 's': case 'S':
+                for (char b : std::string_view(" \t\n\r\f\v")) set.set(static_cast<unsigned char>(b));
+                break;
+            case 'n': return sreByteSet('\n');
+            case 't': return sreByteSet('\t');
+            case 'r': return sreByteSet('\r');
+            case 'f': return sreByteSet('\f');
+            case 'v': return sreByteSet('\v');
+            case 'x': {
+                if (pos_ + 2 > pattern_.size() || !std::isxdigit(static_cast<unsigned char>(pattern_[pos_])) ||
+                    !std::isxdigit(static_cast<unsigned char>(pattern_[pos_ + 1]))) {
+                    fail("bad \\x escape");
+                }
+                int value = std::stoi(std::string(pattern_.substr(pos_, 2)), nullptr, 16);
+                pos_ += 2;
+                return sreByteSet(static_cast<unsigned char>(value));
+            }
+            default:
+                if (std::isalnum(c)) fail("unknown escape");
+                return sreByteSet(c);
+        }
+        return std::isupper(c) ? ~set : set;
+    }
+
+    // 已跳过 [；与 ECMAScript 相同，] 总是结束字符集，[] 为空集，[^] 为任意字节
+    std::bitset<256> parseClass() {
+        std::bitset<256> set;
+        bool negate = !atEnd() && peek() == '^';
+        if (negate) pos_++;
+        for (;;) {
+            if (atEnd()) fail("missing ']'");
+            char c = peek();
+            if (c == ']') break;
+            pos_++;
+            std::bitset<256> item;
+            int low;
+            if (c == '\\') {
+                item = parseEscape();
+                if (item.count() != 1) {
+                    set |= item;
+                    continue;
+                }
+                for (low = 0; !item.test(low); ++low) {}
+            } else {
+                low = static_cast<unsigned char>(c);
+            }
+            int high = low;
+            if (pos_ + 1 < pattern_.size() && peek() == '-' && pattern_[pos_ + 1] != ']') {
+                pos_++;
+                char h = pattern_[pos_++];
+                if (h == '\\') {
+                    std::bitset<256> end = parseEscape();
+                    if (end.count() != 1) fail("bad class range");
+                    for (high = 0; !end.test(high); ++high) {}
+                } else {
+                    high = static_cast<unsigned char>(h);
+                }
+                if (high < low) fail("bad class range");
+            }
+            for (int b = low; b <= high; ++b) set.set(b);
+        }
+        pos_++;  // ]
+        return negate ? ~set : set;
+    }
+
+    std::string_view pattern_;
+    size_t pos_;
+};
+
+// 通配符：整个模式是一串 Set 和 Repeat 节点，前后加上 ^ 和 $ 表示整串匹配
+static std::unique_ptr<SreRegexNode> sreParseGlob(std::string_view pattern) {
+    std::unique_ptr<SreRegexNode> concat(new SreRegexNode(SreRegexNode::Concat));
+    concat->kids.emplace_back(new SreRegexNode(SreRegexNode::AssertStart));
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '*') {
+            // 连续的 * 合并
+            if (!concat->kids.empty() && concat->kids.back()->type == SreRegexNode::Repeat) continue;
+            concat->kids.push_back(sreRepeatNode(sreSetNode(sreAnyByte()), 0, -1));
+        } else if (c == '?') {
+            concat->kids.push_back(sreSetNode(sreAnyByte()));
+        } else if (c == '[') {
+            // 与 POSIX 相同，紧跟在 [ 或 [! 之后的 ] 是普通字符
+            size_t open = i + 1;
+            bool negate = open < pattern.size() && (pattern[open] == '!' || pattern[open] == '^');
+            if (negate) open++;
+            size_t close = pattern.find(']', open + 1);
+            if (close == std::string_view::npos) {
+                throw std::runtime_error("Invalid glob: missing ']'");
+            }
+            std::string_view body = pattern.substr(open, close - open);
+            std::bitset<256> set;
+            for (size_t k = 0; k < body.size(); ++k) {
+                int low = static_cast<unsigned char>(body[k]);
+                int high = low;
+                if (k + 2 < body.size() && body[k + 1] == '-') {
+                    high = static_cast<unsigned char>(body[k + 2]);
+                    k += 2;
+                    if (high < low) throw std::runtime_error("Invalid glob: bad class range");
+                }
+                for (int b = low; b <= high; ++b) set.set(b);
+            }
+            concat->kids.push_back(sreSetNode(negate ? ~set : set));
+            i = close;
+        } else {
+            if (c == '\\') {
+                if (++i == pattern.size()) throw std::runtime_error("Invalid glob: trailing backslash");
+                c = pattern[i];
+            }
+            concat->kids.push_back(sreSetNode(sreByteSet(static_cast<unsigned char>(c))));
+        }
+    }
+    concat->kids.emplace_back(new SreRegexNode(SreRegexNode::AssertEnd));
+    return concat;
+}
+
+// =============================
+// 编译：语法树 -> NFA -> DFA
+// =============================
+std::shared_ptr<const SreRegex> SreRegex::compileRegex(std::string_view pattern) {
+    std::unique_ptr<Node> root = SreRegexParser(pattern).parse();
+    std::shared_ptr<SreRegex> regex = std::make_shared<SreRegex>();
+    regex->build(*root);
+    return regex;
+}
+
+std::shared_ptr<const SreRegex> SreRegex::compileGlob(std::string_view pattern) {
+    std::unique_ptr<Node> root = sreParseGlob(pattern);
+    std::shared_ptr<SreRegex> regex = std::make_shared<SreRegex>();
+    regex->build(*root);
+    return regex;
+}
+
+void SreRegex::build(const Node &root) {
+    nfa_.push_back({ NfaState::Match, 0, 0, 0 });
+    start_ = compileNode(root, 0);
+    buildDfa();
+}
+
+// 从右向左构造：next 为匹配完 node 之后要进入的状态，返回 node 的入口状态
+uint32_t SreRegex::compileNode(const Node &node, uint32_t next) {
+    if (nfa_.size() > kMaxNfaStates) {
+        throw std::runtime_error("Invalid regex: pattern too large");
+    }
+    switch (node.type) {
+        case Node::Empty:
+            return next;
+        case Node::AssertStart:
+            nfa_.push_back({ NfaState::AssertStart, next, 0, 0 });
+            return static_cast<uint32_t>(nfa_.size() - 1);
+        case Node::AssertEnd:
+            nfa_.push_back({ NfaState::AssertEnd, next, 0, 0 });
+            return static_cast<uint32_t>(nfa_.size() - 1);
+        case Node::Set: {
+            auto it = std::find(sets_.begin(), sets_.end(), node.set);
+            uint32_t set = static_cast<uint32_t>(it - sets_.begin());
+            if (it == sets_.end()) sets_.push_back(node.set);
+            nfa_.push_back({ NfaState::Byte, next, 0, set });
+            return static_cast<uint32_t>(nfa_.size() - 1);
+        }
+        case Node::Concat:
+            for (size_t i = node.kids.size(); i-- > 0;) {
+                next = compileNode(*node.kids[i], next);
+            }
+            return next;
+        case Node::Alt: {
+            uint32_t entry = compileNode(*node.kids.back(), next);
+            for (size_t i = node.kids.size() - 1; i-- > 0;) {
+                uint32_t branch = compileNode(*node.kids[i], next);
+                nfa_.push_back({ NfaState::Split, branch, entry, 0 });
+                entry = static_cast<uint32_t>(nfa_.size() - 1);
+            }
+            return entry;
+        }
+        case Node::Repeat: {
+            const Node &kid = *node.kids[0];
+            uint32_t tail = next;
+            if (node.max < 0) {
+                // x*：先建分支状态，再让 x 的出口回到它
+                nfa_.push_back({ NfaState::Split, 0, next, 0 });
+                uint32_t loop = static_cast<uint32_t>(nfa_.size() - 1);
+                uint32_t body = compileNode(kid, loop);
+                nfa_[loop].out = body;
+                tail = loop;
+            } else {
+                // 可选部分 (x(x)?)?，每一层都可以直接跳到 next
+                for (int i = node.min; i < node.max; ++i) {
+                    uint32_t body = compileNode(kid, tail);
+                    nfa_.push_back({ NfaState::Split, body, next, 0 });
+                    tail = static_cast<uint32_t>(nfa_.size() - 1);
+                }
+            }
+            for (int i = 0; i < node.min; ++i) {
+                tail = compileNode(kid, tail);
+            }
+            return tail;
+        }
+    }
+    return next;
+}
+
+void SreRegex::addClosure(Closure &closure, std::vector<uint32_t> &set, uint32_t state, bool atStart) const {
+    std::vector<uint32_t> &stack = closure.stack;
+    stack.push_back(state);
+    while (!stack.empty()) {
+        uint32_t s = stack.back();
+        stack.pop_back();
+        if (closure.mark[s] == closure.generation) continue;
+        closure.mark[s] = closure.generation;
+        switch (nfa_[s].type) {
+            case NfaState::Split:
+                stack.push_back(nfa_[s].out1);
+                stack.push_back(nfa_[s].out);
+                break;
+            case NfaState::AssertStart:
+                if (atStart) stack.push_back(nfa_[s].out);
+                break;
+            default:
+                set.push_back(s);
+                break;
+        }
+    }
+}
+
+bool SreRegex::acceptsAtEnd(Closure &closure, const std::vector<uint32_t> &set, bool atStart) const {
+    closure.reset();
+    std::vector<uint32_t> reached;
+    for (uint32_t s : set) {
+        if (s == 0) return true;
+        if (nfa_[s].type != NfaState::AssertEnd) continue;
+        // 输入已结束，之后的 $ 都成立，Byte 状态不再有用
+        addClosure(closure, reached, nfa_[s].out, atStart);
+        for (size_t i = 0; i < reached.size(); ++i) {
+            uint32_t r = reached[i];
+            if (r == 0) return true;
+            if (nfa_[r].type == NfaState::AssertEnd) addClosure(closure, reached, nfa_[r].out, atStart);
+        }
+        reached.clear();
+    }
+    return false;
+}
+
+void SreRegex::buildDfa() {
+    // 字节等价类：对所有 Byte 状态的集合都不可区分的字节归为一类
+    std::fill(classOf_, classOf_ + 256, 0);
+    classCount_ = 1;
+    for (auto &set : sets_) {
+        std::vector<int> remap(classCount_ * 2, -1);
+        size_t count = 0;
+        for (int b = 0; b < 256; ++b) {
+            int &id = remap[classOf_[b] * 2 + set.test(b)];
+            if (id < 0) id = static_cast<int>(count++);
+            classOf_[b] = static_cast<uint8_t>(id);
+        }
+        classCount_ = count;
+    }
+    std::vector<int> representative(classCount_, -1);
+    for (int b = 0; b < 256; ++b) {
+        if (representative[classOf_[b]] < 0) representative[classOf_[b]] = b;
+    }
+
+    Closure closure(nfa_.size());
+    std::vector<uint32_t> startSet;
+    addClosure(closure, startSet, start_, true);
+    acceptEmpty_ = acceptsAtEnd(closure, startSet, true);
+
+    std::vector<std::vector<uint32_t>> states;
+    std::unordered_map<std::string, uint32_t> index;
+    auto intern = [&](std::vector<uint32_t> &set) -> uint32_t {
+        std::sort(set.begin(), set.end());
+        std::string key(reinterpret_cast<const char *>(set.data()), set.size() * sizeof(uint32_t));
+        auto it = index.find(key);
+        if (it != index.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(states.size());
+        index.emplace(std::move(key), id);
+        accepting_.push_back(std::binary_search(set.begin(), set.end(), 0u));
+        acceptingEnd_.push_back(acceptsAtEnd(closure, set, false));
+        dead_.push_back(set.empty());
+        states.push_back(set);
+        return id;
+    };
+    std::vector<uint32_t> initial = startSet;
+    intern(initial);
+
+    for (size_t s = 0; s < states.size(); ++s) {
+        if (states.size() > kMaxDfaStates) {
+            // 状态过多，放弃 DFA
+            table_.clear();
+            accepting_.clear();
+            acceptingEnd_.clear();
+            dead_.clear();
+            return;
+        }
+        table_.resize(states.size() * classCount_);
+        for (size_t c = 0; c < classCount_; ++c) {
+            int byte = representative[c];
+            closure.reset();
+            std::vector<uint32_t> next;
+            for (uint32_t n : states[s]) {
+                const NfaState &state = nfa_[n];
+                if (state.type == NfaState::Byte && sets_[state.set].test(byte)) {
+                    addClosure(closure, next, state.out, false);
+                }
+            }
+            // 查找：每个位置都可以重新开始匹配，以 ^ 开头的分支在这里不会放行
+            addClosure(closure, next, start_, false);
+            uint32_t target = intern(next);
+            table_[s * classCount_ + c] = target;
+        }
+    }
+    table_.resize(states.size() * classCount_);
+}
+
+bool SreRegex::match(std::string_view text) const {
+    if (accepting_.empty()) return matchNfa(text);
+    // 状态 0 的接受标志按非开头位置计算，空输入单独处理
+    if (text.empty()) return acceptEmpty_;
+    uint32_t s = 0;
+    if (accepting_[s]) return true;
+    const uint32_t *table = table_.data();
+    for (char c : text) {
+        s = table[s * classCount_ + classOf_[static_cast<unsigned char>(c)]];
+        if (accepting_[s]) return true;
+        if (dead_[s]) return false;
+    }
+    return acceptingEnd_[s];
+}
+
+// NFA 模拟：同时跟踪所有可能的状态，时间为 O(输入长度 × 状态数)
+bool SreRegex::matchNfa(std::string_view text) const {
+    Closure closure(nfa_.size());
+    std::vector<uint32_t> current, next;
+    addClosure(closure, current, start_, true);
+    auto accepted = [&](const std::vector<uint32_t> &set) {
+        return std::find(set.begin(), set.end(), 0u) != set.end();
+    };
+    if (accepted(current)) return true;
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        closure.reset();
+        next.clear();
+        for (uint32_t n : current) {
+            const NfaState &state = nfa_[n];
+            if (state.type == NfaState::Byte && sets_[state.set].test(byte)) {
+                addClosure(closure, next, state.out, false);
+            }
+        }
+        addClosure(closure, next, start_, false);
+        current.swap(next);
+        if (accepted(current)) return true;
+        if (current.empty()) return false;
+    }
+    return acceptsAtEnd(closure, current, text.empty());
+}
+
+// =============================
+// 模式缓存
+// =============================
+static bool sreCheckArgs(SreArgs args, const char *name) {
+    if (args.size() != 2) {
+        throw std::runtime_error(std::string(name) + " requires 2 arguments");
+    }
+    return true;
+}
+
+bool sreMatchesUnbound(SreArgs args) {
+    sreCheckArgs(args, "matches");
+    return SreRegex::compileRegex(args[1])->match(args[0]);
+}
+
+bool sreLikeUnbound(SreArgs args) {
+    sreCheckArgs(args, "like");
+    return SreRegex::compileGlob(args[1])->match(args[0]);
+}
+
+static void sreCheckFoldArgs(SreArgs args, SreBuiltin kind) {
+    if (kind == SreBuiltin::IContains && args.size() != 2) {
+        throw std::runtime_error("icontains requires 2 arguments");
+    }
+    if (kind == SreBuiltin::IContainsAny && args.size() < 2) {
+        throw std::runtime_error("icontainsAny requires at least 2 arguments");
+    }
+}
+
+bool sreIContainsUnfolded(SreArgs args) {
+    sreCheckFoldArgs(args, SreBuiltin::IContains);
+    return SreCaseFold::contains(args[0], SreCaseFold::fold(args[1]));
+}
+
+bool sreIContainsAnyUnfolded(SreArgs args) {
+    sreCheckFoldArgs(args, SreBuiltin::IContainsAny);
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (SreCaseFold::contains(args[0], SreCaseFold::fold(args[i]))) return true;
+    }
+    return false;
+}
+
+std::shared_ptr<const SreFunctionEntry> SrePatternCache::folded(SreBuiltin kind) {
+    static const std::shared_ptr<const SreFunctionEntry> icontains = std::make_shared<const SreFunctionEntry>(
+        SreFunctionEntry{ [](SreArgs args) {
+            sreCheckFoldArgs(args, SreBuiltin::IContains);
+            return SreCaseFold::contains(args[0], args[1]);
+        }, SreBuiltin::IContains, true, true });
+    static const std::shared_ptr<const SreFunctionEntry> icontainsAny = std::make_shared<const SreFunctionEntry>(
+        SreFunctionEntry{ [](SreArgs args) {
+            sreCheckFoldArgs(args, SreBuiltin::IContainsAny);
+            return SreCaseFold::containsAny(args[0], args.begin() + 1, args.size() - 1);
+        }, SreBuiltin::IContainsAny, true, true });
+    return kind == SreBuiltin::IContains ? icontains : icontainsAny;
+}
+
+std::shared_ptr<const SreFunctionEntry> SrePatternCache::bind(SreBuiltin kind, std::string_view pattern) {
+    std::string key(1, static_cast<char>(kind));
+    key.append(pattern.data(), pattern.size());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            if (std::shared_ptr<const SreFunctionEntry> entry = it->second.lock()) return entry;
+        }
+    }
+    // 在锁外编译，并发编译同一模式时以先放入缓存的为准
+    const char *name = kind == SreBuiltin::Matches ? "matches" : "like";
+    std::shared_ptr<const SreRegex> regex = kind == SreBuiltin::Matches ? SreRegex::compileRegex(pattern)
+                                                                        : SreRegex::compileGlob(pattern);
+    std::shared_ptr<const SreFunctionEntry> entry = std::make_shared<const SreFunctionEntry>(SreFunctionEntry{
+        [regex, name](SreArgs args) { return sreCheckArgs(args, name) && regex->match(args[0]); }, kind, true });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::weak_ptr<const SreFunctionEntry> &slot = entries_[key];
+    if (std::shared_ptr<const SreFunctionEntry> existing = slot.lock()) return existing;
+    slot = entry;
+    if (entries_.size() >= pruneAt_) {
+        // 清理已经没有规则使用的模式
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            it = it->second.expired() ? entries_.erase(it) : std::next(it);
+        }
+        pruneAt_ = std::max<size_t>(64, entries_.size() * 2);
+    }
+    return entry;
+}
+
+size_t SrePatternCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
@@ -0,0 +1,100 @@
+#ifndef SRE_REGEX_H
+#define SRE_REGEX_H
+
+// 内部头文件：matches/like 使用的模式匹配
+// 模式先编译为 NFA，再用子集构造转换为 DFA，匹配时每个字节只查一次表，时间与输入长度成线性，
+// 不会因为回溯出现指数级耗时；DFA 状态数超过上限时退回 NFA 模拟，仍然是线性时间
+// 按字节匹配，'.' 和字符集都只匹配一个字节
+// ^/$ 是零宽断言，只约束所在的分支：求 epsilon 闭包时 ^ 只在输入开头放行，
+// $ 留在状态集合中，输入结束时再看它之后能否到达接受状态
+#include "SreRuleEngine.h"
+#include <bitset>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class SreRegex {
+public:
+    // 正则表达式，在输入中查找，语义与 std::regex_search（ECMAScript）相同
+    // 支持 . [] [^] \d \w \s \D \W \S \xHH * + ? {m,n} | () (?:) 以及任意位置的 ^ $；语法错误抛异常
+    // 与 ECMAScript 一致：. 不匹配 \n 和 \r；[] 不匹配任何字节，[^] 匹配任意字节，因此 []a] 是空集之后跟 "a]"
+    static std::shared_ptr<const SreRegex> compileRegex(std::string_view pattern);
+    // 通配符，整串匹配，语义与 fnmatch(pattern, text, 0) 相同：* 任意串，? 任意一个字节，
+    // [...] / [!...] 字符集，\ 转义；与 POSIX 一致，紧跟在 [ 或 [! 之后的 ] 是普通字符，例如 []a] 匹配 ] 或 a
+    static std::shared_ptr<const SreRegex> compileGlob(std::string_view pattern);
+
+    bool match(std::string_view text) const;
+
+    // DFA 状态数，0 表示退回了 NFA 模拟
+    size_t dfaStates() const { return accepting_.size(); }
+
+    // 模式的语法树，解析器在 SreRegex.cpp 中
+    struct Node;
+
+private:
+    struct NfaState {
+        // AssertStart/AssertEnd 为 ^/$：不消耗字节，只有在输入开头/结尾才进入 out
+        enum Type : uint8_t { Match, Byte, Split, AssertStart, AssertEnd } type;
+        uint32_t out;
+        uint32_t out1;   // 仅 Split
+        uint32_t set;    // 仅 Byte，sets_ 中的下标
+    };
+    static const size_t kMaxDfaStates = 4096;
+
+    void build(const Node &root);
+    uint32_t compileNode(const Node &node, uint32_t next);
+    void buildDfa();
+    bool matchNfa(std::string_view text) const;
+    // 求 epsilon 闭包时的临时状态：按代数标记已访问的状态，换一个集合时不必清空
+    struct Closure {
+        explicit Closure(size_t states) : mark(states, 0), generation(1) {}
+        void reset() { generation++; }
+        std::vector<uint32_t> mark;
+        uint32_t generation;
+        std::vector<uint32_t> stack;
+    };
+    // 把 state 的 epsilon 闭包中的 Byte/Match/AssertEnd 状态加入 set；atStart 表示位于输入开头
+    void addClosure(Closure &closure, std::vector<uint32_t> &set, uint32_t state, bool atStart) const;
+    // 输入在这里结束时 set 是否接受：含 Match，或某个 AssertEnd 之后不消耗字节就能到达 Match
+    bool acceptsAtEnd(Closure &closure, const std::vector<uint32_t> &set, bool atStart) const;
+
+    std::vector<NfaState> nfa_;
+    std::vector<std::bitset<256>> sets_;  // Byte 状态接受的字节
+    uint32_t start_ = 0;
+
+    uint8_t classOf_[256];              // 字节 -> 等价类
+    size_t classCount_ = 0;
+    std::vector<uint32_t> table_;       // DFA 转移表，state * classCount_ + class
+    std::vector<uint8_t> accepting_;    // 已到达 Match，后面的输入不影响结果
+    std::vector<uint8_t> acceptingEnd_; // 输入在这里结束时接受
+    std::vector<uint8_t> dead_;         // 无法再到达接受状态
+    bool acceptEmpty_ = false;          // 是否匹配空输入
+};
+
+// 模式缓存：同一个模式只编译一次，多条规则共用同一个函数项（规则集据此把相同的调用合并）
+// 缓存只持有弱引用，不再被任何规则使用的模式随规则一起释放
+class SrePatternCache {
+public:
+    // 返回已绑定模式的函数项，语法错误抛异常
+    std::shared_ptr<const SreFunctionEntry> bind(SreBuiltin kind, std::string_view pattern);
+    // icontains/icontainsAny 的字面量在编译期折叠之后使用的函数项，所有规则共用
+    static std::shared_ptr<const SreFunctionEntry> folded(SreBuiltin kind);
+    size_t size() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::weak_ptr<const SreFunctionEntry>> entries_;
+    size_t pruneAt_ = 64;
+};
+
+// 未绑定模式时使用的函数：每次调用都编译模式
+bool sreMatchesUnbound(SreArgs args);
+bool sreLikeUnbound(SreArgs args);
+// 字面量不是常量时使用的 icontains/icontainsAny：每次调用都折叠字面量
+bool sreIContainsUnfolded(SreArgs args);
+bool sreIContainsAnyUnfolded(SreArgs args);
+
+#endif // SRE_REGEX_H
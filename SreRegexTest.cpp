@@ -0,0 +1,135 @@
+// 模式匹配的差分测试：随机生成正则表达式和通配符，
+// 正则表达式以 std::regex_search（ECMAScript）为参照，通配符以 fnmatch(pattern, text, 0) 为参照；
+// 覆盖任意位置的 ^/$、分支、分组、重复、字符集（含 []a]、[^]a]）以及 \r \n 等行结束符
+// 用法：sre_regex_test [种子]；返回值非 0 表示失败
+#include "SreRegex.h"
+#include "SreTest.h"
+#include <cstdlib>
+#include <fnmatch.h>
+#include <random>
+#include <regex>
+
+namespace {
+
+std::string sreRegexAlt(std::mt19937 &rng, int depth);
+
+std::string sreRegexAtom(std::mt19937 &rng, int depth) {
+    static const char *atoms[] = { "a", "b", "c", ".", "\r", "\n", "\\r", "\\n", "[ab]", "[^a]", "[a-c]", "[]a]",
+                                   "[^]a]", "[^]", "\\d", "\\w", "\\s", "\\W", "\\x61", "\\.", "\\]", "]" };
+    static const char *repeats[] = { "*", "+", "?", "{2}", "{1,2}", "{0,}", "*?", "+?" };
+    std::string atom;
+    switch (rng() % (depth > 2 ? 8 : 10)) {
+        case 0: return "^";  // 断言不能重复
+        case 1: return "$";
+        case 8: atom = "(" + sreRegexAlt(rng, depth + 1) + ")"; break;
+        case 9: atom = "(?:" + sreRegexAlt(rng, depth + 1) + ")"; break;
+        default: atom = atoms[rng() % 22]; break;
+    }
+    if (rng() % 4 == 0) atom += repeats[rng() % 8];
+    return atom;
+}
+
+std::string sreRegexAlt(std::mt19937 &rng, int depth) {
+    std::string pattern;
+    for (int n = 1 + rng() % (depth ? 2 : 3); n; --n) {
+        if (!pattern.empty()) pattern += "|";
+        for (int k = rng() % 4; k; --k) pattern += sreRegexAtom(rng, depth);
+    }
+    return pattern;
+}
+
+std::string sreGlob(std::mt19937 &rng) {
+    static const char *tokens[] = { "a", "b", "*", "?", "[ab]", "[!a]", "[^a]", "[]a]", "[!]a]", "[a-c]",
+                                    "\\*", "\\a", "\\?", "]", "!" };
+    std::string pattern;
+    for (int n = rng() % 6; n; --n) pattern += tokens[rng() % 15];
+    return pattern;
+}
+
+std::string sreText(std::mt19937 &rng, const char *alphabet, size_t size) {
+    std::string text;
+    for (int n = rng() % 8; n; --n) text += alphabet[rng() % size];
+    return text;
+}
+
+// 0/1 为结果，2 为编译时抛异常
+int sreOurRegex(const std::string &pattern, const std::string &text) {
+    try {
+        return SreRegex::compileRegex(pattern)->match(text) ? 1 : 0;
+    } catch (const std::exception &) {
+        return 2;
+    }
+}
+
+int sreStdRegex(const std::string &pattern, const std::string &text) {
+    try {
+        return std::regex_search(text, std::regex(pattern)) ? 1 : 0;
+    } catch (const std::exception &) {
+        return 2;
+    }
+}
+
+std::string sreShow(const std::string &pattern, const std::string &text) {
+    std::string shown = "/" + pattern + "/ on \"" + text + "\"";
+    for (char &c : shown) {
+        if (c == '\r') c = 'R';
+        if (c == '\n') c = 'N';
+    }
+    return shown;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 17;
+    std::mt19937 rng(seed);
+
+    // 每个分支只受自己的锚点约束
+    const char *cases[][2] = { { "foo|bar$", "foox" }, { "^foo|bar", "xbar" }, { "^a|b$", "xb" }, { "^a|b$", "ax" },
+                               { "^a|b$", "xa" }, { "^a|b$", "bx" }, { "(a|^)b", "b" }, { "(a|^)b", "xb" },
+                               { "a$|", "x" }, { "$^", "" }, { "a$b", "ab" }, { "(?:a$)*b", "b" }, { ".", "\r" },
+                               { "[]a]", "a]" }, { "[^]a]", "xa]" }, { "[^]", "\n" } };
+    for (auto &c : cases) {
+        SRE_CHECK(sreOurRegex(c[0], c[1]) == sreStdRegex(c[0], c[1]), sreShow(c[0], c[1]));
+    }
+    SRE_CHECK(sreOurRegex("foo|bar$", "foox") == 1, "foo|bar$ on foox");
+    SRE_CHECK(sreOurRegex("^*", "a") == 2, "^* should not compile");
+
+    size_t regexPairs = 0;
+    for (int p = 0; p < 3000; ++p) {
+        std::string pattern = sreRegexAlt(rng, 0);
+        std::regex reference;
+        bool compiles = true;
+        try {
+            reference = std::regex(pattern);
+        } catch (const std::exception &) {
+            compiles = false;
+        }
+        std::shared_ptr<const SreRegex> regex;
+        try {
+            regex = SreRegex::compileRegex(pattern);
+        } catch (const std::exception &) {
+        }
+        SRE_CHECK(compiles == (regex != nullptr), "compiles: /" + pattern + "/");
+        if (!compiles || !regex) continue;
+        for (int t = 0; t < 50; ++t) {
+            std::string text = sreText(rng, "abc\r\n]1_", 8);
+            SRE_CHECK(regex->match(text) == std::regex_search(text, reference), sreShow(pattern, text));
+            ++regexPairs;
+        }
+    }
+
+    size_t globPairs = 0;
+    for (int p = 0; p < 3000; ++p) {
+        std::string pattern = sreGlob(rng);
+        std::shared_ptr<const SreRegex> glob = SreRegex::compileGlob(pattern);
+        for (int t = 0; t < 50; ++t) {
+            std::string text = sreText(rng, "abc*]!?", 7);
+            SRE_CHECK(glob->match(text) == (fnmatch(pattern.c_str(), text.c_str(), 0) == 0), "glob " + sreShow(pattern, text));
+            ++globPairs;
+        }
+    }
+
+    std::cout << regexPairs << " regex pairs, " << globPairs << " glob pairs, seed " << seed << "\n";
+    return sreTestResult("regex test");
+}
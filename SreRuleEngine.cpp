@@ -1,307 +1,422 @@
 #include "SreRuleEngine.h"
+#include "SreAST.h"
+#include "SreBytecode.h"
+#include "SreOptimizer.h"
+#include "SreVectorized.h"
+#include "SreSearch.h"
+#include "SreRcu.h"
+#include "SreRegex.h"
+#include <charconv>
 #include <sstream>
 #include <cctype>
 #include <algorithm>
 #include <iostream>
 
-// 如果使用 C++11 没有 std::make_unique，可以自己实现一个简单版本
-template<typename T, typename... Args>
-std::unique_ptr<T> sre_make_unique(Args&&... args) {
-    return std::unique_ptr<T>(new T(std::forward<Args>(args)...));
-}
-
 // =============================
-// 词法分析相关
+// SreRuleEngine 成员函数实现
 // =============================
-enum class SreTokenType {
-    Identifier,     // 标识符（函数名或变量）
-    StringLiteral,  // 字符串常量（单引号括起来的）
-    Comma,
-    LParen,
-    RParen,
-    And,
-    Or,
-    Not,
-    End
-};
-
-struct SreToken {
-    SreTokenType type;
-    std::string text;
-};
-
-class SreLexer {
-public:
-    SreLexer(const std::string &input) : input_(input), pos_(0) {}
-
-    SreToken nextToken() {
-        skipWhitespace();
-        if (pos_ >= input_.size()) return { SreTokenType::End, "" };
-
-        char c = input_[pos_];
-        if (std::isalpha(c) || c=='#' || c=='{' || c=='}') {
-            std::string s;
-            while (pos_ < input_.size() && (std::isalnum(input_[pos_]) || input_[pos_]=='#' || input_[pos_]=='{' || input_[pos_]=='}')) {
-                s.push_back(input_[pos_++]);
-            }
-            std::string lower = s;
-            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-            if(lower=="and") return { SreTokenType::And, s };
-            if(lower=="or")  return { SreTokenType::Or, s };
-            if(lower=="not") return { SreTokenType::Not, s };
-            return { SreTokenType::Identifier, s };
-        } else if (c=='\'') {
-            pos_++; // 跳过开头的 '
-            std::string s;
-            while (pos_ < input_.size() && input_[pos_] != '\'') {
-                s.push_back(input_[pos_++]);
-            }
-            pos_++; // 跳过结尾的 '
-            return { SreTokenType::StringLiteral, s };
-        } else if(c==',') {
-            pos_++;
-            return { SreTokenType::Comma, "," };
-        } else if(c=='(') {
-            pos_++;
-            return { SreTokenType::LParen, "(" };
-        } else if(c==')') {
-            pos_++;
-            return { SreTokenType::RParen, ")" };
-        } else {
-            throw std::runtime_error("Unexpected character: " + std::string(1, c));
+SreRuleEngine::SreRuleEngine()
+    : functions_(new SreFunctionTable()), rcu_(sre_make_unique<SreRcu>()), backend_(SreBackend::Tree), patterns_(new SrePatternCache()), cacheCapacity_(1024), cacheHits_(0), cacheMisses_(0), cacheGeneration_(0) {
+    initBuiltInFunctions();
+}
+
+SreRuleEngine::~SreRuleEngine() {
+    delete functions_.load();
+}
+
+void SreRuleEngine::registerFunction(const std::string &name, SreFunction func, bool pure) {
+    // 适配旧签名：把视图拷贝为字符串后再调用
+    registerFunction(name, SreViewFunction([func](SreArgs args) -> bool {
+        std::vector<std::string> copied(args.begin(), args.end());
+        return func(copied);
+    }), pure);
+}
+
+void SreRuleEngine::registerFunction(const std::string &name, SreViewFunction func, bool pure) {
+    registerEntry(name, std::move(func), SreBuiltin::None, pure);
+}
+
+void SreRuleEngine::registerEntry(const std::string &name, SreViewFunction func, SreBuiltin builtin, bool pure) {
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    std::unique_ptr<SreFunctionTable> next = sre_make_unique<SreFunctionTable>(*functions_.load());
+    (*next)[lower] = std::make_shared<const SreFunctionEntry>(SreFunctionEntry{ std::move(func), builtin, pure });
+    rcu_->publish(functions_, std::unique_ptr<const SreFunctionTable>(std::move(next)));
+    // 已编译的规则保留旧的绑定；缓存的编译结果作废，字符串求值会使用新函数
+    clearCache();
+}
+
+void SreRuleEngine::initBuiltInFunctions() {
+    // 内置函数 contains(#{var}, 'substring')
+    registerEntry("contains", [](SreArgs args) -> bool {
+        if (args.size() != 2) throw std::runtime_error("contains requires 2 arguments");
+        return SreStringSearch::contains(args[0], args[1]);
+    }, SreBuiltin::Contains, true);
+    // 内置函数 containsAny(#{var}, 's1', 's2', ...)
+    registerEntry("containsany", [](SreArgs args) -> bool {
+        if (args.size() < 2) throw std::runtime_error("containsAny requires at least 2 arguments");
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (SreStringSearch::contains(args[0], args[i])) return true;
+        }
+        return false;
+    }, SreBuiltin::ContainsAny, true);
+    // 内置函数 matches(#{var}, 'regex')：正则查找，模式为常量时在编译期编译
+    registerEntry("matches", sreMatchesUnbound, SreBuiltin::Matches, true);
+    // 内置函数 like(#{var}, 'foo*bar')：通配符整串匹配
+    registerEntry("like", sreLikeUnbound, SreBuiltin::Like, true);
+    // 内置函数 icontains/icontainsAny：忽略大小写的 contains/containsAny，字面量为常量时在编译期折叠
+    registerEntry("icontains", sreIContainsUnfolded, SreBuiltin::IContains, true);
+    registerEntry("icontainsany", sreIContainsAnyUnfolded, SreBuiltin::IContainsAny, true);
+}
+
+SreCompiledRule::SreCompiledRule(const std::string &expression, std::shared_ptr<const SreASTNode> root, bool hasSchema)
+    : expression_(expression), root_(std::move(root)), hasSchema_(hasSchema) {}
+
+#if SRE_PROFILING
+// 调用的文本：变量写作 #{name}，常量加单引号
+static std::string sreCallText(const SreFunctionNode &func) {
+    std::string text(func.name());
+    text += "(";
+    for (size_t i = 0; i < func.args().size(); ++i) {
+        if (i) text += ", ";
+        if (func.args()[i]->kind() != SreNodeKind::Value) {
+            text += "...";
+            continue;
         }
+        const SreValueNode &value = static_cast<const SreValueNode &>(*func.args()[i]);
+        text += value.isVariable() ? "#{" + value.name() + "}" : "'" + std::string(value.value()) + "'";
     }
-private:
-    void skipWhitespace() {
-        while(pos_ < input_.size() && std::isspace(input_[pos_])) pos_++;
+    return text + ")";
+}
+
+// 给函数调用登记调用点；seen 记录每个调用文本已经出现的次数，重新编译同一表达式时得到相同的调用点
+static void sreProfileSites(const SreASTNode &node, uint32_t rule, std::unordered_map<std::string, uint32_t> &seen) {
+    switch (node.kind()) {
+        case SreNodeKind::Logical:
+            for (auto operand : static_cast<const SreLogicalNode &>(node).operands()) {
+                sreProfileSites(*operand, rule, seen);
+            }
+            return;
+        case SreNodeKind::Function: {
+            const SreFunctionNode &func = static_cast<const SreFunctionNode &>(node);
+            std::string call = sreCallText(func);
+            uint32_t occurrence = seen[call]++;
+            func.setProfileSite(SreProfiler::registerSite(rule, std::string(func.name()), call, occurrence));
+            return;
+        }
+        case SreNodeKind::Value:
+        case SreNodeKind::Compare:
+            return;
     }
-    std::string input_;
-    size_t pos_;
-};
+}
+#endif
 
-// =============================
-// AST节点及求值接口
-// 我们采用两种求值接口：evalString() 和 evalBool()
-// 如果节点本质上是字符串型（如变量、常量），evalString() 返回实际字符串；若需要布尔值，则对字符串非空判 true
-// 对于逻辑操作节点和函数节点，evalBool() 返回布尔值
-// 如果不适用的接口调用将抛异常
-// =============================
-class SreASTNode {
-public:
-    virtual ~SreASTNode() {}
-    // 返回布尔值，适用于逻辑表达式
-    virtual bool evalBool(const SreContext &ctx, const std::unordered_map<std::string, SreFunction> &functions) {
-        throw std::runtime_error("Not a boolean expression node");
+SreValue::SreValue(double value) : type_(Type::Double), int_(0), double_(value) {
+    char buf[32];
+    std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), value);
+    text_.assign(buf, r.ptr);
+}
+
+size_t SreSchema::intern(const std::string &name) {
+    auto it = index_.find(name);
+    if (it != index_.end()) return it->second;
+    names_.push_back(name);
+    index_[name] = names_.size() - 1;
+    return names_.size() - 1;
+}
+
+size_t SreSchema::indexOf(const std::string &name) const {
+    auto it = index_.find(name);
+    return it == index_.end() ? npos : it->second;
+}
+
+SreLazyContext::Entry &SreLazyContext::entry(const std::string &name) {
+    auto it = index_.find(name);
+    if (it != index_.end()) return entries_[it->second];
+    index_[name] = entries_.size();
+    entries_.emplace_back();
+    return entries_.back();
+}
+
+void SreLazyContext::set(const std::string &name, std::string value) {
+    Entry &e = entry(name);
+    e.value = std::move(value);
+    e.resolve = nullptr;
+}
+
+void SreLazyContext::define(const std::string &name, Resolver resolver) {
+    Entry &e = entry(name);
+    e.value.clear();
+    e.resolve = std::move(resolver);
+}
+
+SreCompiledRule SreRuleEngine::compileWith(const std::string &expression, SreSchema *schema) const {
+    // 语法树整体分配在内存池中，编译结果通过 shared_ptr 的别名构造持有内存池
+    std::shared_ptr<SreArena> arena = std::make_shared<SreArena>();
+    SreASTNodePtr root;
+    size_t memoSize;
+    {
+        // 内存池持有绑定的函数项，离开读临界区后函数表被替换也不影响已绑定的函数
+        SreRcu::ReadGuard guard(*rcu_);
+        SreLexer lexer(expression);
+        SreParser parser(lexer, *functions_.load(), *arena, schema, patterns_.get());
+        root = SreOptimizer(*arena).optimize(parser.parseExpression());
+        memoSize = parser.memoCount();
     }
-    // 返回字符串，适用于变量和字面量
-    virtual std::string evalString(const SreContext &ctx, const std::unordered_map<std::string, SreFunction> &functions) {
-        throw std::runtime_error("Not a string expression node");
+    SreCompiledRule rule(expression, std::shared_ptr<const SreASTNode>(arena, root), schema != nullptr);
+    rule.memoSize_ = memoSize;
+#if SRE_PROFILING
+    rule.profileId_ = SreProfiler::registerRule(expression);
+    std::unordered_map<std::string, uint32_t> seen;
+    sreProfileSites(*rule.root_, rule.profileId_, seen);
+#endif
+    SreBackend backend = backend_.load();
+    if (backend == SreBackend::Bytecode) {
+        rule.program_ = SreProgram::lower(*rule.root_);
     }
-};
-
-using SreASTNodePtr = std::unique_ptr<SreASTNode>;
-
-// 逻辑节点（and, or, not），其子节点均要求为 boolean 表达式
-class SreLogicalNode : public SreASTNode {
-public:
-    enum Operator { And, Or, Not };
-    SreLogicalNode(Operator op, SreASTNodePtr left, SreASTNodePtr right = nullptr)
-        : op_(op), left_(std::move(left)), right_(std::move(right)) {}
-
-    bool evalBool(const SreContext &ctx, const std::unordered_map<std::string, SreFunction> &functions) override {
-        switch(op_) {
-            case And:
-                return left_->evalBool(ctx, functions) && right_->evalBool(ctx, functions);
-            case Or:
-                return left_->evalBool(ctx, functions) || right_->evalBool(ctx, functions);
-            case Not:
-                return !left_->evalBool(ctx, functions);
-        }
-        throw std::runtime_error("Invalid logical operator");
+    return rule;
+}
+
+SreCompiledRule SreRuleEngine::compile(const std::string &expression) const {
+    return compileWith(expression, nullptr);
+}
+
+SreCompiledRule SreRuleEngine::compile(const std::string &expression, SreSchema &schema) const {
+    return compileWith(expression, &schema);
+}
+
+bool SreRuleEngine::evaluate(const std::string &expression, const SreContext &ctx) {
+    return evaluate(compileCached(expression), ctx);
+}
+
+bool SreRuleEngine::evaluate(const SreCompiledRule &rule, const SreContext &ctx) const {
+    if (!rule.valid()) {
+        throw std::runtime_error("Rule is not compiled");
     }
-private:
-    Operator op_;
-    SreASTNodePtr left_;
-    SreASTNodePtr right_;
-};
-
-// 变量或字符串常量节点：对于变量节点，返回上下文中对应的值；对于字符串常量节点，返回自身值
-class SreValueNode : public SreASTNode {
-public:
-    // isVariable 表示是否为变量引用
-    SreValueNode(const std::string &val, bool isVariable) : val_(val), isVariable_(isVariable) {}
-
-    std::string evalString(const SreContext &ctx, const std::unordered_map<std::string, SreFunction> &/*functions*/) override {
-        if (isVariable_) {
-            auto it = ctx.find(val_);
-            if (it == ctx.end()) {
-                throw std::runtime_error("Variable not found: " + val_);
-            }
-            return it->second;
-        } else {
-            return val_;
-        }
+    // 顶层表达式应返回 boolean
+    SreScalarMemo memo(rule.memoSize_);
+    SreEvalContext evalCtx = { &ctx, nullptr, nullptr, memo.data(), memo.size() };
+    return run(rule, evalCtx);
+}
+
+bool SreRuleEngine::evaluate(const SreCompiledRule &rule, const SreSlotContext &ctx) const {
+    if (!rule.valid()) {
+        throw std::runtime_error("Rule is not compiled");
     }
-    // 如果要求布尔值，则返回非空判断
-    bool evalBool(const SreContext &ctx, const std::unordered_map<std::string, SreFunction> &functions) override {
-        std::string s = evalString(ctx, functions);
-        // 可根据需要调整，这里简单认为非空字符串为 true
-        return !s.empty();
+    if (!rule.hasSchema()) {
+        throw std::runtime_error("Rule is not compiled with a schema");
     }
-private:
-    std::string val_;
-    bool isVariable_;
-};
-
-// 函数调用节点，函数调用用于返回布尔值（例如 contains）
-class SreFunctionNode : public SreASTNode {
-public:
-    SreFunctionNode(const std::string &name, std::vector<SreASTNodePtr> args)
-        : name_(name), args_(std::move(args)) {}
-
-    bool evalBool(const SreContext &ctx, const std::unordered_map<std::string, SreFunction> &functions) override {
-        std::vector<std::string> evaluatedArgs;
-        for (auto &arg : args_) {
-            // 对于函数调用参数，我们认为调用 evalString 得到实际值
-            evaluatedArgs.push_back(arg->evalString(ctx, functions));
-        }
-        std::string lower = name_;
-        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-        auto it = functions.find(lower);
-        if (it == functions.end()) {
-            throw std::runtime_error("Function not found: " + name_);
-        }
-        return it->second(evaluatedArgs);
+    SreScalarMemo memo(rule.memoSize_);
+    SreEvalContext evalCtx = { nullptr, &ctx, nullptr, memo.data(), memo.size() };
+    return run(rule, evalCtx);
+}
+
+bool SreRuleEngine::evaluate(const SreCompiledRule &rule, const SreTypedContext &ctx) const {
+    if (!rule.valid()) {
+        throw std::runtime_error("Rule is not compiled");
     }
-private:
-    std::string name_;
-    std::vector<SreASTNodePtr> args_;
-};
+    SreScalarMemo memo(rule.memoSize_);
+    SreEvalContext evalCtx = { nullptr, nullptr, &ctx, memo.data(), memo.size() };
+    return run(rule, evalCtx);
+}
 
-// =============================
-// 解析器（递归下降解析器）
-// =============================
-class SreParser {
-public:
-    SreParser(SreLexer &lexer) : lexer_(lexer) {
-        currentToken_ = lexer_.nextToken();
+bool SreRuleEngine::evaluate(const SreCompiledRule &rule, const SreLazyContext &ctx) const {
+    if (!rule.valid()) {
+        throw std::runtime_error("Rule is not compiled");
     }
-    // 解析顶级表达式，返回一个 AST 节点，该表达式应为 boolean 表达式
-    SreASTNodePtr parseExpression() {
-        return parseOr();
+    SreScalarMemo memo(rule.memoSize_);
+    SreLazyMemo lazy(ctx);
+    SreEvalContext evalCtx = { nullptr, nullptr, nullptr, memo.data(), memo.size() };
+    evalCtx.lazy = &lazy;
+    return run(rule, evalCtx);
+}
+
+bool SreRuleEngine::run(const SreCompiledRule &rule, const SreEvalContext &ctx) const {
+#if SRE_PROFILING
+    SreProfileScope scope(rule.profileId_);
+    return scope.finish(dispatch(rule, ctx));
+#else
+    return dispatch(rule, ctx);
+#endif
+}
+
+bool SreRuleEngine::dispatch(const SreCompiledRule &rule, const SreEvalContext &ctx) {
+    if (rule.program_) return rule.program_->run(ctx);
+    return rule.root_->evalBool(ctx);
+}
+
+SreOutcome SreRuleEngine::tryEvaluate(const SreCompiledRule &rule, const SreContext &ctx, SreMissing missing) const noexcept {
+    SreEvalContext evalCtx = { &ctx, nullptr };
+    return tryRun(rule, evalCtx, missing);
+}
+
+SreOutcome SreRuleEngine::tryEvaluate(const SreCompiledRule &rule, const SreSlotContext &ctx, SreMissing missing) const noexcept {
+    if (!rule.hasSchema()) {
+        return { SreResult::Error, SreError::InvalidRule, std::string_view() };
     }
-private:
-    SreASTNodePtr parseOr() {
-        SreASTNodePtr node = parseAnd();
-        while (currentToken_.type == SreTokenType::Or) {
-            consume(SreTokenType::Or);
-            SreASTNodePtr right = parseAnd();
-            node = sre_make_unique<SreLogicalNode>(SreLogicalNode::Or, std::move(node), std::move(right));
-        }
-        return node;
+    SreEvalContext evalCtx = { nullptr, &ctx };
+    return tryRun(rule, evalCtx, missing);
+}
+
+SreOutcome SreRuleEngine::tryEvaluate(const SreCompiledRule &rule, const SreTypedContext &ctx, SreMissing missing) const noexcept {
+    SreEvalContext evalCtx = { nullptr, nullptr, &ctx };
+    return tryRun(rule, evalCtx, missing);
+}
+
+SreOutcome SreRuleEngine::tryEvaluate(const SreCompiledRule &rule, const SreLazyContext &ctx, SreMissing missing) const noexcept {
+    SreLazyMemo lazy(ctx);
+    SreEvalContext evalCtx = { nullptr, nullptr };
+    evalCtx.lazy = &lazy;
+    return tryRun(rule, evalCtx, missing);
+}
+
+SreOutcome SreRuleEngine::tryRun(const SreCompiledRule &rule, SreEvalContext &ctx, SreMissing missing) const noexcept {
+    if (!rule.valid()) {
+        return { SreResult::Error, SreError::InvalidRule, std::string_view() };
     }
-    SreASTNodePtr parseAnd() {
-        SreASTNodePtr node = parseNot();
-        while (currentToken_.type == SreTokenType::And) {
-            consume(SreTokenType::And);
-            SreASTNodePtr right = parseNot();
-            node = sre_make_unique<SreLogicalNode>(SreLogicalNode::And, std::move(node), std::move(right));
+    SreEvalStatus status(missing);
+    ctx.status = &status;
+    try {
+        SreScalarMemo memo(rule.memoSize_);
+        ctx.memo = memo.data();
+        ctx.memoSize = memo.size();
+        bool result = run(rule, ctx);
+        if (status.error != SreError::None) {
+            return { SreResult::Error, status.error, status.variable };
         }
-        return node;
+        return { result ? SreResult::True : SreResult::False, SreError::None, status.variable };
+    } catch (...) {
+        // 只可能来自函数本身（或内存不足）
+        return { SreResult::Error, SreError::FunctionFailed, status.variable };
     }
-    SreASTNodePtr parseNot() {
-        if (currentToken_.type == SreTokenType::Not) {
-            consume(SreTokenType::Not);
-            SreASTNodePtr operand = parsePrimary();
-            return sre_make_unique<SreLogicalNode>(SreLogicalNode::Not, std::move(operand));
-        }
-        return parsePrimary();
+}
+
+void SreRuleEngine::evaluate(const SreCompiledRule &rule, const SreBatch &batch, std::vector<bool> &matched,
+                             SreMissing missing) const {
+    if (!rule.valid()) {
+        throw std::runtime_error("Rule is not compiled");
     }
-    SreASTNodePtr parsePrimary() {
-        if (currentToken_.type == SreTokenType::LParen) {
-            consume(SreTokenType::LParen);
-            SreASTNodePtr node = parseExpression();
-            consume(SreTokenType::RParen);
-            return node;
-        } else if (currentToken_.type == SreTokenType::Identifier) {
-            std::string name = currentToken_.text;
-            consume(SreTokenType::Identifier);
-            if (currentToken_.type == SreTokenType::LParen) {
-                // 函数调用
-                consume(SreTokenType::LParen);
-                std::vector<SreASTNodePtr> args;
-                if (currentToken_.type != SreTokenType::RParen) {
-                    args.push_back(parseExpression());
-                    while (currentToken_.type == SreTokenType::Comma) {
-                        consume(SreTokenType::Comma);
-                        args.push_back(parseExpression());
-                    }
-                }
-                consume(SreTokenType::RParen);
-                return sre_make_unique<SreFunctionNode>(name, std::move(args));
-            } else {
-                // 变量引用，例如 #{a}，这里如果包含 '#' 或 '{' 则视为变量
-                bool isVar = (name.find('#') != std::string::npos);
-                std::string varName = name;
-                // 去掉特殊符号
-                varName.erase(std::remove(varName.begin(), varName.end(), '#'), varName.end());
-                varName.erase(std::remove(varName.begin(), varName.end(), '{'), varName.end());
-                varName.erase(std::remove(varName.begin(), varName.end(), '}'), varName.end());
-                return sre_make_unique<SreValueNode>(varName, isVar);
-            }
-        } else if (currentToken_.type == SreTokenType::StringLiteral) {
-            std::string s = currentToken_.text;
-            consume(SreTokenType::StringLiteral);
-            return sre_make_unique<SreValueNode>(s, false);
-        } else {
-            throw std::runtime_error("Unexpected token: " + currentToken_.text);
-        }
+    SreBatchEvaluator(batch, missing).run(*rule.root_, matched);
+}
+
+SreCompiledRule SreRuleEngine::reorder(const SreCompiledRule &rule, const std::vector<SreContext> &samples) const {
+    std::vector<SreEvalContext> contexts;
+    contexts.reserve(samples.size());
+    for (auto &sample : samples) {
+        contexts.push_back({ &sample, nullptr });
     }
-    void consume(SreTokenType type) {
-        if (currentToken_.type != type) {
-            throw std::runtime_error("Expected token type mismatch");
-        }
-        currentToken_ = lexer_.nextToken();
+    return reorderWith(rule, contexts);
+}
+
+SreCompiledRule SreRuleEngine::reorder(const SreCompiledRule &rule, const std::vector<SreSlotContext> &samples) const {
+    if (rule.valid() && !rule.hasSchema()) {
+        throw std::runtime_error("Rule is not compiled with a schema");
     }
-    SreLexer &lexer_;
-    SreToken currentToken_;
-};
+    std::vector<SreEvalContext> contexts;
+    contexts.reserve(samples.size());
+    for (auto &sample : samples) {
+        contexts.push_back({ nullptr, &sample });
+    }
+    return reorderWith(rule, contexts);
+}
+
+SreCompiledRule SreRuleEngine::reorderWith(const SreCompiledRule &rule, const std::vector<SreEvalContext> &samples) const {
+    if (!rule.valid()) {
+        throw std::runtime_error("Rule is not compiled");
+    }
+    // 重排只新建改动过的 and/or 节点，其余子树仍位于原规则的内存池中
+    std::shared_ptr<SreArena> arena = std::make_shared<SreArena>();
+    arena->retain(rule.root_);
+    SreASTNodePtr root = SreOptimizer(*arena).reorder(rule.root_.get(), samples);
+    SreCompiledRule result(rule.expression_, std::shared_ptr<const SreASTNode>(arena, root), rule.hasSchema_);
+    result.memoSize_ = rule.memoSize_;
+    // 表达式相同，沿用原规则的编号；新建的只有 and/or 节点，函数调用保留原来的调用点
+    result.profileId_ = rule.profileId_;
+    if (rule.program_) {
+        result.program_ = SreProgram::lower(*result.root_);
+    }
+    return result;
+}
+
+size_t SreRuleEngine::patternCacheSize() const {
+    return patterns_->size();
+}
+
+void SreRuleEngine::setBackend(SreBackend backend) {
+    backend_ = backend;
+    // 缓存中的规则按旧后端编译，需要作废
+    clearCache();
+}
 
 // =============================
-// SreRuleEngine 成员函数实现
+// 表达式缓存
 // =============================
-SreRuleEngine::SreRuleEngine() {
-    initBuiltInFunctions();
+SreCompiledRule SreRuleEngine::compileCached(const std::string &expression) {
+    size_t generation;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        auto it = cacheIndex_.find(expression);
+        if (it != cacheIndex_.end()) {
+            ++cacheHits_;
+            cacheList_.splice(cacheList_.begin(), cacheList_, it->second);
+            return it->second->second;
+        }
+        ++cacheMisses_;
+        if (cacheCapacity_ == 0) {
+            return compile(expression);
+        }
+        generation = cacheGeneration_;
+    }
+    // 解析放在锁外进行，避免阻塞其它线程的命中路径
+    SreCompiledRule rule = compile(expression);
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    if (cacheCapacity_ == 0 || generation != cacheGeneration_ || cacheIndex_.count(expression)) {
+        // 缓存已关闭、编译期间函数表或后端发生了变化，或其它线程已经放入了相同的表达式
+        return rule;
+    }
+    cacheList_.emplace_front(expression, rule);
+    cacheIndex_[expression] = cacheList_.begin();
+    trimCache();
+    return rule;
 }
 
-SreRuleEngine::~SreRuleEngine() {}
+void SreRuleEngine::trimCache() {
+    while (cacheList_.size() > cacheCapacity_) {
+        cacheIndex_.erase(cacheList_.back().first);
+        cacheList_.pop_back();
+    }
+}
 
-void SreRuleEngine::registerFunction(const std::string &name, SreFunction func) {
-    std::string lower = name;
-    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-    functions_[lower] = func;
+void SreRuleEngine::setCacheCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    cacheCapacity_ = capacity;
+    trimCache();
 }
 
-void SreRuleEngine::initBuiltInFunctions() {
-    // 内置函数 contains(#{var}, 'substring')
-    registerFunction("contains", [](const std::vector<std::string>& args) -> bool {
-        if (args.size() != 2) throw std::runtime_error("contains requires 2 arguments");
-        return args[0].find(args[1]) != std::string::npos;
-    });
-    // 内置函数 containsAny(#{var}, 's1', 's2', ...)
-    registerFunction("containsany", [](const std::vector<std::string>& args) -> bool {
-        if (args.size() < 2) throw std::runtime_error("containsAny requires at least 2 arguments");
-        for (size_t i = 1; i < args.size(); ++i) {
-            if (args[0].find(args[i]) != std::string::npos) return true;
-        }
-        return false;
-    });
+size_t SreRuleEngine::cacheCapacity() const {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    return cacheCapacity_;
 }
 
-bool SreRuleEngine::evaluate(const std::string &expression, const SreContext &ctx) {
-    SreLexer lexer(expression);
-    SreParser parser(lexer);
-    SreASTNodePtr root = parser.parseExpression();
-    // 顶层表达式应返回 boolean
-    return root->evalBool(ctx, functions_);
+size_t SreRuleEngine::cacheSize() const {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    return cacheList_.size();
+}
+
+size_t SreRuleEngine::cacheHits() const {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    return cacheHits_;
+}
+
+size_t SreRuleEngine::cacheMisses() const {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    return cacheMisses_;
+}
+
+void SreRuleEngine::clearCache() {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    cacheList_.clear();
+    cacheIndex_.clear();
+    ++cacheGeneration_;
 }
@@ -2,37 +2,335 @@
 #define SRE_RULE_ENGINE_H
 
 #include <string>
+#include <string_view>
 #include <functional>
 #include <unordered_map>
 #include <vector>
 #include <memory>
 #include <stdexcept>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
 
 // 上下文：存储变量值（简单采用字符串映射）
 using SreContext = std::unordered_map<std::string, std::string>;
 
+// 变量表：把变量名固定映射为从 0 开始的连续下标
+// 编译时遇到新变量会追加，已分配的下标不会改变；非线程安全，应在加载规则阶段使用
+class SreSchema {
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    // 返回变量下标，不存在时追加
+    size_t intern(const std::string &name);
+    // 返回变量下标，不存在时返回 npos
+    size_t indexOf(const std::string &name) const;
+    const std::string &nameOf(size_t index) const { return names_.at(index); }
+    size_t size() const { return names_.size(); }
+
+private:
+    std::unordered_map<std::string, size_t> index_;
+    std::vector<std::string> names_;
+};
+
+// 按下标存储的上下文：第 i 个元素对应 SreSchema 中下标为 i 的变量
+// 下标超出范围视为变量不存在
+using SreSlotContext = std::vector<std::string>;
+
+// 带类型的值：整数、浮点数、布尔或字符串，比较运算（> < == in 等）直接使用，不必再从字符串转换
+// 构造时同时保存文本形式，contains 等字符串函数读取的是文本
+class SreValue {
+public:
+    enum class Type { String, Int, Double, Bool };
+
+    SreValue() : type_(Type::String), int_(0), double_(0) {}
+    SreValue(std::string text) : type_(Type::String), int_(0), double_(0), text_(std::move(text)) {}
+    SreValue(const char *text) : SreValue(std::string(text)) {}
+    template<typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+    SreValue(T value)
+        : type_(Type::Int), int_(static_cast<int64_t>(value)), double_(static_cast<double>(value)), text_(std::to_string(value)) {}
+    // 文本为能精确还原该值的最短十进制形式
+    SreValue(double value);
+    SreValue(bool value) : type_(Type::Bool), int_(value), double_(value), text_(value ? "true" : "false") {}
+
+    Type type() const { return type_; }
+    // asInt 仅对 Int/Bool 有意义，asDouble 对所有数值和布尔类型有意义；String 均为 0
+    int64_t asInt() const { return int_; }
+    double asDouble() const { return double_; }
+    bool asBool() const { return type_ == Type::Double ? double_ != 0 : int_ != 0; }
+    const std::string &text() const { return text_; }
+
+private:
+    Type type_;
+    int64_t int_;
+    double double_;
+    std::string text_;
+};
+
+// 带类型的上下文
+using SreTypedContext = std::unordered_map<std::string, SreValue>;
+
+// 按需取值的上下文：变量只在求值真正读到时才调用它的取值函数，and/or 短路跳过的分支不会触发取值
+// 同一次求值中同一个变量最多取值一次，求值结束后丢弃，下一次求值重新调用
+// 求值期间只读；取值函数线程安全时可以在多个线程间共享
+class SreLazyContext {
+public:
+    // 取值函数：写入 value 并返回 true，返回 false 表示变量不存在；抛出的异常从 evaluate 传出
+    using Resolver = std::function<bool(std::string &value)>;
+
+    // 已知的值，直接使用
+    void set(const std::string &name, std::string value);
+    // 需要时才计算的值，同名的变量会被替换
+    void define(const std::string &name, Resolver resolver);
+    size_t size() const { return entries_.size(); }
+
+private:
+    struct Entry {
+        std::string value;
+        Resolver resolve;  // 为空时 value 为已知的值
+    };
+    std::unordered_map<std::string, size_t> index_;
+    std::vector<Entry> entries_;
+
+    Entry &entry(const std::string &name);
+    friend class SreLazyMemo;
+};
+
 // 内置函数类型：接收字符串参数列表，返回 bool
 using SreFunction = std::function<bool(const std::vector<std::string>&)>;
 
+// 函数参数列表：每个参数是指向上下文值或字面量的只读视图，不做拷贝
+// 视图只在函数调用期间有效，需要保存时请自行拷贝
+class SreArgs {
+public:
+    SreArgs(const std::string_view *data, size_t size) : data_(data), size_(size) {}
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const std::string_view &operator[](size_t i) const { return data_[i]; }
+    const std::string_view *begin() const { return data_; }
+    const std::string_view *end() const { return data_ + size_; }
+
+private:
+    const std::string_view *data_;
+    size_t size_;
+};
+
+// 零拷贝函数类型：推荐使用；SreFunction 通过适配器转换为该类型
+using SreViewFunction = std::function<bool(SreArgs)>;
+
+class SreAsyncBatch;
+// 异步函数类型：接收一批调用（SreAsync.h），立即返回，稍后（可以在其它线程）逐个报告结果
+using SreAsyncFunction = std::function<void(const std::shared_ptr<SreAsyncBatch> &batch)>;
+
+// 内置函数标识：编译期优化（如规则集的多模式索引）据此识别可以特殊处理的调用
+// 用户注册的函数一律为 None，即使与内置函数同名
+enum class SreBuiltin { None, Contains, ContainsAny, Matches, Like, IContains, IContainsAny };
+
+// 函数表中的一项：函数本身以及编译期需要的附加信息
+// 一律由 std::make_shared 创建，规则集只保存字节码时通过 shared_from_this 持有用到的函数项
+struct SreFunctionEntry : std::enable_shared_from_this<SreFunctionEntry> {
+    SreFunctionEntry(SreViewFunction call, SreBuiltin builtin, bool pure, bool folded = false)
+        : call(std::move(call)), builtin(builtin), pure(pure), folded(folded) {}
+
+    SreViewFunction call;
+    SreBuiltin builtin;
+    // 纯函数：结果只取决于参数且没有副作用，参数全为常量的调用会在编译期求值
+    bool pure;
+    // 仅 icontains/icontainsAny：字面量已在编译期折叠，调用时只折叠第一个参数
+    bool folded;
+};
+
+// 函数表：小写函数名 -> 函数，编译时按名字绑定到节点上
+using SreFunctionTable = std::unordered_map<std::string, std::shared_ptr<const SreFunctionEntry>>;
+
+class SreASTNode;
+class SreProgram;
+class SreBatch;
+class SrePatternCache;
+class SreRcu;
+struct SreEvalContext;
+
+// 求值后端：默认遍历语法树；Bytecode 把规则降级为线性指令数组后解释执行
+// 后端只影响单条规则的求值，规则集和按列批量求值有各自的执行方式
+enum class SreBackend { Tree, Bytecode };
+
+// 不抛异常的求值（tryEvaluate）中缺失变量的处理方式
+// - Error：规则求值出错，结果为 SreResult::Error
+// - Empty：按空字符串处理，与变量存在且为空相同
+// - False：读到缺失变量的函数调用、比较或非空判断直接为 false，不调用函数；外层的 not 仍会取反
+enum class SreMissing : uint8_t { Error, Empty, False };
+
+enum class SreResult : uint8_t { False, True, Error };
+
+enum class SreError : uint8_t {
+    None,
+    MissingVariable,    // 变量不存在（SreMissing::Error）
+    InvalidExpression,  // 表达式中有不能求值的部分，例如函数参数不是变量或常量
+    FunctionFailed,     // 函数抛出了异常
+    InvalidRule         // 规则未编译，或用 SreSlotContext 求值未按 schema 编译的规则
+};
+
+// 不抛异常的求值结果
+struct SreOutcome {
+    SreResult result = SreResult::False;
+    SreError error = SreError::None;
+    // 第一个缺失的变量名（Empty 语义下不记录），指向规则中的文本，规则存活期间有效
+    std::string_view variable;
+
+    bool matched() const { return result == SreResult::True; }
+};
+
+// 编译后的规则：表达式只解析一次，之后可反复求值
+// 对象本身不可变，拷贝只是共享同一棵语法树，可以放心在多处持有
+class SreCompiledRule {
+public:
+    SreCompiledRule() {}
+
+    // 编译时使用的原始表达式
+    const std::string &expression() const { return expression_; }
+    // 默认构造的对象不包含任何规则
+    bool valid() const { return root_ != nullptr; }
+    // 是否按 SreSchema 编译，只有这样的规则才能用 SreSlotContext 求值
+    bool hasSchema() const { return hasSchema_; }
+    SreBackend backend() const { return program_ ? SreBackend::Bytecode : SreBackend::Tree; }
+
+private:
+    friend class SreRuleEngine;
+    friend class SreRuleSet;
+    SreCompiledRule(const std::string &expression, std::shared_ptr<const SreASTNode> root, bool hasSchema);
+
+    std::string expression_;
+    std::shared_ptr<const SreASTNode> root_;
+    std::shared_ptr<const SreProgram> program_;  // 仅 Bytecode 后端
+    bool hasSchema_ = false;
+    size_t memoSize_ = 0;  // 比较运算中出现的不同变量个数，求值时每个变量最多转换一次
+    uint32_t profileId_ = UINT32_MAX;  // 性能分析的规则编号（SreProfile.h），未启用时不使用
+};
+
+// 线程安全约定：
+// - evaluate(const SreCompiledRule&, ...) 只读取不可变的编译结果，不加锁，可任意并发
+// - compile 可以并发，读取函数表时不加锁
+// - evaluate(const std::string&, ...) 可以并发，但在表达式缓存上会持有一把短锁
+// - registerFunction/setBackend 可以与以上调用并发：新函数表通过原子指针发布，读者不会阻塞；
+//   多个写者之间串行，写者只等待本引擎正在进行的 compile。编译时会调用参数全为常量的纯函数，
+//   不要在这些函数内部调用同一个引擎的 registerFunction；其它引擎和规则集不受影响
+// - 注册的函数会被多个线程同时调用，函数自身需要保证线程安全
 class SreRuleEngine {
 public:
     SreRuleEngine();
     ~SreRuleEngine();
 
     // 注册函数，函数名会转为小写保存
-    void registerFunction(const std::string &name, SreFunction func);
+    // 函数在编译时绑定：重新注册同名函数只影响之后编译的规则，已编译的规则继续使用旧函数
+    // pure 为 true 表示函数是纯函数，参数全为常量的调用会在编译期折叠为常量，
+    // 重复出现的相同调用也可能被合并；抛异常的调用不会折叠，仍在求值时抛出
+    void registerFunction(const std::string &name, SreViewFunction func, bool pure = false);
+    // 兼容旧签名：每次调用会把参数拷贝为 std::vector<std::string>
+    void registerFunction(const std::string &name, SreFunction func, bool pure = false);
+    // 注册异步函数（例如远程查询），不是纯函数，不会在编译期折叠
+    // 在 SreAsyncEvaluator 中求值时调用会挂起，同一批求值的调用合并成批次发出；
+    // 其它求值方式中每次调用单独成批，阻塞等待结果
+    void registerAsyncFunction(const std::string &name, SreAsyncFunction func);
+
+    // 编译表达式，语法错误和未注册的函数在此处抛出异常
+    SreCompiledRule compile(const std::string &expression) const;
+    // 按变量表编译：变量引用被解析为下标，新变量会追加到 schema 中
+    SreCompiledRule compile(const std::string &expression, SreSchema &schema) const;
 
     // 评估表达式，表达式返回布尔值
     bool evaluate(const std::string &expression, const SreContext &ctx);
 
+    // 评估已编译的规则，只做求值，不再重新解析
+    bool evaluate(const SreCompiledRule &rule, const SreContext &ctx) const;
+    // 按下标取值，规则必须是按 schema 编译的
+    bool evaluate(const SreCompiledRule &rule, const SreSlotContext &ctx) const;
+    // 带类型的上下文：比较运算直接使用值的类型，字符串函数读取值的文本形式
+    bool evaluate(const SreCompiledRule &rule, const SreTypedContext &ctx) const;
+    // 按需取值的上下文，见 SreLazyContext
+    bool evaluate(const SreCompiledRule &rule, const SreLazyContext &ctx) const;
+
+    // 不抛异常的求值：缺失变量按 missing 处理，其它数据导致的错误和用法错误都通过返回值报告，
+    // 出错路径不构造异常和错误消息，也不分配内存（函数自己抛出的异常除外，会被捕获为 FunctionFailed）
+    SreOutcome tryEvaluate(const SreCompiledRule &rule, const SreContext &ctx,
+                           SreMissing missing = SreMissing::Error) const noexcept;
+    SreOutcome tryEvaluate(const SreCompiledRule &rule, const SreSlotContext &ctx,
+                           SreMissing missing = SreMissing::Error) const noexcept;
+    SreOutcome tryEvaluate(const SreCompiledRule &rule, const SreTypedContext &ctx,
+                           SreMissing missing = SreMissing::Error) const noexcept;
+    // 取值函数返回 false 视为变量缺失，抛出的异常视为 FunctionFailed
+    SreOutcome tryEvaluate(const SreCompiledRule &rule, const SreLazyContext &ctx,
+                           SreMissing missing = SreMissing::Error) const noexcept;
+
+    // 列式批量求值（见 SreBatch.h）：matched[i] 为第 i 行的结果，与逐行求值一致
+    // 每个节点一次处理一块行，短路通过缩小待求值的行集合实现；总是遍历语法树，与规则的后端无关
+    // 缺失变量按 missing 处理，同 tryEvaluate；Error 语义下缺失变量、以及任何语义下函数抛出的异常
+    // 会使整批抛出行号最小的出错行的异常，与逐行求值遇到的第一个异常相同，此时 matched 的内容未定义
+    void evaluate(const SreCompiledRule &rule, const SreBatch &batch, std::vector<bool> &matched,
+                  SreMissing missing = SreMissing::Error) const;
+
+    // 按样本重排 and/or 的子项：统计各子项的平均耗时和为真比例，把代价低、最可能短路的子项排在前面，
+    // 返回新的规则，原规则不变；后端与原规则相同
+    // 只重排由纯函数组成、且在所有样本中都没有抛异常的子项，因此样本上的求值结果不变；
+    // 样本中没有出现过的异常情况（例如缺少变量）在重排后可能抛出不同的异常或不再抛出
+    // 统计时纯子项不短路、全部求值；非纯函数（含异步函数）只在按原顺序短路求值时才会被调用
+    SreCompiledRule reorder(const SreCompiledRule &rule, const std::vector<SreContext> &samples) const;
+    SreCompiledRule reorder(const SreCompiledRule &rule, const std::vector<SreSlotContext> &samples) const;
+
+    // 选择之后编译的规则使用的求值后端，已编译的规则不受影响
+    void setBackend(SreBackend backend);
+    SreBackend backend() const { return backend_.load(); }
+
+    // 表达式缓存：evaluate(const std::string&) 按表达式文本缓存编译结果，按 LRU 淘汰
+    // 容量为 0 表示关闭缓存；缩小容量会立即淘汰多余的条目
+    void setCacheCapacity(size_t capacity);
+    size_t cacheCapacity() const;
+    size_t cacheSize() const;
+    size_t cacheHits() const;
+    size_t cacheMisses() const;
+    void clearCache();
+
+    // matches/like 的模式缓存中的模式个数：模式为常量时在编译期编译一次，多条规则共用
+    size_t patternCacheSize() const;
+
 private:
-    // 内部存储函数映射
-    std::unordered_map<std::string, SreFunction> functions_;
+    friend class SreRuleSet;  // 读取规则集文件时按名字绑定函数
+
+    // 内部存储函数映射：不可变的函数表，写者复制后整体替换（RCU），读者无锁读取
+    std::atomic<const SreFunctionTable *> functions_;
+    std::unique_ptr<SreRcu> rcu_;  // 函数表的读临界区只在编译和读取规则集文件期间
+    std::mutex registryMutex_;     // 串行化写者
+    std::atomic<SreBackend> backend_;
+    std::unique_ptr<SrePatternCache> patterns_;  // 内部自带锁
+
+    // 表达式缓存，所有成员均由 cacheMutex_ 保护
+    using SreCacheList = std::list<std::pair<std::string, SreCompiledRule>>;
+    mutable std::mutex cacheMutex_;
+    SreCacheList cacheList_;  // 头部为最近使用
+    std::unordered_map<std::string, SreCacheList::iterator> cacheIndex_;
+    size_t cacheCapacity_;
+    size_t cacheHits_;
+    size_t cacheMisses_;
+    size_t cacheGeneration_;  // clearCache 时递增，丢弃清空之前开始的编译结果
+
+    // 从缓存取出编译结果，未命中时编译并放入缓存
+    SreCompiledRule compileCached(const std::string &expression);
+    // 淘汰超出容量的条目，调用方需持有 cacheMutex_
+    void trimCache();
 
     // 初始化内置函数
     void initBuiltInFunctions();
+    void registerEntry(const std::string &name, SreViewFunction func, SreBuiltin builtin, bool pure);
+
+    SreCompiledRule compileWith(const std::string &expression, SreSchema *schema) const;
+    SreCompiledRule reorderWith(const SreCompiledRule &rule, const std::vector<SreEvalContext> &samples) const;
+    bool run(const SreCompiledRule &rule, const SreEvalContext &ctx) const;
+    static bool dispatch(const SreCompiledRule &rule, const SreEvalContext &ctx);
+    SreOutcome tryRun(const SreCompiledRule &rule, SreEvalContext &ctx, SreMissing missing) const noexcept;
 
-    // 以下为内部解析和求值相关类和函数，声明放在 SreRuleEngine.cpp 中
+    // 内部解析和求值相关类声明放在 SreAST.h 中
 };
 
 #endif // SRE_RULE_ENGINE_H
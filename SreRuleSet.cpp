@@ -0,0 +1,707 @@
+#include "SreRuleSet.h"
+#include "SreBytecode.h"
+#include "SreRcu.h"
+#include "SreMemory.h"
+#include "SreSerialize.h"
+#include "SreThreadPool.h"
+#include <algorithm>
+#include <unordered_set>
+
+// 规则集的字节码、符号表和多模式索引，发布之后不再修改
+// 只删除规则时新版本直接共用上一版本的这一部分
+struct SreRuleSetProgram {
+    SreSymbols symbols;
+    std::vector<SreInstr> code;
+    size_t maxStack = 0;
+    std::shared_ptr<const SrePatternIndex> patterns;
+    // 与 symbols.functions 一一对应，持有字节码用到的函数项，规则集因此不需要保留各条规则的语法树
+    std::vector<std::shared_ptr<const SreFunctionEntry>> bound;
+};
+
+// 规则集内部数据：某一版本的规则列表，所有规则的字节码连续存放，共用一份符号表
+// 发布之后不再修改
+class SreRuleSetData {
+public:
+    // 只记录字节码的位置，不引用语法树：规则加入规则集后，调用方丢掉编译结果即可释放语法树
+    struct Entry {
+        SreRuleId id;
+        uint32_t start;  // 字节码起始下标，与跳转目标一样为 32 位
+        uint32_t profile = SreProfiler::npos;  // 性能分析的规则编号，从文件读取的规则没有
+        bool hasSchema;
+    };
+
+    std::shared_ptr<const SreRuleSetProgram> program;
+    std::vector<Entry> rules;
+    bool allHaveSchema = true;
+    uint64_t version = 0;  // 发布的序号，SreFieldSource 据此判断变量表是否变化
+    SrePrefilter prefilter;  // 按这一版本的规则列表建立，不保存到文件，读取时重新分析
+
+    void save(SreBinaryWriter &out) const {
+        program->symbols.save(out);
+        out.array(program->code);
+        out.pod<uint8_t>(allHaveSchema);
+        out.pod<uint64_t>(rules.size());
+        for (auto &rule : rules) {
+            out.pod<uint64_t>(rule.id);
+            out.pod<uint64_t>(rule.start);
+        }
+        program->patterns->save(out);
+    }
+
+    template<typename Visitor>
+    void run(const SreEvalContext &ctx, Visitor visit) const {
+        SreEvalState state;
+        run(ctx, state, visit);
+    }
+    // 复用调用方的 state，连续求值多个事件时避免重复分配
+    // 预过滤跳过的规则必然为 false，不调用 visit
+    template<typename Visitor>
+    void run(const SreEvalContext &ctx, SreEvalState &state, Visitor visit) const {
+        const SreRuleSetProgram &p = *program;
+        state.reset(p.symbols, p.patterns.get());
+        if (prefilter.filteredCount() && prefilter.select(p.symbols, ctx, state)) {
+            for (uint32_t i : state.candidates) {
+                visit(i, runRule(i, ctx, state));
+            }
+            return;
+        }
+        for (size_t i = 0; i < rules.size(); ++i) {
+            visit(i, runRule(i, ctx, state));
+        }
+    }
+    // 不抛异常的求值：ctx.status 不为空，每条规则各自出错，visit(i, hit, failed)
+    template<typename Visitor>
+    void tryRun(const SreEvalContext &ctx, Visitor visit) const {
+        SreEvalState state;
+        tryRun(ctx, state, visit);
+    }
+    template<typename Visitor>
+    void tryRun(const SreEvalContext &ctx, SreEvalState &state, Visitor visit) const {
+        state.reset(program->symbols, program->patterns.get());
+        bool filtered = false;
+        if (prefilter.filteredCount()) {
+            try {
+                filtered = prefilter.select(program->symbols, ctx, state);
+            } catch (...) {
+                // 只有内存不足时才会出错，退回到执行所有规则
+            }
+        }
+        if (filtered) {
+            for (uint32_t i : state.candidates) {
+                tryRule(i, ctx, state, visit);
+            }
+            return;
+        }
+        for (size_t i = 0; i < rules.size(); ++i) {
+            tryRule(i, ctx, state, visit);
+        }
+    }
+
+private:
+    template<typename Visitor>
+    void tryRule(size_t i, const SreEvalContext &ctx, SreEvalState &state, Visitor &visit) const {
+        SreEvalStatus &status = *ctx.status;
+        status.error = SreError::None;
+        bool hit;
+        try {
+            hit = runRule(i, ctx, state);
+        } catch (...) {
+            status.error = SreError::FunctionFailed;
+            hit = false;
+        }
+        visit(i, hit, status.error != SreError::None);
+    }
+
+    bool runRule(size_t i, const SreEvalContext &ctx, SreEvalState &state) const {
+        const SreRuleSetProgram &p = *program;
+#if SRE_PROFILING
+        SreProfileScope scope(rules[i].profile);
+        return scope.finish(SreInterpreter::run(p.code.data(), rules[i].start, p.maxStack, p.symbols, ctx, &state));
+#else
+        return SreInterpreter::run(p.code.data(), rules[i].start, p.maxStack, p.symbols, ctx, &state);
+#endif
+    }
+};
+
+// 写者的工作副本，只在持有 writeMutex_ 时访问
+// 符号表带去重索引，新规则的字节码和符号追加在末尾，多模式索引只重建新增了字面量的组；
+// 删除和替换留下的字节码和符号在超过有效部分时整体压缩，均摊下来每次修改的代价与改动的规则成正比
+class SreRuleSetWriter {
+public:
+    enum Mode { Add, Replace, Upsert };
+
+    SreRuleSetProgram program;
+    std::unordered_map<SreRuleId, size_t> positions;  // id -> 在当前版本 rules 中的下标
+    size_t liveCode = 0;  // 当前规则的指令数之和
+    // 预过滤的分析结果，按字节码起始下标缓存，每个版本只分析新增的规则；压缩后下标变化，整体清空
+    std::unordered_map<size_t, SrePrefilter::Signature> signatures;
+
+    SreRuleSetWriter() {
+        program.patterns = std::make_shared<SrePatternIndex>();
+    }
+
+    // 发布用的副本，不含去重索引
+    static std::shared_ptr<const SreRuleSetProgram> snapshot(const SreRuleSetProgram &from,
+                                                             std::shared_ptr<const SrePatternIndex> patterns) {
+        std::shared_ptr<SreRuleSetProgram> copy = std::make_shared<SreRuleSetProgram>();
+        copy->symbols = from.symbols.withoutIndex();
+        copy->code = from.code;
+        copy->maxStack = from.maxStack;
+        copy->patterns = std::move(patterns);
+        copy->bound = from.bound;
+        return copy;
+    }
+
+    std::unique_ptr<SreRuleSetData> empty() const {
+        std::unique_ptr<SreRuleSetData> data = sre_make_unique<SreRuleSetData>();
+        data->program = snapshot(program, program.patterns);
+        return data;
+    }
+
+    size_t ruleLength(size_t start) const {
+        size_t end = start;
+        while (program.code[end].op != SreOpCode::Return) ++end;
+        return end - start + 1;
+    }
+
+    // 在 current 的基础上先删除 removed，再写入 upserts，返回待发布的新版本
+    // 出错时抛异常，工作副本保持不变
+    std::unique_ptr<SreRuleSetData> apply(const SreRuleSetData &current, const SreRuleSet::Rules &upserts, Mode mode,
+                                          const std::vector<SreRuleId> &removed);
+
+    // 读取 save 的结果，函数按名字绑定到 functions，常量模式从 patternCache 中取已编译的模式
+    std::unique_ptr<SreRuleSetData> load(SreBinaryReader &in, const SreFunctionTable &functions, SrePatternCache &patternCache);
+
+private:
+    // 建立 data 的预过滤
+    void index(SreRuleSetData &data);
+    void compact(SreRuleSetProgram &target, std::vector<SreRuleSetData::Entry> &rules) const;
+};
+
+// 有效指令不到一半且死代码超过这个数时压缩
+static const size_t kCompactSlack = 4096;
+
+std::unique_ptr<SreRuleSetData> SreRuleSetWriter::apply(const SreRuleSetData &current, const SreRuleSet::Rules &upserts,
+                                                        Mode mode, const std::vector<SreRuleId> &removed) {
+    // 先校验，不修改任何状态
+    std::unordered_set<SreRuleId> dropped;
+    for (SreRuleId id : removed) {
+        if (!positions.count(id) || !dropped.insert(id).second) {
+            throw std::runtime_error("Rule not found: " + std::to_string(id));
+        }
+    }
+    std::unordered_set<SreRuleId> seen;
+    for (auto &rule : upserts) {
+        if (!rule.second.valid()) {
+            throw std::runtime_error("Rule is not compiled");
+        }
+        bool exists = positions.count(rule.first) && !dropped.count(rule.first);
+        if (!seen.insert(rule.first).second || (mode == Add && exists)) {
+            throw std::runtime_error("Duplicate rule id: " + std::to_string(rule.first));
+        }
+        if (mode == Replace && !exists) {
+            throw std::runtime_error("Rule not found: " + std::to_string(rule.first));
+        }
+    }
+
+    // 被删除的规则在当前版本中的下标，升序
+    std::vector<size_t> gone;
+    for (SreRuleId id : dropped) {
+        gone.push_back(positions.at(id));
+    }
+    std::sort(gone.begin(), gone.end());
+
+    std::unique_ptr<SreRuleSetData> next = sre_make_unique<SreRuleSetData>();
+    size_t live = liveCode;
+    next->rules.reserve(current.rules.size() - gone.size() + upserts.size());
+    for (size_t i = 0, g = 0; i < current.rules.size(); ++i) {
+        const SreRuleSetData::Entry &entry = current.rules[i];
+        if (g < gone.size() && gone[g] == i) {
+            live -= ruleLength(entry.start);
+            ++g;
+        } else {
+            next->rules.push_back(entry);
+        }
+    }
+    // 删除之后的下标
+    auto positionOf = [&](size_t old) {
+        return old - (std::lower_bound(gone.begin(), gone.end(), old) - gone.begin());
+    };
+
+    SreSymbols::Mark mark = program.symbols.mark();
+    size_t codeSize = program.code.size();
+    size_t maxStack = program.maxStack;
+    SreRuleSetProgram compacted;
+    bool compacting = false;
+    try {
+        for (auto &rule : upserts) {
+            SreProgramBuilder builder(program.symbols, program.code, true);
+            size_t start = builder.lowerRule(*SreRuleSet::rootOf(rule.second));
+            program.maxStack = std::max(program.maxStack, builder.maxStack());
+            live += program.code.size() - start;
+            // 新增的函数项由规则集持有；死代码引用的函数项同样保留到压缩，去重索引不会把新函数项误认成旧的
+            for (size_t f = program.bound.size(); f < program.symbols.functions.size(); ++f) {
+                program.bound.push_back(program.symbols.functions[f]->shared_from_this());
+            }
+            SreRuleSetData::Entry entry = { rule.first, static_cast<uint32_t>(start),
+                                            SreRuleSet::profileOf(rule.second), rule.second.hasSchema() };
+            auto it = positions.find(rule.first);
+            if (it != positions.end() && !dropped.count(rule.first)) {
+                // 替换：保持原来的位置
+                SreRuleSetData::Entry &old = next->rules[positionOf(it->second)];
+                live -= ruleLength(old.start);
+                old = entry;
+            } else {
+                next->rules.push_back(entry);
+            }
+        }
+        compacting = program.code.size() > 2 * live + kCompactSlack;
+        if (compacting) {
+            compact(compacted, next->rules);
+            next->program = snapshot(compacted, compacted.patterns);
+        } else if (program.code.size() != codeSize) {
+            std::shared_ptr<SrePatternIndex> patterns = std::make_shared<SrePatternIndex>();
+            patterns->extend(*program.patterns, program.symbols);
+            next->program = snapshot(program, patterns);
+        } else {
+            // 只删除了规则：字节码和符号表与当前版本相同，直接共用
+            next->program = current.program;
+        }
+    } catch (...) {
+        program.symbols.truncate(mark);
+        program.bound.resize(mark.functions);
+        program.code.resize(codeSize);
+        program.maxStack = maxStack;
+        throw;
+    }
+
+    // 提交：以下不再抛出业务异常
+    for (auto &entry : next->rules) {
+        next->allHaveSchema = next->allHaveSchema && entry.hasSchema;
+    }
+    for (SreRuleId id : dropped) {
+        positions.erase(id);
+    }
+    // 第一条被删除的规则之后的下标前移，新规则追加在末尾
+    for (size_t i = gone.empty() ? current.rules.size() : gone[0]; i < next->rules.size(); ++i) {
+        positions[next->rules[i].id] = i;
+    }
+    if (compacting) {
+        program = std::move(compacted);
+        liveCode = program.code.size();
+        signatures.clear();
+    } else {
+        program.patterns = next->program->patterns;
+        liveCode = live;
+    }
+    index(*next);
+    return next;
+}
+
+void SreRuleSetWriter::index(SreRuleSetData &data) {
+    const SreRuleSetProgram &p = *data.program;
+    std::vector<const SrePrefilter::Signature *> rules;
+    rules.reserve(data.rules.size());
+    for (auto &entry : data.rules) {
+        auto it = signatures.find(entry.start);
+        if (it == signatures.end()) {
+            it = signatures.emplace(entry.start, SrePrefilter::analyze(p.code, entry.start, p.symbols)).first;
+        }
+        rules.push_back(&it->second);
+    }
+    data.prefilter.build(rules, *p.patterns);
+}
+
+void SreRuleSetWriter::compact(SreRuleSetProgram &target, std::vector<SreRuleSetData::Entry> &rules) const {
+    // 直接复制字节码，从文件读取、没有语法树的规则同样可以压缩
+    SreRelocator relocator(program.symbols, target.symbols, target.code);
+    for (auto &entry : rules) {
+        entry.start = relocator.copyRule(program.code, entry.start);
+    }
+    target.maxStack = program.maxStack;
+    for (const SreFunctionEntry *func : target.symbols.functions) {
+        target.bound.push_back(func->shared_from_this());
+    }
+    std::shared_ptr<SrePatternIndex> patterns = std::make_shared<SrePatternIndex>();
+    patterns->build(target.symbols);
+    target.patterns = patterns;
+}
+
+std::unique_ptr<SreRuleSetData> SreRuleSetWriter::load(SreBinaryReader &in, const SreFunctionTable &functions,
+                                                       SrePatternCache &patternCache) {
+    std::unique_ptr<SreRuleSetData> data = sre_make_unique<SreRuleSetData>();
+    program.symbols.load(in);
+    in.array(program.code);
+    data->allHaveSchema = in.pod<uint8_t>() != 0;
+    for (size_t n = in.count(), i = 0; i < n; ++i) {
+        SreRuleId id = in.pod<uint64_t>();
+        uint64_t start = in.pod<uint64_t>();
+        // 每条规则从一段代码的开头开始
+        SreBinaryReader::check(start, program.code.size());
+        if (start != 0 && program.code[start - 1].op != SreOpCode::Return) SreBinaryReader::fail();
+        if (!positions.emplace(id, data->rules.size()).second) SreBinaryReader::fail();
+        data->rules.push_back({ id, static_cast<uint32_t>(start), SreProfiler::npos, data->allHaveSchema });
+    }
+    std::shared_ptr<SrePatternIndex> loaded = std::make_shared<SrePatternIndex>();
+    loaded->load(in, program.symbols);
+    program.patterns = loaded;
+    if (!in.atEnd()) SreBinaryReader::fail();
+
+    SreSymbols &symbols = program.symbols;
+    for (uint32_t i = 0; i < symbols.functionRefs.size(); ++i) {
+        const SreFunctionRef &ref = symbols.functionRefs[i];
+        auto it = functions.find(ref.name);
+        if (it == functions.end()) {
+            throw std::runtime_error("Function not found: " + ref.name);
+        }
+        // 多模式索引和常量模式都依赖内置函数的语义
+        if (it->second->builtin != ref.builtin) {
+            throw std::runtime_error("Function changed since the rule set was saved: " + ref.name);
+        }
+        std::shared_ptr<const SreFunctionEntry> entry = it->second;
+        if (ref.pattern != SreFunctionRef::npos) {
+            entry = patternCache.bind(ref.builtin, symbols.constants[ref.pattern]);
+        } else if (ref.folded) {
+            entry = SrePatternCache::folded(ref.builtin);
+        }
+        symbols.bindFunction(i, entry.get());
+        program.bound.push_back(std::move(entry));
+    }
+    // 值栈深度由校验时重新计算，不信任文件中的数据
+    program.maxStack = SreInterpreter::verify(program.code, symbols);
+    for (auto &entry : data->rules) {
+        liveCode += ruleLength(entry.start);
+    }
+    data->program = snapshot(program, program.patterns);
+    index(*data);
+    return data;
+}
+
+SreRuleSet::SreRuleSet() : data_(nullptr), rcu_(sre_make_unique<SreRcu>()), writer_(sre_make_unique<SreRuleSetWriter>()) {
+    data_.store(writer_->empty().release());
+}
+
+SreRuleSet::~SreRuleSet() {
+    delete data_.load();
+}
+
+void SreRuleSet::publish(std::unique_ptr<SreRuleSetData> next) {
+    next->version = ++version_;
+    rcu_->publish(data_, std::unique_ptr<const SreRuleSetData>(std::move(next)));
+}
+
+// 写者串行，当前版本只会被持有 writeMutex_ 的线程替换，读取当前版本无需读临界区
+void SreRuleSet::add(SreRuleId id, const SreCompiledRule &rule) {
+    add(Rules{ { id, rule } });
+}
+
+void SreRuleSet::add(const Rules &rules) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    publish(writer_->apply(*data_.load(), rules, SreRuleSetWriter::Add, {}));
+}
+
+void SreRuleSet::replace(SreRuleId id, const SreCompiledRule &rule) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    publish(writer_->apply(*data_.load(), Rules{ { id, rule } }, SreRuleSetWriter::Replace, {}));
+}
+
+void SreRuleSet::remove(SreRuleId id) {
+    update(Rules(), { id });
+}
+
+void SreRuleSet::update(const Rules &upserts, const std::vector<SreRuleId> &removed) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    publish(writer_->apply(*data_.load(), upserts, SreRuleSetWriter::Upsert, removed));
+}
+
+void SreRuleSet::reload(const Rules &rules) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    std::unique_ptr<SreRuleSetWriter> fresh = sre_make_unique<SreRuleSetWriter>();
+    std::unique_ptr<SreRuleSetData> next = fresh->apply(*fresh->empty(), rules, SreRuleSetWriter::Add, {});
+    writer_ = std::move(fresh);
+    publish(std::move(next));
+}
+
+// 文件格式版本，格式变化时递增；读取时版本不同直接报错
+static const char kRuleSetMagic[8] = { 'S', 'R', 'E', 'R', 'U', 'L', 'E', 'S' };
+static const uint32_t kRuleSetVersion = 3;
+
+void SreRuleSet::save(const std::string &path) const {
+    SreBinaryWriter out;
+    {
+        SreRcu::ReadGuard guard(*rcu_);
+        data_.load()->save(out);
+    }
+    sreWriteFile(path, kRuleSetMagic, kRuleSetVersion, out.data());
+}
+
+void SreRuleSet::load(const std::string &path, const SreRuleEngine &engine) {
+    SreMappedFile file(path);
+    SreBinaryReader in = sreOpenPayload(file, kRuleSetMagic, kRuleSetVersion);
+    std::unique_ptr<SreRuleSetWriter> fresh = sre_make_unique<SreRuleSetWriter>();
+    std::unique_ptr<SreRuleSetData> next;
+    {
+        // 绑定的函数项由新版本持有，离开读临界区后函数表被替换也不影响
+        SreRcu::ReadGuard guard(*engine.rcu_);
+        next = fresh->load(in, *engine.functions_.load(), *engine.patterns_);
+    }
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    writer_ = std::move(fresh);
+    publish(std::move(next));
+}
+
+size_t SreRuleSet::size() const {
+    SreRcu::ReadGuard guard(*rcu_);
+    return data_.load()->rules.size();
+}
+
+size_t SreRuleSet::sharedPredicateCount() const {
+    SreRcu::ReadGuard guard(*rcu_);
+    return data_.load()->program->symbols.predicates.size();
+}
+
+size_t SreRuleSet::indexedVariableCount() const {
+    SreRcu::ReadGuard guard(*rcu_);
+    return data_.load()->program->patterns->groupCount();
+}
+
+size_t SreRuleSet::prefilteredRuleCount() const {
+    SreRcu::ReadGuard guard(*rcu_);
+    return data_.load()->prefilter.filteredCount();
+}
+
+SreRuleSetMemory SreRuleSet::memoryUsage() const {
+    // 持有写锁时当前版本不会被替换
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    const SreRuleSetData &data = *data_.load();
+    const SreRuleSetProgram &published = *data.program;
+    SreRuleSetMemory memory;
+    memory.rules = sizeof(SreRuleSetData) + sreHeapBytes(data.rules);
+    memory.code = sreHeapBytes(published.code);
+    memory.symbols = sizeof(SreRuleSetProgram) + published.symbols.memoryUsage() + sreHeapBytes(published.bound);
+    memory.patterns = sizeof(SrePatternIndex) + published.patterns->memoryUsage();
+    memory.prefilter = data.prefilter.memoryUsage();
+
+    const SreRuleSetWriter &writer = *writer_;
+    memory.writer = sizeof(SreRuleSetWriter) + writer.program.symbols.memoryUsage() + sreHeapBytes(writer.program.code) +
+                    sreHeapBytes(writer.program.bound) + sreHeapBytes(writer.positions) + sreHeapBytes(writer.signatures);
+    for (auto &entry : writer.signatures) {
+        memory.writer += sreHeapBytes(entry.second.required) + sreHeapBytes(entry.second.vars);
+    }
+    // 写者的多模式索引通常就是当前版本的，只在不同时计入
+    if (writer.program.patterns != published.patterns) {
+        memory.writer += sizeof(SrePatternIndex) + writer.program.patterns->memoryUsage();
+    }
+    return memory;
+}
+
+std::vector<SreRuleId> SreRuleSet::evaluate(const SreContext &ctx) const {
+    SreRcu::ReadGuard guard(*rcu_);
+    const SreRuleSetData *data = data_.load();
+    std::vector<SreRuleId> ids;
+    SreEvalContext evalCtx = { &ctx, nullptr };
+    data->run(evalCtx, [&](size_t i, bool hit) {
+        if (hit) ids.push_back(data->rules[i].id);
+    });
+    return ids;
+}
+
+std::vector<SreRuleId> SreRuleSet::evaluate(const SreSlotContext &ctx) const {
+    SreRcu::ReadGuard guard(*rcu_);
+    const SreRuleSetData *data = data_.load();
+    if (!data->allHaveSchema) {
+        throw std::runtime_error("Rule is not compiled with a schema");
+    }
+    std::vector<SreRuleId> ids;
+    SreEvalContext evalCtx = { nullptr, &ctx };
+    data->run(evalCtx, [&](size_t i, bool hit) {
+        if (hit) ids.push_back(data->rules[i].id);
+    });
+    return ids;
+}
+
+std::vector<SreRuleId> SreRuleSet::evaluate(const SreTypedContext &ctx) const {
+    SreRcu::ReadGuard guard(*rcu_);
+    const SreRuleSetData *data = data_.load();
+    std::vector<SreRuleId> ids;
+    SreEvalContext evalCtx = { nullptr, nullptr, &ctx };
+    data->run(evalCtx, [&](size_t i, bool hit) {
+        if (hit) ids.push_back(data->rules[i].id);
+    });
+    return ids;
+}
+
+std::vector<SreRuleId> SreRuleSet::evaluate(const SreLazyContext &ctx) const {
+    SreRcu::ReadGuard guard(*rcu_);
+    const SreRuleSetData *data = data_.load();
+    std::vector<SreRuleId> ids;
+    SreLazyMemo lazy(ctx);
+    SreEvalContext evalCtx = { nullptr, nullptr };
+    evalCtx.lazy = &lazy;
+    data->run(evalCtx, [&](size_t i, bool hit) {
+        if (hit) ids.push_back(data->rules[i].id);
+    });
+    return ids;
+}
+
+void SreRuleSet::evaluate(const SreContext &ctx, std::vector<bool> &matched) const {
+    SreRcu::ReadGuard guard(*rcu_);
+    const SreRuleSetData *data = data_.load();
+    matched.assign(data->rules.size(), false);
+    SreEvalContext evalCtx = { &ctx, nullptr };
+    data->run(evalCtx, [&](size_t i, bool hit) { matched[i] = hit; });
+}
+
+void SreRuleSet::evaluate(const SreSlotContext &ctx, std::vector<bool> &matched) const {
+    SreRcu::ReadGuard guard(*rcu_);
+    const SreRuleSetData *data = data_.load();
+    if (!data->allHaveSchema) {
+        throw std::runtime_error("Rule is not compiled with a schema");
+    }
+    matched.assign(data->rules.size(), false);
+    SreEvalContext evalCtx = { nullptr, &ctx };
+    data->run(evalCtx, [&](size_t i, bool hit) { matched[i] = hit; });
+}
+
+void SreRuleSet::evaluate(const SreTypedContext &ctx, std::vector<bool> &matched) const {
+    SreRcu::ReadGuard guard(*rcu_);
+    const SreRuleSetData *data = data_.load();
+    matched.assign(data->rules.size(), false);
+    SreEvalContext evalCtx = { nullptr, nullptr, &ctx };
+    data->run(evalCtx, [&](size_t i, bool hit) { matched[i] = hit; });
+}
+
+void SreRuleSet::evaluate(const SreLazyContext &ctx, std::vector<bool> &matched) const {
+    SreRcu::ReadGuard guard(*rcu_);
+    const SreRuleSetData *data = data_.load();
+    matched.assign(data->rules.size(), false);
+    SreLazyMemo lazy(ctx);
+    SreEvalContext evalCtx = { nullptr, nullptr };
+    evalCtx.lazy = &lazy;
+    data->run(evalCtx, [&](size_t i, bool hit) { matched[i] = hit; });
+}
+
+std::vector<SreRuleId> SreRuleSet::tryEvaluate(const SreContext &ctx, SreMissing missing,
+                                               std::vector<SreRuleId> *errors) const {
+    SreEvalContext evalCtx = { &ctx, nullptr };
+    return tryEvaluateWith(evalCtx, missing, errors);
+}
+
+std::vector<SreRuleId> SreRuleSet::tryEvaluate(const SreSlotContext &ctx, SreMissing missing,
+                                               std::vector<SreRuleId> *errors) const {
+    SreEvalContext evalCtx = { nullptr, &ctx };
+    return tryEvaluateWith(evalCtx, missing, errors);
+}
+
+std::vector<SreRuleId> SreRuleSet::tryEvaluate(const SreTypedContext &ctx, SreMissing missing,
+                                               std::vector<SreRuleId> *errors) const {
+    SreEvalContext evalCtx = { nullptr, nullptr, &ctx };
+    return tryEvaluateWith(evalCtx, missing, errors);
+}
+
+std::vector<SreRuleId> SreRuleSet::tryEvaluate(const SreLazyContext &ctx, SreMissing missing,
+                                               std::vector<SreRuleId> *errors) const {
+    SreLazyMemo lazy(ctx);
+    SreEvalContext evalCtx = { nullptr, nullptr };
+    evalCtx.lazy = &lazy;
+    return tryEvaluateWith(evalCtx, missing, errors);
+}
+
+std::vector<SreRuleId> SreRuleSet::tryEvaluateWith(SreEvalContext &ctx, SreMissing missing,
+                                                   std::vector<SreRuleId> *errors) const {
+    SreRcu::ReadGuard guard(*rcu_);
+    const SreRuleSetData *data = data_.load();
+    if (ctx.slots && !data->allHaveSchema) {
+        throw std::runtime_error("Rule is not compiled with a schema");
+    }
+    if (errors) errors->clear();
+    SreEvalStatus status(missing);
+    ctx.status = &status;
+    std::vector<SreRuleId> ids;
+    data->tryRun(ctx, [&](size_t i, bool hit, bool failed) {
+        if (failed) {
+            if (errors) errors->push_back(data->rules[i].id);
+        } else if (hit) {
+            ids.push_back(data->rules[i].id);
+        }
+    });
+    return ids;
+}
+
+void SreRuleSet::evaluate(SreFieldSource &source, SreMissing missing) const {
+    std::vector<std::string_view> names;
+    std::vector<std::string_view> fields;
+    std::vector<SreRuleId> hits;
+    std::vector<SreRuleId> errors;
+    SreEvalState state;
+    SreEvalStatus status(missing);
+    SreEvalContext ctx = { nullptr, nullptr };
+    ctx.status = &status;
+    bool bound = false;
+    uint64_t version = 0;
+    for (;;) {
+        {
+            // 每个事件单独进入读临界区，matched 在临界区之外调用：回调可以修改本规则集，慢的回调也不拖住写者
+            SreRcu::ReadGuard guard(*rcu_);
+            const SreRuleSetData *data = data_.load();
+            if (!bound || data->version != version) {
+                names.clear();
+                for (const SreVarRef &var : data->program->symbols.vars) names.push_back(var.name);
+                source.bind(names);
+                fields.resize(names.size());
+                ctx.fields = fields.data();
+                bound = true;
+                version = data->version;
+            }
+            std::fill(fields.begin(), fields.end(), std::string_view());
+            if (!source.next(fields.data())) return;
+            hits.clear();
+            errors.clear();
+            data->tryRun(ctx, state, [&](size_t i, bool hit, bool failed) {
+                if (failed) {
+                    errors.push_back(data->rules[i].id);
+                } else if (hit) {
+                    hits.push_back(data->rules[i].id);
+                }
+            });
+        }
+        source.matched(hits, errors);
+    }
+}
+
+// 每个任务处理的事件数
+static const size_t kBatchGrain = 64;
+
+static SreEvalContext sreEventContext(const SreContext &ctx) { return { &ctx, nullptr }; }
+static SreEvalContext sreEventContext(const SreSlotContext &ctx) { return { nullptr, &ctx }; }
+
+template<typename Context>
+void SreRuleSet::evaluateBatch(const std::vector<Context> &events, std::vector<std::vector<SreRuleId>> &results,
+                               SreThreadPool &pool) const {
+    // 读临界区由调用线程持有，整批结束前旧版本不会被释放，工作线程可以直接使用同一份数据
+    SreRcu::ReadGuard guard(*rcu_);
+    const SreRuleSetData *data = data_.load();
+    if (std::is_same<Context, SreSlotContext>::value && !data->allHaveSchema) {
+        throw std::runtime_error("Rule is not compiled with a schema");
+    }
+    results.assign(events.size(), std::vector<SreRuleId>());
+    pool.parallelFor(events.size(), kBatchGrain, [&](size_t begin, size_t end) {
+        SreEvalState state;
+        for (size_t e = begin; e < end; ++e) {
+            std::vector<SreRuleId> &ids = results[e];
+            data->run(sreEventContext(events[e]), state, [&](size_t i, bool hit) {
+                if (hit) ids.push_back(data->rules[i].id);
+            });
+        }
+    });
+}
+
+void SreRuleSet::evaluate(const std::vector<SreContext> &events, std::vector<std::vector<SreRuleId>> &results,
+                          SreThreadPool &pool) const {
+    evaluateBatch(events, results, pool);
+}
+
+void SreRuleSet::evaluate(const std::vector<SreSlotContext> &events, std::vector<std::vector<SreRuleId>> &results,
+                          SreThreadPool &pool) const {
+    evaluateBatch(events, results, pool);
+}
@@ -0,0 +1,156 @@
+#ifndef SRE_RULE_SET_H
+#define SRE_RULE_SET_H
+
+#include "SreRuleEngine.h"
+#include <cstdint>
+
+// 规则 id，由调用方指定
+using SreRuleId = uint64_t;
+
+class SreRuleSetData;
+class SreRuleSetWriter;
+class SreThreadPool;
+class SreRcu;
+
+// 字段视图形式的事件来源（例如 SreStream）：规则集按自己引用的变量向来源要字段值，
+// 字段值为指向来源缓冲区的 string_view，不构造 SreContext
+class SreFieldSource {
+public:
+    virtual ~SreFieldSource() = default;
+    // 规则集引用的变量名，下标即 next 中 fields 的下标；规则集发布新版本后会再次调用，names 只在调用期间有效
+    virtual void bind(const std::vector<std::string_view> &names) = 0;
+    // 读取下一个事件，写入出现的字段，没有更多事件时返回 false
+    // fields 共 names.size() 个，调用前已全部清空；data() 为空的视图表示字段不存在，
+    // 空字符串需要用指向有效地址的空视图（例如指向缓冲区）；视图到下一次调用 next 之前有效
+    virtual bool next(std::string_view *fields) = 0;
+    // 上一个事件的结果：命中的和出错的规则 id，按规则在规则集中的顺序排列
+    // bind 和 next 在规则集的读临界区内调用，matched 在临界区之外调用，其中可以修改规则集
+    virtual void matched(const std::vector<SreRuleId> &hits, const std::vector<SreRuleId> &errors) = 0;
+};
+
+// 规则集的内存占用（字节），按容器的容量估算，不含分配器的额外开销，见 SreRuleSet::memoryUsage
+struct SreRuleSetMemory {
+    size_t rules = 0;      // 规则列表：每条规则 24 字节
+    size_t code = 0;       // 字节码：每条指令 8 字节
+    size_t symbols = 0;    // 符号表：去重后的常量、变量、函数、共享谓词和比较运算
+    size_t patterns = 0;   // 多模式索引
+    size_t prefilter = 0;  // 预过滤
+    // 写者的工作副本：带去重索引的符号表、字节码、id 索引和预过滤的分析缓存，供之后的增量修改使用
+    size_t writer = 0;
+
+    size_t total() const { return rules + code + symbols + patterns + prefilter + writer; }
+};
+
+// 规则集：对同一个上下文一次求值所有规则
+// 所有规则共用一份符号表：每个变量每个事件只查找一次，
+// 函数和参数都相同的调用（例如多条规则里的 contains(#{a}, 'x')）每个事件只计算一次，
+// 同一变量上所有内置 contains/containsAny 的字面量合并为一个多模式自动机，扫描一遍即可回答全部调用
+//
+// 线程安全约定：
+// - evaluate 及各个查询接口不加锁，可任意并发
+// - 修改接口可以与 evaluate 并发：写者在自己的工作副本上修改，再通过原子指针发布新版本（RCU），
+//   进行中的 evaluate 继续使用旧版本，旧版本在本规则集的所有读者离开后释放；多个写者之间串行。
+//   每个规则集的读者单独计数，修改一个规则集不会等待其它规则集或引擎上的求值
+// - 修改是增量的：新规则的字节码和符号追加在末尾，多模式索引只重建新增了字面量的变量；
+//   删除和替换留下的无用部分超过有效部分时自动压缩。每次发布仍要复制一遍符号表和规则列表
+//   （只删除规则时不复制符号表），成批的修改请一次性传入
+// - 不要在规则调用的函数内部修改同一个规则集，否则写者会等待自己；修改其它规则集、注册函数没有限制
+// 规则集只保存字节码和符号表，不引用各条规则的语法树：规则加入之后，调用方丢掉 SreCompiledRule 即可释放语法树
+class SreRuleSet {
+public:
+    using Rules = std::vector<std::pair<SreRuleId, SreCompiledRule>>;
+
+    SreRuleSet();
+    ~SreRuleSet();
+    SreRuleSet(const SreRuleSet &) = delete;
+    SreRuleSet &operator=(const SreRuleSet &) = delete;
+
+    // 以下修改接口出错时规则集保持不变
+    // 添加规则，id 不能重复
+    void add(SreRuleId id, const SreCompiledRule &rule);
+    void add(const Rules &rules);
+    // 替换已有的规则，保持它在结果中的位置；id 不存在时抛异常
+    void replace(SreRuleId id, const SreCompiledRule &rule);
+    // 删除规则，id 不存在时抛异常；之后的规则位置前移
+    void remove(SreRuleId id);
+    // 一次发布多项修改：先删除 removed，再逐条写入 upserts，id 已存在时原位替换，否则追加到末尾
+    void update(const Rules &upserts, const std::vector<SreRuleId> &removed = {});
+    // 用给定的规则整体替换规则集
+    void reload(const Rules &rules);
+
+    // 保存为二进制文件：字节码、符号表和多模式索引，格式与地址无关，带版本号和校验和
+    void save(const std::string &path) const;
+    // 读取 save 写出的文件（mmap）并整体替换规则集，不再解析规则文本；出错时规则集保持不变
+    // 函数按名字绑定到 engine 当前注册的函数，缺少函数、或内置函数被同名的自定义函数替换时抛异常；
+    // 按 schema 编译的规则保存的是变量下标，读取后需要按同样的 schema 构造 SreSlotContext
+    void load(const std::string &path, const SreRuleEngine &engine);
+
+    size_t size() const;
+    // 去重后的函数调用个数，包含已删除规则留下、尚未压缩的部分
+    size_t sharedPredicateCount() const;
+    // 建立了多模式索引的变量个数：这些变量上的内置 contains/containsAny 每个事件只扫描一遍
+    size_t indexedVariableCount() const;
+    // 可以预过滤的规则个数：这些规则只在至少一个必要的 contains/containsAny 为真时才执行，
+    // 例如 contains(#{path}, '/admin') and #{status} >= 500 在 path 不含 /admin 的事件上直接跳过
+    size_t prefilteredRuleCount() const;
+    // 当前版本和写者工作副本的内存占用，用于容量规划；与修改接口互斥，与 evaluate 可以并发
+    // 正在被读者使用的旧版本不计入
+    SreRuleSetMemory memoryUsage() const;
+
+    // 返回命中的规则 id，按规则在规则集中的顺序排列
+    std::vector<SreRuleId> evaluate(const SreContext &ctx) const;
+    // 按下标取值，所有规则必须按同一个 schema 编译
+    std::vector<SreRuleId> evaluate(const SreSlotContext &ctx) const;
+    // 带类型的上下文，见 SreRuleEngine::evaluate
+    std::vector<SreRuleId> evaluate(const SreTypedContext &ctx) const;
+    // 按需取值的上下文：变量只在某条规则真正读到时取值，整个规则集求值期间每个变量最多取值一次
+    std::vector<SreRuleId> evaluate(const SreLazyContext &ctx) const;
+
+    // 不抛异常的求值（见 SreRuleEngine::tryEvaluate）：缺失变量按 missing 处理，出错的规则不算命中，
+    // errors 不为空时写入出错的规则 id；只有用法错误（用 SreSlotContext 求值未按 schema 编译的规则）仍抛异常
+    std::vector<SreRuleId> tryEvaluate(const SreContext &ctx, SreMissing missing = SreMissing::Error,
+                                       std::vector<SreRuleId> *errors = nullptr) const;
+    std::vector<SreRuleId> tryEvaluate(const SreSlotContext &ctx, SreMissing missing = SreMissing::Error,
+                                       std::vector<SreRuleId> *errors = nullptr) const;
+    std::vector<SreRuleId> tryEvaluate(const SreTypedContext &ctx, SreMissing missing = SreMissing::Error,
+                                       std::vector<SreRuleId> *errors = nullptr) const;
+    std::vector<SreRuleId> tryEvaluate(const SreLazyContext &ctx, SreMissing missing = SreMissing::Error,
+                                       std::vector<SreRuleId> *errors = nullptr) const;
+
+    // 逐个求值 source 给出的事件，直到 next 返回 false；缺失字段按 missing 处理，同 tryEvaluate
+    // 每个事件读取一次当前版本，版本变化时重新 bind；长时间的流不会拖住旧版本的释放
+    void evaluate(SreFieldSource &source, SreMissing missing = SreMissing::Error) const;
+
+    // 结果位图：matched[i] 对应规则集中的第 i 条规则
+    void evaluate(const SreContext &ctx, std::vector<bool> &matched) const;
+    void evaluate(const SreSlotContext &ctx, std::vector<bool> &matched) const;
+    void evaluate(const SreTypedContext &ctx, std::vector<bool> &matched) const;
+    void evaluate(const SreLazyContext &ctx, std::vector<bool> &matched) const;
+
+    // 用线程池并行求值一批事件：results[i] 为第 i 个事件命中的规则 id，与逐个调用 evaluate 的结果相同
+    // 整批使用同一个规则集版本；某些事件抛异常时，在全部事件结束后抛出下标最小的那个事件的异常
+    void evaluate(const std::vector<SreContext> &events, std::vector<std::vector<SreRuleId>> &results,
+                  SreThreadPool &pool) const;
+    void evaluate(const std::vector<SreSlotContext> &events, std::vector<std::vector<SreRuleId>> &results,
+                  SreThreadPool &pool) const;
+
+private:
+    std::atomic<const SreRuleSetData *> data_;  // 当前发布的不可变版本
+    std::unique_ptr<SreRcu> rcu_;               // 本规则集的读临界区，写者只等待本规则集的读者
+    mutable std::mutex writeMutex_;             // 串行化写者
+    std::unique_ptr<SreRuleSetWriter> writer_;  // 写者的工作副本，由 writeMutex_ 保护
+    uint64_t version_ = 0;                      // 最近发布的版本序号，由 writeMutex_ 保护
+
+    void publish(std::unique_ptr<SreRuleSetData> next);
+    template<typename Context>
+    void evaluateBatch(const std::vector<Context> &events, std::vector<std::vector<SreRuleId>> &results,
+                       SreThreadPool &pool) const;
+
+    std::vector<SreRuleId> tryEvaluateWith(SreEvalContext &ctx, SreMissing missing, std::vector<SreRuleId> *errors) const;
+
+    friend class SreRuleSetWriter;
+    static const std::shared_ptr<const SreASTNode> &rootOf(const SreCompiledRule &rule) { return rule.root_; }
+    static uint32_t profileOf(const SreCompiledRule &rule) { return rule.profileId_; }
+};
+
+#endif // SRE_RULE_SET_H
@@ -0,0 +1,761 @@
+#include "SreSearch.h"
+#include "SreSerialize.h"
+#include "SreMemory.h"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SRE_SEARCH_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SRE_SEARCH_NEON 1
+#endif
+
+// =============================
+// 单模式子串查找
+// =============================
+// 偏移 pos 处的候选位置：首字节和末字节已经相等，比较中间部分
+static inline bool sreMatchAt(const char *haystack, size_t pos, std::string_view needle) {
+    return std::memcmp(haystack + pos + 1, needle.data() + 1, needle.size() - 2) == 0;
+}
+
+static bool sreContainsScalar(std::string_view haystack, std::string_view needle) {
+    return haystack.find(needle) != std::string_view::npos;
+}
+
+// 以下内核要求候选位置（haystack.size() - needle.size() + 1）至少一个向量块，由 SreStringSearch::contains 保证
+#ifdef SRE_SEARCH_X86
+static bool sreContainsSse2(std::string_view haystack, std::string_view needle) {
+    const size_t n = needle.size();
+    const char *h = haystack.data();
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+    const size_t end = haystack.size() - (n - 1);
+    size_t i = 0;
+    while (i + 16 <= end) {
+        // 同 sreContainsAvx2：没有候选位置的块在不含函数调用的内层循环中跳过
+        unsigned mask;
+        do {
+            __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i));
+            __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i + n - 1));
+            mask = static_cast<unsigned>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast))));
+            if (mask) break;
+            i += 16;
+        } while (i + 16 <= end);
+        if (!mask) break;
+        do {
+            if (sreMatchAt(h, i + __builtin_ctz(mask), needle)) return true;
+            mask &= mask - 1;
+        } while (mask);
+        i += 16;
+    }
+    if (i == end) return false;
+    // 不足一块的尾部：取最后一整块，去掉已经检查过的位置
+    const size_t tail = end - 16;
+    __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + tail));
+    __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + tail + n - 1));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast))));
+    for (mask &= ~0u << (i - tail); mask; mask &= mask - 1) {
+        if (sreMatchAt(h, tail + __builtin_ctz(mask), needle)) return true;
+    }
+    return false;
+}
+
+__attribute__((target("avx2")))
+static bool sreContainsAvx2(std::string_view haystack, std::string_view needle) {
+    const size_t n = needle.size();
+    const char *h = haystack.data();
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+    const size_t end = haystack.size() - (n - 1);
+    size_t i = 0;
+    while (i + 32 <= end) {
+        // 没有候选位置的块在内层循环中跳过：循环里没有函数调用，变量都留在寄存器中
+        unsigned mask;
+        do {
+            __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(h + i));
+            __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(h + i + n - 1));
+            mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast))));
+            if (mask) break;
+            i += 32;
+        } while (i + 32 <= end);
+        if (!mask) break;
+        do {
+            if (sreMatchAt(h, i + __builtin_ctz(mask), needle)) return true;
+            mask &= mask - 1;
+        } while (mask);
+        i += 32;
+    }
+    if (i == end) return false;
+    // 不足一块的尾部：取最后一整块，去掉已经检查过的位置，不再转入标量查找
+    const size_t tail = end - 32;
+    __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(h + tail));
+    __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(h + tail + n - 1));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast))));
+    for (mask &= ~0u << (i - tail); mask; mask &= mask - 1) {
+        if (sreMatchAt(h, tail + __builtin_ctz(mask), needle)) return true;
+    }
+    return false;
+}
+#endif
+
+#ifdef SRE_SEARCH_NEON
+static bool sreContainsNeon(std::string_view haystack, std::string_view needle) {
+    const size_t n = needle.size();
+    const uint8_t *h = reinterpret_cast<const uint8_t *>(haystack.data());
+    const uint8x16_t first = vdupq_n_u8(static_cast<uint8_t>(needle[0]));
+    const uint8x16_t last = vdupq_n_u8(static_cast<uint8_t>(needle[n - 1]));
+    const size_t end = haystack.size() - (n - 1);
+    size_t i = 0;
+    while (i + 16 <= end) {
+        // 同 sreContainsAvx2：没有候选位置的块在不含函数调用的内层循环中跳过
+        uint64_t mask;
+        do {
+            uint8x16_t eq = vandq_u8(vceqq_u8(first, vld1q_u8(h + i)), vceqq_u8(last, vld1q_u8(h + i + n - 1)));
+            // 每个字节压缩为 4 位，得到 64 位掩码
+            mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+            if (mask) break;
+            i += 16;
+        } while (i + 16 <= end);
+        if (!mask) break;
+        do {
+            if (sreMatchAt(haystack.data(), i + __builtin_ctzll(mask) / 4, needle)) return true;
+            mask &= ~(0xFULL << (__builtin_ctzll(mask) & ~3U));
+        } while (mask);
+        i += 16;
+    }
+    if (i == end) return false;
+    // 不足一块的尾部：取最后一整块，去掉已经检查过的位置
+    const size_t tail = end - 16;
+    uint8x16_t eq = vandq_u8(vceqq_u8(first, vld1q_u8(h + tail)), vceqq_u8(last, vld1q_u8(h + tail + n - 1)));
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+    for (mask &= ~0ULL << (4 * (i - tail)); mask; mask &= ~(0xFULL << (__builtin_ctzll(mask) & ~3U))) {
+        if (sreMatchAt(haystack.data(), tail + __builtin_ctzll(mask) / 4, needle)) return true;
+    }
+    return false;
+}
+#endif
+
+using SreContainsKernel = bool (*)(std::string_view, std::string_view);
+
+struct SreSearchDispatch {
+    SreContainsKernel kernel;
+    const char *name;
+    size_t width;  // 一个向量块的字节数
+};
+
+static SreSearchDispatch sreSelectKernel() {
+#ifdef SRE_SEARCH_X86
+    if (__builtin_cpu_supports("avx2")) return { sreContainsAvx2, "avx2", 32 };
+    return { sreContainsSse2, "sse2", 16 };
+#elif defined(SRE_SEARCH_NEON)
+    return { sreContainsNeon, "neon", 16 };
+#else
+    return { sreContainsScalar, "scalar", 0 };
+#endif
+}
+
+static const SreSearchDispatch &sreSearchDispatch() {
+    static const SreSearchDispatch dispatch = sreSelectKernel();
+    return dispatch;
+}
+
+bool SreStringSearch::contains(std::string_view haystack, std::string_view needle) {
+    // 空串、单字节（memchr 已足够快）和过长的 needle 不走向量化路径
+    if (needle.size() < 2 || needle.size() > haystack.size()) {
+        return needle.size() <= haystack.size() && sreContainsScalar(haystack, needle);
+    }
+    // 内核按整块检查候选位置，尾部用最后一整块重叠检查；候选位置不足一块时直接用标量查找
+    const SreSearchDispatch &dispatch = sreSearchDispatch();
+    if (haystack.size() - needle.size() + 1 < dispatch.width) return sreContainsScalar(haystack, needle);
+    return dispatch.kernel(haystack, needle);
+}
+
+const char *SreStringSearch::kernelName() {
+    return sreSearchDispatch().name;
+}
+
+// =============================
+// 忽略大小写的查找
+// =============================
+// 折叠表：[first, last] 中与 first 相差 stride 整数倍的码点加上 delta，按 first 升序
+// 由 Unicode 14.0 CaseFolding.txt 的 C 和 S 项生成
+struct SreFoldRange {
+    uint32_t first;
+    uint32_t last;
+    int32_t delta;
+    uint32_t stride;
+};
+
+static const SreFoldRange kFoldRanges[] = {
+    { 0x00B5, 0x00B5, 775, 1 },
+    { 0x00C0, 0x00D6, 32, 1 },
+    { 0x00D8, 0x00DE, 32, 1 },
+    { 0x0100, 0x012E, 1, 2 },
+    { 0x0132, 0x0136, 1, 2 },
+    { 0x0139, 0x0147, 1, 2 },
+    { 0x014A, 0x0176, 1, 2 },
+    { 0x0178, 0x0178, -121, 1 },
+    { 0x0179, 0x017D, 1, 2 },
+    { 0x017F, 0x017F, -268, 1 },
+    { 0x0181, 0x0181, 210, 1 },
+    { 0x0182, 0x0184, 1, 2 },
+    { 0x0186, 0x0186, 206, 1 },
+    { 0x0187, 0x0187, 1, 1 },
+    { 0x0189, 0x018A, 205, 1 },
+    { 0x018B, 0x018B, 1, 1 },
+    { 0x018E, 0x018E, 79, 1 },
+    { 0x018F, 0x018F, 202, 1 },
+    { 0x0190, 0x0190, 203, 1 },
+    { 0x0191, 0x0191, 1, 1 },
+    { 0x0193, 0x0193, 205, 1 },
+    { 0x0194, 0x0194, 207, 1 },
+    { 0x0196, 0x0196, 211, 1 },
+    { 0x0197, 0x0197, 209, 1 },
+    { 0x0198, 0x0198, 1, 1 },
+    { 0x019C, 0x019C, 211, 1 },
+    { 0x019D, 0x019D, 213, 1 },
+    { 0x019F, 0x019F, 214, 1 },
+    { 0x01A0, 0x01A4, 1, 2 },
+    { 0x01A6, 0x01A6, 218, 1 },
+    { 0x01A7, 0x01A7, 1, 1 },
+    { 0x01A9, 0x01A9, 218, 1 },
+    { 0x01AC, 0x01AC, 1, 1 },
+    { 0x01AE, 0x01AE, 218, 1 },
+    { 0x01AF, 0x01AF, 1, 1 },
+    { 0x01B1, 0x01B2, 217, 1 },
+    { 0x01B3, 0x01B5, 1, 2 },
+    { 0x01B7, 0x01B7, 219, 1 },
+    { 0x01B8, 0x01B8, 1, 1 },
+    { 0x01BC, 0x01BC, 1, 1 },
+    { 0x01C4, 0x01C4, 2, 1 },
+    { 0x01C5, 0x01C5, 1, 1 },
+    { 0x01C7, 0x01C7, 2, 1 },
+    { 0x01C8, 0x01C8, 1, 1 },
+    { 0x01CA, 0x01CA, 2, 1 },
+    { 0x01CB, 0x01DB, 1, 2 },
+    { 0x01DE, 0x01EE, 1, 2 },
+    { 0x01F1, 0x01F1, 2, 1 },
+    { 0x01F2, 0x01F4, 1, 2 },
+    { 0x01F6, 0x01F6, -97, 1 },
+    { 0x01F7, 0x01F7, -56, 1 },
+    { 0x01F8, 0x021E, 1, 2 },
+    { 0x0220, 0x0220, -130, 1 },
+    { 0x0222, 0x0232, 1, 2 },
+    { 0x023A, 0x023A, 10795, 1 },
+    { 0x023B, 0x023B, 1, 1 },
+    { 0x023D, 0x023D, -163, 1 },
+    { 0x023E, 0x023E, 10792, 1 },
+    { 0x0241, 0x0241, 1, 1 },
+    { 0x0243, 0x0243, -195, 1 },
+    { 0x0244, 0x0244, 69, 1 },
+    { 0x0245, 0x0245, 71, 1 },
+    { 0x0246, 0x024E, 1, 2 },
+    { 0x0345, 0x0345, 116, 1 },
+    { 0x0370, 0x0372, 1, 2 },
+    { 0x0376, 0x0376, 1, 1 },
+    { 0x037F, 0x037F, 116, 1 },
+    { 0x0386, 0x0386, 38, 1 },
+    { 0x0388, 0x038A, 37, 1 },
+    { 0x038C, 0x038C, 64, 1 },
+    { 0x038E, 0x038F, 63, 1 },
+    { 0x0391, 0x03A1, 32, 1 },
+    { 0x03A3, 0x03AB, 32, 1 },
+    { 0x03C2, 0x03C2, 1, 1 },
+    { 0x03CF, 0x03CF, 8, 1 },
+    { 0x03D0, 0x03D0, -30, 1 },
+    { 0x03D1, 0x03D1, -25, 1 },
+    { 0x03D5, 0x03D5, -15, 1 },
+    { 0x03D6, 0x03D6, -22, 1 },
+    { 0x03D8, 0x03EE, 1, 2 },
+    { 0x03F0, 0x03F0, -54, 1 },
+    { 0x03F1, 0x03F1, -48, 1 },
+    { 0x03F4, 0x03F4, -60, 1 },
+    { 0x03F5, 0x03F5, -64, 1 },
+    { 0x03F7, 0x03F7, 1, 1 },
+    { 0x03F9, 0x03F9, -7, 1 },
+    { 0x03FA, 0x03FA, 1, 1 },
+    { 0x03FD, 0x03FF, -130, 1 },
+    { 0x0400, 0x040F, 80, 1 },
+    { 0x0410, 0x042F, 32, 1 },
+    { 0x0460, 0x0480, 1, 2 },
+    { 0x048A, 0x04BE, 1, 2 },
+    { 0x04C0, 0x04C0, 15, 1 },
+    { 0x04C1, 0x04CD, 1, 2 },
+    { 0x04D0, 0x052E, 1, 2 },
+    { 0x0531, 0x0556, 48, 1 },
+    { 0x10A0, 0x10C5, 7264, 1 },
+    { 0x10C7, 0x10C7, 7264, 1 },
+    { 0x10CD, 0x10CD, 7264, 1 },
+    { 0x13F8, 0x13FD, -8, 1 },
+    { 0x1C80, 0x1C80, -6222, 1 },
+    { 0x1C81, 0x1C81, -6221, 1 },
+    { 0x1C82, 0x1C82, -6212, 1 },
+    { 0x1C83, 0x1C84, -6210, 1 },
+    { 0x1C85, 0x1C85, -6211, 1 },
+    { 0x1C86, 0x1C86, -6204, 1 },
+    { 0x1C87, 0x1C87, -6180, 1 },
+    { 0x1C88, 0x1C88, 35267, 1 },
+    { 0x1C90, 0x1CBA, -3008, 1 },
+    { 0x1CBD, 0x1CBF, -3008, 1 },
+    { 0x1E00, 0x1E94, 1, 2 },
+    { 0x1E9B, 0x1E9B, -58, 1 },
+    { 0x1E9E, 0x1E9E, -7615, 1 },
+    { 0x1EA0, 0x1EFE, 1, 2 },
+    { 0x1F08, 0x1F0F, -8, 1 },
+    { 0x1F18, 0x1F1D, -8, 1 },
+    { 0x1F28, 0x1F2F, -8, 1 },
+    { 0x1F38, 0x1F3F, -8, 1 },
+    { 0x1F48, 0x1F4D, -8, 1 },
+    { 0x1F59, 0x1F5F, -8, 2 },
+    { 0x1F68, 0x1F6F, -8, 1 },
+    { 0x1F88, 0x1F8F, -8, 1 },
+    { 0x1F98, 0x1F9F, -8, 1 },
+    { 0x1FA8, 0x1FAF, -8, 1 },
+    { 0x1FB8, 0x1FB9, -8, 1 },
+    { 0x1FBA, 0x1FBB, -74, 1 },
+    { 0x1FBC, 0x1FBC, -9, 1 },
+    { 0x1FBE, 0x1FBE, -7173, 1 },
+    { 0x1FC8, 0x1FCB, -86, 1 },
+    { 0x1FCC, 0x1FCC, -9, 1 },
+    { 0x1FD8, 0x1FD9, -8, 1 },
+    { 0x1FDA, 0x1FDB, -100, 1 },
+    { 0x1FE8, 0x1FE9, -8, 1 },
+    { 0x1FEA, 0x1FEB, -112, 1 },
+    { 0x1FEC, 0x1FEC, -7, 1 },
+    { 0x1FF8, 0x1FF9, -128, 1 },
+    { 0x1FFA, 0x1FFB, -126, 1 },
+    { 0x1FFC, 0x1FFC, -9, 1 },
+    { 0x2126, 0x2126, -7517, 1 },
+    { 0x212A, 0x212A, -8383, 1 },
+    { 0x212B, 0x212B, -8262, 1 },
+    { 0x2132, 0x2132, 28, 1 },
+    { 0x2160, 0x216F, 16, 1 },
+    { 0x2183, 0x2183, 1, 1 },
+    { 0x24B6, 0x24CF, 26, 1 },
+    { 0x2C00, 0x2C2F, 48, 1 },
+    { 0x2C60, 0x2C60, 1, 1 },
+    { 0x2C62, 0x2C62, -10743, 1 },
+    { 0x2C63, 0x2C63, -3814, 1 },
+    { 0x2C64, 0x2C64, -10727, 1 },
+    { 0x2C67, 0x2C6B, 1, 2 },
+    { 0x2C6D, 0x2C6D, -10780, 1 },
+    { 0x2C6E, 0x2C6E, -10749, 1 },
+    { 0x2C6F, 0x2C6F, -10783, 1 },
+    { 0x2C70, 0x2C70, -10782, 1 },
+    { 0x2C72, 0x2C72, 1, 1 },
+    { 0x2C75, 0x2C75, 1, 1 },
+    { 0x2C7E, 0x2C7F, -10815, 1 },
+    { 0x2C80, 0x2CE2, 1, 2 },
+    { 0x2CEB, 0x2CED, 1, 2 },
+    { 0x2CF2, 0x2CF2, 1, 1 },
+    { 0xA640, 0xA66C, 1, 2 },
+    { 0xA680, 0xA69A, 1, 2 },
+    { 0xA722, 0xA72E, 1, 2 },
+    { 0xA732, 0xA76E, 1, 2 },
+    { 0xA779, 0xA77B, 1, 2 },
+    { 0xA77D, 0xA77D, -35332, 1 },
+    { 0xA77E, 0xA786, 1, 2 },
+    { 0xA78B, 0xA78B, 1, 1 },
+    { 0xA78D, 0xA78D, -42280, 1 },
+    { 0xA790, 0xA792, 1, 2 },
+    { 0xA796, 0xA7A8, 1, 2 },
+    { 0xA7AA, 0xA7AA, -42308, 1 },
+    { 0xA7AB, 0xA7AB, -42319, 1 },
+    { 0xA7AC, 0xA7AC, -42315, 1 },
+    { 0xA7AD, 0xA7AD, -42305, 1 },
+    { 0xA7AE, 0xA7AE, -42308, 1 },
+    { 0xA7B0, 0xA7B0, -42258, 1 },
+    { 0xA7B1, 0xA7B1, -42282, 1 },
+    { 0xA7B2, 0xA7B2, -42261, 1 },
+    { 0xA7B3, 0xA7B3, 928, 1 },
+    { 0xA7B4, 0xA7C2, 1, 2 },
+    { 0xA7C4, 0xA7C4, -48, 1 },
+    { 0xA7C5, 0xA7C5, -42307, 1 },
+    { 0xA7C6, 0xA7C6, -35384, 1 },
+    { 0xA7C7, 0xA7C9, 1, 2 },
+    { 0xA7D0, 0xA7D0, 1, 1 },
+    { 0xA7D6, 0xA7D8, 1, 2 },
+    { 0xA7F5, 0xA7F5, 1, 1 },
+    { 0xAB70, 0xABBF, -38864, 1 },
+    { 0xFF21, 0xFF3A, 32, 1 },
+    { 0x10400, 0x10427, 40, 1 },
+    { 0x104B0, 0x104D3, 40, 1 },
+    { 0x10570, 0x1057A, 39, 1 },
+    { 0x1057C, 0x1058A, 39, 1 },
+    { 0x1058C, 0x10592, 39, 1 },
+    { 0x10594, 0x10595, 39, 1 },
+    { 0x10C80, 0x10CB2, 64, 1 },
+    { 0x118A0, 0x118BF, 32, 1 },
+    { 0x16E40, 0x16E5F, 32, 1 },
+    { 0x1E900, 0x1E921, 34, 1 },
+};
+
+static inline char sreLowerAscii(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32) : c;
+}
+
+static uint32_t sreFoldCodePoint(uint32_t code) {
+    const SreFoldRange *end = kFoldRanges + sizeof(kFoldRanges) / sizeof(kFoldRanges[0]);
+    const SreFoldRange *range = std::upper_bound(kFoldRanges, end, code,
+        [](uint32_t c, const SreFoldRange &r) { return c < r.first; });
+    if (range == kFoldRanges) return code;
+    --range;
+    if (code > range->last || (code - range->first) % range->stride) return code;
+    return static_cast<uint32_t>(static_cast<int32_t>(code) + range->delta);
+}
+
+// 写入 code 的 UTF-8 编码，返回写入之后的位置
+static char *sreWriteUtf8(uint32_t code, char *out) {
+    if (code < 0x80) {
+        *out++ = static_cast<char>(code);
+    } else if (code < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (code >> 6));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (code >> 12));
+        *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (code >> 18));
+        *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+    }
+    return out;
+}
+
+// 解码 p 处的一个 UTF-8 字符，返回字节数；非法或不完整的序列返回 0
+static size_t sreDecodeUtf8(const unsigned char *p, const unsigned char *end, uint32_t &code) {
+    size_t length = *p >= 0xF0 ? 4 : *p >= 0xE0 ? 3 : *p >= 0xC2 ? 2 : 0;
+    if (length == 0 || *p > 0xF4 || static_cast<size_t>(end - p) < length) return 0;
+    code = *p & (0x7F >> length);
+    for (size_t i = 1; i < length; ++i) {
+        if ((p[i] & 0xC0) != 0x80) return 0;
+        code = (code << 6) | (p[i] & 0x3F);
+    }
+    // 过长编码和代理项
+    static const uint32_t kMin[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (code < kMin[length] || (code >= 0xD800 && code < 0xE000) || code > 0x10FFFF) return 0;
+    return length;
+}
+
+void SreCaseFold::fold(std::string_view text, std::string &out) {
+    // 折叠最多把 2 字节的字符变为 3 字节（例如 U+023A -> U+2C65），先按 1.5 倍预留，最后截断
+    size_t base = out.size();
+    out.resize(base + text.size() + text.size() / 2);
+    char *w = &out[base];
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(text.data());
+    const unsigned char *end = p + text.size();
+    while (p < end) {
+#ifdef SRE_SEARCH_X86
+        // 整块 16 字节转小写（非 ASCII 字节不变）并写出，前面连续的 ASCII 字节即为结果；
+        // 输出不超过已读输入的 1.5 倍，剩余空间总是不小于 16 字节
+        if (end - p >= 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('A' - 1)),
+                                          _mm_cmplt_epi8(block, _mm_set1_epi8('Z' + 1)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(w), _mm_add_epi8(block, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(block));
+            size_t ascii = mask ? static_cast<size_t>(__builtin_ctz(mask)) : 16;
+            p += ascii;
+            w += ascii;
+            if (!mask) continue;
+        }
+#endif
+        if (*p < 0x80) {
+            *w++ = sreLowerAscii(static_cast<char>(*p++));
+            continue;
+        }
+        // U+3000 到 U+9FFF（中日文标点、假名和中日韩统一表意文字）没有大小写，校验后直接复制
+        if (*p >= 0xE3 && *p <= 0xE9 && end - p >= 3 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80) {
+            std::memcpy(w, p, 3);
+            p += 3;
+            w += 3;
+            continue;
+        }
+        uint32_t code;
+        size_t length = sreDecodeUtf8(p, end, code);
+        if (length == 0) {
+            *w++ = static_cast<char>(*p++);
+            continue;
+        }
+        // 中日韩文字、假名和谚文所在的两段区间中没有需要折叠的字符
+        bool mayFold = code >= kFoldRanges[0].first && !(code > 0x2CF2 && code < 0xA640) && !(code > 0xABBF && code < 0xFF21);
+        uint32_t folded = mayFold ? sreFoldCodePoint(code) : code;
+        if (folded == code) {
+            std::memcpy(w, p, length);
+            w += length;
+        } else {
+            w = sreWriteUtf8(folded, w);
+        }
+        p += length;
+    }
+    out.resize(static_cast<size_t>(w - out.data()));
+}
+
+std::string SreCaseFold::fold(std::string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    fold(text, out);
+    return out;
+}
+
+static bool sreIsAscii(std::string_view text) {
+    const char *p = text.data();
+    size_t n = text.size(), i = 0;
+#ifdef SRE_SEARCH_X86
+    __m128i bits = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        bits = _mm_or_si128(bits, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i)));
+    }
+    if (_mm_movemask_epi8(bits)) return false;
+#else
+    uint64_t bits = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        bits |= word;
+    }
+    if (bits & 0x8080808080808080ULL) return false;
+#endif
+    for (; i < n; ++i) {
+        if (static_cast<unsigned char>(p[i]) >= 0x80) return false;
+    }
+    return true;
+}
+
+// 纯 ASCII 的 haystack 中忽略大小写查找 needle：大写字母只会折叠为对应的小写字母
+static inline bool sreMatchAsciiAt(const char *haystack, std::string_view needle) {
+    for (size_t j = 0; j < needle.size(); ++j) {
+        if (sreLowerAscii(haystack[j]) != needle[j]) return false;
+    }
+    return true;
+}
+
+static bool sreContainsAscii(std::string_view haystack, std::string_view needle) {
+    const size_t n = needle.size();
+    if (n > haystack.size()) return false;
+    const char *h = haystack.data();
+    size_t i = 0;
+#ifdef SRE_SEARCH_X86
+    // 按字节或上 0x20 后比较首末字节，得到的候选位置包含所有大小写形式，再逐字节确认
+    if (n >= 2) {
+        const __m128i caseBit = _mm_set1_epi8(0x20);
+        const __m128i first = _mm_set1_epi8(static_cast<char>(needle[0] | 0x20));
+        const __m128i last = _mm_set1_epi8(static_cast<char>(needle[n - 1] | 0x20));
+        for (; i + n - 1 + 16 <= haystack.size(); i += 16) {
+            __m128i blockFirst = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i)), caseBit);
+            __m128i blockLast = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i + n - 1)), caseBit);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast))));
+            while (mask) {
+                if (sreMatchAsciiAt(h + i + __builtin_ctz(mask), needle)) return true;
+                mask &= mask - 1;
+            }
+        }
+    }
+#endif
+    for (; i + n <= haystack.size(); ++i) {
+        if (sreMatchAsciiAt(h + i, needle)) return true;
+    }
+    return false;
+}
+
+// 含非 ASCII 字节的 haystack 折叠到线程内复用的缓冲区
+static std::string_view sreFoldBuffer(std::string_view haystack) {
+    static thread_local std::string buffer;
+    buffer.clear();
+    SreCaseFold::fold(haystack, buffer);
+    return buffer;
+}
+
+bool SreCaseFold::contains(std::string_view haystack, std::string_view needle) {
+    if (sreIsAscii(haystack)) return sreContainsAscii(haystack, needle);
+    return SreStringSearch::contains(sreFoldBuffer(haystack), needle);
+}
+
+bool SreCaseFold::containsAny(std::string_view haystack, const std::string_view *needles, size_t count) {
+    if (sreIsAscii(haystack)) {
+        for (size_t i = 0; i < count; ++i) {
+            if (sreContainsAscii(haystack, needles[i])) return true;
+        }
+        return false;
+    }
+    std::string_view folded = sreFoldBuffer(haystack);
+    for (size_t i = 0; i < count; ++i) {
+        if (SreStringSearch::contains(folded, needles[i])) return true;
+    }
+    return false;
+}
+
+// =============================
+// Aho-Corasick
+// =============================
+uint32_t SreAhoCorasick::add(std::string_view pattern) {
+    std::string key(pattern);
+    auto it = patternIndex_.find(key);
+    if (it != patternIndex_.end()) return it->second;
+    uint32_t index = static_cast<uint32_t>(patterns_.size());
+    patterns_.push_back(key);
+    patternIndex_[key] = index;
+    return index;
+}
+
+size_t SreAhoCorasick::memoryUsage() const {
+    return sreHeapBytes(patterns_) + sreHeapBytes(patternIndex_) + sreHeapBytes(delta_) + sreHeapBytes(outStart_) +
+           sreHeapBytes(outputs_);
+}
+
+void SreAhoCorasick::build() {
+    // 模式串中出现过的字节各占一个等价类，其余字节共用类 0
+    for (auto &c : classOf_) c = 0;
+    classCount_ = 1;
+    for (auto &pattern : patterns_) {
+        for (unsigned char c : pattern) {
+            if (classOf_[c] == 0) {
+                if (classCount_ > UINT8_MAX) {
+                    throw std::runtime_error("Too many distinct bytes in patterns");
+                }
+                classOf_[c] = static_cast<uint8_t>(classCount_++);
+            }
+        }
+    }
+
+    // 构建 trie，UINT32_MAX 表示没有子节点
+    const uint32_t kNone = UINT32_MAX;
+    delta_.assign(classCount_, kNone);
+    std::vector<std::vector<uint32_t>> own(1);
+    for (uint32_t p = 0; p < patterns_.size(); ++p) {
+        uint32_t state = 0;
+        for (unsigned char c : patterns_[p]) {
+            uint32_t &next = delta_[state * classCount_ + classOf_[c]];
+            if (next == kNone) {
+                next = static_cast<uint32_t>(own.size());
+                own.emplace_back();
+                delta_.resize(delta_.size() + classCount_, kNone);
+            }
+            // resize 可能使 next 引用失效，重新读取
+            state = delta_[state * classCount_ + classOf_[c]];
+        }
+        own[state].push_back(p);
+    }
+
+    // 按层序计算失败链接，同时把 trie 补全为 DFA 并合并输出
+    size_t stateCount = own.size();
+    std::vector<uint32_t> fail(stateCount, 0);
+    // 根状态的输出（空串）单独处理，不沿失败链接合并，避免每个状态都带上它
+    std::vector<std::vector<uint32_t>> out(stateCount);
+    std::deque<uint32_t> queue;
+    for (uint32_t c = 0; c < classCount_; ++c) {
+        uint32_t &next = delta_[c];
+        if (next == kNone) {
+            next = 0;
+        } else {
+            fail[next] = 0;
+            queue.push_back(next);
+        }
+    }
+    while (!queue.empty()) {
+        uint32_t state = queue.front();
+        queue.pop_front();
+        out[state] = own[state];
+        out[state].insert(out[state].end(), out[fail[state]].begin(), out[fail[state]].end());
+        for (uint32_t c = 0; c < classCount_; ++c) {
+            uint32_t &next = delta_[state * classCount_ + c];
+            uint32_t fallback = delta_[fail[state] * classCount_ + c];
+            if (next == kNone) {
+                next = fallback;
+            } else {
+                fail[next] = fallback;
+                queue.push_back(next);
+            }
+        }
+    }
+
+    outStart_.assign(stateCount + 1, 0);
+    outputs_.clear();
+    out[0] = own[0];
+    for (size_t s = 0; s < stateCount; ++s) {
+        outStart_[s] = static_cast<uint32_t>(outputs_.size());
+        outputs_.insert(outputs_.end(), out[s].begin(), out[s].end());
+    }
+    outStart_[stateCount] = static_cast<uint32_t>(outputs_.size());
+}
+
+void SreAhoCorasick::scan(std::string_view text, uint8_t *found) const {
+    scanWith<false>(text, found, nullptr);
+}
+
+void SreAhoCorasick::scan(std::string_view text, uint8_t *found, std::vector<uint32_t> &newly) const {
+    scanWith<true>(text, found, &newly);
+}
+
+template<bool Collect>
+void SreAhoCorasick::scanWith(std::string_view text, uint8_t *found, std::vector<uint32_t> *newly) const {
+    auto mark = [&](uint32_t pattern) {
+        if (Collect && !found[pattern]) newly->push_back(pattern);
+        found[pattern] = 1;
+    };
+    // 根状态的输出只有空串，空串总是匹配
+    for (uint32_t i = outStart_[0]; i < outStart_[1]; ++i) {
+        mark(outputs_[i]);
+    }
+    const uint32_t *delta = delta_.data();
+    uint32_t state = 0;
+    for (unsigned char c : text) {
+        state = delta[state * classCount_ + classOf_[c]];
+        for (uint32_t i = outStart_[state]; i < outStart_[state + 1]; ++i) {
+            mark(outputs_[i]);
+        }
+    }
+}
+
+void SreAhoCorasick::save(SreBinaryWriter &out) const {
+    out.pod<uint64_t>(patterns_.size());
+    for (auto &pattern : patterns_) {
+        out.string(pattern);
+    }
+    std::vector<uint8_t> classes(classOf_, classOf_ + 256);
+    out.array(classes);
+    out.pod(classCount_);
+    out.array(delta_);
+    out.array(outStart_);
+    out.array(outputs_);
+}
+
+void SreAhoCorasick::load(SreBinaryReader &in) {
+    patterns_.clear();
+    patternIndex_.clear();
+    size_t count = in.count();
+    for (size_t i = 0; i < count; ++i) {
+        patterns_.push_back(in.string());
+        patternIndex_[patterns_.back()] = static_cast<uint32_t>(i);
+    }
+    std::vector<uint8_t> classes;
+    in.array(classes);
+    if (classes.size() != 256) SreBinaryReader::fail();
+    std::copy(classes.begin(), classes.end(), classOf_);
+    classCount_ = in.pod<uint32_t>();
+    in.array(delta_);
+    in.array(outStart_);
+    in.array(outputs_);
+
+    // 扫描时不做边界检查，读取时校验所有下标
+    if (classCount_ == 0 || delta_.size() % classCount_ != 0) SreBinaryReader::fail();
+    size_t states = delta_.size() / classCount_;
+    if (states == 0 || outStart_.size() != states + 1 || outStart_.back() != outputs_.size()) SreBinaryReader::fail();
+    for (uint8_t c : classes) SreBinaryReader::check(c, classCount_);
+    for (uint32_t next : delta_) SreBinaryReader::check(next, states);
+    for (size_t s = 0; s < states; ++s) {
+        if (outStart_[s] > outStart_[s + 1]) SreBinaryReader::fail();
+    }
+    for (uint32_t pattern : outputs_) SreBinaryReader::check(pattern, patterns_.size());
+}
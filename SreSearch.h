@@ -0,0 +1,74 @@
+#ifndef SRE_SEARCH_H
+#define SRE_SEARCH_H
+
+// 内部头文件：字符串查找相关的算法
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 单模式子串查找：按首字节和末字节同时过滤候选位置，一次比较 16/32 字节，
+// 只有两端都相等的位置才做完整比较；对短 needle 明显快于逐字节查找
+// 运行时按 CPU 能力选择 AVX2、SSE2 或 NEON 实现，其它平台退回标量实现；
+// 不足一块的尾部用最后一整块重叠比较，候选位置不足一块的短文本直接用 std::string_view::find
+class SreStringSearch {
+public:
+    static bool contains(std::string_view haystack, std::string_view needle);
+    // 当前选用的实现名，用于基准测试和日志
+    static const char *kernelName();
+};
+
+// 忽略大小写的查找：按 Unicode 简单大小写折叠（CaseFolding.txt 中的 C 和 S 项）把大写转为小写后比较
+// 折叠表取自 Unicode 14.0，覆盖拉丁、希腊、西里尔等有大小写的文字以及全角拉丁字母；中日韩文字没有大小写，原样保留
+// 纯 ASCII 的文本不做折叠，直接按忽略大小写的首末字节过滤候选位置；含非 ASCII 字节时先折叠到线程内复用的缓冲区再查找
+class SreCaseFold {
+public:
+    // 折叠 text 追加到 out；折叠后长度可能变化，非法的 UTF-8 字节原样保留
+    static void fold(std::string_view text, std::string &out);
+    static std::string fold(std::string_view text);
+    // 以下 needle 必须已经折叠过
+    static bool contains(std::string_view haystack, std::string_view needle);
+    static bool containsAny(std::string_view haystack, const std::string_view *needles, size_t count);
+};
+
+class SreBinaryWriter;
+class SreBinaryReader;
+
+// Aho-Corasick 多模式匹配：一次扫描文本，找出所有出现过的模式串
+// 字节先映射为等价类以压缩状态转移表，构建后的自动机为完全 DFA，扫描时每个字节只查一次表
+class SreAhoCorasick {
+public:
+    // 添加模式串，返回模式下标；相同的模式串返回同一个下标
+    // 添加后需要重新 build
+    uint32_t add(std::string_view pattern);
+    void build();
+
+    size_t patternCount() const { return patterns_.size(); }
+    // 堆上占用的字节数，不含对象本身
+    size_t memoryUsage() const;
+
+    // 扫描文本，模式 i 出现时 found[i] 置 1；found 的长度不小于 patternCount()
+    void scan(std::string_view text, uint8_t *found) const;
+    // 同上，另外把 found 从 0 变为 1 的模式下标依次追加到 newly
+    void scan(std::string_view text, uint8_t *found, std::vector<uint32_t> &newly) const;
+
+    // 序列化已构建的自动机（见 SreSerialize.h），读取后无需重新 build
+    void save(SreBinaryWriter &out) const;
+    void load(SreBinaryReader &in);
+
+private:
+    template<bool Collect>
+    void scanWith(std::string_view text, uint8_t *found, std::vector<uint32_t> *newly) const;
+
+    std::vector<std::string> patterns_;
+    std::unordered_map<std::string, uint32_t> patternIndex_;
+
+    uint8_t classOf_[256] = {};
+    uint32_t classCount_ = 0;
+    std::vector<uint32_t> delta_;      // 状态转移表：delta_[state * classCount_ + class]
+    std::vector<uint32_t> outStart_;   // 状态 s 的输出为 outputs_[outStart_[s], outStart_[s + 1])
+    std::vector<uint32_t> outputs_;
+};
+
+#endif // SRE_SEARCH_H
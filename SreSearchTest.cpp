@@ -0,0 +1,38 @@
+// 子串查找测试：向量化内核（含尾部的重叠块和不对齐的起点）与 std::string_view::find 的结果一致
+// 用法：sre_search_test [种子]；返回值非 0 表示失败
+#include "SreSearch.h"
+#include "SreTest.h"
+#include <cstdlib>
+#include <random>
+
+namespace {
+
+// 字母表很小，首末字节经常相等，候选位置多；含多字节 UTF-8 的首字节
+std::string sreText(std::mt19937 &rng, size_t size) {
+    static const char alphabet[] = { 'a', 'b', 'x', '\xE6', '\0' };
+    std::string text(size, 'a');
+    for (auto &c : text) c = alphabet[rng() % sizeof(alphabet)];
+    return text;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 9;
+    std::mt19937 rng(seed);
+    size_t checks = 0;
+    for (int i = 0; i < 200000; ++i) {
+        std::string haystack = sreText(rng, rng() % 300);
+        std::string needle = sreText(rng, rng() % 10);
+        // 一部分文本中放入 needle，位置随机，包括最后一块
+        if (rng() % 3 == 0 && haystack.size() > needle.size()) {
+            haystack.replace(rng() % (haystack.size() - needle.size() + 1), needle.size(), needle);
+        }
+        std::string_view view = std::string_view(haystack).substr(rng() % (haystack.size() / 4 + 1));
+        SRE_CHECK(SreStringSearch::contains(view, needle) == (view.find(needle) != std::string_view::npos),
+                  "contains(\"" + std::string(view) + "\", \"" + needle + "\")");
+        ++checks;
+    }
+    std::cout << checks << " checks, kernel " << SreStringSearch::kernelName() << ", seed " << seed << "\n";
+    return sreTestResult("search test");
+}
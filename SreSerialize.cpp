@@ -0,0 +1,174 @@
+#include "SreSerialize.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SRE_HAVE_MMAP 1
+#endif
+
+namespace {
+// 与负载的对齐一致，负载从 8 字节边界开始
+struct SreFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t payloadSize;
+    uint64_t checksum;
+};
+const uint32_t kByteOrder = 0x01020304;
+
+// FNV-1a 64 位
+uint64_t sreChecksum(const char *data, size_t size) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// 临时文件名：与目标文件在同一目录（改名才是原子的），进程号和进程内序号保证同时写同一文件时互不覆盖
+std::string sreTempName(const std::string &path) {
+    static std::atomic<uint64_t> sequence{ 0 };
+#ifdef SRE_HAVE_MMAP
+    uint64_t pid = static_cast<uint64_t>(::getpid());
+#else
+    uint64_t pid = 0;
+#endif
+    return path + ".tmp." + std::to_string(pid) + "." + std::to_string(sequence.fetch_add(1));
+}
+
+#ifdef SRE_HAVE_MMAP
+// 独占创建临时文件（O_EXCL），名字已被占用时换一个；权限与普通新建文件相同（按 umask）
+int sreCreateTemp(const std::string &path, std::string &tmp) {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        tmp = sreTempName(path);
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0 || errno != EEXIST) return fd;
+    }
+    return -1;
+}
+
+bool sreWriteAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+#endif
+}
+
+SreMappedFile::SreMappedFile(const std::string &path) : data_(nullptr), size_(0), mapped_(false) {
+#ifdef SRE_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+        void *map = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Cannot map file: " + path);
+        }
+        data_ = static_cast<const char *>(map);
+        mapped_ = true;
+    }
+    // 映射建立后即可关闭文件描述符
+    ::close(fd);
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+}
+
+SreMappedFile::~SreMappedFile() {
+#ifdef SRE_HAVE_MMAP
+    if (mapped_) {
+        ::munmap(const_cast<char *>(data_), size_);
+    }
+#endif
+}
+
+void sreWriteFile(const std::string &path, const char magic[8], uint32_t version, const std::string &payload) {
+    SreFileHeader header;
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = version;
+    header.byteOrder = kByteOrder;
+    header.payloadSize = payload.size();
+    header.checksum = sreChecksum(payload.data(), payload.size());
+
+    std::string tmp;
+#ifdef SRE_HAVE_MMAP
+    int fd = sreCreateTemp(path, tmp);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + tmp);
+    }
+    bool written = sreWriteAll(fd, reinterpret_cast<const char *>(&header), sizeof(header)) &&
+                   sreWriteAll(fd, payload.data(), payload.size());
+    if (::close(fd) != 0) written = false;
+    if (!written) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Cannot write file: " + tmp);
+    }
+#else
+    tmp = sreTempName(path);
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Cannot open file: " + tmp);
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        out.flush();
+        if (!out) {
+            out.close();
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Cannot write file: " + tmp);
+        }
+    }
+#endif
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Cannot write file: " + path);
+    }
+}
+
+SreBinaryReader sreOpenPayload(const SreMappedFile &file, const char magic[8], uint32_t version) {
+    SreFileHeader header;
+    if (file.size() < sizeof(header)) SreBinaryReader::fail();
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0) SreBinaryReader::fail();
+    if (header.byteOrder != kByteOrder) {
+        throw std::runtime_error("Rule set file has a different byte order");
+    }
+    if (header.version != version) {
+        throw std::runtime_error("Unsupported rule set file version: " + std::to_string(header.version));
+    }
+    const char *payload = file.data() + sizeof(header);
+    if (header.payloadSize != file.size() - sizeof(header)) SreBinaryReader::fail();
+    if (sreChecksum(payload, header.payloadSize) != header.checksum) SreBinaryReader::fail();
+    return SreBinaryReader(payload, header.payloadSize);
+}
@@ -0,0 +1,133 @@
+#ifndef SRE_SERIALIZE_H
+#define SRE_SERIALIZE_H
+
+// 内部头文件：二进制序列化
+// 格式与地址无关：只包含定长的整数、按下标互相引用的数组和带长度的字符串，不含指针；
+// 整数按本机字节序写入，文件头记录字节序，读取时不一致直接报错。
+// 定长元素的数组按自身对齐写入，读取时整块拷贝，不逐个解析
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+class SreBinaryWriter {
+public:
+    template<typename T>
+    void pod(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "pod requires a trivially copyable type");
+        align(alignof(T));
+        out_.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+    // 元素个数 + 连续的元素
+    template<typename T>
+    void array(const std::vector<T> &values) {
+        static_assert(std::is_trivially_copyable<T>::value, "array requires a trivially copyable type");
+        pod<uint64_t>(values.size());
+        align(alignof(T));
+        out_.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+    void string(std::string_view text) {
+        pod<uint32_t>(static_cast<uint32_t>(text.size()));
+        out_.append(text.data(), text.size());
+    }
+
+    const std::string &data() const { return out_; }
+
+private:
+    void align(size_t alignment) {
+        while (out_.size() % alignment) out_.push_back('\0');
+    }
+    std::string out_;
+};
+
+// 读取时检查边界，越界视为文件损坏
+class SreBinaryReader {
+public:
+    SreBinaryReader(const char *data, size_t size) : data_(data), size_(size), pos_(0) {}
+
+    template<typename T>
+    T pod() {
+        static_assert(std::is_trivially_copyable<T>::value, "pod requires a trivially copyable type");
+        align(alignof(T));
+        need(sizeof(T));
+        T value;
+        std::memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+    template<typename T>
+    void array(std::vector<T> &values) {
+        static_assert(std::is_trivially_copyable<T>::value, "array requires a trivially copyable type");
+        uint64_t count = pod<uint64_t>();
+        align(alignof(T));
+        if (count > (size_ - pos_) / sizeof(T)) fail();
+        values.resize(static_cast<size_t>(count));
+        if (!values.empty()) std::memcpy(values.data(), data_ + pos_, values.size() * sizeof(T));
+        pos_ += values.size() * sizeof(T);
+    }
+    std::string string() {
+        uint32_t size = pod<uint32_t>();
+        need(size);
+        std::string text(data_ + pos_, size);
+        pos_ += size;
+        return text;
+    }
+    // 元素个数，调用方逐个读取元素；个数不可能超过剩余字节数
+    size_t count() {
+        uint64_t count = pod<uint64_t>();
+        if (count > size_ - pos_) fail();
+        return static_cast<size_t>(count);
+    }
+
+    bool atEnd() const { return pos_ == size_; }
+    [[noreturn]] static void fail() {
+        throw std::runtime_error("Corrupt rule set file");
+    }
+    // 下标校验：index < size，否则视为文件损坏
+    static void check(uint64_t index, size_t size) {
+        if (index >= size) fail();
+    }
+
+private:
+    void align(size_t alignment) {
+        size_t pad = (alignment - pos_ % alignment) % alignment;
+        need(pad);
+        pos_ += pad;
+    }
+    void need(size_t bytes) {
+        if (bytes > size_ - pos_) fail();
+    }
+    const char *data_;
+    size_t size_;
+    size_t pos_;
+};
+
+// 只读映射整个文件；不支持 mmap 的平台退回一次性读入内存
+class SreMappedFile {
+public:
+    explicit SreMappedFile(const std::string &path);
+    ~SreMappedFile();
+    SreMappedFile(const SreMappedFile &) = delete;
+    SreMappedFile &operator=(const SreMappedFile &) = delete;
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char *data_;
+    size_t size_;
+    bool mapped_;
+    std::vector<char> buffer_;
+};
+
+// 带文件头的整体读写：文件头包含魔数、格式版本、字节序、负载长度和校验和
+// 写入先在同一目录写一个独占创建、名字唯一的临时文件再改名，读者不会看到写了一半的文件，
+// 多个线程或进程同时写同一路径时以最后改名的为准
+void sreWriteFile(const std::string &path, const char magic[8], uint32_t version, const std::string &payload);
+// 校验文件头，返回负载所在的位置；魔数、版本、字节序或校验和不符时抛异常
+SreBinaryReader sreOpenPayload(const SreMappedFile &file, const char magic[8], uint32_t version);
+
+#endif // SRE_SERIALIZE_H
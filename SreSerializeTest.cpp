@@ -0,0 +1,307 @@
+// 规则集文件的测试：save/load 往返后结果不变（按名字和按 schema 编译的规则、含未压缩的死代码），
+// 损坏、截断、版本/魔数/字节序不符的文件抛异常且规则集保持不变，
+// 以及写文件使用名字唯一的临时文件：并发保存同一路径互不干扰，也不留下临时文件
+// 用法：sre_serialize_test [种子]；返回值非 0 表示失败
+#include "SreRuleSet.h"
+#include "SreTest.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <thread>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+const size_t kHeaderSize = 32;  // 魔数 8、版本 4、字节序 4、负载长度 8、校验和 8
+
+std::string sreWord(std::mt19937 &rng) {
+    static const char *words[] = { "err", "ERR", "warn", "timeout", "db", "/admin", "503", "", "Σ", "-7", "2.5" };
+    return words[rng() % 11];
+}
+
+std::string sreRule(std::mt19937 &rng, int depth = 0) {
+    std::string v = std::string("#{") + "abcd"[rng() % 4] + "}";
+    switch (rng() % (depth > 1 ? 9 : 12)) {
+        case 0: return "contains(" + v + ", '" + sreWord(rng) + "')";
+        case 1: return "containsAny(" + v + ", '" + sreWord(rng) + "', '" + sreWord(rng) + "')";
+        case 2: return "matches(" + v + ", '^" + sreWord(rng) + "|[0-9]+$')";
+        case 3: return "like(" + v + ", '*" + sreWord(rng) + "?')";
+        case 4: return v + (rng() % 2 ? " >= " : " != ") + std::to_string(static_cast<int>(rng() % 1000) - 100);
+        case 5: return v + " in ('" + sreWord(rng) + "', 503, true)";
+        case 6: return "icontains(" + v + ", '" + sreWord(rng) + "')";
+        case 7: return "tag(" + v + ", '" + sreWord(rng) + "')";
+        case 8: return rng() % 2 ? v : "not " + v;
+        case 9: return "(" + sreRule(rng, depth + 1) + " and " + sreRule(rng, depth + 1) + ")";
+        case 10: return "(" + sreRule(rng, depth + 1) + " or " + sreRule(rng, depth + 1) + ")";
+        default: return "not (" + sreRule(rng, depth + 1) + " and " + sreRule(rng, depth + 1) + ")";
+    }
+}
+
+SreContext sreEvent(std::mt19937 &rng) {
+    SreContext event;
+    for (char c : std::string("abcd")) {
+        if (rng() % 5 == 0) continue;
+        std::string value = sreWord(rng) + (rng() % 2 ? sreWord(rng) : "");
+        if (rng() % 4 == 0) value = std::to_string(static_cast<int>(rng() % 2000) - 500);
+        event[std::string(1, c)] = value;
+    }
+    return event;
+}
+
+void sreRegister(SreRuleEngine &engine) {
+    engine.registerFunction("tag", [](SreArgs args) { return args.size() == 2 && args[0].size() % 3 == args[1].size() % 3; }, true);
+}
+
+std::string sreRead(const fs::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void sreWrite(const fs::path &path, const std::string &bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+// 与 SreSerialize.cpp 相同的 FNV-1a，用于构造校验和正确、但负载有问题的文件
+uint64_t sreChecksum(const char *data, size_t size) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// 把 payload 换成 [kHeaderSize, size) 之后重写文件头中的长度和校验和
+std::string sreWithPayload(std::string file, const std::string &payload) {
+    file.resize(kHeaderSize);
+    uint64_t size = payload.size();
+    uint64_t checksum = sreChecksum(payload.data(), payload.size());
+    std::memcpy(&file[16], &size, sizeof(size));
+    std::memcpy(&file[24], &checksum, sizeof(checksum));
+    return file + payload;
+}
+
+// 所有事件在所有缺失处理方式下的命中和出错结果
+std::vector<std::vector<SreRuleId>> sreResults(const SreRuleSet &rules, const std::vector<SreContext> &events) {
+    std::vector<std::vector<SreRuleId>> results;
+    for (auto &event : events) {
+        for (SreMissing missing : { SreMissing::Error, SreMissing::Empty, SreMissing::False }) {
+            std::vector<SreRuleId> errors;
+            results.push_back(rules.tryEvaluate(event, missing, &errors));
+            results.push_back(errors);
+        }
+    }
+    return results;
+}
+
+std::vector<std::vector<SreRuleId>> sreSlotResults(const SreRuleSet &rules, const SreSchema &schema,
+                                                   const std::vector<SreContext> &events) {
+    std::vector<std::vector<SreRuleId>> results;
+    for (auto &event : events) {
+        SreSlotContext slots(schema.size());
+        for (auto &field : event) {
+            size_t index = schema.indexOf(field.first);
+            if (index != SreSchema::npos) slots[index] = field.second;
+        }
+        std::vector<SreRuleId> errors;
+        results.push_back(rules.tryEvaluate(slots, SreMissing::Error, &errors));
+        results.push_back(errors);
+    }
+    return results;
+}
+
+// 读取 bytes 应抛出异常（消息包含 expected），规则集保持不变
+void sreCheckRejected(SreRuleSet &rules, const SreRuleEngine &engine, const fs::path &path, const std::string &bytes,
+                      const std::vector<SreContext> &events, const std::vector<std::vector<SreRuleId>> &before,
+                      const std::string &expected, const std::string &what) {
+    sreWrite(path, bytes);
+    std::string message;
+    try {
+        rules.load(path.string(), engine);
+    } catch (const std::runtime_error &e) {
+        message = e.what();
+    }
+    SRE_CHECK(!message.empty(), what + ": load should throw");
+    SRE_CHECK(message.find(expected) != std::string::npos, what + ": " + message);
+    SRE_CHECK(sreResults(rules, events) == before, what + ": rule set changed after a failed load");
+}
+
+// 目录中除 keep 之外没有别的文件（临时文件都已改名或删除）
+bool sreOnly(const fs::path &dir, const fs::path &keep) {
+    for (auto &entry : fs::directory_iterator(dir)) {
+        if (entry.path().filename() != keep.filename()) return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 19;
+    std::mt19937 rng(seed);
+
+    fs::path dir = fs::temp_directory_path() / ("sre_serialize_test." + std::to_string(seed) + "." + std::to_string(rng()));
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    fs::path path = dir / "rules.bin";
+
+    SreRuleEngine engine;
+    sreRegister(engine);
+    std::vector<SreContext> events;
+    for (int i = 0; i < 500; ++i) events.push_back(sreEvent(rng));
+
+    // 往返：按名字编译的规则，中间做过替换和删除，字节码里留有尚未压缩的死代码
+    SreRuleSet rules;
+    SreRuleSet::Rules initial;
+    for (SreRuleId id = 0; id < 300; ++id) initial.emplace_back(id, engine.compile(sreRule(rng)));
+    rules.add(initial);
+    SreRuleSet::Rules upserts;
+    for (SreRuleId id = 0; id < 300; id += 7) upserts.emplace_back(id, engine.compile(sreRule(rng)));
+    rules.update(upserts, { 3, 50, 299 });
+    std::vector<std::vector<SreRuleId>> expected = sreResults(rules, events);
+    rules.save(path.string());
+    SRE_CHECK(sreOnly(dir, path), "save leaves no temporary files");
+
+    SreRuleSet loaded;
+    loaded.load(path.string(), engine);
+    SRE_CHECK(loaded.size() == rules.size(), "round trip: size");
+    SRE_CHECK(sreResults(loaded, events) == expected, "round trip: results");
+    // 另一个注册了同样函数的引擎也可以读取
+    SreRuleEngine other;
+    sreRegister(other);
+    SreRuleSet elsewhere;
+    elsewhere.load(path.string(), other);
+    SRE_CHECK(sreResults(elsewhere, events) == expected, "round trip into another engine");
+    // 读取后的规则集可以继续修改，修改后再次往返
+    loaded.add(1000, engine.compile("contains(#{a}, 'err') and #{b} != 3"));
+    loaded.remove(7);
+    std::vector<std::vector<SreRuleId>> modified = sreResults(loaded, events);
+    loaded.save(path.string());
+    SreRuleSet reloaded;
+    reloaded.load(path.string(), engine);
+    SRE_CHECK(sreResults(reloaded, events) == modified, "round trip after modifying a loaded rule set");
+
+    // 按 schema 编译的规则：读取后按同一个 schema 取值
+    {
+        SreSchema schema;
+        SreRuleSet slotRules;
+        for (SreRuleId id = 0; id < 100; ++id) slotRules.add(id, engine.compile(sreRule(rng), schema));
+        std::vector<std::vector<SreRuleId>> slotExpected = sreSlotResults(slotRules, schema, events);
+        fs::path slotPath = dir / "slots.bin";
+        slotRules.save(slotPath.string());
+        SreRuleSet slotLoaded;
+        slotLoaded.load(slotPath.string(), engine);
+        SRE_CHECK(sreSlotResults(slotLoaded, schema, events) == slotExpected, "round trip: schema rules");
+        fs::remove(slotPath);
+    }
+
+    // 缺少函数时读取失败
+    {
+        SreRuleEngine bare;
+        SreRuleSet target;
+        bool threw = false;
+        try {
+            target.load(path.string(), bare);
+        } catch (const std::runtime_error &) {
+            threw = true;
+        }
+        SRE_CHECK(threw && target.size() == 0, "load without the custom function");
+    }
+
+    // 损坏的文件：目标规则集事先有内容，读取失败后保持不变
+    rules.save(path.string());
+    std::string good = sreRead(path);
+    SRE_CHECK(good.size() > kHeaderSize, "file has a payload");
+    SreRuleSet target;
+    target.add(1, engine.compile("contains(#{a}, 'err')"));
+    target.add(2, engine.compile("#{b} >= 10"));
+    std::vector<std::vector<SreRuleId>> before = sreResults(target, events);
+
+    for (int i = 0; i < 200; ++i) {
+        std::string bytes = good;
+        size_t pos = rng() % bytes.size();
+        bytes[pos] = static_cast<char>(bytes[pos] ^ (1 + rng() % 255));
+        // 版本字段被改时报告版本不符，字节序字段被改时报告字节序不符，其余都是损坏
+        const char *message = pos >= 8 && pos < 12 ? "version" : pos >= 12 && pos < 16 ? "byte order" : "Corrupt";
+        sreCheckRejected(target, engine, path, bytes, events, before, message, "flipped byte " + std::to_string(pos));
+    }
+    size_t cuts[] = { 0, 1, 8, kHeaderSize - 1, kHeaderSize, kHeaderSize + 1, good.size() / 2, good.size() - 1 };
+    for (size_t cut : cuts) {
+        sreCheckRejected(target, engine, path, good.substr(0, cut), events, before, "Corrupt",
+                         "truncated to " + std::to_string(cut));
+    }
+    // 文件头正确、负载被截断：由读取时的边界检查发现
+    std::string payload = good.substr(kHeaderSize);
+    for (int i = 0; i < 100; ++i) {
+        size_t cut = rng() % payload.size();
+        sreCheckRejected(target, engine, path, sreWithPayload(good, payload.substr(0, cut)), events, before, "Corrupt",
+                         "payload truncated to " + std::to_string(cut));
+    }
+    sreCheckRejected(target, engine, path, good + "x", events, before, "Corrupt", "trailing byte");
+
+    std::string bytes = good;
+    uint32_t version;
+    std::memcpy(&version, &bytes[8], sizeof(version));
+    version += 1;
+    std::memcpy(&bytes[8], &version, sizeof(version));
+    sreCheckRejected(target, engine, path, bytes, events, before,
+                     "Unsupported rule set file version: " + std::to_string(version), "newer version");
+    bytes = good;
+    bytes[0] = 'X';
+    sreCheckRejected(target, engine, path, bytes, events, before, "Corrupt", "wrong magic");
+    bytes = good;
+    std::reverse(bytes.begin() + 12, bytes.begin() + 16);
+    sreCheckRejected(target, engine, path, bytes, events, before, "byte order", "other byte order");
+    SRE_CHECK(sreResults(target, events) == before, "target unchanged");
+    {
+        bool threw = false;
+        try {
+            target.load((dir / "missing.bin").string(), engine);
+        } catch (const std::runtime_error &) {
+            threw = true;
+        }
+        SRE_CHECK(threw, "load of a missing file");
+        threw = false;
+        try {
+            rules.save((dir / "no-such-dir" / "rules.bin").string());
+        } catch (const std::runtime_error &) {
+            threw = true;
+        }
+        SRE_CHECK(threw, "save into a missing directory");
+    }
+
+    // 多个线程同时保存同一路径：各自的临时文件互不覆盖，每次改名后都是完整的文件
+    {
+        fs::path shared = dir / "shared.bin";
+        std::atomic<int> failures{ 0 };
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < 20; ++i) {
+                    try {
+                        rules.save(shared.string());
+                        SreRuleSet check;
+                        check.load(shared.string(), engine);
+                        if (check.size() != rules.size()) ++failures;
+                    } catch (const std::exception &) {
+                        ++failures;
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) thread.join();
+        SRE_CHECK(failures == 0, "concurrent saves: " + std::to_string(failures.load()) + " failed");
+        fs::remove(path);
+        SRE_CHECK(sreOnly(dir, shared), "concurrent saves leave no temporary files");
+    }
+
+    fs::remove_all(dir);
+    return sreTestResult("serialize test");
+}
@@ -0,0 +1,325 @@
+#include "SreStream.h"
+#include "SreSerialize.h"
+#include <algorithm>
+
+namespace {
+
+bool sreIsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+int sreHexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void sreAppendUtf8(uint32_t code, std::string &out) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+// 一行输入的扫描位置；解码的内容追加到 scratch，scratch 的容量不小于行长，追加时不会重新分配，
+// 之前得到的视图保持有效
+class SreLineScanner {
+public:
+    SreLineScanner(std::string_view line, std::string &scratch)
+        : p_(line.data()), end_(line.data() + line.size()), scratch_(scratch) {}
+
+    bool atEnd() const { return p_ == end_; }
+
+    // ----- NDJSON -----
+    void skipSpace() {
+        while (p_ < end_ && sreIsSpace(*p_)) ++p_;
+    }
+    bool eat(char c) {
+        skipSpace();
+        if (p_ < end_ && *p_ == c) {
+            ++p_;
+            return true;
+        }
+        return false;
+    }
+    // 字符串，当前位置在开头的引号之后；out 为空时只跳过
+    bool jsonString(std::string_view *out) {
+        const char *start = p_;
+        bool escaped = false;
+        while (p_ < end_ && *p_ != '"') {
+            if (*p_ == '\\') {
+                escaped = true;
+                if (++p_ == end_) return false;
+            }
+            ++p_;
+        }
+        if (p_ == end_) return false;
+        const char *stop = p_++;
+        if (!out) return true;
+        if (!escaped) {
+            *out = std::string_view(start, static_cast<size_t>(stop - start));
+            return true;
+        }
+        size_t begin = scratch_.size();
+        if (!unescapeJson(start, stop)) return false;
+        *out = std::string_view(scratch_.data() + begin, scratch_.size() - begin);
+        return true;
+    }
+    // 一个值，out 为空时只跳过；null 写入默认构造的视图，即字段不存在
+    bool jsonValue(std::string_view *out) {
+        skipSpace();
+        if (p_ == end_) return false;
+        if (*p_ == '"') {
+            ++p_;
+            return jsonString(out);
+        }
+        const char *start = p_;
+        if (*p_ == '{' || *p_ == '[') {
+            if (!skipNested()) return false;
+        } else {
+            while (p_ < end_ && !sreIsSpace(*p_) && *p_ != ',' && *p_ != '}' && *p_ != ']') ++p_;
+            std::string_view token(start, static_cast<size_t>(p_ - start));
+            if (token == "null") {
+                if (out) *out = std::string_view();
+                return true;
+            }
+            bool number = !token.empty() && (token[0] == '-' || (token[0] >= '0' && token[0] <= '9'));
+            if (!number && token != "true" && token != "false") return false;
+        }
+        if (out) *out = std::string_view(start, static_cast<size_t>(p_ - start));
+        return true;
+    }
+
+    // ----- key=value -----
+    void skipBlank() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t')) ++p_;
+    }
+    // 下一个 key=value，没有 = 的词返回空的 key；格式错误（引号不配对）返回 false
+    bool pair(std::string_view &key, std::string_view &value) {
+        const char *start = p_;
+        while (p_ < end_ && *p_ != '=' && *p_ != ' ' && *p_ != '\t') ++p_;
+        key = std::string_view();
+        if (p_ == end_ || *p_ != '=') return true;
+        key = std::string_view(start, static_cast<size_t>(p_ - start));
+        ++p_;
+        if (p_ < end_ && *p_ == '"') {
+            start = ++p_;
+            bool escaped = false;
+            while (p_ < end_ && *p_ != '"') {
+                if (*p_ == '\\') {
+                    escaped = true;
+                    if (++p_ == end_) return false;
+                }
+                ++p_;
+            }
+            if (p_ == end_) return false;
+            const char *stop = p_++;
+            if (p_ < end_ && *p_ != ' ' && *p_ != '\t') return false;
+            if (!escaped) {
+                value = std::string_view(start, static_cast<size_t>(stop - start));
+                return true;
+            }
+            size_t begin = scratch_.size();
+            for (const char *q = start; q < stop; ++q) {
+                if (*q == '\\' && (q[1] == '"' || q[1] == '\\')) ++q;
+                scratch_ += *q;
+            }
+            value = std::string_view(scratch_.data() + begin, scratch_.size() - begin);
+            return true;
+        }
+        start = p_;
+        while (p_ < end_ && *p_ != ' ' && *p_ != '\t') ++p_;
+        value = std::string_view(start, static_cast<size_t>(p_ - start));
+        return true;
+    }
+
+private:
+    // 跳过嵌套的对象或数组，当前位置在开头的括号上；只数括号深度，不检查括号是否配对
+    bool skipNested() {
+        int depth = 0;
+        while (p_ < end_) {
+            char c = *p_++;
+            if (c == '"') {
+                if (!jsonString(nullptr)) return false;
+            } else if (c == '{' || c == '[') {
+                ++depth;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) return true;
+            }
+        }
+        return false;
+    }
+
+    bool hex4(const char *&q, const char *stop, uint32_t &code) {
+        if (stop - q < 4) return false;
+        code = 0;
+        for (int k = 0; k < 4; ++k) {
+            int digit = sreHexDigit(*q++);
+            if (digit < 0) return false;
+            code = code * 16 + static_cast<uint32_t>(digit);
+        }
+        return true;
+    }
+
+    // 解码 [q, stop) 中的转义，\u 的代理对合并为一个码点，落单的代理项替换为 U+FFFD
+    bool unescapeJson(const char *q, const char *stop) {
+        while (q < stop) {
+            if (*q != '\\') {
+                scratch_ += *q++;
+                continue;
+            }
+            ++q;
+            switch (*q++) {
+                case '"': scratch_ += '"'; break;
+                case '\\': scratch_ += '\\'; break;
+                case '/': scratch_ += '/'; break;
+                case 'b': scratch_ += '\b'; break;
+                case 'f': scratch_ += '\f'; break;
+                case 'n': scratch_ += '\n'; break;
+                case 'r': scratch_ += '\r'; break;
+                case 't': scratch_ += '\t'; break;
+                case 'u': {
+                    uint32_t code;
+                    if (!hex4(q, stop, code)) return false;
+                    if (code >= 0xD800 && code < 0xDC00 && stop - q >= 6 && q[0] == '\\' && q[1] == 'u') {
+                        const char *low = q + 2;
+                        uint32_t second;
+                        if (hex4(low, stop, second) && second >= 0xDC00 && second < 0xE000) {
+                            code = 0x10000 + ((code - 0xD800) << 10) + (second - 0xDC00);
+                            q = low;
+                        }
+                    }
+                    if (code >= 0xD800 && code < 0xE000) code = 0xFFFD;
+                    sreAppendUtf8(code, scratch_);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    const char *p_;
+    const char *end_;
+    std::string &scratch_;
+};
+
+}  // namespace
+
+SreStream::SreStream(const SreRuleSet &rules, SreStreamFormat format, Callback callback, SreMissing missing)
+    : rules_(rules), format_(format), callback_(std::move(callback)), missing_(missing) {}
+
+void SreStream::feed(std::string_view data) {
+    if (!pending_.empty()) {
+        size_t eol = data.find('\n');
+        if (eol == std::string_view::npos) {
+            pending_.append(data.data(), data.size());
+            return;
+        }
+        pending_.append(data.data(), eol);
+        std::string line;
+        line.swap(pending_);
+        evaluate(line);
+        data.remove_prefix(eol + 1);
+    }
+    size_t last = data.rfind('\n');
+    if (last == std::string_view::npos) {
+        pending_.assign(data.data(), data.size());
+        return;
+    }
+    evaluate(data.substr(0, last));
+    pending_.assign(data.data() + last + 1, data.size() - last - 1);
+}
+
+void SreStream::finish() {
+    if (pending_.empty()) return;
+    std::string line;
+    line.swap(pending_);
+    evaluate(line);
+}
+
+void SreStream::run(const std::string &path) {
+    SreMappedFile file(path);
+    feed(std::string_view(file.data(), file.size()));
+    finish();
+}
+
+void SreStream::evaluate(std::string_view data) {
+    input_ = data;
+    pos_ = 0;
+    rules_.evaluate(*this, missing_);
+    input_ = std::string_view();
+}
+
+void SreStream::bind(const std::vector<std::string_view> &names) {
+    index_.clear();
+    names_.assign(names.begin(), names.end());
+    for (size_t i = 0; i < names_.size(); ++i) {
+        index_.emplace(names_[i], static_cast<uint32_t>(i));
+    }
+}
+
+bool SreStream::next(std::string_view *fields) {
+    while (pos_ <= input_.size()) {
+        size_t eol = input_.find('\n', pos_);
+        if (eol == std::string_view::npos) eol = input_.size();
+        std::string_view line = input_.substr(pos_, eol - pos_);
+        pos_ = eol + 1;
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (std::all_of(line.begin(), line.end(), sreIsSpace)) continue;
+        if (parse(line, fields)) {
+            line_ = line;
+            return true;
+        }
+        ++malformed_;
+        std::fill(fields, fields + names_.size(), std::string_view());
+    }
+    return false;
+}
+
+void SreStream::matched(const std::vector<SreRuleId> &hits, const std::vector<SreRuleId> &errors) {
+    ++lines_;
+    ruleErrors_ += errors.size();
+    if (callback_) callback_(line_, hits);
+}
+
+bool SreStream::parse(std::string_view line, std::string_view *fields) {
+    scratch_.clear();
+    scratch_.reserve(line.size());
+    SreLineScanner in(line, scratch_);
+    if (format_ == SreStreamFormat::KeyValue) {
+        for (in.skipBlank(); !in.atEnd(); in.skipBlank()) {
+            std::string_view key, value;
+            if (!in.pair(key, value)) return false;
+            if (key.empty()) continue;
+            auto it = index_.find(key);
+            if (it != index_.end()) fields[it->second] = value;
+        }
+        return true;
+    }
+    if (!in.eat('{')) return false;
+    if (!in.eat('}')) {
+        do {
+            std::string_view key;
+            if (!in.eat('"') || !in.jsonString(&key) || !in.eat(':')) return false;
+            auto it = index_.find(key);
+            if (!in.jsonValue(it == index_.end() ? nullptr : &fields[it->second])) return false;
+        } while (in.eat(','));
+        if (!in.eat('}')) return false;
+    }
+    in.skipSpace();
+    return in.atEnd();
+}
@@ -0,0 +1,66 @@
+#ifndef SRE_STREAM_H
+#define SRE_STREAM_H
+
+// 流式求值：逐行读取 NDJSON 或 key=value 格式的日志，每行作为一个事件交给规则集求值
+// 只提取规则集引用的字段，字段值是指向输入缓冲区的 string_view，不构造 SreContext；
+// 其它字段只跳过、不解码，只有带转义的字符串才解码到一块按行复用的缓冲区
+#include "SreRuleSet.h"
+#include <functional>
+
+enum class SreStreamFormat {
+    // 每行一个 JSON 对象，只看顶层的键：字符串取解码后的内容，数字和 true/false 取原文，
+    // 嵌套的对象和数组取整段原文，null 视为字段不存在；不做完整的 JSON 校验
+    Ndjson,
+    // 空格或制表符分隔的 key=value，值可以用双引号括起来（其中 \" 和 \\ 为转义），没有 = 的词忽略
+    KeyValue,
+};
+
+// 不是线程安全的，每个线程各用一个；求值期间规则集可以被其它线程修改（见 SreRuleSet::evaluate(SreFieldSource &)）
+// 同一行中重复的字段以最后一次出现的为准；格式错误的行跳过、不回调
+class SreStream : private SreFieldSource {
+public:
+    // line 为去掉换行符的一行，hits 为命中的规则 id，两者只在回调期间有效
+    // 回调在规则集的读临界区之外执行，可以修改规则集，修改从下一行开始生效
+    using Callback = std::function<void(std::string_view line, const std::vector<SreRuleId> &hits)>;
+
+    // 缺失的字段按 missing 处理（见 SreRuleEngine::tryEvaluate），出错的规则不算命中
+    SreStream(const SreRuleSet &rules, SreStreamFormat format, Callback callback,
+              SreMissing missing = SreMissing::Error);
+
+    // 求值 data 中的完整行；最后不以换行结尾的部分复制下来，与下一次 feed 的开头拼成一行，用于 socket 等分块输入
+    void feed(std::string_view data);
+    // 求值 feed 留下的最后一行
+    void finish();
+    // 映射整个文件（mmap）逐行求值，相当于对文件内容 feed 之后 finish
+    void run(const std::string &path);
+
+    size_t lines() const { return lines_; }            // 已求值的行数
+    size_t malformed() const { return malformed_; }    // 格式错误而跳过的行数，空行不计
+    size_t ruleErrors() const { return ruleErrors_; }  // 出错的规则累计次数，例如 Error 模式下缺少字段
+
+private:
+    void bind(const std::vector<std::string_view> &names) override;
+    bool next(std::string_view *fields) override;
+    void matched(const std::vector<SreRuleId> &hits, const std::vector<SreRuleId> &errors) override;
+
+    // 求值 data 中的每一行，最后一行可以没有换行符
+    void evaluate(std::string_view data);
+    bool parse(std::string_view line, std::string_view *fields);
+
+    const SreRuleSet &rules_;
+    SreStreamFormat format_;
+    Callback callback_;
+    SreMissing missing_;
+    std::vector<std::string> names_;                        // 规则集引用的变量名
+    std::unordered_map<std::string_view, uint32_t> index_;  // 变量名 -> 下标，键指向 names_
+    std::string pending_;                                   // 上一次 feed 留下的不完整的行
+    std::string scratch_;                                   // 解码带转义的字符串，每行开头清空
+    std::string_view input_;                                // 正在求值的数据
+    size_t pos_ = 0;                                        // 下一行在 input_ 中的位置
+    std::string_view line_;                                 // 当前行
+    size_t lines_ = 0;
+    size_t malformed_ = 0;
+    size_t ruleErrors_ = 0;
+};
+
+#endif // SRE_STREAM_H
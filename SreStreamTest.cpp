@@ -0,0 +1,216 @@
+// SreStream 的行为测试：NDJSON 与 key=value 两种格式的字段提取
+// 覆盖转义、代理对、null、嵌套的值、重复的键、空值（必须是非空指针的视图，不能当作缺失）、
+// CRLF、跨 feed 分块的行、空行和格式错误的行；分块输入在随机切分下与整块输入的结果相同
+// 用法：sre_stream_test [种子]；返回值非 0 表示失败
+#include "SreStream.h"
+#include "SreTest.h"
+#include <cstdlib>
+#include <random>
+
+namespace {
+
+// 一行中看到的 a、b 两个字段，缺失的字段为 "<missing>"
+struct SreSeen {
+    std::string line;
+    std::string a = "<missing>";
+    std::string b = "<missing>";
+
+    bool operator==(const SreSeen &other) const { return line == other.line && a == other.a && b == other.b; }
+};
+
+SreSeen current;
+
+struct SreScan {
+    std::vector<SreSeen> seen;
+    size_t malformed = 0;
+    size_t ruleErrors = 0;
+};
+
+// 规则集：seeA(#{a}) 与 seeB(#{b})，Error 语义下缺失的字段不调用函数，因此可以区分空值和缺失
+class SreStreamFixture {
+public:
+    SreStreamFixture() {
+        engine_.registerFunction("seeA", [](SreArgs args) {
+            current.a = std::string(args[0]);
+            return true;
+        });
+        engine_.registerFunction("seeB", [](SreArgs args) {
+            current.b = std::string(args[0]);
+            return true;
+        });
+        rules_.add(1, engine_.compile("seeA(#{a})"));
+        rules_.add(2, engine_.compile("seeB(#{b})"));
+    }
+
+    // chunks 依次 feed，最后 finish
+    SreScan scan(SreStreamFormat format, const std::vector<std::string_view> &chunks) const {
+        SreScan result;
+        current = SreSeen();
+        SreStream stream(rules_, format, [&](std::string_view line, const std::vector<SreRuleId> &) {
+            current.line = std::string(line);
+            result.seen.push_back(current);
+            current = SreSeen();
+        });
+        for (auto chunk : chunks) stream.feed(chunk);
+        stream.finish();
+        result.malformed = stream.malformed();
+        result.ruleErrors = stream.ruleErrors();
+        SRE_CHECK(stream.lines() == result.seen.size(), "lines() counts the callbacks");
+        return result;
+    }
+
+    SreScan scan(SreStreamFormat format, std::string_view input) const {
+        return scan(format, std::vector<std::string_view>{ input });
+    }
+
+private:
+    SreRuleEngine engine_;
+    SreRuleSet rules_;
+};
+
+void sreCheckLine(const SreScan &scan, size_t i, const std::string &a, const std::string &b, const std::string &what) {
+    if (i >= scan.seen.size()) {
+        SRE_CHECK(false, what + ": line missing");
+        return;
+    }
+    SRE_CHECK(scan.seen[i].a == a, what + ": a = " + scan.seen[i].a);
+    SRE_CHECK(scan.seen[i].b == b, what + ": b = " + scan.seen[i].b);
+}
+
+// 把 input 随机切成若干块逐块 feed，结果应与整块 feed 相同
+void sreCheckChunks(const SreStreamFixture &fixture, SreStreamFormat format, const std::string &input,
+                    std::mt19937 &rng, const char *what) {
+    SreScan whole = fixture.scan(format, input);
+    for (int round = 0; round < 200; ++round) {
+        std::vector<std::string_view> chunks;
+        for (size_t pos = 0; pos < input.size();) {
+            size_t size = std::min(input.size() - pos, static_cast<size_t>(rng() % (round % 2 ? 4 : 40)));
+            chunks.push_back(std::string_view(input).substr(pos, size));  // 可以是空块
+            pos += size;
+        }
+        SreScan split = fixture.scan(format, chunks);
+        SRE_CHECK(split.seen == whole.seen && split.malformed == whole.malformed, std::string(what) + ": chunked feed");
+    }
+}
+
+void sreTestNdjson(const SreStreamFixture &fixture, std::mt19937 &rng) {
+    const SreStreamFormat ndjson = SreStreamFormat::Ndjson;
+    SreScan s = fixture.scan(ndjson, R"({"a":"x\"y\\z\/\n\t\b\f\r","b":"plain"})");
+    sreCheckLine(s, 0, "x\"y\\z/\n\t\b\f\r", "plain", "simple escapes");
+
+    s = fixture.scan(ndjson, R"({"a":"\u00e9\u4E2D","b":"\u0041"})");
+    sreCheckLine(s, 0, "\xC3\xA9\xE4\xB8\xAD", "A", "\\u escapes");
+
+    // 代理对合并为一个码点；落单的代理项替换为 U+FFFD
+    s = fixture.scan(ndjson, R"({"a":"\ud83d\ude00!","b":"\ud800x"})" "\n"
+                             R"({"a":"\udc00","b":"\ud83d\u0041"})");
+    sreCheckLine(s, 0, "\xF0\x9F\x98\x80!", "\xEF\xBF\xBDx", "surrogate pair");
+    sreCheckLine(s, 1, "\xEF\xBF\xBD", "\xEF\xBF\xBD" "A", "lone surrogates");
+
+    // null 视为缺失；嵌套的对象和数组、数字和布尔值取原文
+    s = fixture.scan(ndjson, R"({"a":null,"b":"1"})" "\n"
+                             R"({"a":{"k":[1,"}",{"z":null}],"s":"]"},"b":[1,[2]]})" "\n"
+                             R"({"a":-1.5e3,"b":true})" "\n"
+                             R"(  { "a" : false , "z" : {"deep":[{}]}, "b" : 0 }  )");
+    SRE_CHECK(s.ruleErrors == 1, "null is missing");
+    sreCheckLine(s, 0, "<missing>", "1", "null");
+    sreCheckLine(s, 1, R"({"k":[1,"}",{"z":null}],"s":"]"})", "[1,[2]]", "nested");
+    sreCheckLine(s, 2, "-1.5e3", "true", "scalars");
+    sreCheckLine(s, 3, "false", "0", "whitespace and skipped fields");
+
+    // 空字符串是存在的字段，不是缺失
+    s = fixture.scan(ndjson, R"({"a":"","b":""})" "\n" R"({"a":"\u0000","b":""})");
+    SRE_CHECK(s.ruleErrors == 0, "empty strings are present");
+    sreCheckLine(s, 0, "", "", "empty values");
+    sreCheckLine(s, 1, std::string(1, '\0'), "", "escaped NUL");
+
+    // 重复的键以最后一次为准，包括 null；键本身也可以带转义
+    s = fixture.scan(ndjson, R"({"a":"1","b":"x","a":"2"})" "\n" R"({"a":"1","a":null,"b":"y"})" "\n"
+                             R"({"\u0061":"k","b\u0000":"no","b":"z"})");
+    sreCheckLine(s, 0, "2", "x", "duplicate keys");
+    sreCheckLine(s, 1, "<missing>", "y", "duplicate key set to null");
+    sreCheckLine(s, 2, "k", "z", "escaped keys");
+
+    // 格式错误的行跳过、计数；空行既不回调也不计为格式错误
+    const char *malformed[] = { R"({"a":})", R"({"a" "x"})", "not json", R"({"a":"x"} tail)", R"({"a":"unterminated)",
+                                R"({"a":tru})", R"({"a":"\u12"})", R"({"a":"\x"})", "[1,2]", R"({"a":1,})",
+                                R"({"a":{"b":1})", R"({"a":"1")", "{" };
+    for (const char *line : malformed) {
+        s = fixture.scan(ndjson, std::string(line) + "\n" + R"({"a":"ok","b":"ok"})");
+        SRE_CHECK(s.malformed == 1, std::string("malformed: ") + line);
+        SRE_CHECK(s.seen.size() == 1 && s.seen[0].line == R"({"a":"ok","b":"ok"})", std::string("next line after: ") + line);
+    }
+    s = fixture.scan(ndjson, "\n   \n\t\r\n{}\n");
+    SRE_CHECK(s.malformed == 0 && s.seen.size() == 1, "blank lines");
+    sreCheckLine(s, 0, "<missing>", "<missing>", "empty object");
+
+    // CRLF：\r 不属于行的内容
+    s = fixture.scan(ndjson, "{\"a\":\"1\"}\r\n{\"a\":\"2\",\"b\":\"3\"}\r\n");
+    SRE_CHECK(s.seen.size() == 2 && s.seen[0].line == "{\"a\":\"1\"}", "CRLF line");
+    sreCheckLine(s, 1, "2", "3", "CRLF");
+
+    // 最后一行没有换行符，由 finish 求值
+    s = fixture.scan(ndjson, std::vector<std::string_view>{ "{\"a\":\"par", "tial\"", "}" });
+    SRE_CHECK(s.seen.size() == 1, "line split across feeds");
+    sreCheckLine(s, 0, "partial", "<missing>", "line split across feeds");
+
+    std::string input = R"({"a":"\ud83d\ude00","b":"\"q\""})" "\r\n"
+                        R"({"a":{"x":"\n"},"b":""})" "\n"
+                        "broken\r\n"
+                        "\r\n"
+                        R"({"b":"last","a":null})";
+    sreCheckChunks(fixture, ndjson, input, rng, "ndjson");
+}
+
+void sreTestKeyValue(const SreStreamFixture &fixture, std::mt19937 &rng) {
+    const SreStreamFormat kv = SreStreamFormat::KeyValue;
+    SreScan s = fixture.scan(kv, "a=1 b=2\n"
+                                 "a=\"x y\"\tb=\"q\\\"uo\\\\te\"\n"
+                                 "a=\"c:\\temp\" b=b=c\n"
+                                 "hello a=3 world z=\"skip me\" b=4\n");
+    sreCheckLine(s, 0, "1", "2", "plain");
+    sreCheckLine(s, 1, "x y", "q\"uo\\te", "quoted");
+    sreCheckLine(s, 2, "c:\\temp", "b=c", "other backslashes and '=' in values");
+    sreCheckLine(s, 3, "3", "4", "words without '='");
+
+    // 空值是存在的字段
+    s = fixture.scan(kv, "a= b=\"\"\n" "a=\"\" b=");
+    SRE_CHECK(s.ruleErrors == 0, "empty kv values are present");
+    sreCheckLine(s, 0, "", "", "empty values");
+    sreCheckLine(s, 1, "", "", "empty values at end of line");
+
+    s = fixture.scan(kv, "a=1 a=2 b=x\n" "a b=y\n" "=1 b=z\n");
+    sreCheckLine(s, 0, "2", "x", "duplicate keys");
+    sreCheckLine(s, 1, "<missing>", "y", "bare word");
+    sreCheckLine(s, 2, "<missing>", "z", "empty key");
+
+    const char *malformed[] = { "a=\"unterminated", "a=\"x\"y b=1", "a=\"ends with backslash\\" };
+    for (const char *line : malformed) {
+        s = fixture.scan(kv, std::string(line) + "\na=ok b=ok");
+        SRE_CHECK(s.malformed == 1, std::string("malformed: ") + line);
+        SRE_CHECK(s.seen.size() == 1 && s.seen[0].line == "a=ok b=ok", std::string("next line after: ") + line);
+    }
+
+    s = fixture.scan(kv, "a=1\r\nb=2 \r\n\r\n");
+    SRE_CHECK(s.seen.size() == 2 && s.malformed == 0, "CRLF lines");
+    sreCheckLine(s, 0, "1", "<missing>", "CRLF");
+    sreCheckLine(s, 1, "<missing>", "2", "CRLF with trailing blank");
+
+    std::string input = "a=\"1 2\" b=\\\r\n"
+                        "a=\"x\"y\n"
+                        "   \n"
+                        "b= a=\"\\\"\"\n"
+                        "a=tail b=end";
+    sreCheckChunks(fixture, kv, input, rng, "key=value");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 24;
+    std::mt19937 rng(seed);
+    SreStreamFixture fixture;
+    sreTestNdjson(fixture, rng);
+    sreTestKeyValue(fixture, rng);
+    return sreTestResult("stream test");
+}
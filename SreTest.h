@@ -0,0 +1,33 @@
+#ifndef SRE_TEST_H
+#define SRE_TEST_H
+
+// 内部头文件：测试共用的检查宏，不依赖测试框架
+// 检查失败时打印位置并计数，不中断测试；main 结束时用 sreTestResult 得到进程的返回值
+#include <atomic>
+#include <iostream>
+
+inline std::atomic<int> &sreTestFailures() {
+    static std::atomic<int> failures{0};
+    return failures;
+}
+
+#define SRE_CHECK(cond, what)                                                                  \
+    do {                                                                                       \
+        if (!(cond)) {                                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << (what) << "\n"; \
+            ++sreTestFailures();                                                               \
+        }                                                                                      \
+    } while (0)
+
+// 打印结果，返回 main 的返回值：0 表示全部通过
+inline int sreTestResult(const char *name) {
+    int failures = sreTestFailures().load();
+    if (failures) {
+        std::cerr << name << ": " << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << name << " passed\n";
+    return 0;
+}
+
+#endif // SRE_TEST_H
@@ -0,0 +1,147 @@
+#include "SreThreadPool.h"
+#include <algorithm>
+#include <exception>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// 一次 parallelFor 调用
+struct SreThreadPool::Job {
+    const std::function<void(size_t, size_t)> *body;
+    std::atomic<size_t> remaining;
+    std::mutex errorMutex;
+    size_t errorChunk;
+    std::exception_ptr error;
+};
+
+SreThreadPool::SreThreadPool() : SreThreadPool(Options()) {}
+
+SreThreadPool::SreThreadPool(const Options &options) : pending_(0), next_(0), stop_(false) {
+    size_t threads = options.threads;
+    if (threads == 0) {
+        threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (size_t i = 1; i < threads; ++i) {
+        workers_.emplace_back(&SreThreadPool::workerLoop, this, i);
+#if defined(__linux__)
+        if (options.pinThreads) {
+            unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(i % cpus, &set);
+            pthread_setaffinity_np(workers_.back().native_handle(), sizeof(set), &set);
+        }
+#endif
+    }
+}
+
+SreThreadPool::~SreThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+void SreThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body) {
+    if (count == 0) return;
+    grain = std::max<size_t>(1, grain);
+    size_t chunks = (count + grain - 1) / grain;
+    if (chunks == 1 || queues_.size() == 1) {
+        // 不值得分发或没有工作线程，直接在调用线程执行
+        body(0, count);
+        return;
+    }
+
+    Job job;
+    job.body = &body;
+    job.remaining = chunks;
+    job.errorChunk = chunks;
+    // 先计数再入队，保证 pending_ 不会小于队列中的任务数
+    pending_.fetch_add(chunks);
+    // 相邻的块放进同一个队列，窃取从队头开始
+    size_t first = next_.fetch_add(1) % queues_.size();
+    size_t perQueue = (chunks + queues_.size() - 1) / queues_.size();
+    for (size_t q = 0, chunk = 0; chunk < chunks; ++q) {
+        Queue &queue = *queues_[(first + q) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (size_t i = 0; i < perQueue && chunk < chunks; ++i, ++chunk) {
+            size_t begin = chunk * grain;
+            queue.tasks.push_back({ &job, chunk, begin, std::min(count, begin + grain) });
+        }
+    }
+    {
+        // 与工作线程检查 pending_ 的过程互斥，避免丢失唤醒
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    wake_.notify_all();
+
+    // 调用线程也执行任务（可能是其它调用提交的），直到本次的块全部完成
+    while (job.remaining.load(std::memory_order_acquire) != 0) {
+        if (!runOne(0)) {
+            std::this_thread::yield();
+        }
+    }
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
+void SreThreadPool::workerLoop(size_t self) {
+    for (;;) {
+        if (runOne(self)) continue;
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        wake_.wait(lock, [this] { return stop_ || pending_.load() != 0; });
+        if (stop_) return;
+    }
+}
+
+bool SreThreadPool::runOne(size_t self) {
+    Task task;
+    if (!pop(self, task)) return false;
+    Job &job = *task.job;
+    try {
+        (*job.body)(task.begin, task.end);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(job.errorMutex);
+        if (task.chunk < job.errorChunk) {
+            job.errorChunk = task.chunk;
+            job.error = std::current_exception();
+        }
+    }
+    // 最后一个块完成后 job 可能立即被调用线程销毁，之后不能再访问
+    job.remaining.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+bool SreThreadPool::pop(size_t self, Task &task) {
+    if (pending_.load() == 0) return false;
+    {
+        Queue &own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            pending_.fetch_sub(1);
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        Queue &victim = *queues_[(self + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            pending_.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,65 @@
+#ifndef SRE_THREAD_POOL_H
+#define SRE_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 工作窃取线程池：每个线程有自己的任务队列，从队尾取自己的任务，空闲时从其它队列的队头窃取
+// 调用 parallelFor 的线程也参与执行，直到本次提交的任务全部完成；线程池可以在多次调用间复用，
+// 也可以被多个线程同时使用
+class SreThreadPool {
+public:
+    struct Options {
+        // 参与执行的线程数（含调用线程），0 表示 std::thread::hardware_concurrency()
+        size_t threads = 0;
+        // 把第 i 个工作线程绑定到第 i 个 CPU 上，仅 Linux 有效
+        bool pinThreads = false;
+    };
+
+    SreThreadPool();
+    explicit SreThreadPool(const Options &options);
+    ~SreThreadPool();
+    SreThreadPool(const SreThreadPool &) = delete;
+    SreThreadPool &operator=(const SreThreadPool &) = delete;
+
+    // 参与执行的线程数（含调用线程）
+    size_t threadCount() const { return queues_.size(); }
+
+    // 把 [0, count) 按 grain 分块，并行执行 body(begin, end)
+    // 某些块抛出异常时，等所有块结束后重新抛出下标最小的那一块的异常
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+private:
+    struct Job;
+    struct Task {
+        Job *job;
+        size_t chunk;
+        size_t begin;
+        size_t end;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t self);
+    // 取一个任务执行，没有可执行的任务时返回 false
+    bool runOne(size_t self);
+    bool pop(size_t self, Task &task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;  // 0 号队列属于调用线程
+    std::vector<std::thread> workers_;
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> pending_;  // 队列中尚未取走的任务数
+    std::atomic<size_t> next_;     // 调用线程共用队列时轮流选择起始队列
+    bool stop_;
+};
+
+#endif // SRE_THREAD_POOL_H
@@ -0,0 +1,242 @@
+#include "SreVectorized.h"
+#include "SreSearch.h"
+#include <algorithm>
+
+void SreBatchEvaluator::run(const SreASTNode &root, std::vector<bool> &matched) {
+    size_t rows = batch_.rows();
+    if (rows > UINT32_MAX) {
+        throw std::runtime_error("Too many rows in batch");
+    }
+    matched.assign(rows, false);
+    std::unique_ptr<Selection> all = acquire();
+    std::unique_ptr<Selection> hits = acquire();
+    for (size_t base = 0; base < rows; base += kChunkRows) {
+        size_t end = std::min(rows, base + kChunkRows);
+        all->clear();
+        for (size_t row = base; row < end; ++row) {
+            all->push_back(static_cast<uint32_t>(row));
+        }
+        filter(root, *all, *hits);
+        if (error_) {
+            // 块按顺序处理，这一块中行号最小的错误也是整批中最早的错误
+            std::exception_ptr error = std::move(error_);
+            error_ = nullptr;
+            limit_ = UINT32_MAX;
+            std::rethrow_exception(error);
+        }
+        for (uint32_t row : *hits) {
+            matched[row] = true;
+        }
+    }
+    release(std::move(all));
+    release(std::move(hits));
+}
+
+void SreBatchEvaluator::filter(const SreASTNode &node, const Selection &in, Selection &out) {
+    out.clear();
+    if (in.empty()) return;
+    switch (node.kind()) {
+        case SreNodeKind::Logical:
+            filterLogical(static_cast<const SreLogicalNode &>(node), in, out);
+            break;
+        case SreNodeKind::Value:
+            filterValue(static_cast<const SreValueNode &>(node), in, out);
+            break;
+        case SreNodeKind::Function:
+            filterFunction(static_cast<const SreFunctionNode &>(node), in, out);
+            break;
+        case SreNodeKind::Compare:
+            filterCompare(static_cast<const SreCompareNode &>(node), in, out);
+            break;
+    }
+    trim(out);
+}
+
+void SreBatchEvaluator::filterLogical(const SreLogicalNode &logical, const Selection &in, Selection &out) {
+    const SreNodeList &operands = logical.operands();
+    std::unique_ptr<Selection> part = acquire();
+    std::unique_ptr<Selection> rest = acquire();
+    switch (logical.op()) {
+        case SreLogicalNode::And:
+            // 每一项只对前面各项都为真的行求值
+            *rest = in;
+            for (auto operand : operands) {
+                filter(*operand, *rest, *part);
+                rest.swap(part);
+                if (rest->empty()) break;
+            }
+            out.swap(*rest);
+            break;
+        case SreLogicalNode::Or: {
+            // 每一项只对前面各项都为假的行求值，为真的行并入结果
+            std::unique_ptr<Selection> merged = acquire();
+            *rest = in;
+            for (auto operand : operands) {
+                filter(*operand, *rest, *part);
+                if (part->empty()) {
+                    // 出错的行不为真，但也不能交给下一项
+                    trim(*rest);
+                    if (rest->empty()) break;
+                    continue;
+                }
+                merged->clear();
+                std::merge(out.begin(), out.end(), part->begin(), part->end(), std::back_inserter(*merged));
+                out.swap(*merged);
+                merged->clear();
+                std::set_difference(rest->begin(), rest->end(), part->begin(), part->end(), std::back_inserter(*merged));
+                rest.swap(merged);
+                trim(*rest);
+                if (rest->empty()) break;
+            }
+            release(std::move(merged));
+            break;
+        }
+        case SreLogicalNode::Not:
+            // 出错的行不在 part 中，结果由 filter 末尾的 trim 去掉
+            filter(*operands[0], in, *part);
+            std::set_difference(in.begin(), in.end(), part->begin(), part->end(), std::back_inserter(out));
+            break;
+    }
+    release(std::move(part));
+    release(std::move(rest));
+}
+
+void SreBatchEvaluator::filterValue(const SreValueNode &value, const Selection &in, Selection &out) {
+    if (!value.isVariable()) {
+        if (!value.value().empty()) out = in;
+        return;
+    }
+    const SreColumn *col = column(value);
+    for (uint32_t row : in) {
+        if (row >= limit_) break;
+        if (!valueAt(value, col, row).empty()) out.push_back(row);
+    }
+}
+
+void SreBatchEvaluator::filterFunction(const SreFunctionNode &func, const Selection &in, Selection &out) {
+    const SreNodeList &args = func.args();
+    // 每个参数要么是常量，要么是一列；列在整块开始前解析一次
+    std::vector<std::string_view> values(args.size());
+    std::vector<const SreValueNode *> vars(args.size(), nullptr);
+    std::vector<const SreColumn *> columns(args.size(), nullptr);
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i]->kind() != SreNodeKind::Value) {
+            // 每一行都会在这里出错，最早的是第一行
+            fail(in.front(), std::make_exception_ptr(std::runtime_error("Not a string expression node")));
+            return;
+        }
+        const SreValueNode &value = static_cast<const SreValueNode &>(*args[i]);
+        if (value.isVariable()) {
+            vars[i] = &value;
+            columns[i] = column(value);
+        } else {
+            values[i] = value.value();
+        }
+    }
+    if (func.function()->builtin == SreBuiltin::Contains && args.size() == 2 && vars[0] && !vars[1]) {
+        // 最常见的 contains(#{var}, 'literal')：直接调用查找内核，省去逐行的函数对象调用
+        for (uint32_t row : in) {
+            if (row >= limit_) break;
+            std::string_view text = valueAt(*vars[0], columns[0], row);
+            if (SreEvalStatus::isMissing(text)) continue;
+            if (SreStringSearch::contains(text, values[1])) out.push_back(row);
+        }
+        return;
+    }
+    for (uint32_t row : in) {
+        if (row >= limit_) break;
+        bool missing = false;
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (!vars[i]) continue;
+            values[i] = valueAt(*vars[i], columns[i], row);
+            // 与逐行求值相同：在第一个缺失的参数处停下，不调用函数
+            if (SreEvalStatus::isMissing(values[i])) {
+                missing = true;
+                break;
+            }
+        }
+        if (missing) continue;
+        try {
+            if (func.function()->call(SreArgs(values.data(), values.size()))) out.push_back(row);
+        } catch (...) {
+            fail(row, std::current_exception());
+        }
+    }
+}
+
+void SreBatchEvaluator::filterCompare(const SreCompareNode &compare, const Selection &in, Selection &out) {
+    // in 的右侧可能短路，列在第一次用到时才解析，缺少的列与逐行求值在同一处报错
+    // 每行的字符串在节点内最多转换一次，不跨节点缓存
+    std::vector<const SreColumn *> columns(compare.operandCount(), nullptr);
+    std::vector<bool> resolved(compare.operandCount(), false);
+    for (uint32_t row : in) {
+        if (row >= limit_) break;
+        bool missing = false;
+        bool hit = compare.evaluate([&](size_t i, SreScalar &local) -> SreScalar & {
+            const SreCompareOperand &o = compare.operand(i);
+            if (!o.var) {
+                local = o.literal;
+            } else if (missing) {
+                // 逐行求值在第一个缺失的变量处就出错了，后面的变量不再读取
+                local = SreScalar::ofText(std::string_view());
+            } else {
+                if (!resolved[i]) {
+                    columns[i] = column(*o.var);
+                    resolved[i] = true;
+                }
+                std::string_view text = valueAt(*o.var, columns[i], row);
+                missing = SreEvalStatus::isMissing(text);
+                local = SreScalar::ofText(text);
+            }
+            return local;
+        });
+        if (hit && !missing) out.push_back(row);
+    }
+}
+
+const SreColumn *SreBatchEvaluator::column(const SreValueNode &var) const {
+    return batch_.column(var.name());
+}
+
+std::string_view SreBatchEvaluator::valueAt(const SreValueNode &var, const SreColumn *column, uint32_t row) {
+    if (column && column->valid(row)) {
+        return column->value(row);
+    }
+    switch (missing_) {
+        case SreMissing::Empty:
+            return std::string_view();
+        case SreMissing::False:
+            break;
+        case SreMissing::Error:
+            fail(row, std::make_exception_ptr(std::runtime_error("Variable not found: " + var.name())));
+            break;
+    }
+    return SreEvalStatus::missingValue();
+}
+
+void SreBatchEvaluator::fail(uint32_t row, std::exception_ptr error) {
+    // 行号不小于 limit_ 的行不会再被求值，这里总是更早的错误
+    limit_ = row;
+    error_ = std::move(error);
+}
+
+void SreBatchEvaluator::trim(Selection &selection) const {
+    if (limit_ == UINT32_MAX) return;
+    selection.erase(std::lower_bound(selection.begin(), selection.end(), limit_), selection.end());
+}
+
+std::unique_ptr<SreBatchEvaluator::Selection> SreBatchEvaluator::acquire() {
+    if (free_.empty()) {
+        std::unique_ptr<Selection> selection = sre_make_unique<Selection>();
+        selection->reserve(kChunkRows);
+        return selection;
+    }
+    std::unique_ptr<Selection> selection = std::move(free_.back());
+    free_.pop_back();
+    selection->clear();
+    return selection;
+}
+
+void SreBatchEvaluator::release(std::unique_ptr<Selection> selection) {
+    free_.push_back(std::move(selection));
+}
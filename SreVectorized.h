@@ -0,0 +1,55 @@
+#ifndef SRE_VECTORIZED_H
+#define SRE_VECTORIZED_H
+
+// 内部头文件：列式批量求值
+// 按块（kChunkRows 行）处理，每个节点一次处理块内所有待求的行：
+// 行集合用递增的行号数组（选择向量）表示，and 依次缩小选择向量，or 只把尚未为真的行交给下一项，
+// 等价于逐行短路求值
+// 出错的行（缺失变量、函数抛异常等）记下异常后从选择向量中去掉，比它靠后的行也不再求值；
+// 每块结束后如有出错的行就抛出行号最小的那一行的异常，与逐行求值先遇到的错误相同
+#include "SreAST.h"
+#include "SreBatch.h"
+#include <exception>
+
+class SreBatchEvaluator {
+public:
+    static const size_t kChunkRows = 1024;
+
+    // 缺失变量按 missing 处理，同 tryEvaluate；Error 语义下抛出与逐行求值相同的异常
+    SreBatchEvaluator(const SreBatch &batch, SreMissing missing) : batch_(batch), missing_(missing) {}
+
+    // matched[i] 为第 i 行的结果
+    void run(const SreASTNode &root, std::vector<bool> &matched);
+
+private:
+    using Selection = std::vector<uint32_t>;
+
+    // 从 in 中筛选出 node 为真的行，写入 out
+    void filter(const SreASTNode &node, const Selection &in, Selection &out);
+    void filterLogical(const SreLogicalNode &logical, const Selection &in, Selection &out);
+    void filterValue(const SreValueNode &value, const Selection &in, Selection &out);
+    void filterFunction(const SreFunctionNode &func, const Selection &in, Selection &out);
+    void filterCompare(const SreCompareNode &compare, const Selection &in, Selection &out);
+    // 变量对应的列，不存在时为空
+    const SreColumn *column(const SreValueNode &var) const;
+    // 第 row 行的值；变量缺失时按缺失语义返回空字符串或特殊空值（SreEvalStatus::missingValue），
+    // Error 语义下同时记录该行出错
+    std::string_view valueAt(const SreValueNode &var, const SreColumn *column, uint32_t row);
+
+    // 记录第 row 行出错，之后只需要求值行号更小的行
+    void fail(uint32_t row, std::exception_ptr error);
+    // 去掉 selection 中不再需要求值的行
+    void trim(Selection &selection) const;
+
+    // 各层节点共用的选择向量缓冲区
+    std::unique_ptr<Selection> acquire();
+    void release(std::unique_ptr<Selection> selection);
+
+    const SreBatch &batch_;
+    SreMissing missing_;
+    uint32_t limit_ = UINT32_MAX;  // 当前块中出错的最小行号，没有出错时为 UINT32_MAX
+    std::exception_ptr error_;     // 该行的异常
+    std::vector<std::unique_ptr<Selection>> free_;
+};
+
+#endif // SRE_VECTORIZED_H